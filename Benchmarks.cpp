@@ -0,0 +1,3228 @@
+#include "Benchmarks.h"
+#include "Transform.h"
+#include "TransformSystem.h"
+#include "EntityWorld.h"
+#include "Components.h"
+#include "FrustumCulling.h"
+#include "OcclusionCulling.h"
+#include "ContributionCulling.h"
+#include "SceneBVH.h"
+#include "LightSelection.h"
+#include "ClusteredLighting.h"
+#include "MeshBVH.h"
+#include "JobSystem.h"
+#include "FramePipeline.h"
+#include "FixedTimestep.h"
+#include "FramePacer.h"
+#include "DynamicResolution.h"
+#include "FrameStats.h"
+#include "Profiler.h"
+#include "RenderCounters.h"
+#include "MemoryTracker.h"
+#include "LinearArena.h"
+#include "MaterialTable.h"
+#include "PipelineCache.h"
+#include "LightPartition.h"
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <cfloat>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cwchar>
+#include <fstream>
+#include <memory>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace DirectX;
+
+typedef std::chrono::high_resolution_clock BenchmarkClock;
+
+static double MillisecondsSince(BenchmarkClock::time_point start)
+{
+	std::chrono::duration<double, std::milli> elapsed = BenchmarkClock::now() - start;
+	return elapsed.count();
+}
+
+// Largest difference between two matrices, relative to the size of the values
+static float MatrixDifference(const XMFLOAT4X4& a, const XMFLOAT4X4& b)
+{
+	float difference = 0;
+	for (int row = 0; row < 4; row++)
+	{
+		for (int col = 0; col < 4; col++)
+		{
+			float scale = fmaxf(1.0f, fabsf(a.m[row][col]));
+			difference = fmaxf(difference, fabsf(a.m[row][col] - b.m[row][col]) / scale);
+		}
+	}
+	return difference;
+}
+
+// --------------------------------------------------------
+// Ends a benchmark's line with whether its results were right,
+// and asserts they were, so a wrong answer doesn't scroll by
+// --------------------------------------------------------
+static void ReportCheck(const char* name, bool match)
+{
+	printf("%s\n", match ? "results match" : "RESULTS DIFFER");
+	if (!match)
+		printf("%s: check failed\n", name);
+	fflush(stdout);
+	assert(match && "Benchmark check failed");
+}
+
+// How far apart (see MatrixDifference) two ways of building the same
+// matrix, or direction, may end up. Inverses amplify rounding, so they
+// get more room.
+static const float matrixTolerance = 0.0001f;
+static const float inverseTolerance = 0.001f;
+
+// The Transform as it was before it stored a quaternion: every direction
+// query and relative move rebuilds a quaternion from the Euler angles,
+// and the normal matrix uses a general 4x4 inverse
+struct LegacyTransform
+{
+	XMFLOAT3 position;
+	XMFLOAT3 scale;
+	XMFLOAT3 pitchYawRoll;
+	XMFLOAT4X4 worldMatrix;
+	XMFLOAT4X4 worldInverseTransposeMatrix;
+	bool dirty;
+
+	LegacyTransform(XMFLOAT3 _position, XMFLOAT3 _scale, XMFLOAT3 _pitchYawRoll) :
+		position(_position), scale(_scale), pitchYawRoll(_pitchYawRoll), dirty(true) {}
+
+	void Rotate(float pitch, float yaw, float roll)
+	{
+		XMStoreFloat3(&pitchYawRoll, XMVectorAdd(XMLoadFloat3(&pitchYawRoll), XMVectorSet(pitch, yaw, roll, 0)));
+		dirty = true;
+	}
+
+	void MoveRelative(float x, float y, float z)
+	{
+		XMVECTOR quaternion = XMQuaternionRotationRollPitchYaw(pitchYawRoll.x, pitchYawRoll.y, pitchYawRoll.z);
+		XMVECTOR move = XMVector3Rotate(XMVectorSet(x, y, z, 0), quaternion);
+		XMStoreFloat3(&position, XMVectorAdd(move, XMLoadFloat3(&position)));
+		dirty = true;
+	}
+
+	XMFLOAT3 GetDirection(XMVECTOR axis)
+	{
+		XMVECTOR quaternion = XMQuaternionRotationRollPitchYaw(pitchYawRoll.x, pitchYawRoll.y, pitchYawRoll.z);
+		XMFLOAT3 result;
+		XMStoreFloat3(&result, XMVector3Rotate(axis, quaternion));
+		return result;
+	}
+
+	void GenerateMatricies()
+	{
+		XMMATRIX world = XMMatrixMultiply(XMMatrixMultiply(
+			XMMatrixScaling(scale.x, scale.y, scale.z),
+			XMMatrixRotationRollPitchYaw(pitchYawRoll.x, pitchYawRoll.y, pitchYawRoll.z)),
+			XMMatrixTranslation(position.x, position.y, position.z));
+		XMStoreFloat4x4(&worldMatrix, world);
+		XMStoreFloat4x4(&worldInverseTransposeMatrix, XMMatrixInverse(0, XMMatrixTranspose(world)));
+		dirty = false;
+	}
+};
+
+// --------------------------------------------------------
+// Times the work objects and cameras do with their Transforms each
+// frame (rotate + rebuild matrices, and look up directions + move
+// relative) with the old Euler-angle Transform and the current one
+//
+// objectCount - Number of transforms to update
+// frames - Number of simulated frames to average over
+// --------------------------------------------------------
+void RunTransformClassBenchmark(unsigned int objectCount, unsigned int frames)
+{
+	std::mt19937 random(1234);
+	std::uniform_real_distribution<float> positionDist(-100.0f, 100.0f);
+	std::uniform_real_distribution<float> angleDist(-3.14f, 3.14f);
+	std::uniform_real_distribution<float> scaleDist(0.5f, 2.0f);
+
+	std::vector<LegacyTransform> oldTransforms;
+	std::vector<Transform> newTransforms;
+	oldTransforms.reserve(objectCount);
+	newTransforms.reserve(objectCount);
+	for (unsigned int i = 0; i < objectCount; i++)
+	{
+		XMFLOAT3 position(positionDist(random), positionDist(random), positionDist(random));
+		XMFLOAT3 rotation(angleDist(random), angleDist(random), angleDist(random));
+		XMFLOAT3 scale(scaleDist(random), scaleDist(random), scaleDist(random));
+		oldTransforms.push_back(LegacyTransform(position, scale, rotation));
+		newTransforms.push_back(Transform(position, scale, rotation));
+	}
+
+	// Rotate and rebuild matrices, like spinning renderables
+	float sink = 0;
+	BenchmarkClock::time_point start = BenchmarkClock::now();
+	for (unsigned int frame = 0; frame < frames; frame++)
+	{
+		for (unsigned int i = 0; i < objectCount; i++)
+		{
+			oldTransforms[i].Rotate(0.01f, 0.01f, 0.01f);
+			oldTransforms[i].GenerateMatricies();
+			sink += oldTransforms[i].worldMatrix._11 + oldTransforms[i].worldInverseTransposeMatrix._11;
+		}
+	}
+	double oldMatrixMs = MillisecondsSince(start) / frames;
+
+	start = BenchmarkClock::now();
+	for (unsigned int frame = 0; frame < frames; frame++)
+	{
+		for (unsigned int i = 0; i < objectCount; i++)
+		{
+			newTransforms[i].Rotate(0.01f, 0.01f, 0.01f);
+			sink += newTransforms[i].GetWorldMatrix()._11 + newTransforms[i].GetWorldInverseTransposeMatrix()._11;
+		}
+	}
+	double newMatrixMs = MillisecondsSince(start) / frames;
+
+	// Direction queries and relative moves, like the camera
+	start = BenchmarkClock::now();
+	for (unsigned int frame = 0; frame < frames; frame++)
+	{
+		for (unsigned int i = 0; i < objectCount; i++)
+		{
+			sink += oldTransforms[i].GetDirection(XMVectorSet(0, 0, 1, 0)).x;
+			sink += oldTransforms[i].GetDirection(XMVectorSet(1, 0, 0, 0)).y;
+			oldTransforms[i].MoveRelative(0, 0, 0.01f);
+			oldTransforms[i].MoveRelative(0.01f, 0, 0);
+		}
+	}
+	double oldMoveMs = MillisecondsSince(start) / frames;
+
+	start = BenchmarkClock::now();
+	for (unsigned int frame = 0; frame < frames; frame++)
+	{
+		for (unsigned int i = 0; i < objectCount; i++)
+		{
+			sink += newTransforms[i].GetForward().x;
+			sink += newTransforms[i].GetRight().y;
+			newTransforms[i].MoveRelative(0, 0, 0.01f);
+			newTransforms[i].MoveRelative(0.01f, 0, 0);
+		}
+	}
+	double newMoveMs = MillisecondsSince(start) / frames;
+
+	// Both should end up in the same place with the same matrices
+	float worldError = 0;
+	float inverseTransposeError = 0;
+	float forwardError = 0;
+	for (unsigned int i = 0; i < objectCount; i++)
+	{
+		oldTransforms[i].GenerateMatricies();
+		worldError = fmaxf(worldError, MatrixDifference(oldTransforms[i].worldMatrix, newTransforms[i].GetWorldMatrix()));
+		inverseTransposeError = fmaxf(inverseTransposeError, MatrixDifference(oldTransforms[i].worldInverseTransposeMatrix, newTransforms[i].GetWorldInverseTransposeMatrix()));
+
+		XMFLOAT3 oldForward = oldTransforms[i].GetDirection(XMVectorSet(0, 0, 1, 0));
+		XMFLOAT3 newForward = newTransforms[i].GetForward();
+		forwardError = fmaxf(forwardError, XMVectorGetX(XMVector3Length(XMVectorSubtract(XMLoadFloat3(&oldForward), XMLoadFloat3(&newForward)))));
+	}
+
+	printf("Transform (%u objects): rotate + matrices %.3fms -> %.3fms (%.1fx), directions + moves %.3fms -> %.3fms (%.1fx), max error %g / %g / %g [%g], ",
+		objectCount,
+		oldMatrixMs,
+		newMatrixMs,
+		oldMatrixMs / newMatrixMs,
+		oldMoveMs,
+		newMoveMs,
+		oldMoveMs / newMoveMs,
+		worldError,
+		inverseTransposeError,
+		forwardError,
+		sink);
+	ReportCheck("Transform", worldError <= matrixTolerance && inverseTransposeError <= inverseTolerance && forwardError <= matrixTolerance);
+}
+
+// --------------------------------------------------------
+// Rotates a large number of objects every frame and rebuilds their
+// world and inverse transpose matrices, first with individual
+// Transforms (as Renderables used to) and then with a TransformSystem
+//
+// objectCount - Number of objects to transform
+// frames - Number of simulated frames to average over
+// --------------------------------------------------------
+void RunTransformBenchmark(unsigned int objectCount, unsigned int frames)
+{
+	std::mt19937 random(1234);
+	std::uniform_real_distribution<float> positionDist(-100.0f, 100.0f);
+	std::uniform_real_distribution<float> angleDist(-3.14f, 3.14f);
+	std::uniform_real_distribution<float> scaleDist(0.5f, 2.0f);
+
+	std::vector<Transform> transforms;
+	TransformSystem transformSystem;
+	std::vector<TransformHandle> handles;
+	transforms.reserve(objectCount);
+	handles.reserve(objectCount);
+	for (unsigned int i = 0; i < objectCount; i++)
+	{
+		XMFLOAT3 position(positionDist(random), positionDist(random), positionDist(random));
+		XMFLOAT3 rotation(angleDist(random), angleDist(random), angleDist(random));
+		XMFLOAT3 scale(scaleDist(random), scaleDist(random), scaleDist(random));
+		transforms.push_back(Transform(position, scale, rotation));
+		handles.push_back(transformSystem.Create(position, rotation, scale));
+	}
+
+	// Old path: each object rebuilds its own matrices when asked for them
+	XMFLOAT4X4 sink = {};
+	BenchmarkClock::time_point start = BenchmarkClock::now();
+	for (unsigned int frame = 0; frame < frames; frame++)
+	{
+		for (unsigned int i = 0; i < objectCount; i++)
+		{
+			transforms[i].Rotate(0.01f, 0.01f, 0.01f);
+			XMFLOAT4X4 world = transforms[i].GetWorldMatrix();
+			XMFLOAT4X4 inverseTranspose = transforms[i].GetWorldInverseTransposeMatrix();
+			sink._11 += world._11 + inverseTranspose._11;
+		}
+	}
+	double perObjectMs = MillisecondsSince(start) / frames;
+
+	// New path: change everything, then rebuild in batches
+	start = BenchmarkClock::now();
+	for (unsigned int frame = 0; frame < frames; frame++)
+	{
+		for (unsigned int i = 0; i < objectCount; i++)
+			transformSystem.Rotate(handles[i], XMFLOAT3(0.01f, 0.01f, 0.01f));
+		transformSystem.UpdateMatrices();
+		for (unsigned int i = 0; i < objectCount; i++)
+			sink._11 += transformSystem.GetWorldMatrix(handles[i])._11 + transformSystem.GetWorldInverseTransposeMatrix(handles[i])._11;
+	}
+	double batchedMs = MillisecondsSince(start) / frames;
+
+	// Both paths should agree
+	float worldError = 0;
+	float inverseTransposeError = 0;
+	for (unsigned int i = 0; i < objectCount; i++)
+	{
+		worldError = fmaxf(worldError, MatrixDifference(transforms[i].GetWorldMatrix(), transformSystem.GetWorldMatrix(handles[i])));
+		inverseTransposeError = fmaxf(inverseTransposeError, MatrixDifference(transforms[i].GetWorldInverseTransposeMatrix(), transformSystem.GetWorldInverseTransposeMatrix(handles[i])));
+	}
+
+	printf("Transforms (%u objects): per-object %.3fms, batched %.3fms (%.1fx), max error %g / %g [%g], ",
+		objectCount,
+		perObjectMs,
+		batchedMs,
+		perObjectMs / batchedMs,
+		worldError,
+		inverseTransposeError,
+		sink._11);
+	ReportCheck("Transforms", worldError <= matrixTolerance && inverseTransposeError <= inverseTolerance);
+}
+
+// --------------------------------------------------------
+// Builds forests of transforms in a TransformSystem and times
+// propagating world matrices through them, both when every tree
+// moves and when only a few do, along with reparenting and bulk
+// creation/destruction. Results are checked against chains of
+// individual Transforms multiplied together.
+//
+// objectCount - Total number of transforms in each hierarchy
+// --------------------------------------------------------
+void RunHierarchyBenchmark(unsigned int objectCount)
+{
+	// Deep: long chains (an arm of bones, props on props)
+	// Wide: many children on each root (everything on a moving platform)
+	const struct { const char* name; unsigned int treeSize; bool chain; } shapes[] =
+	{
+		{ "deep", 64, true },
+		{ "wide", 1000, false },
+	};
+
+	// Matrices multiplied down a chain of parents (and bounds merged up
+	// it) pick up rounding at every level, unlike a single transform
+	const float chainTolerance = 0.001f;
+
+	for (const auto& shape : shapes)
+	{
+		std::mt19937 random(1234);
+		std::uniform_real_distribution<float> positionDist(-2.0f, 2.0f);
+		std::uniform_real_distribution<float> angleDist(-3.14f, 3.14f);
+		std::uniform_real_distribution<float> scaleDist(0.8f, 1.25f);
+
+		unsigned int treeCount = objectCount / shape.treeSize;
+		TransformSystem transformSystem;
+		std::vector<TransformHandle> handles;
+		std::vector<TransformHandle> roots;
+		std::vector<unsigned int> referenceParents;
+		std::vector<Transform> referenceLocals;
+		for (unsigned int tree = 0; tree < treeCount; tree++)
+		{
+			for (unsigned int node = 0; node < shape.treeSize; node++)
+			{
+				XMFLOAT3 position(positionDist(random), positionDist(random), positionDist(random));
+				XMFLOAT3 rotation(angleDist(random), angleDist(random), angleDist(random));
+				XMFLOAT3 scale(scaleDist(random), scaleDist(random), scaleDist(random));
+
+				unsigned int parent = node == 0 ? INVALID_TRANSFORM_HANDLE :
+					(unsigned int)handles.size() - (shape.chain ? 1 : node);
+				TransformHandle handle = transformSystem.Create(position, rotation, scale,
+					parent == INVALID_TRANSFORM_HANDLE ? INVALID_TRANSFORM_HANDLE : handles[parent]);
+				transformSystem.SetLocalBounds(handle, XMFLOAT4(0, 0, 0, 0.5f));
+
+				if (node == 0)
+					roots.push_back(handle);
+				handles.push_back(handle);
+				referenceParents.push_back(parent);
+				referenceLocals.push_back(Transform(position, scale, rotation));
+			}
+		}
+		transformSystem.UpdateMatrices();
+
+		// Every tree moves
+		const unsigned int frames = 10;
+		BenchmarkClock::time_point start = BenchmarkClock::now();
+		unsigned int recalculated = 0;
+		for (unsigned int frame = 0; frame < frames; frame++)
+		{
+			for (TransformHandle root : roots)
+				transformSystem.Rotate(root, XMFLOAT3(0.01f, 0.01f, 0.01f));
+			recalculated = transformSystem.UpdateMatrices();
+		}
+		double allMs = MillisecondsSince(start) / frames;
+
+		// One in a hundred trees moves
+		start = BenchmarkClock::now();
+		unsigned int partialRecalculated = 0;
+		for (unsigned int frame = 0; frame < frames; frame++)
+		{
+			for (unsigned int tree = 0; tree < treeCount; tree += 100)
+				transformSystem.Rotate(roots[tree], XMFLOAT3(0.01f, 0.01f, 0.01f));
+			partialRecalculated = transformSystem.UpdateMatrices();
+		}
+		double partialMs = MillisecondsSince(start) / frames;
+
+		// Compare against individual Transforms (the roots rotated once per frame in each test)
+		for (unsigned int tree = 0; tree < treeCount; tree++)
+			referenceLocals[tree * shape.treeSize].setRotation(transformSystem.GetPitchYawRoll(roots[tree]));
+		std::vector<XMFLOAT4X4> referenceWorlds(handles.size());
+		float worldError = 0;
+		float boundsError = 0;
+		for (unsigned int i = 0; i < handles.size(); i++)
+		{
+			XMFLOAT4X4 local = referenceLocals[i].GetWorldMatrix();
+			XMMATRIX world = XMLoadFloat4x4(&local);
+			if (referenceParents[i] != INVALID_TRANSFORM_HANDLE)
+				world = XMMatrixMultiply(world, XMLoadFloat4x4(&referenceWorlds[referenceParents[i]]));
+			XMStoreFloat4x4(&referenceWorlds[i], world);
+			worldError = fmaxf(worldError, MatrixDifference(referenceWorlds[i], transformSystem.GetWorldMatrix(handles[i])));
+
+			// Each transform's bounds must be inside its root's hierarchy bounds
+			unsigned int root = i - i % shape.treeSize;
+			XMFLOAT4 outer = transformSystem.GetHierarchyBounds(handles[root]);
+			XMFLOAT4 inner = transformSystem.GetWorldBounds(handles[i]);
+			float distance = XMVectorGetX(XMVector3Length(XMVectorSubtract(XMLoadFloat4(&inner), XMLoadFloat4(&outer))));
+			boundsError = fmaxf(boundsError, distance + inner.w - outer.w);
+		}
+
+		// Move a thousand nodes to other trees, twice: the first time
+		// storage has to be re-sorted, after that roots are all in front
+		// of their new children so the order still holds
+		double reparentMs[2];
+		for (unsigned int round = 0; round < 2; round++)
+		{
+			start = BenchmarkClock::now();
+			for (unsigned int i = 0; i < 1000; i++)
+			{
+				unsigned int child = (i * 7919 + round * 104729 + 1) % (unsigned int)handles.size();
+				if (child % shape.treeSize != 0)
+					transformSystem.SetParent(handles[child], roots[i % treeCount]);
+			}
+			transformSystem.UpdateMatrices();
+			reparentMs[round] = MillisecondsSince(start);
+		}
+
+		// Add and then remove a batch of new children
+		std::vector<TransformHandle> added;
+		start = BenchmarkClock::now();
+		for (unsigned int i = 0; i < objectCount / 10; i++)
+			added.push_back(transformSystem.Create(XMFLOAT3(1, 0, 0), XMFLOAT3(0, 0, 0), XMFLOAT3(1, 1, 1), roots[i % treeCount]));
+		transformSystem.UpdateMatrices();
+		for (TransformHandle handle : added)
+			transformSystem.Destroy(handle);
+		transformSystem.UpdateMatrices();
+		double bulkMs = MillisecondsSince(start);
+
+		printf("Hierarchy %s (%u trees of %u): all moving %.3fms (%u), 1%% moving %.3fms (%u), reparent 1000 %.3fms (re-sort) / %.3fms, add + remove %u %.3fms, max error %g / bounds %g, ",
+			shape.name,
+			treeCount,
+			shape.treeSize,
+			allMs,
+			recalculated,
+			partialMs,
+			partialRecalculated,
+			reparentMs[0],
+			reparentMs[1],
+			objectCount / 10,
+			bulkMs,
+			worldError,
+			fmaxf(boundsError, 0.0f));
+		ReportCheck(shape.chain ? "Hierarchy deep" : "Hierarchy wide", worldError <= chainTolerance && boundsError <= chainTolerance);
+	}
+}
+
+// A Renderable as it was before entities: its own Transform plus
+// shared_ptrs that are copied every time they're asked for
+class LegacyRenderable
+{
+public:
+	LegacyRenderable(std::shared_ptr<Mesh> _mesh, std::shared_ptr<Material> _material, XMFLOAT3 position) :
+		transform(position), mesh(_mesh), material(_material) {}
+
+	std::shared_ptr<Mesh> GetMesh() { return mesh; }
+	std::shared_ptr<Material> GetMaterial() { return material; }
+	Transform& GetTransform() { return transform; }
+
+private:
+	Transform transform;
+	std::shared_ptr<Mesh> mesh;
+	std::shared_ptr<Material> material;
+};
+
+// What the draw loop reads for each object
+struct DrawPrepSink
+{
+	ID3D12PipelineState* pipeline;
+	unsigned int materialIndex;
+	unsigned int indexCount;
+	float matrixSum;
+	unsigned long long bufferSum;
+
+	void Add(ID3D12PipelineState* _pipeline, unsigned int _materialIndex, Mesh* mesh, const XMFLOAT4X4& world, const XMFLOAT4X4& inverseTranspose)
+	{
+		pipeline = _pipeline;
+		materialIndex += _materialIndex;
+		indexCount += mesh->GetIndexCount();
+		bufferSum += mesh->GetvbView().BufferLocation + mesh->GetibView().BufferLocation;
+		matrixSum += world._41 + inverseTranspose._11;
+	}
+};
+
+// --------------------------------------------------------
+// Spins a large number of objects and gathers everything the draw
+// loop needs from each, once with the old vector of Renderables
+// and once with entity queries, plus the cost of spawning and
+// despawning that many entities
+//
+// resources, meshHandle, materialHandle - Shared by every object
+// entityCount - Number of objects
+// --------------------------------------------------------
+void RunEntityBenchmark(ResourceRegistry& resources, MeshHandle meshHandle, MaterialHandle materialHandle, unsigned int entityCount)
+{
+	// The old path owned its resources through shared_ptrs
+	std::shared_ptr<Mesh> mesh = std::make_shared<Mesh>(*resources.GetMesh(meshHandle));
+	std::shared_ptr<Material> material = std::make_shared<Material>(*resources.GetMaterial(materialHandle));
+
+	std::mt19937 random(1234);
+	std::uniform_real_distribution<float> positionDist(-100.0f, 100.0f);
+	std::vector<XMFLOAT3> positions(entityCount);
+	for (XMFLOAT3& position : positions)
+		position = XMFLOAT3(positionDist(random), positionDist(random), positionDist(random));
+
+	// Old: one Renderable per object
+	std::vector<LegacyRenderable> renderables;
+	renderables.reserve(entityCount);
+	for (unsigned int i = 0; i < entityCount; i++)
+		renderables.push_back(LegacyRenderable(mesh, material, positions[i]));
+
+	// New: entities, spawned and despawned once to time it
+	TransformSystem transformSystem;
+	EntityWorld entities;
+	XMFLOAT3 center = mesh->GetBoundingSphereCenter();
+	XMFLOAT4 localBounds(center.x, center.y, center.z, mesh->GetBoundingSphereRadius());
+	std::vector<Entity> spawned(entityCount);
+	double spawnMs = 0;
+	double despawnMs = 0;
+	for (unsigned int pass = 0; pass < 2; pass++)
+	{
+		BenchmarkClock::time_point start = BenchmarkClock::now();
+		for (unsigned int i = 0; i < entityCount; i++)
+		{
+			TransformComponent transform = { transformSystem.Create(positions[i]) };
+			transformSystem.SetLocalBounds(transform.handle, localBounds);
+			MeshComponent meshComponent = { meshHandle };
+			MaterialComponent materialComponent = { materialHandle, material->GetPipelineState().Get(), material->GetMaterialIndex() };
+			BoundsComponent bounds = {};
+			FlagsComponent flags = { ENTITY_FLAG_VISIBLE | ENTITY_FLAG_SPINNING };
+			spawned[i] = entities.Spawn(transform, meshComponent, materialComponent, bounds, flags);
+		}
+		spawnMs = MillisecondsSince(start);
+
+		// Keep the second set around for the frame test
+		if (pass == 1)
+			break;
+
+		start = BenchmarkClock::now();
+		for (unsigned int i = 0; i < entityCount; i++)
+		{
+			transformSystem.Destroy(entities.Get<TransformComponent>(spawned[i])->handle);
+			entities.Despawn(spawned[i]);
+		}
+		despawnMs = MillisecondsSince(start);
+	}
+
+	const unsigned int frames = 10;
+	DrawPrepSink oldSink = {};
+	BenchmarkClock::time_point start = BenchmarkClock::now();
+	for (unsigned int frame = 0; frame < frames; frame++)
+	{
+		// Update
+		for (size_t i = 0; i < renderables.size(); i++)
+			renderables[i].GetTransform().Rotate(0.01f, 0.01f, 0.01f);
+
+		// Draw
+		for (size_t i = 0; i < renderables.size(); i++)
+		{
+			std::shared_ptr<Material> mat = renderables[i].GetMaterial();
+			oldSink.Add(
+				mat->GetPipelineState().Get(),
+				mat->GetMaterialIndex(),
+				renderables[i].GetMesh().get(),
+				renderables[i].GetTransform().GetWorldMatrix(),
+				renderables[i].GetTransform().GetWorldInverseTransposeMatrix());
+		}
+	}
+	double oldMs = MillisecondsSince(start) / frames;
+
+	DrawPrepSink newSink = {};
+	start = BenchmarkClock::now();
+	for (unsigned int frame = 0; frame < frames; frame++)
+	{
+		// Update
+		entities.ForEachChunk<TransformComponent, FlagsComponent>(
+			[&](unsigned int count, Entity*, TransformComponent* transforms, FlagsComponent* flags)
+		{
+			for (unsigned int i = 0; i < count; i++)
+			{
+				if (flags[i].flags & ENTITY_FLAG_SPINNING)
+					transformSystem.Rotate(transforms[i].handle, XMFLOAT3(0.01f, 0.01f, 0.01f));
+			}
+		});
+		transformSystem.UpdateMatrices();
+		entities.ForEachChunk<TransformComponent, BoundsComponent>(
+			[&](unsigned int count, Entity*, TransformComponent* transforms, BoundsComponent* bounds)
+		{
+			for (unsigned int i = 0; i < count; i++)
+				bounds[i].sphere = transformSystem.GetWorldBounds(transforms[i].handle);
+		});
+
+		// Draw
+		entities.ForEachChunk<TransformComponent, MeshComponent, MaterialComponent, FlagsComponent>(
+			[&](unsigned int count, Entity*, TransformComponent* transforms, MeshComponent* meshes, MaterialComponent* materials, FlagsComponent* flags)
+		{
+			for (unsigned int i = 0; i < count; i++)
+			{
+				if (!(flags[i].flags & ENTITY_FLAG_VISIBLE))
+					continue;
+
+				Mesh* entityMesh = resources.GetMesh(meshes[i].mesh);
+				if (!entityMesh)
+					continue;
+
+				newSink.Add(
+					materials[i].pipelineState,
+					materials[i].materialIndex,
+					entityMesh,
+					transformSystem.GetWorldMatrix(transforms[i].handle),
+					transformSystem.GetWorldInverseTransposeMatrix(transforms[i].handle));
+			}
+		});
+	}
+	double newMs = MillisecondsSince(start) / frames;
+
+	// Same draws, and every object ended up with the same matrix
+	float worldError = 0;
+	for (unsigned int i = 0; i < entityCount; i++)
+	{
+		TransformHandle handle = entities.Get<TransformComponent>(spawned[i])->handle;
+		worldError = fmaxf(worldError, MatrixDifference(renderables[i].GetTransform().GetWorldMatrix(), transformSystem.GetWorldMatrix(handle)));
+	}
+	bool match =
+		oldSink.pipeline == newSink.pipeline &&
+		oldSink.indexCount == newSink.indexCount &&
+		oldSink.materialIndex == newSink.materialIndex &&
+		oldSink.bufferSum == newSink.bufferSum &&
+		worldError <= matrixTolerance;
+
+	printf("Entities (%u): renderables %.3fms/frame, entities %.3fms/frame (%.1fx), spawn %.3fms, despawn %.3fms, max error %g, ",
+		entityCount,
+		oldMs,
+		newMs,
+		oldMs / newMs,
+		spawnMs,
+		despawnMs,
+		worldError);
+	ReportCheck("Entities", match);
+}
+
+// --------------------------------------------------------
+// Churns a ResourcePool: adds objects, looks them all up through
+// their handles, unloads every other one and collects them, then
+// checks stale handles stop resolving and live ones still find the
+// right object after the pool compacts
+//
+// resourceCount - Number of objects added
+// --------------------------------------------------------
+void RunResourcePoolBenchmark(unsigned int resourceCount)
+{
+	ResourcePool<XMFLOAT4> pool;
+	std::vector<ResourceHandle<XMFLOAT4>> handles(resourceCount);
+
+	BenchmarkClock::time_point start = BenchmarkClock::now();
+	for (unsigned int i = 0; i < resourceCount; i++)
+		handles[i] = pool.Add(XMFLOAT4((float)i, 0, 0, 0));
+	double addMs = MillisecondsSince(start);
+
+	// Look everything up the way the draw loop does
+	float sum = 0;
+	start = BenchmarkClock::now();
+	for (unsigned int i = 0; i < resourceCount; i++)
+		sum += pool.Get(handles[i])->x;
+	double getMs = MillisecondsSince(start);
+
+	// Unload every other object, as if during frame 1
+	start = BenchmarkClock::now();
+	for (unsigned int i = 0; i < resourceCount; i += 2)
+		pool.Remove(handles[i], 1);
+	double removeMs = MillisecondsSince(start);
+
+	// Nothing goes until the "GPU" finishes frame 1
+	unsigned int early = pool.Collect(0);
+	start = BenchmarkClock::now();
+	unsigned int collected = pool.Collect(1);
+	double collectMs = MillisecondsSince(start);
+
+	// Reused slots must not bring old handles back to life
+	std::vector<ResourceHandle<XMFLOAT4>> reused;
+	for (unsigned int i = 0; i < resourceCount / 2; i++)
+		reused.push_back(pool.Add(XMFLOAT4(-1, 0, 0, 0)));
+
+	unsigned int errors = early + (collected != (resourceCount + 1) / 2 ? 1 : 0);
+	for (unsigned int i = 0; i < resourceCount; i++)
+	{
+		XMFLOAT4* object = pool.Get(handles[i]);
+		if (i % 2 == 0)
+			errors += object != 0;
+		else
+			errors += object == 0 || object->x != (float)i;
+	}
+	for (ResourceHandle<XMFLOAT4> handle : reused)
+		errors += pool.Get(handle) == 0 || pool.Get(handle)->x != -1;
+
+	printf("Resource pool (%u): add %.3fms, lookup %.3fms (%g), unload half %.3fms, collect %.3fms, %u bad handles, ",
+		resourceCount,
+		addMs,
+		getMs,
+		sum,
+		removeMs,
+		collectMs,
+		errors);
+	ReportCheck("Resource pool", errors == 0);
+}
+
+// --------------------------------------------------------
+// Frustum culls a large number of random spheres with the SIMD,
+// multithreaded path and with the scalar reference, and checks
+// both keep exactly the same objects
+//
+// objectCount - Number of spheres
+// frames - Number of times each version is run (timings are averaged)
+// --------------------------------------------------------
+void RunCullingBenchmark(unsigned int objectCount, unsigned int frames)
+{
+	std::mt19937 random(1234);
+	std::uniform_real_distribution<float> positionDist(-500.0f, 500.0f);
+	std::uniform_real_distribution<float> radiusDist(0.5f, 2.0f);
+	std::vector<XMFLOAT4> spheres(objectCount);
+	for (XMFLOAT4& sphere : spheres)
+		sphere = XMFLOAT4(positionDist(random), positionDist(random), positionDist(random), radiusDist(random));
+
+	// A camera in the middle of everything, turning a little each frame
+	XMMATRIX projection = XMMatrixPerspectiveFovLH(XM_PIDIV2, 16.0f / 9.0f, 0.01f, 1000.0f);
+	std::vector<XMFLOAT4X4> viewProjections(frames);
+	for (unsigned int frame = 0; frame < frames; frame++)
+	{
+		XMMATRIX view = XMMatrixRotationRollPitchYaw(0, frame * 0.3f, 0);
+		XMStoreFloat4x4(&viewProjections[frame], XMMatrixMultiply(XMMatrixTranspose(view), projection));
+	}
+
+	FrustumCulling culling;
+	double bruteForceMs = 0;
+	unsigned int bruteForceVisible = 0;
+	std::vector<std::vector<unsigned int>> expected(frames);
+	for (unsigned int frame = 0; frame < frames; frame++)
+	{
+		culling.CullBruteForce(viewProjections[frame], spheres.data(), objectCount);
+		bruteForceMs += culling.GetLastCullTimeMs();
+		bruteForceVisible += culling.GetVisibleCount();
+		expected[frame] = culling.GetVisible();
+	}
+
+	double simdMs = 0;
+	bool match = true;
+	for (unsigned int frame = 0; frame < frames; frame++)
+	{
+		culling.Cull(viewProjections[frame], spheres.data(), objectCount);
+		simdMs += culling.GetLastCullTimeMs();
+		match = match && culling.GetVisible() == expected[frame];
+	}
+
+	printf("Frustum culling (%u): %.1f%% visible, scalar %.3fms, SIMD + threads %.3fms (%.1fx), ",
+		objectCount,
+		100.0 * bruteForceVisible / ((double)objectCount * frames),
+		bruteForceMs / frames,
+		simdMs / frames,
+		bruteForceMs / simdMs);
+	ReportCheck("Frustum culling", match);
+}
+
+// --------------------------------------------------------
+// Occlusion culls objects scattered through a grid of box shaped
+// buildings, with a camera walking down a street. Checks the fast
+// path against the brute force one, and against a reference at four
+// times the resolution to see how close to exact visibility it gets.
+//
+// objectCount - Number of objects (spheres) in the city
+// frames - Number of camera positions
+// --------------------------------------------------------
+void RunOcclusionBenchmark(unsigned int objectCount, unsigned int frames)
+{
+	// 16 x 16 buildings, each 10 x 30 x 10, with 10 unit wide streets between
+	OcclusionCulling occlusion;
+	OcclusionCulling exact(occlusion.GetWidth() * 4, occlusion.GetHeight() * 4);
+	unsigned int box = occlusion.AddOccluderBox(XMFLOAT3(-5, 0, -5), XMFLOAT3(5, 30, 5));
+	exact.AddOccluderBox(XMFLOAT3(-5, 0, -5), XMFLOAT3(5, 30, 5));
+
+	const unsigned int buildingsPerSide = 16;
+	std::vector<XMFLOAT4X4> buildingWorlds;
+	std::vector<XMFLOAT4> buildingSpheres;
+	for (unsigned int z = 0; z < buildingsPerSide; z++)
+	{
+		for (unsigned int x = 0; x < buildingsPerSide; x++)
+		{
+			XMFLOAT4X4 world;
+			XMStoreFloat4x4(&world, XMMatrixTranslation(x * 20.0f, 0, z * 20.0f));
+			buildingWorlds.push_back(world);
+			buildingSpheres.push_back(XMFLOAT4(x * 20.0f, 15, z * 20.0f, sqrtf(5 * 5 + 15 * 15 + 5 * 5)));
+		}
+	}
+
+	std::mt19937 random(1234);
+	std::uniform_real_distribution<float> positionDist(-10.0f, buildingsPerSide * 20.0f);
+	std::uniform_real_distribution<float> heightDist(0.0f, 40.0f);
+	std::uniform_real_distribution<float> radiusDist(0.25f, 1.5f);
+	std::vector<XMFLOAT4> spheres(objectCount);
+	for (XMFLOAT4& sphere : spheres)
+		sphere = XMFLOAT4(positionDist(random), heightDist(random), positionDist(random), radiusDist(random));
+
+	XMMATRIX projection = XMMatrixPerspectiveFovLH(XM_PIDIV2, 16.0f / 9.0f, 0.1f, 1000.0f);
+	FrustumCulling frustum;
+	double rasterMs = 0, testMs = 0, bruteForceMs = 0;
+	unsigned int frustumVisible = 0, occlusionVisible = 0, exactVisible = 0;
+	unsigned int wronglyCulled = 0, skippedOccluders = 0;
+	bool match = true;
+	for (unsigned int frame = 0; frame < frames; frame++)
+	{
+		// Walk down the street between the first two rows, looking along it
+		XMFLOAT3 eye(10, 2, frame * 4.0f);
+		XMFLOAT4X4 viewProjection;
+		XMStoreFloat4x4(&viewProjection, XMMatrixMultiply(
+			XMMatrixLookToLH(XMLoadFloat3(&eye), XMVectorSet(0.3f, 0, 1, 0), XMVectorSet(0, 1, 0, 0)),
+			projection));
+
+		frustum.Cull(viewProjection, spheres.data(), objectCount);
+		const std::vector<unsigned int>& candidates = frustum.GetVisible();
+		frustumVisible += (unsigned int)candidates.size();
+
+		occlusion.BeginFrame(viewProjection);
+		exact.BeginFrame(viewProjection);
+		for (size_t b = 0; b < buildingWorlds.size(); b++)
+		{
+			occlusion.AddOccluder((unsigned int)b, box, buildingWorlds[b], buildingSpheres[b]);
+			exact.AddOccluder((unsigned int)b, box, buildingWorlds[b], buildingSpheres[b]);
+		}
+
+		occlusion.RasterizeOccluders();
+		occlusion.Cull(spheres.data(), candidates.data(), (unsigned int)candidates.size());
+		rasterMs += occlusion.GetLastRasterTimeMs();
+		testMs += occlusion.GetLastTestTimeMs();
+		occlusionVisible += occlusion.GetVisibleCount();
+		skippedOccluders += occlusion.GetSkippedOccluderCount();
+		std::vector<unsigned int> fast = occlusion.GetVisible();
+
+		// Brute force draws the same occluders in the same passes, so it should agree exactly
+		occlusion.CullBruteForce(spheres.data(), candidates.data(), (unsigned int)candidates.size());
+		bruteForceMs += occlusion.GetLastRasterTimeMs() + occlusion.GetLastTestTimeMs();
+		match = match && fast == occlusion.GetVisible();
+
+		// Anything the high resolution reference sees must have been kept (it's
+		// never Cull()ed, so it draws every occluder every frame)
+		exact.CullBruteForce(spheres.data(), candidates.data(), (unsigned int)candidates.size());
+		const std::vector<unsigned int>& reference = exact.GetVisible();
+		exactVisible += (unsigned int)reference.size();
+		for (unsigned int index : reference)
+			wronglyCulled += !std::binary_search(fast.begin(), fast.end(), index);
+	}
+
+	printf("Occlusion culling (%u objects, %u occluders, %ux%u): %.1f%% of frustum survivors visible (reference %.1f%%), "
+		"raster %.3fms + test %.3fms (brute force %.3fms), %.1f occluders skipped, %u wrongly culled, ",
+		objectCount,
+		(unsigned int)buildingWorlds.size(),
+		occlusion.GetWidth(),
+		occlusion.GetHeight(),
+		100.0 * occlusionVisible / std::max(frustumVisible, 1u),
+		100.0 * exactVisible / std::max(frustumVisible, 1u),
+		rasterMs / frames,
+		testMs / frames,
+		bruteForceMs / frames,
+		(double)skippedOccluders / frames,
+		wronglyCulled);
+	ReportCheck("Occlusion culling", match);
+}
+
+// --------------------------------------------------------
+// Drops small objects from a large scattered scene, with the SIMD
+// path and the scalar reference, and reports how many draws each
+// layer's threshold removes. Then does the same with grouping on, to
+// see how many stand ins bring back distant clusters.
+//
+// objectCount - Number of spheres (spread over three layers)
+// frames - Number of times each version is run (timings are averaged)
+// --------------------------------------------------------
+void RunContributionBenchmark(unsigned int objectCount, unsigned int frames)
+{
+	// Props and details are smaller than world objects, and clustered
+	// in small piles so grouping has something to find
+	std::mt19937 random(1234);
+	std::uniform_real_distribution<float> positionDist(-500.0f, 500.0f);
+	std::uniform_real_distribution<float> offsetDist(-2.0f, 2.0f);
+	std::uniform_real_distribution<float> worldRadiusDist(0.5f, 4.0f);
+	std::uniform_real_distribution<float> smallRadiusDist(0.05f, 0.5f);
+	std::vector<XMFLOAT4> spheres(objectCount);
+	std::vector<unsigned int> layers(objectCount);
+	XMFLOAT3 pile(0, 0, 0);
+	for (unsigned int i = 0; i < objectCount; i++)
+	{
+		layers[i] = i % 3;
+		if (layers[i] == RENDER_LAYER_WORLD)
+		{
+			spheres[i] = XMFLOAT4(positionDist(random), positionDist(random), positionDist(random), worldRadiusDist(random));
+			continue;
+		}
+
+		if (i % 48 == 1)
+			pile = XMFLOAT3(positionDist(random), positionDist(random), positionDist(random));
+		spheres[i] = XMFLOAT4(pile.x + offsetDist(random), pile.y + offsetDist(random), pile.z + offsetDist(random), smallRadiusDist(random));
+	}
+
+	// Everything starts out as a candidate, so the frustum doesn't hide anything
+	std::vector<unsigned int> candidates(objectCount);
+	for (unsigned int i = 0; i < objectCount; i++)
+		candidates[i] = i;
+
+	// A 1280x720 camera in the middle of everything, turning a little each frame
+	XMFLOAT4X4 projection;
+	XMStoreFloat4x4(&projection, XMMatrixPerspectiveFovLH(XM_PIDIV2, 16.0f / 9.0f, 0.01f, 1000.0f));
+	float viewportHeight = 720.0f;
+	std::vector<XMFLOAT4X4> viewProjections(frames);
+	for (unsigned int frame = 0; frame < frames; frame++)
+	{
+		XMMATRIX view = XMMatrixRotationRollPitchYaw(0, frame * 0.3f, 0);
+		XMStoreFloat4x4(&viewProjections[frame], XMMatrixMultiply(XMMatrixTranspose(view), XMLoadFloat4x4(&projection)));
+	}
+
+	ContributionCulling culling;
+	culling.SetThreshold(RENDER_LAYER_WORLD, 1.0f);
+	culling.SetThreshold(RENDER_LAYER_PROPS, 4.0f);
+	culling.SetThreshold(RENDER_LAYER_DETAIL, 16.0f);
+
+	double bruteForceMs = 0;
+	std::vector<std::vector<unsigned int>> expected(frames);
+	for (unsigned int frame = 0; frame < frames; frame++)
+	{
+		culling.CullBruteForce(viewProjections[frame], projection, viewportHeight, spheres.data(), layers.data(), candidates.data(), objectCount);
+		bruteForceMs += culling.GetLastCullTimeMs();
+		expected[frame] = culling.GetVisible();
+	}
+
+	double simdMs = 0;
+	unsigned int dropped[3] = {};
+	bool match = true;
+	for (unsigned int frame = 0; frame < frames; frame++)
+	{
+		culling.Cull(viewProjections[frame], projection, viewportHeight, spheres.data(), layers.data(), candidates.data(), objectCount);
+		simdMs += culling.GetLastCullTimeMs();
+		for (unsigned int layer = 0; layer < 3; layer++)
+			dropped[layer] += culling.GetDroppedCount(layer);
+		match = match && culling.GetVisible() == expected[frame];
+	}
+
+	// Grouping by 8 unit cells brings back piles that are big enough together
+	culling.SetGroupCellSize(8.0f);
+	double groupedMs = 0;
+	unsigned int standIns = 0;
+	for (unsigned int frame = 0; frame < frames; frame++)
+	{
+		culling.Cull(viewProjections[frame], projection, viewportHeight, spheres.data(), layers.data(), candidates.data(), objectCount);
+		groupedMs += culling.GetLastCullTimeMs();
+		standIns += culling.GetStandInCount();
+		std::vector<unsigned int> grouped = culling.GetVisible();
+
+		culling.CullBruteForce(viewProjections[frame], projection, viewportHeight, spheres.data(), layers.data(), candidates.data(), objectCount);
+		match = match && grouped == culling.GetVisible();
+	}
+
+	unsigned int perLayer = objectCount / 3;
+	printf("Contribution culling (%u): dropped %.1f%% world (1px), %.1f%% props (4px), %.1f%% detail (16px), "
+		"scalar %.3fms, SIMD %.3fms (%.1fx), grouped %.3fms with %.1f stand ins, ",
+		objectCount,
+		100.0 * dropped[RENDER_LAYER_WORLD] / ((double)perLayer * frames),
+		100.0 * dropped[RENDER_LAYER_PROPS] / ((double)perLayer * frames),
+		100.0 * dropped[RENDER_LAYER_DETAIL] / ((double)perLayer * frames),
+		bruteForceMs / frames,
+		simdMs / frames,
+		bruteForceMs / simdMs,
+		groupedMs / frames,
+		(double)standIns / frames);
+	ReportCheck("Contribution culling", match);
+}
+
+// --------------------------------------------------------
+// Bins random point and spot lights into clusters with the
+// SIMD jobs and with the one pair at a time reference (which
+// tests the exact froxels), and checks the SIMD version never
+// misses a light the reference finds
+// --------------------------------------------------------
+void RunClusteredLightingBenchmark(unsigned int lightCount, unsigned int frames)
+{
+	// A quarter of them spot lights, pointing every which way
+	std::mt19937 random(1234);
+	std::uniform_real_distribution<float> positionDist(-100.0f, 100.0f);
+	std::uniform_real_distribution<float> directionDist(-1.0f, 1.0f);
+	std::uniform_real_distribution<float> rangeDist(2.0f, 10.0f);
+	std::uniform_real_distribution<float> falloffDist(2.0f, 32.0f);
+	unsigned int spotCount = lightCount / 4;
+	unsigned int pointCount = lightCount - spotCount;
+	std::vector<Light> lights(lightCount);
+	for (unsigned int i = 0; i < lightCount; i++)
+	{
+		Light& light = lights[i];
+		light = {};
+		light.Type = i < pointCount ? LIGHT_TYPE_POINT : LIGHT_TYPE_SPOT;
+		light.Position = XMFLOAT3(positionDist(random), positionDist(random), positionDist(random));
+		XMStoreFloat3(&light.Direction, XMVector3Normalize(XMVectorSet(directionDist(random), directionDist(random), directionDist(random), 0)));
+		light.Range = rangeDist(random);
+		light.intensity = 1.0f;
+		light.Color = XMFLOAT3(1, 1, 1);
+		light.SpotFalloff = falloffDist(random);
+	}
+
+	// A camera in the middle of them, turning a little each frame
+	XMFLOAT4X4 projection;
+	XMStoreFloat4x4(&projection, XMMatrixPerspectiveFovLH(XM_PIDIV2, 16.0f / 9.0f, 0.1f, 200.0f));
+	ClusteredLighting clustered;
+	clustered.UpdateClusterBounds(projection, 0.1f, 200.0f);
+	clustered.Reserve(lightCount);
+	unsigned int clusterCount = clustered.GetClusterCountX() * clustered.GetClusterCountY() * clustered.GetClusterCountZ();
+
+	double simdMs = 0;
+	double bruteForceMs = 0;
+	unsigned long long simdPairs = 0;
+	unsigned long long exactPairs = 0;
+	unsigned int overflows = 0;
+	bool match = true;
+	for (unsigned int frame = 0; frame < frames; frame++)
+	{
+		XMFLOAT4X4 view;
+		XMStoreFloat4x4(&view, XMMatrixTranspose(XMMatrixRotationRollPitchYaw(0, frame * 0.3f, 0)));
+
+		clustered.BinLights(lights.data(), pointCount, spotCount, view);
+		simdMs += clustered.GetLastBinTimeMs();
+		simdPairs += clustered.GetLightIndices().size();
+		overflows += clustered.GetOverflowCount();
+
+		clustered.BinLightsBruteForce(lights.data(), pointCount, spotCount, view);
+		bruteForceMs += clustered.GetLastBinTimeMs();
+		exactPairs += clustered.GetLightIndices().size();
+
+		match = match && clustered.VerifyAgainstBruteForce(lights.data(), pointCount, spotCount, view);
+	}
+
+	// Lights the boxes let in that the froxels don't, as a share of the exact count
+	printf("Clustered lighting (%u point + %u spot lights, %u clusters): SIMD %.3fms, brute force %.3fms (%.0fx), "
+		"%.2f lights per cluster (%.2f exact, %.1f%% extra from the looser boxes), %u dropped from full clusters, ",
+		pointCount,
+		spotCount,
+		clusterCount,
+		simdMs / frames,
+		bruteForceMs / frames,
+		bruteForceMs / simdMs,
+		(double)simdPairs / ((double)clusterCount * frames),
+		(double)exactPairs / ((double)clusterCount * frames),
+		exactPairs == 0 ? 0.0 : 100.0 * (simdPairs - exactPairs) / exactPairs,
+		overflows);
+	ReportCheck("Clustered lighting", match && overflows == 0);
+}
+
+// --------------------------------------------------------
+// Picks each object's few strongest lights from a scene full
+// of them, with the SIMD frustum cull and running top few, and
+// with the reference that scores every light and partial sorts
+// --------------------------------------------------------
+void RunLightSelectionBenchmark(unsigned int objectCount, unsigned int lightCount, unsigned int frames)
+{
+	std::mt19937 random(1234);
+	std::uniform_real_distribution<float> positionDist(-100.0f, 100.0f);
+	std::uniform_real_distribution<float> radiusDist(0.5f, 4.0f);
+	std::uniform_real_distribution<float> rangeDist(15.0f, 40.0f);
+	std::uniform_real_distribution<float> unitDist(0.0f, 1.0f);
+	std::vector<XMFLOAT4> spheres(objectCount);
+	for (XMFLOAT4& sphere : spheres)
+		sphere = XMFLOAT4(positionDist(random), positionDist(random), positionDist(random), radiusDist(random));
+
+	// Colors and intensities vary so the rankings aren't all ties
+	unsigned int spotCount = lightCount / 4;
+	unsigned int pointCount = lightCount - spotCount;
+	std::vector<Light> lights(lightCount);
+	for (unsigned int i = 0; i < lightCount; i++)
+	{
+		Light& light = lights[i];
+		light = {};
+		light.Type = i < pointCount ? LIGHT_TYPE_POINT : LIGHT_TYPE_SPOT;
+		light.Position = XMFLOAT3(positionDist(random), positionDist(random), positionDist(random));
+		light.Direction = XMFLOAT3(0, -1, 0);
+		light.Range = rangeDist(random);
+		light.intensity = 0.5f + unitDist(random) * 1.5f;
+		light.Color = XMFLOAT3(unitDist(random), unitDist(random), unitDist(random));
+		light.SpotFalloff = 8.0f;
+	}
+
+	// A camera in the middle of everything, turning a little each frame
+	XMMATRIX projection = XMMatrixPerspectiveFovLH(XM_PIDIV2, 16.0f / 9.0f, 0.01f, 1000.0f);
+	LightSelection selection;
+	double simdMs = 0;
+	double bruteForceMs = 0;
+	double lightsPerObject = 0;
+	unsigned int visibleLights = 0;
+	bool match = true;
+	for (unsigned int frame = 0; frame < frames; frame++)
+	{
+		XMFLOAT4X4 viewProjection;
+		XMMATRIX view = XMMatrixRotationRollPitchYaw(0, frame * 0.3f, 0);
+		XMStoreFloat4x4(&viewProjection, XMMatrixMultiply(XMMatrixTranspose(view), projection));
+
+		selection.SelectLights(lights.data(), pointCount, spotCount, viewProjection, spheres.data(), objectCount);
+		simdMs += selection.GetLastSelectTimeMs();
+		lightsPerObject += selection.GetAverageLightsPerObject();
+		visibleLights += selection.GetVisibleLightCount();
+
+		match = match && selection.VerifyAgainstBruteForce(lights.data(), pointCount, spotCount, viewProjection, spheres.data(), objectCount);
+		bruteForceMs += selection.GetLastSelectTimeMs();
+	}
+
+	printf("Light selection (%u objects, %u point + %u spot lights, %.0f in view): SIMD %.3fms, score all + partial sort %.3fms (%.1fx), %.2f lights per object (at most %u), ",
+		objectCount,
+		pointCount,
+		spotCount,
+		(double)visibleLights / frames,
+		simdMs / frames,
+		bruteForceMs / frames,
+		bruteForceMs / simdMs,
+		lightsPerObject / frames,
+		MAX_LIGHTS_PER_OBJECT);
+	ReportCheck("Light selection", match && lightsPerObject > 0);
+}
+
+// --------------------------------------------------------
+// Builds a BVH over random spheres, moves some of them every
+// frame (refitting, and rebuilding when the tree gets too slow),
+// and runs each kind of query against the linear scans they
+// replace, checking the results are exactly the same
+//
+// objectCount - Number of spheres
+// frames - Number of times the objects move
+// queryCount - Number of each of the sphere, ray and nearest queries
+// --------------------------------------------------------
+void RunBVHBenchmark(unsigned int objectCount, unsigned int frames, unsigned int queryCount)
+{
+	std::mt19937 random(1234);
+	std::uniform_real_distribution<float> positionDist(-500.0f, 500.0f);
+	std::uniform_real_distribution<float> radiusDist(0.5f, 2.0f);
+	std::uniform_real_distribution<float> moveDist(-1.0f, 1.0f);
+	std::vector<XMFLOAT4> spheres(objectCount);
+	for (XMFLOAT4& sphere : spheres)
+		sphere = XMFLOAT4(positionDist(random), positionDist(random), positionDist(random), radiusDist(random));
+
+	SceneBVH bvh;
+	bvh.Build(spheres.data(), objectCount);
+	double buildMs = bvh.GetLastBuildTimeMs();
+	unsigned int nodeCount = bvh.GetNodeCount();
+
+	// A tenth of the objects wander a little each frame
+	double refitMs = 0;
+	unsigned int rebuilds = 0;
+	for (unsigned int frame = 0; frame < frames; frame++)
+	{
+		for (unsigned int i = frame % 10; i < objectCount; i += 10)
+		{
+			spheres[i].x += moveDist(random) * 5.0f;
+			spheres[i].y += moveDist(random) * 5.0f;
+			spheres[i].z += moveDist(random) * 5.0f;
+		}
+		rebuilds += bvh.Update(spheres.data(), objectCount) ? 1 : 0;
+		refitMs += bvh.GetLastRefitTimeMs();
+	}
+
+	printf("BVH (%u): build %.3fms (%u nodes, %u bytes each), refit %.3fms, %u rebuilds in %u frames, SAH cost %.1f (%.1f when built)\n",
+		objectCount,
+		buildMs,
+		nodeCount,
+		(unsigned int)(sizeof(float) * 24 + sizeof(unsigned int) * 8),
+		refitMs / frames,
+		rebuilds,
+		frames,
+		bvh.GetCost(),
+		bvh.GetBuildCost());
+
+	// Frustum queries vs. the SIMD linear culling (and its scalar reference)
+	XMMATRIX projection = XMMatrixPerspectiveFovLH(XM_PIDIV2, 16.0f / 9.0f, 0.01f, 1000.0f);
+	FrustumCulling culling;
+	std::vector<unsigned int> results;
+	std::vector<unsigned int> expected;
+	double bvhMs = 0, linearMs = 0;
+	bool match = true;
+	for (unsigned int frame = 0; frame < frames; frame++)
+	{
+		XMFLOAT4X4 viewProjection;
+		XMStoreFloat4x4(&viewProjection, XMMatrixMultiply(XMMatrixTranspose(XMMatrixRotationRollPitchYaw(0, frame * 0.3f, 0)), projection));
+
+		BenchmarkClock::time_point start = BenchmarkClock::now();
+		bvh.QueryFrustum(viewProjection, results);
+		bvhMs += MillisecondsSince(start);
+
+		culling.Cull(viewProjection, spheres.data(), objectCount);
+		linearMs += culling.GetLastCullTimeMs();
+		culling.CullBruteForce(viewProjection, spheres.data(), objectCount);
+		match = match && results == culling.GetVisible();
+	}
+	// A frame's refit and query don't allocate once the results have
+	// grown, and a rebuild (the object count changing) is let off
+	XMFLOAT4X4 frameViewProjection;
+	XMStoreFloat4x4(&frameViewProjection, projection);
+	unsigned long long forbiddenBefore = MemoryTracker::GetForbiddenAllocationCount();
+	unsigned long long allocationsBefore = MemoryTracker::GetThreadAllocationCount();
+	bool refitAllocated = true;
+	{
+		ZERO_ALLOCATIONS(true);
+		bool rebuilt = bvh.Update(spheres.data(), objectCount);
+		bvh.QueryFrustum(frameViewProjection, results);
+		refitAllocated = rebuilt || MemoryTracker::GetThreadAllocationCount() != allocationsBefore;
+		match = match && bvh.Update(spheres.data(), objectCount - 1) && bvh.Update(spheres.data(), objectCount);
+	}
+	match = match && !refitAllocated && MemoryTracker::GetForbiddenAllocationCount() == forbiddenBefore;
+
+	printf("BVH frustum queries: %.3fms vs. %.3fms linear SIMD (%.1fx), ",
+		bvhMs / frames,
+		linearMs / frames,
+		linearMs / bvhMs);
+	ReportCheck("BVH frustum queries", match);
+
+	// Sphere queries, the size of a point light's range
+	std::vector<XMFLOAT4> querySpheres(queryCount);
+	for (XMFLOAT4& sphere : querySpheres)
+		sphere = XMFLOAT4(positionDist(random), positionDist(random), positionDist(random), 20.0f);
+
+	unsigned int found = 0;
+	match = true;
+	BenchmarkClock::time_point start = BenchmarkClock::now();
+	for (unsigned int q = 0; q < queryCount; q++)
+	{
+		bvh.QuerySphere(querySpheres[q], results);
+		found += (unsigned int)results.size();
+	}
+	bvhMs = MillisecondsSince(start);
+	start = BenchmarkClock::now();
+	for (unsigned int q = 0; q < queryCount; q++)
+		bvh.QuerySphereBruteForce(querySpheres[q], expected);
+	linearMs = MillisecondsSince(start);
+	for (unsigned int q = 0; q < queryCount && match; q++)
+	{
+		bvh.QuerySphere(querySpheres[q], results);
+		bvh.QuerySphereBruteForce(querySpheres[q], expected);
+		match = results == expected;
+	}
+	printf("BVH sphere queries: %.0f/ms vs. %.1f/ms linear (%.1f objects each), ",
+		queryCount / bvhMs,
+		queryCount / linearMs,
+		(double)found / queryCount);
+	ReportCheck("BVH sphere queries", match);
+
+	// Rays in random directions, like picking
+	std::vector<XMFLOAT3> origins(queryCount);
+	std::vector<XMFLOAT3> directions(queryCount);
+	for (unsigned int q = 0; q < queryCount; q++)
+	{
+		origins[q] = XMFLOAT3(positionDist(random), positionDist(random), positionDist(random));
+		directions[q] = XMFLOAT3(moveDist(random), moveDist(random), moveDist(random));
+	}
+
+	std::vector<unsigned int> hitIndices(queryCount);
+	std::vector<float> hitDistances(queryCount);
+	std::vector<bool> hits(queryCount);
+	unsigned int hitCount = 0;
+	start = BenchmarkClock::now();
+	for (unsigned int q = 0; q < queryCount; q++)
+	{
+		hits[q] = bvh.Raycast(origins[q], directions[q], 1000.0f, hitIndices[q], hitDistances[q]);
+		hitCount += hits[q] ? 1 : 0;
+	}
+	bvhMs = MillisecondsSince(start);
+
+	match = true;
+	start = BenchmarkClock::now();
+	for (unsigned int q = 0; q < queryCount; q++)
+	{
+		unsigned int hitIndex = 0;
+		float hitDistance = 0;
+		bool hit = bvh.RaycastBruteForce(origins[q], directions[q], 1000.0f, hitIndex, hitDistance);
+		match = match && hit == hits[q] && (!hit || (hitIndex == hitIndices[q] && hitDistance == hitDistances[q]));
+	}
+	linearMs = MillisecondsSince(start);
+	printf("BVH raycasts: %.0f/ms vs. %.1f/ms linear (%u of %u hit), ",
+		queryCount / bvhMs,
+		queryCount / linearMs,
+		hitCount,
+		queryCount);
+	ReportCheck("BVH raycasts", match);
+
+	// Eight nearest objects to random points
+	match = true;
+	start = BenchmarkClock::now();
+	for (unsigned int q = 0; q < queryCount; q++)
+		bvh.QueryNearest(origins[q], 8, results);
+	bvhMs = MillisecondsSince(start);
+	start = BenchmarkClock::now();
+	for (unsigned int q = 0; q < queryCount; q++)
+		bvh.QueryNearestBruteForce(origins[q], 8, expected);
+	linearMs = MillisecondsSince(start);
+	for (unsigned int q = 0; q < queryCount && match; q++)
+	{
+		bvh.QueryNearest(origins[q], 8, results);
+		bvh.QueryNearestBruteForce(origins[q], 8, expected);
+		match = results == expected;
+	}
+	printf("BVH 8 nearest queries: %.0f/ms vs. %.1f/ms linear, ",
+		queryCount / bvhMs,
+		queryCount / linearMs);
+	ReportCheck("BVH 8 nearest queries", match);
+}
+
+// --------------------------------------------------------
+// Fires random rays at each mesh (from outside its bounds, aimed
+// at a random point inside them, like picking rays) and compares
+// the triangle BVH against testing every triangle
+//
+// meshHandles - Meshes to test (ones without CPU geometry are skipped)
+// rayCount - Number of rays per mesh (a tenth as many for brute force)
+// --------------------------------------------------------
+void RunMeshBVHBenchmark(ResourceRegistry& resources, const std::vector<MeshHandle>& meshHandles, unsigned int rayCount)
+{
+	std::mt19937 random(1234);
+	std::uniform_real_distribution<float> unitDist(0.0f, 1.0f);
+	std::uniform_real_distribution<float> directionDist(-1.0f, 1.0f);
+
+	for (size_t m = 0; m < meshHandles.size(); m++)
+	{
+		Mesh* mesh = resources.GetMesh(meshHandles[m]);
+		if (!mesh || !mesh->HasCPUGeometry())
+			continue;
+		MeshBVH* triangleBVH = mesh->GetTriangleBVH();
+
+		// Rays start on a sphere around the mesh and aim somewhere inside its box
+		XMFLOAT3 boundsMin = mesh->GetBoundsMin();
+		XMFLOAT3 boundsMax = mesh->GetBoundsMax();
+		XMFLOAT3 sphereCenter = mesh->GetBoundingSphereCenter();
+		XMVECTOR center = XMLoadFloat3(&sphereCenter);
+		float radius = mesh->GetBoundingSphereRadius() * 2.0f;
+		std::vector<XMFLOAT3> origins(rayCount);
+		std::vector<XMFLOAT3> directions(rayCount);
+		for (unsigned int r = 0; r < rayCount; r++)
+		{
+			XMVECTOR offset = XMVector3Normalize(XMVectorSet(directionDist(random), directionDist(random), directionDist(random), 0));
+			XMVECTOR origin = XMVectorMultiplyAdd(offset, XMVectorReplicate(radius), center);
+			XMVECTOR target = XMVectorSet(
+				boundsMin.x + (boundsMax.x - boundsMin.x) * unitDist(random),
+				boundsMin.y + (boundsMax.y - boundsMin.y) * unitDist(random),
+				boundsMin.z + (boundsMax.z - boundsMin.z) * unitDist(random),
+				0);
+			XMStoreFloat3(&origins[r], origin);
+			XMStoreFloat3(&directions[r], XMVector3Normalize(XMVectorSubtract(target, origin)));
+		}
+
+		std::vector<unsigned int> hitTriangles(rayCount);
+		std::vector<float> hitDistances(rayCount);
+		std::vector<bool> hits(rayCount);
+		unsigned int hitCount = 0;
+		BenchmarkClock::time_point start = BenchmarkClock::now();
+		for (unsigned int r = 0; r < rayCount; r++)
+		{
+			hits[r] = triangleBVH->Raycast(origins[r], directions[r], FLT_MAX, hitTriangles[r], hitDistances[r]);
+			hitCount += hits[r] ? 1 : 0;
+		}
+		double bvhMs = MillisecondsSince(start);
+
+		unsigned int bruteForceCount = std::max(1u, rayCount / 10);
+		bool match = true;
+		start = BenchmarkClock::now();
+		for (unsigned int r = 0; r < bruteForceCount; r++)
+		{
+			unsigned int hitTriangle = 0;
+			float hitDistance = 0;
+			bool hit = triangleBVH->RaycastBruteForce(origins[r], directions[r], FLT_MAX, hitTriangle, hitDistance);
+			match = match && hit == hits[r] && (!hit || (hitTriangle == hitTriangles[r] && hitDistance == hitDistances[r]));
+		}
+		double bruteForceMs = MillisecondsSince(start);
+
+		printf("Mesh BVH (mesh %u, %u triangles, %u nodes, %.1fKB): %.2fM rays/s vs. %.3fM rays/s brute force (%.0f%% hit), ",
+			(unsigned int)m,
+			triangleBVH->GetTriangleCount(),
+			triangleBVH->GetNodeCount(),
+			triangleBVH->GetMemorySize() / 1024.0,
+			rayCount / bvhMs / 1000.0,
+			bruteForceCount / bruteForceMs / 1000.0,
+			100.0 * hitCount / rayCount);
+		ReportCheck("Mesh BVH", match);
+	}
+}
+
+// A few dozen flops per element, so the loop isn't just memory bound
+static void JobBenchmarkWork(const float* input, float* output, unsigned int first, unsigned int last)
+{
+	for (unsigned int i = first; i < last; i++)
+	{
+		float x = input[i];
+		float sum = 0;
+		for (int k = 0; k < 16; k++)
+			sum += sinf(x * (k + 1)) * 0.5f;
+		output[i] = sum;
+	}
+}
+
+static void EmptyJob(void* data, unsigned int, unsigned int)
+{
+	((std::atomic<unsigned int>*)data)->fetch_add(1);
+}
+
+// Slow enough that a queue of them is still waiting at Shutdown()
+static void SlowJob(void* data, unsigned int, unsigned int)
+{
+	std::this_thread::sleep_for(std::chrono::microseconds(100));
+	((std::atomic<unsigned int>*)data)->fetch_add(1);
+}
+
+// --------------------------------------------------------
+// Re-initializes the job system with 1, 2, 4... threads (up to one
+// per core) and times the same parallel loop on each, then the cost
+// per job of queueing lots of tiny ones, fanned out from inside jobs
+// (so they're stolen) and chained with RunAfter. Each size ends by
+// shutting down with jobs still queued for its last worker, which
+// must all run first. The job system is put back to its default
+// size at the end.
+// --------------------------------------------------------
+void RunJobSystemBenchmark(unsigned int elementCount, unsigned int jobCount)
+{
+	JobSystem& jobs = JobSystem::GetInstance();
+	std::mt19937 random(1234);
+	std::uniform_real_distribution<float> valueDist(0.0f, 10.0f);
+	std::vector<float> input(elementCount);
+	for (unsigned int i = 0; i < elementCount; i++)
+		input[i] = valueDist(random);
+
+	// Serial reference
+	std::vector<float> expected(elementCount);
+	BenchmarkClock::time_point start = BenchmarkClock::now();
+	JobBenchmarkWork(input.data(), expected.data(), 0, elementCount);
+	double serialMs = MillisecondsSince(start);
+	printf("Job system: serial loop %.2fms (%u elements)\n", serialMs, elementCount);
+
+	unsigned int maxThreads = std::max(std::thread::hardware_concurrency(), 1u);
+	std::vector<float> output(elementCount);
+	for (unsigned int threads = 1; ; threads = std::min(threads * 2, maxThreads))
+	{
+		jobs.Initialize(threads);
+
+		std::fill(output.begin(), output.end(), 0.0f);
+		start = BenchmarkClock::now();
+		jobs.ParallelFor(0, elementCount, 1024, [&](unsigned int first, unsigned int last)
+		{
+			JobBenchmarkWork(input.data(), output.data(), first, last);
+		});
+		double loopMs = MillisecondsSince(start);
+		bool match = output == expected;
+
+		// Tiny jobs queued from this thread
+		std::atomic<unsigned int> ran(0);
+		JobCounter counter;
+		start = BenchmarkClock::now();
+		for (unsigned int j = 0; j < jobCount; j++)
+			jobs.Run(&EmptyJob, &ran, 0, 0, &counter);
+		jobs.Wait(counter);
+		double queueMs = MillisecondsSince(start);
+
+		// Tiny jobs queued from inside other jobs, so most are stolen
+		unsigned int fanOut = 64;
+		start = BenchmarkClock::now();
+		JobCounter outer;
+		for (unsigned int j = 0; j < jobCount / fanOut; j++)
+		{
+			jobs.Run([&]()
+			{
+				JobCounter inner;
+				for (unsigned int k = 0; k < fanOut; k++)
+					jobs.Run(&EmptyJob, &ran, 0, 0, &inner);
+				jobs.Wait(inner);
+			}, &outer);
+		}
+		jobs.Wait(outer);
+		double nestedMs = MillisecondsSince(start);
+
+		// A chain where each job only starts once the one before it is done
+		unsigned int chainLength = std::min(jobCount, 10000u);
+		std::vector<JobCounter> chain(chainLength);
+		std::vector<unsigned int> order;
+		order.reserve(chainLength);
+		start = BenchmarkClock::now();
+		jobs.Run([&]() { order.push_back(0); }, &chain[0]);
+		for (unsigned int j = 1; j < chainLength; j++)
+			jobs.RunAfter(chain[j - 1], [&order, j]() { order.push_back(j); }, &chain[j]);
+		jobs.Wait(chain[chainLength - 1]);
+		double chainMs = MillisecondsSince(start);
+		bool chainInOrder = order.size() == chainLength;
+		for (unsigned int j = 0; chainInOrder && j < chainLength; j++)
+			chainInOrder = order[j] == j;
+
+		unsigned int stolen = jobs.GetStealCount();
+
+		// Only the last worker can run these, and most of them are
+		// still queued when Shutdown() starts
+		const unsigned int pinnedJobCount = 64;
+		std::atomic<unsigned int> pinnedRan(0);
+		JobCounter pinned;
+		for (unsigned int j = 0; j < pinnedJobCount; j++)
+			jobs.Run(&SlowJob, &pinnedRan, 0, 0, &pinned, threads - 1);
+		jobs.Shutdown();
+
+		match = match &&
+			chainInOrder &&
+			ran.load() == jobCount + (jobCount / fanOut) * fanOut &&
+			pinned.IsDone() &&
+			pinnedRan.load() == pinnedJobCount;
+		printf("Job system (%u threads): loop %.2fms (%.2fx), %.0fns/job queued, %.0fns/job nested, %.0fns/job chained, %u stolen, ",
+			threads,
+			loopMs,
+			serialMs / loopMs,
+			queueMs * 1000000.0 / jobCount,
+			nestedMs * 1000000.0 / ((jobCount / fanOut) * (fanOut + 1)),
+			chainMs * 1000000.0 / chainLength,
+			stolen);
+		ReportCheck("Job system", match);
+
+		if (threads == maxThreads)
+			break;
+	}
+
+	jobs.Initialize();
+}
+
+// Stands in for a frame's CPU work
+static void BusyWait(double milliseconds)
+{
+	BenchmarkClock::time_point start = BenchmarkClock::now();
+	while (MillisecondsSince(start) < milliseconds)
+	{
+	}
+}
+
+// --------------------------------------------------------
+// Runs the same simulated update and draw costs through a
+// FramePipeline with and without its render thread. Each update
+// writes its frame number into its slot and each draw checks it
+// sees them all, in order, from the right slot.
+// --------------------------------------------------------
+void RunFramePipelineBenchmark(unsigned int frames)
+{
+	struct FrameCosts { double updateMs; double drawMs; };
+	FrameCosts costs[] = { { 4, 4 }, { 2, 6 }, { 6, 2 } };
+
+	for (const FrameCosts& cost : costs)
+	{
+		double frameTimeMs[2];
+		double latencyMs[2];
+		double waitMs = 0;
+		bool match = true;
+		for (int pipelined = 0; pipelined < 2; pipelined++)
+		{
+			FramePipeline pipeline;
+			unsigned int slots[FRAME_PIPELINE_SLOTS] = {};
+			unsigned int nextDrawn = 0;
+			pipeline.SetDrawFunction([&](unsigned int slot)
+			{
+				match = match && slots[slot] == nextDrawn;
+				nextDrawn++;
+				BusyWait(cost.drawMs);
+			});
+			if (pipelined)
+				pipeline.Start();
+
+			BenchmarkClock::time_point start = BenchmarkClock::now();
+			for (unsigned int f = 0; f < frames; f++)
+			{
+				pipeline.BeginFrame();
+				BusyWait(cost.updateMs);
+				slots[pipeline.GetUpdateSlot()] = f;
+				pipeline.EndFrame();
+			}
+			pipeline.Flush();
+			frameTimeMs[pipelined] = MillisecondsSince(start) / frames;
+			latencyMs[pipelined] = pipeline.GetAverageLatencyMs();
+			if (pipelined)
+				waitMs = pipeline.GetAverageWaitTimeMs();
+
+			pipeline.Stop();
+			match = match && nextDrawn == frames && pipeline.GetFrameCount() == frames;
+		}
+
+		printf("Frame pipeline (update %.0fms, draw %.0fms): serial %.2fms/frame, pipelined %.2fms/frame (%.2fx), latency %.2fms -> %.2fms, update waited %.2fms/frame, ",
+			cost.updateMs,
+			cost.drawMs,
+			frameTimeMs[0],
+			frameTimeMs[1],
+			frameTimeMs[0] / frameTimeMs[1],
+			latencyMs[0],
+			latencyMs[1],
+			waitMs);
+		ReportCheck("Frame pipeline", match);
+	}
+}
+
+// --------------------------------------------------------
+// Part one plays the same ten seconds of real time through a
+// FixedTimestep as a few different frame time traces, spinning an
+// object each tick, and checks they all end up in exactly the same
+// state (except where a hitch drops ticks), unlike spinning by a
+// fixed amount per frame.
+//
+// Part two checks interpolated matrices against the previous tick
+// (alpha 0), the current one (alpha 1) and a copy of the hierarchy
+// rotated halfway (alpha 0.5), then times interpolation against the
+// tick's own UpdateMatrices().
+// --------------------------------------------------------
+void RunFixedTimestepBenchmark(unsigned int objectCount)
+{
+	const double realTime = 10.005;
+	const float spinSpeed = 0.6f;
+	struct Trace { const char* name; double minFrameMs; double maxFrameMs; double hitchMs; };
+	const Trace traces[] =
+	{
+		{ "60fps", 16.667, 16.667, 0 },
+		{ "30fps", 33.333, 33.333, 0 },
+		{ "144fps", 6.944, 6.944, 0 },
+		{ "jittery", 2, 40, 0 },
+		{ "hitches", 16.667, 16.667, 250 },
+	};
+
+	float expected = 0;
+	for (const Trace& trace : traces)
+	{
+		std::mt19937 random(1234);
+		std::uniform_real_distribution<double> frameDist(trace.minFrameMs, trace.maxFrameMs);
+
+		FixedTimestep timestep;
+		TransformSystem transformSystem;
+		TransformHandle handle = transformSystem.Create();
+		unsigned int frames = 0;
+		float perFrameAngle = 0;
+		for (double time = 0; time < realTime; frames++)
+		{
+			// Every hundredth frame hitches, if this trace has them
+			double frameTime = (trace.hitchMs > 0 && frames % 100 == 99 ? trace.hitchMs : frameDist(random)) / 1000.0;
+			frameTime = std::min(frameTime, realTime - time);
+			time += frameTime;
+
+			unsigned int ticks = timestep.Advance(frameTime);
+			for (unsigned int tick = 0; tick < ticks; tick++)
+			{
+				transformSystem.BeginTick();
+				float spin = spinSpeed * (float)timestep.GetTickTime();
+				transformSystem.Rotate(handle, XMFLOAT3(spin, spin, spin));
+				transformSystem.UpdateMatrices();
+			}
+			perFrameAngle += 0.01f;
+		}
+
+		// Everything is compared to the first trace
+		float angle = transformSystem.GetPitchYawRoll(handle).x;
+		if (&trace == &traces[0])
+			expected = angle;
+		bool match = timestep.GetDroppedTicks() > 0 ? angle < expected : angle == expected;
+
+		printf("Fixed timestep (%s, %u frames): %llu ticks, %llu dropped, angle %.4f (per frame spin %.4f), ",
+			trace.name,
+			frames,
+			timestep.GetTotalTicks(),
+			timestep.GetDroppedTicks(),
+			angle,
+			perFrameAngle);
+		ReportCheck("Fixed timestep", match);
+	}
+
+	// Same hierarchies in both: chains of four under each root
+	std::mt19937 random(1234);
+	std::uniform_real_distribution<float> positionDist(-2.0f, 2.0f);
+	std::uniform_real_distribution<float> angleDist(-3.14f, 3.14f);
+	TransformSystem transformSystem;
+	TransformSystem halfway;
+	std::vector<TransformHandle> handles;
+	for (unsigned int i = 0; i < objectCount; i++)
+	{
+		XMFLOAT3 position(positionDist(random), positionDist(random), positionDist(random));
+		XMFLOAT3 rotation(angleDist(random), angleDist(random), angleDist(random));
+		TransformHandle parent = i % 4 == 0 ? INVALID_TRANSFORM_HANDLE : handles[i - 1];
+		handles.push_back(transformSystem.Create(position, rotation, XMFLOAT3(1, 1, 1), parent));
+		halfway.Create(position, rotation, XMFLOAT3(1, 1, 1), parent);
+	}
+	transformSystem.UpdateMatrices();
+	std::vector<XMFLOAT4X4> previousWorlds(objectCount);
+	for (unsigned int i = 0; i < objectCount; i++)
+		previousWorlds[i] = transformSystem.GetWorldMatrix(handles[i]);
+
+	// One tick of everything spinning
+	const XMFLOAT3 spin(0.01f, 0.02f, 0.03f);
+	BenchmarkClock::time_point start = BenchmarkClock::now();
+	transformSystem.BeginTick();
+	transformSystem.RotateAll(spin);
+	transformSystem.UpdateMatrices();
+	double tickMs = MillisecondsSince(start);
+	halfway.RotateAll(XMFLOAT3(spin.x * 0.5f, spin.y * 0.5f, spin.z * 0.5f));
+	halfway.UpdateMatrices();
+
+	float error = 0;
+	const float alphas[] = { 0, 1, 0.5f };
+	double interpolateMs = 0;
+	for (float alpha : alphas)
+	{
+		start = BenchmarkClock::now();
+		transformSystem.UpdateInterpolatedMatrices(alpha);
+		interpolateMs = MillisecondsSince(start);
+		for (unsigned int i = 0; i < objectCount; i++)
+		{
+			const XMFLOAT4X4& expectedWorld =
+				alpha == 0 ? previousWorlds[i] :
+				alpha == 1 ? transformSystem.GetWorldMatrix(handles[i]) :
+				halfway.GetWorldMatrix(handles[i]);
+			error = fmaxf(error, MatrixDifference(expectedWorld, transformSystem.GetInterpolatedWorldMatrix(handles[i])));
+		}
+	}
+
+	// Only one chain in a hundred moves
+	transformSystem.BeginTick();
+	for (unsigned int i = 0; i < objectCount; i += 400)
+		transformSystem.Rotate(handles[i], spin);
+	transformSystem.UpdateMatrices();
+	start = BenchmarkClock::now();
+	unsigned int partialInterpolated = transformSystem.UpdateInterpolatedMatrices(0.5f);
+	double partialMs = MillisecondsSince(start);
+
+	printf("Interpolation (%u objects): tick %.3fms, all moving %.3fms, 1%% moving %.3fms (%u), max error %g, ",
+		objectCount,
+		tickMs,
+		interpolateMs,
+		partialMs,
+		partialInterpolated,
+		error);
+	ReportCheck("Interpolation", error < 0.001f);
+}
+
+// --------------------------------------------------------
+// A clock for testing frame pacing. Time only moves when it's read
+// (a microsecond per read, like one pass of a spin loop), slept on or
+// worked on, and sleeps wake up late the way a real system timer
+// does: by a random amount, then on the timer's next tick.
+// --------------------------------------------------------
+class SimulatedFrameClock : public FrameClock
+{
+public:
+	SimulatedFrameClock(double timerResolution, double maxOversleep) :
+		time(1),
+		spinTime(0),
+		timerResolution(timerResolution),
+		oversleep(0, maxOversleep),
+		random(1234)
+	{
+	}
+
+	double Now()
+	{
+		time += 0.000001;
+		return time;
+	}
+
+	void Sleep(double seconds)
+	{
+		time += seconds + oversleep(random);
+		if (timerResolution > 0)
+			time = ceil(time / timerResolution) * timerResolution;
+	}
+
+	void Work(double seconds)
+	{
+		time += seconds;
+	}
+
+	double time;
+	double spinTime;
+
+private:
+	double timerResolution;
+	std::uniform_real_distribution<double> oversleep;
+	std::mt19937 random;
+};
+
+// --------------------------------------------------------
+// Runs frames of random CPU work through a frame limiter at a
+// simulated 60 and 144fps, on a 1ms system timer and a coarse
+// 15.6ms one (Windows' default), comparing FramePacer's sleep then
+// spin against sleeping the whole way (cheap but late) and spinning
+// the whole way (exact but burns the CPU). Then shows the input to
+// present latency of reading input after the limiter's wait versus
+// before it, and runs FramePacer on the real clock.
+// --------------------------------------------------------
+void RunFramePacingBenchmark(unsigned int frames)
+{
+	const struct { const char* name; double resolution; double maxOversleep; } timers[] =
+	{
+		{ "1ms timer", 0.001, 0.0005 },
+		{ "15.6ms timer", 0.015625, 0.0005 },
+	};
+	const float frameRates[] = { 60, 144 };
+	const char* limiterNames[] = { "sleep + spin", "sleep only", "spin only" };
+	const unsigned int settleFrames = 30;
+
+	for (const auto& timer : timers)
+	{
+		for (float frameRate : frameRates)
+		{
+			double interval = 1.0 / frameRate;
+			double averageFps[3];
+			double maxErrorMs[3];
+			double spinMs[3];
+			for (int limiter = 0; limiter < 3; limiter++)
+			{
+				SimulatedFrameClock clock(timer.resolution, timer.maxOversleep);
+				FramePacer pacer(&clock);
+				pacer.SetTargetFrameRate(frameRate);
+				std::uniform_real_distribution<double> workDist(0.002, 0.006);
+				std::mt19937 random(1234);
+
+				double deadline = 0;
+				double first = 0;
+				double previous = 0;
+				double maxError = 0;
+				double spinTotal = 0;
+				for (unsigned int f = 0; f <= settleFrames + frames; f++)
+				{
+					if (limiter == 0)
+					{
+						pacer.WaitForNextFrame();
+					}
+					else
+					{
+						// Same schedule as FramePacer
+						double now = clock.Now();
+						if (now - deadline > interval)
+							deadline = now;
+						if (limiter == 1 && deadline > now)
+							clock.Sleep(deadline - now);
+						double spinStart = clock.Now();
+						while (clock.Now() < deadline)
+						{
+						}
+						spinTotal += clock.time - spinStart;
+						deadline += interval;
+					}
+
+					// Timing starts once FramePacer has had a few frames to learn the timer
+					double start = clock.time;
+					if (f == settleFrames)
+						first = start;
+					else if (f > settleFrames)
+						maxError = std::max(maxError, fabs(start - previous - interval));
+					previous = start;
+					clock.Work(workDist(random));
+				}
+
+				averageFps[limiter] = frames / (previous - first);
+				maxErrorMs[limiter] = maxError * 1000.0;
+				spinMs[limiter] = limiter == 0 ? pacer.GetAverageSpinMs() : spinTotal * 1000.0 / (settleFrames + frames + 1);
+			}
+
+			bool match = fabs(averageFps[0] - frameRate) < frameRate * 0.001 && maxErrorMs[0] <= maxErrorMs[1];
+			printf("Frame pacing (%s, %.0ffps): ", timer.name, frameRate);
+			for (int limiter = 0; limiter < 3; limiter++)
+				printf("%s %.2ffps, worst frame off by %.3fms, spinning %.2fms/frame; ", limiterNames[limiter], averageFps[limiter], maxErrorMs[limiter], spinMs[limiter]);
+			ReportCheck("Frame pacing", match);
+		}
+	}
+
+	// Reading input before the limiter's wait means it sits through the wait too
+	double latencyMs[2];
+	for (int readAfterWait = 0; readAfterWait < 2; readAfterWait++)
+	{
+		SimulatedFrameClock clock(0.001, 0.0005);
+		FramePacer pacer(&clock);
+		pacer.SetTargetFrameRate(60);
+		for (unsigned int f = 0; f < frames; f++)
+		{
+			double inputTime = pacer.Now();
+			pacer.WaitForNextFrame();
+			if (readAfterWait)
+				inputTime = pacer.Now();
+			clock.Work(0.004);
+			pacer.RecordPresent(inputTime);
+		}
+		latencyMs[readAfterWait] = pacer.GetAverageLatencyMs();
+	}
+	printf("Frame pacing latency (60fps, 4ms frames): input read before the wait %.2fms, after it %.2fms (%.1fx)\n",
+		latencyMs[0],
+		latencyMs[1],
+		latencyMs[0] / latencyMs[1]);
+
+	// And for real
+	FramePacer pacer;
+	pacer.SetTargetFrameRate(120);
+	pacer.WaitForNextFrame();
+	BenchmarkClock::time_point start = BenchmarkClock::now();
+	BenchmarkClock::time_point previous = start;
+	double maxErrorMs = 0;
+	const unsigned int realFrames = 120;
+	for (unsigned int f = 0; f < realFrames; f++)
+	{
+		BusyWait(2);
+		pacer.WaitForNextFrame();
+		maxErrorMs = std::max(maxErrorMs, fabs(MillisecondsSince(previous) - 1000.0 / 120));
+		previous = BenchmarkClock::now();
+	}
+	printf("Frame pacing (system clock, 120fps, 2ms frames): %.2ffps, worst frame off by %.3fms, sleeping %.2fms/frame, spinning %.2fms/frame\n",
+		realFrames / (MillisecondsSince(start) / 1000.0),
+		maxErrorMs,
+		pacer.GetAverageSleepMs(),
+		pacer.GetAverageSpinMs());
+}
+
+// --------------------------------------------------------
+// Feeds DynamicResolution synthetic frame times from a frame whose
+// cost is a fixed part plus a part that goes with pixel count (the
+// scale squared), with some noise on top. Checks it stays at full
+// resolution when there's room, settles inside the budget under load
+// (the exact scale that fits is known for these), holds steady near
+// the budget where an unsmoothed controller with no hysteresis keeps
+// changing, gets through a load spike and back, and stops at the
+// minimum scale when even that can't fit.
+// --------------------------------------------------------
+void RunDynamicResolutionBenchmark(unsigned int frames)
+{
+	const float budget = 16.667f;
+	const float minScale = 0.5f;
+	struct Trace { const char* name; float fixedMs; float pixelMs; float spikePixelMs; float noiseMs; };
+	const Trace traces[] =
+	{
+		{ "light load", 4, 8, 8, 0.5f },
+		{ "heavy load", 4, 24, 24, 0.5f },
+		{ "near budget", 4, 12, 12, 3 },
+		{ "load spike", 4, 8, 30, 0.5f },
+		{ "impossible load", 20, 20, 20, 0.5f },
+	};
+
+	// Settling is checked over the last quarter of each trace, and the
+	// spike (if there is one) is the second quarter, so there's time to
+	// settle both during and after it
+	unsigned int settledFrames = frames / 4;
+	unsigned int spikeStart = frames / 4;
+	unsigned int spikeEnd = frames / 2;
+	for (const Trace& trace : traces)
+	{
+		std::mt19937 random(1234);
+		std::uniform_real_distribution<float> noise(-trace.noiseMs, trace.noiseMs);
+		bool spike = trace.spikePixelMs != trace.pixelMs;
+
+		// The largest scale that fits in the budget without the noise
+		auto FitScale = [&](float pixelMs)
+		{
+			float fit = budget > trace.fixedMs ? sqrtf((budget - trace.fixedMs) / pixelMs) : 0;
+			return std::min(std::max(fit, minScale), 1.0f);
+		};
+		float fitScale = FitScale(trace.pixelMs);
+		float spikeFitScale = FitScale(trace.spikePixelMs);
+
+		DynamicResolution controller(budget, minScale, 1.0f);
+		float naiveScale = 1.0f;
+		unsigned int naiveChanges = 0;
+		unsigned int settledOverBudget = 0;
+		unsigned int recoveryFrames = 0;
+		float settledScaleMin = 1.0f;
+		float settledScaleMax = 0.0f;
+		float spikeScale = 1.0f;
+		BenchmarkClock::time_point start = BenchmarkClock::now();
+		for (unsigned int f = 0; f < frames; f++)
+		{
+			bool inSpike = spike && f >= spikeStart && f < spikeEnd;
+			float pixelMs = inSpike ? trace.spikePixelMs : trace.pixelMs;
+			float frameNoise = noise(random);
+			float scale = controller.GetScale();
+			float frameTime = trace.fixedMs + pixelMs * scale * scale + frameNoise;
+
+			// Frames over budget while the spike is being caught up with
+			if (inSpike && frameTime > budget && recoveryFrames == f - spikeStart)
+				recoveryFrames++;
+			if (inSpike && f >= spikeEnd - settledFrames / 2)
+				spikeScale = scale;
+
+			if (f >= frames - settledFrames)
+			{
+				if (trace.fixedMs + pixelMs * scale * scale > budget)
+					settledOverBudget++;
+				settledScaleMin = std::min(settledScaleMin, scale);
+				settledScaleMax = std::max(settledScaleMax, scale);
+			}
+			controller.Update(frameTime);
+
+			// The same frame with a controller that jumps straight to
+			// whatever fits the last frame
+			float naiveTime = trace.fixedMs + pixelMs * naiveScale * naiveScale + frameNoise;
+			float newNaiveScale = std::min(std::max(naiveScale * sqrtf(DYNAMIC_RESOLUTION_TARGET * budget / naiveTime), minScale), 1.0f);
+			if (fabs(newNaiveScale - naiveScale) > 0.001f)
+				naiveChanges++;
+			naiveScale = newNaiveScale;
+		}
+		double updateMs = MillisecondsSince(start);
+
+		// Settled means not changing, and inside the budget (noise aside)
+		// but not so far under it that it should have scaled back up,
+		// unless the load has pushed it to one end of the range
+		float settledTime = trace.fixedMs + trace.pixelMs * settledScaleMax * settledScaleMax;
+		bool match =
+			settledScaleMax - settledScaleMin < 0.001f &&
+			(settledTime <= budget || settledScaleMax <= minScale) &&
+			(settledTime >= budget * DYNAMIC_RESOLUTION_HEADROOM - trace.noiseMs || settledScaleMax >= 1.0f);
+		if (spike)
+			match = match && spikeScale <= spikeFitScale + 0.001f && recoveryFrames < 20;
+
+		printf("Dynamic resolution (%s): settled at %.3f scale (fits up to %.3f), %u changes (no hysteresis %u), %u settled frames over budget",
+			trace.name,
+			settledScaleMax,
+			fitScale,
+			controller.GetChangeCount(),
+			naiveChanges,
+			settledOverBudget);
+		if (spike)
+			printf(", spike settled at %.3f (fits up to %.3f) after %u frames over budget", spikeScale, spikeFitScale, recoveryFrames);
+		printf(", %.1fns/frame, ",
+			updateMs * 1000000.0 / frames);
+		ReportCheck("Dynamic resolution", match);
+	}
+}
+
+// --------------------------------------------------------
+// Records a synthetic frame time trace (60fps with some noise, a
+// hitch every 97th frame and random phase splits) into FrameStats,
+// timing the recording, then checks its summaries of the whole
+// frame and each phase against sorting the same frames in full.
+// Then records the trace again through a FramePipeline with a render
+// thread (which finishes each frame) while the main thread summarizes
+// as it goes, and checks the exports hold every frame kept.
+// --------------------------------------------------------
+void RunFrameStatsBenchmark(unsigned int frames)
+{
+	// The trace, and where each frame's time went
+	std::mt19937 random(1234);
+	std::uniform_real_distribution<float> noise(-1.0f, 1.0f);
+	std::uniform_real_distribution<float> hitch(40.0f, 60.0f);
+	std::uniform_real_distribution<float> split(0.0f, 1.0f);
+	std::vector<float> frameMs(frames);
+	std::vector<float> phaseMs(frames * FRAME_PHASE_COUNT);
+	for (unsigned int f = 0; f < frames; f++)
+	{
+		frameMs[f] = f % 97 == 96 ? hitch(random) : 16.667f + noise(random);
+		for (unsigned int p = 0; p < FRAME_PHASE_COUNT; p++)
+			phaseMs[f * FRAME_PHASE_COUNT + p] = frameMs[f] * split(random) / FRAME_PHASE_COUNT;
+	}
+
+	// Present times that are exactly the trace apart. The first frame
+	// only starts the clock, so it has no time of its own.
+	std::vector<double> presentTimes(frames);
+	double time = 1.0;
+	for (unsigned int f = 0; f < frames; f++)
+	{
+		time += frameMs[f] / 1000.0;
+		presentTimes[f] = time - frameMs[0] / 1000.0;
+	}
+
+	FrameStats stats;
+	BenchmarkClock::time_point start = BenchmarkClock::now();
+	for (unsigned int f = 0; f < frames; f++)
+	{
+		stats.BeginFrame(f);
+		for (unsigned int p = 0; p < FRAME_PHASE_COUNT; p++)
+			stats.AddPhaseTime(f, p, phaseMs[f * FRAME_PHASE_COUNT + p]);
+		stats.EndFrame(f, presentTimes[f]);
+	}
+	double recordMs = MillisecondsSince(start);
+
+	// Brute force: copy the frames kept, sort them all and pick by rank
+	unsigned int count = stats.GetFrameCount();
+	bool match = count == std::min(frames - 1, (unsigned int)(FRAME_STATS_CAPACITY - FRAME_STATS_WRITE_AHEAD));
+	double summarizeMs = 0;
+	std::vector<float> sorted(count);
+	for (unsigned int column = 0; column <= FRAME_PHASE_COUNT; column++)
+	{
+		for (unsigned int i = 0; i < count; i++)
+		{
+			unsigned int f = frames - count + i;
+			sorted[i] = column < FRAME_PHASE_COUNT ? phaseMs[f * FRAME_PHASE_COUNT + column] : frameMs[f];
+		}
+
+		start = BenchmarkClock::now();
+		FrameTimeSummary summary = column < FRAME_PHASE_COUNT ? stats.SummarizePhase(column) : stats.Summarize();
+		summarizeMs += MillisecondsSince(start);
+
+		// The recorded frame times went through a subtraction, so they can be off by a little
+		float tolerance = column < FRAME_PHASE_COUNT ? 0 : 0.001f;
+		std::sort(sorted.begin(), sorted.end());
+		float p50 = sorted[(count + 1) / 2 - 1];
+		unsigned int hitches = (unsigned int)std::count_if(sorted.begin(), sorted.end(), [=](float value) { return value > p50 * FRAME_STATS_HITCH_FACTOR; });
+		match = match &&
+			summary.frameCount == count &&
+			fabs(summary.p50Ms - p50) <= tolerance &&
+			fabs(summary.p95Ms - sorted[(unsigned int)ceil(0.95f * count) - 1]) <= tolerance &&
+			fabs(summary.p99Ms - sorted[(unsigned int)ceil(0.99f * count) - 1]) <= tolerance &&
+			fabs(summary.maxMs - sorted[count - 1]) <= tolerance &&
+			(column < FRAME_PHASE_COUNT || summary.hitchCount == hitches);
+
+		if (column == FRAME_PHASE_COUNT)
+		{
+			printf("Frame stats (%u frames, %u kept): recording %.1fns/frame, all summaries %.3fms, frame p50/p95/p99/max %.2f/%.2f/%.2f/%.2fms with %u hitches (expected %u), ",
+				frames,
+				count,
+				recordMs * 1000000.0 / frames,
+				summarizeMs,
+				summary.p50Ms,
+				summary.p95Ms,
+				summary.p99Ms,
+				summary.maxMs,
+				summary.hitchCount,
+				hitches);
+			ReportCheck("Frame stats", match);
+		}
+	}
+
+	// The same again with the frame's draw phases and present on a render thread
+	FrameStats threadedStats;
+	FramePipeline pipeline;
+	pipeline.SetDrawFunction([&](unsigned int)
+	{
+		unsigned int f = pipeline.GetDrawFrame();
+		for (unsigned int p = FRAME_PHASE_DRAW; p < FRAME_PHASE_COUNT; p++)
+			threadedStats.AddPhaseTime(f, p, phaseMs[f * FRAME_PHASE_COUNT + p]);
+		threadedStats.EndFrame(f, presentTimes[f]);
+	});
+	pipeline.Start();
+	for (unsigned int f = 0; f < frames; f++)
+	{
+		pipeline.BeginFrame();
+		threadedStats.BeginFrame(f);
+		threadedStats.AddPhaseTime(f, FRAME_PHASE_INPUT, phaseMs[f * FRAME_PHASE_COUNT + FRAME_PHASE_INPUT]);
+		threadedStats.AddPhaseTime(f, FRAME_PHASE_UPDATE, phaseMs[f * FRAME_PHASE_COUNT + FRAME_PHASE_UPDATE]);
+		pipeline.EndFrame();
+
+		// Summaries while frames are still being finished only ever see finished ones
+		if (f % 64 == 0)
+		{
+			FrameTimeSummary summary = threadedStats.SummarizePhase(FRAME_PHASE_PRESENT);
+			match = match && (summary.frameCount == 0 || summary.p50Ms > 0);
+		}
+	}
+	pipeline.Stop();
+
+	FrameTimeSummary threaded = threadedStats.Summarize();
+	FrameTimeSummary serial = stats.Summarize();
+	match = match && memcmp(&threaded, &serial, sizeof(FrameTimeSummary)) == 0;
+
+	// One line per frame in the CSV (after the header), and one frame per line in the JSON's list
+	unsigned int csvLines = 0;
+	unsigned int jsonFrames = 0;
+	bool exported = threadedStats.ExportCSV("FrameStatsBenchmark.csv") && threadedStats.ExportJSON("FrameStatsBenchmark.json");
+	std::string line;
+	std::ifstream csv("FrameStatsBenchmark.csv");
+	while (std::getline(csv, line))
+		csvLines++;
+	std::ifstream json("FrameStatsBenchmark.json");
+	while (std::getline(json, line))
+		jsonFrames += line.find("{ \"frame\": ") != std::string::npos ? 1 : 0;
+	csv.close();
+	json.close();
+	std::remove("FrameStatsBenchmark.csv");
+	std::remove("FrameStatsBenchmark.json");
+	match = match && exported && csvLines == count + 1 && jsonFrames == count;
+
+	printf("Frame stats (render thread): frame p50/p95/p99/max %.2f/%.2f/%.2f/%.2fms, exported %u CSV lines and %u JSON frames, ",
+		threaded.p50Ms,
+		threaded.p95Ms,
+		threaded.p99Ms,
+		threaded.maxMs,
+		csvLines,
+		jsonFrames);
+	ReportCheck("Frame stats (render thread)", match);
+}
+
+// --------------------------------------------------------
+// Times a zone outside a capture (just the flag check) and inside
+// one (two clock reads and a store), as groups of an outer zone
+// around three inner ones. Then checks what was captured: every
+// inner zone inside its outer one, zones past a thread's buffer
+// counted as dropped rather than written, the same groups recorded
+// from every job system thread at once, GPU ranges from a stand-in
+// clock landing where the calibration puts them, and one trace
+// event exported per zone.
+// --------------------------------------------------------
+void RunProfilerBenchmark(unsigned int groups)
+{
+	Profiler& profiler = Profiler::GetInstance();
+	if (profiler.IsCapturing())
+	{
+		printf("Profiler: skipped, since it would replace the capture that's running\n");
+		return;
+	}
+
+	static const char* outerName = "Benchmark outer";
+	static const char* innerName = "Benchmark inner";
+	groups = std::min(groups, (unsigned int)PROFILER_EVENTS_PER_THREAD / 4);
+	auto RecordGroups = [](unsigned int count)
+	{
+		for (unsigned int g = 0; g < count; g++)
+		{
+			PROFILE_ZONE(outerName);
+			for (unsigned int i = 0; i < 3; i++)
+			{
+				PROFILE_ZONE(innerName);
+			}
+		}
+	};
+
+	// Most of a recorded zone is its two clock reads, which cost whatever the OS makes them cost
+	BenchmarkClock::time_point start = BenchmarkClock::now();
+	for (unsigned int z = 0; z < groups * 4; z++)
+		Profiler::Now();
+	double clockMs = MillisecondsSince(start);
+
+	start = BenchmarkClock::now();
+	RecordGroups(groups);
+	double offMs = MillisecondsSince(start);
+
+	profiler.StartCapture();
+	start = BenchmarkClock::now();
+	RecordGroups(groups);
+	double onMs = MillisecondsSince(start);
+
+	// Whatever this thread's track is, it has only the groups in it
+	unsigned int mainTrack = 0;
+	for (unsigned int t = 0; t < profiler.GetTrackCount(); t++)
+	{
+		if (profiler.GetEventCount(t) > 0)
+			mainTrack = t;
+	}
+
+	// Groups end inner zones first, then the outer one around them
+	auto CheckNesting = [&](unsigned int track, unsigned int& zoneCount)
+	{
+		bool nested = true;
+		unsigned int eventCount = profiler.GetEventCount(track);
+		std::vector<ProfileEvent> inner;
+		for (unsigned int e = 0; e < eventCount; e++)
+		{
+			ProfileEvent event = profiler.GetEvent(track, e);
+			nested = nested && event.start <= event.end;
+			if (event.name == innerName)
+			{
+				inner.push_back(event);
+				zoneCount++;
+			}
+			else if (event.name == outerName)
+			{
+				for (const ProfileEvent& child : inner)
+					nested = nested && child.start >= event.start && child.end <= event.end;
+				nested = nested && inner.size() == 3;
+				inner.clear();
+				zoneCount++;
+			}
+		}
+		return nested && inner.empty();
+	};
+	unsigned int zoneCount = 0;
+	bool match = CheckNesting(mainTrack, zoneCount) && zoneCount == groups * 4 && profiler.GetDroppedCount(mainTrack) == 0;
+
+	// Past the end of the buffer, zones are only counted
+	unsigned int overflow = 100;
+	for (unsigned int z = groups * 4; z < PROFILER_EVENTS_PER_THREAD + overflow; z++)
+	{
+		PROFILE_ZONE(innerName);
+	}
+	match = match &&
+		profiler.GetEventCount(mainTrack) == PROFILER_EVENTS_PER_THREAD &&
+		profiler.GetDroppedCount(mainTrack) == overflow;
+
+	printf("Profiler (%u zones): %.1fns/zone outside a capture, %.1fns/zone recording (%.1fns of it reading the clock), %u zones dropped past %u per thread, ",
+		groups * 4,
+		offMs * 1000000.0 / (groups * 4),
+		onMs * 1000000.0 / (groups * 4),
+		clockMs * 2000000.0 / (groups * 4),
+		profiler.GetDroppedCount(mainTrack),
+		PROFILER_EVENTS_PER_THREAD);
+	ReportCheck("Profiler", match);
+
+	// Every thread at once, in a fresh capture
+	profiler.StartCapture();
+	JobSystem::GetInstance().ParallelFor(0, groups, 64, [&](unsigned int first, unsigned int last)
+	{
+		RecordGroups(last - first);
+	});
+
+	// A stand-in GPU: a microsecond clock that read 5000 when the profiler's read cpuTime
+	unsigned long long cpuTime = Profiler::Now() + 10000000;
+	profiler.SetGpuClock(1000000.0, 5000, cpuTime);
+	profiler.AddGpuRange("Benchmark GPU early", 4000, 4500);
+	profiler.AddGpuRange("Benchmark GPU late", 5000, 7500);
+
+	zoneCount = 0;
+	unsigned int tracksUsed = 0;
+	unsigned int eventCount = 0;
+	bool gpuMatch = false;
+	match = true;
+	for (unsigned int t = 0; t < profiler.GetTrackCount(); t++)
+	{
+		unsigned int trackZones = 0;
+		match = CheckNesting(t, trackZones) && match;
+		zoneCount += trackZones;
+		tracksUsed += trackZones > 0 ? 1 : 0;
+		eventCount += profiler.GetEventCount(t);
+
+		if (strcmp(profiler.GetTrackName(t), "GPU") == 0 && profiler.GetEventCount(t) == 2)
+		{
+			ProfileEvent early = profiler.GetEvent(t, 0);
+			ProfileEvent late = profiler.GetEvent(t, 1);
+			gpuMatch =
+				early.start == cpuTime - 1000000 && early.end == cpuTime - 500000 &&
+				late.start == cpuTime && late.end == cpuTime + 2500000;
+		}
+	}
+	match = match && gpuMatch && zoneCount == groups * 4;
+
+	// One complete event per zone, and each track named
+	bool exported = profiler.ExportChromeTrace("ProfilerBenchmark.json");
+	profiler.StopCapture();
+	unsigned int traceEvents = 0;
+	unsigned int traceTracks = 0;
+	std::string line;
+	std::ifstream trace("ProfilerBenchmark.json");
+	while (std::getline(trace, line))
+	{
+		traceEvents += line.find("\"ph\":\"X\"") != std::string::npos ? 1 : 0;
+		traceTracks += line.find("\"thread_name\"") != std::string::npos ? 1 : 0;
+	}
+	trace.close();
+	std::remove("ProfilerBenchmark.json");
+	match = match && exported && traceEvents == eventCount && traceTracks == profiler.GetTrackCount();
+
+	printf("Profiler (job system): %u zones on %u threads, GPU stand-in ranges %s, exported %u trace events on %u tracks, ",
+		zoneCount,
+		tracksUsed,
+		gpuMatch ? "placed" : "MISPLACED",
+		traceEvents,
+		traceTracks);
+	ReportCheck("Profiler (job system)", match);
+}
+
+// --------------------------------------------------------
+// Feeds RenderCounters a simulated renderer: each frame draws a
+// random number of objects (with the odd frame of far too many),
+// taking a CBV each from a ring laid out like DX12Helper's, and
+// checks every frame's counts, the totals, and that exactly the
+// frames that overran the ring were counted as over budget. Also
+// times Add() and EndFrame(), since they run on every draw.
+// --------------------------------------------------------
+void RunRenderCountersBenchmark(unsigned int frames)
+{
+	const unsigned int ringSlots = 1000;
+	const unsigned int slotBytes = 256;
+	RenderCounters counters;
+	counters.SetBudgetWarnings(false);
+	counters.SetBudget(RENDER_COUNTER_CBVS_CREATED, ringSlots);
+	counters.SetBudget(RENDER_COUNTER_CB_RING_WRAPS, 1);
+
+	std::mt19937 random(1234);
+	std::uniform_int_distribution<unsigned int> drawCount(50, 150);
+	std::uniform_int_distribution<unsigned int> overloadCount(1000, 3000);
+	std::uniform_int_distribution<unsigned int> materialRun(1, 10);
+
+	// The ring starts over when the next slot would reach its end, so
+	// the last slot is never used and it holds ringSlots - 1 in a row
+	unsigned int ringPosition = 0;
+	unsigned long long expectedTotals[RENDER_COUNTER_COUNT] = {};
+	unsigned int expectedCBVFrames = 0;
+	unsigned int expectedWrapFrames = 0;
+	unsigned long long adds = 0;
+	double addMs = 0;
+	double endFrameMs = 0;
+	bool match = true;
+	for (unsigned int f = 0; f < frames; f++)
+	{
+		unsigned int draws = f % 100 == 99 ? overloadCount(random) : drawCount(random);
+
+		BenchmarkClock::time_point start = BenchmarkClock::now();
+		unsigned int wraps = 0;
+		unsigned int psoChanges = 0;
+		unsigned int nextChange = 0;
+		for (unsigned int d = 0; d <= draws; d++)
+		{
+			// One CBV for the frame, then one per draw
+			if ((ringPosition + 1) * slotBytes >= ringSlots * slotBytes)
+			{
+				ringPosition = 0;
+				wraps++;
+				counters.Add(RENDER_COUNTER_CB_RING_WRAPS);
+			}
+			ringPosition++;
+			counters.Add(RENDER_COUNTER_CB_BYTES_COPIED, slotBytes);
+			counters.Add(RENDER_COUNTER_CBVS_CREATED);
+			counters.Add(RENDER_COUNTER_DESCRIPTORS_CONSUMED);
+			counters.Add(RENDER_COUNTER_DESCRIPTOR_TABLE_BINDS);
+			if (d == 0)
+				continue;
+
+			if (d == nextChange + 1)
+			{
+				counters.Add(RENDER_COUNTER_PSO_CHANGES);
+				psoChanges++;
+				nextChange += materialRun(random);
+			}
+			counters.Add(RENDER_COUNTER_DRAW_CALLS);
+		}
+		addMs += MillisecondsSince(start);
+		adds += draws * 5 + 4 + psoChanges + wraps;
+
+		start = BenchmarkClock::now();
+		counters.EndFrame();
+		endFrameMs += MillisecondsSince(start);
+
+		// The whole frame's worth, counted separately
+		unsigned long long expected[RENDER_COUNTER_COUNT] = {};
+		expected[RENDER_COUNTER_DRAW_CALLS] = draws;
+		expected[RENDER_COUNTER_PSO_CHANGES] = psoChanges;
+		expected[RENDER_COUNTER_DESCRIPTOR_TABLE_BINDS] = draws + 1;
+		expected[RENDER_COUNTER_CBVS_CREATED] = draws + 1;
+		expected[RENDER_COUNTER_CB_BYTES_COPIED] = (draws + 1) * (unsigned long long)slotBytes;
+		expected[RENDER_COUNTER_CB_RING_WRAPS] = wraps;
+		expected[RENDER_COUNTER_DESCRIPTORS_CONSUMED] = draws + 1;
+		for (unsigned int c = 0; c < RENDER_COUNTER_COUNT; c++)
+		{
+			match = match && counters.GetLastFrame(c) == expected[c] && counters.GetCurrent(c) == 0;
+			expectedTotals[c] += expected[c];
+		}
+		expectedCBVFrames += draws + 1 > ringSlots ? 1 : 0;
+		expectedWrapFrames += wraps > 1 ? 1 : 0;
+	}
+
+	for (unsigned int c = 0; c < RENDER_COUNTER_COUNT; c++)
+		match = match && counters.GetTotal(c) == expectedTotals[c];
+	match = match &&
+		counters.GetFrameCount() == frames &&
+		counters.GetOverBudgetFrames(RENDER_COUNTER_CBVS_CREATED) == expectedCBVFrames &&
+		counters.GetOverBudgetFrames(RENDER_COUNTER_CB_RING_WRAPS) == expectedWrapFrames &&
+		counters.GetOverBudgetFrames(RENDER_COUNTER_DRAW_CALLS) == 0;
+
+	printf("Render counters (%u frames, %llu draws): %.2fns/add, EndFrame %.1fns, %llu frames over the CBV budget (expected %u), %llu with the CB ring wrapping more than once (expected %u), ",
+		frames,
+		counters.GetTotal(RENDER_COUNTER_DRAW_CALLS),
+		addMs * 1000000.0 / adds,
+		endFrameMs * 1000000.0 / frames,
+		counters.GetOverBudgetFrames(RENDER_COUNTER_CBVS_CREATED),
+		expectedCBVFrames,
+		counters.GetOverBudgetFrames(RENDER_COUNTER_CB_RING_WRAPS),
+		expectedWrapFrames);
+	ReportCheck("Render counters", match);
+}
+
+// --------------------------------------------------------
+// Tests the memory tracker: what replacing operator new costs
+// next to calling malloc() directly, allocations tagged on one
+// set of job system threads and freed on another coming off the
+// right totals, tag scopes nesting, and GPU stand-in allocations
+// adding up by heap and by use
+// --------------------------------------------------------
+void RunMemoryTrackingBenchmark(unsigned int allocations)
+{
+	std::mt19937 random(1234);
+	std::uniform_int_distribution<unsigned int> sizeDist(8, 512);
+	std::vector<unsigned int> sizes(allocations);
+	unsigned long long totalBytes = 0;
+	for (unsigned int i = 0; i < allocations; i++)
+	{
+		sizes[i] = sizeDist(random);
+		totalBytes += sizes[i];
+	}
+	std::vector<void*> blocks(allocations);
+
+	// Every block is kept until they're all made, so neither loop can be optimized away
+	BenchmarkClock::time_point start = BenchmarkClock::now();
+	for (unsigned int i = 0; i < allocations; i++)
+		blocks[i] = malloc(sizes[i]);
+	for (unsigned int i = 0; i < allocations; i++)
+		free(blocks[i]);
+	double mallocMs = MillisecondsSince(start);
+
+	start = BenchmarkClock::now();
+	for (unsigned int i = 0; i < allocations; i++)
+		blocks[i] = ::operator new(sizes[i]);
+	for (unsigned int i = 0; i < allocations; i++)
+		::operator delete(blocks[i]);
+	double trackedMs = MillisecondsSince(start);
+
+	// Tagged on whichever threads pick up the batches...
+	MemoryStats before = MemoryTracker::GetCPUStats(MEMORY_TAG_MESH);
+	JobSystem& jobSystem = JobSystem::GetInstance();
+	jobSystem.ParallelFor(0, allocations, 256, [&](unsigned int first, unsigned int last)
+	{
+		MEMORY_TAG(MEMORY_TAG_MESH);
+		for (unsigned int i = first; i < last; i++)
+			blocks[i] = ::operator new(sizes[i]);
+	});
+	MemoryStats allocated = MemoryTracker::GetCPUStats(MEMORY_TAG_MESH);
+
+	// ...and freed, untagged and in reverse, on whichever pick them up this time
+	jobSystem.ParallelFor(0, allocations, 256, [&](unsigned int first, unsigned int last)
+	{
+		for (unsigned int i = last; i > first; i--)
+			::operator delete(blocks[allocations - i]);
+	});
+	MemoryStats freed = MemoryTracker::GetCPUStats(MEMORY_TAG_MESH);
+
+	bool match =
+		allocated.liveBytes - before.liveBytes == totalBytes &&
+		allocated.liveCount - before.liveCount == allocations &&
+		allocated.totalCount - before.totalCount == allocations &&
+		allocated.peakBytes >= before.liveBytes + totalBytes &&
+		freed.liveBytes == before.liveBytes &&
+		freed.liveCount == before.liveCount &&
+		freed.totalCount == allocated.totalCount &&
+		freed.peakBytes == allocated.peakBytes;
+
+	// Scopes put back whatever tag they replaced
+	unsigned int outerTag = MemoryTracker::GetThreadTag();
+	{
+		MEMORY_TAG(MEMORY_TAG_SCENE);
+		{
+			MEMORY_TAG(MEMORY_TAG_FRAME);
+			match = match && MemoryTracker::GetThreadTag() == MEMORY_TAG_FRAME;
+		}
+		match = match && MemoryTracker::GetThreadTag() == MEMORY_TAG_SCENE;
+	}
+	match = match && MemoryTracker::GetThreadTag() == outerTag;
+
+	// GPU stand-ins: each lands in one heap and one category, and the two views agree
+	MemoryStats heapsBefore[GPU_HEAP_COUNT];
+	MemoryStats categoriesBefore[GPU_MEMORY_COUNT];
+	for (unsigned int h = 0; h < GPU_HEAP_COUNT; h++)
+		heapsBefore[h] = MemoryTracker::GetGpuHeapStats(h);
+	for (unsigned int c = 0; c < GPU_MEMORY_COUNT; c++)
+		categoriesBefore[c] = MemoryTracker::GetGpuCategoryStats(c);
+
+	struct GpuAllocation { unsigned int heap; unsigned int category; unsigned long long bytes; };
+	std::vector<GpuAllocation> gpuAllocations(1024);
+	unsigned long long heapBytes[GPU_HEAP_COUNT] = {};
+	unsigned long long categoryBytes[GPU_MEMORY_COUNT] = {};
+	std::uniform_int_distribution<unsigned int> heapDist(0, GPU_HEAP_COUNT - 1);
+	std::uniform_int_distribution<unsigned int> categoryDist(0, GPU_MEMORY_COUNT - 1);
+	std::uniform_int_distribution<unsigned int> pagesDist(1, 16);
+	for (GpuAllocation& allocation : gpuAllocations)
+	{
+		allocation.heap = heapDist(random);
+		allocation.category = categoryDist(random);
+		allocation.bytes = pagesDist(random) * 65536ULL;
+		heapBytes[allocation.heap] += allocation.bytes;
+		categoryBytes[allocation.category] += allocation.bytes;
+		MemoryTracker::AddGpuAllocation(allocation.heap, allocation.category, allocation.bytes);
+	}
+
+	unsigned long long gpuBytes = 0;
+	unsigned long long heapTotal = 0;
+	unsigned long long categoryTotal = 0;
+	for (unsigned int h = 0; h < GPU_HEAP_COUNT; h++)
+	{
+		unsigned long long added = MemoryTracker::GetGpuHeapStats(h).liveBytes - heapsBefore[h].liveBytes;
+		match = match && added == heapBytes[h];
+		heapTotal += added;
+		gpuBytes += heapBytes[h];
+	}
+	for (unsigned int c = 0; c < GPU_MEMORY_COUNT; c++)
+	{
+		unsigned long long added = MemoryTracker::GetGpuCategoryStats(c).liveBytes - categoriesBefore[c].liveBytes;
+		match = match && added == categoryBytes[c];
+		categoryTotal += added;
+	}
+	match = match && heapTotal == gpuBytes && categoryTotal == gpuBytes;
+
+	for (const GpuAllocation& allocation : gpuAllocations)
+		MemoryTracker::RemoveGpuAllocation(allocation.heap, allocation.category, allocation.bytes);
+	for (unsigned int h = 0; h < GPU_HEAP_COUNT; h++)
+	{
+		MemoryStats after = MemoryTracker::GetGpuHeapStats(h);
+		match = match && after.liveBytes == heapsBefore[h].liveBytes && after.liveCount == heapsBefore[h].liveCount;
+	}
+	for (unsigned int c = 0; c < GPU_MEMORY_COUNT; c++)
+	{
+		MemoryStats after = MemoryTracker::GetGpuCategoryStats(c);
+		match = match && after.liveBytes == categoriesBefore[c].liveBytes && after.liveCount == categoriesBefore[c].liveCount;
+	}
+
+	printf("Memory tracking (%u allocations, %.1fMB): malloc/free %.1fns, tracked new/delete %.1fns (+%.1fns), %llu tagged across threads and %llu left after freeing, %.1fMB of GPU stand-ins by heap and by use, ",
+		allocations,
+		totalBytes / (1024.0 * 1024.0),
+		mallocMs * 1000000.0 / allocations,
+		trackedMs * 1000000.0 / allocations,
+		(trackedMs - mallocMs) * 1000000.0 / allocations,
+		allocated.liveCount - before.liveCount,
+		freed.liveCount - before.liveCount,
+		gpuBytes / (1024.0 * 1024.0));
+	ReportCheck("Memory tracking", match);
+}
+
+// --------------------------------------------------------
+// Part one times LinearArena against new/delete for the kind of
+// small arrays frames use, and checks alignment, Rewind(), scratch
+// scopes nesting and the heap fallback past the arena's capacity.
+//
+// Part two runs a steady-state frame through a FramePipeline with
+// its render thread: spinning entities, their matrices and bounds,
+// a snapshot of the bounds in the slot's frame arena, and frustum
+// culling into the draw side's part of it. Once warmed up, both
+// threads run their frames under ZERO_ALLOCATIONS, and nothing
+// (job system threads included) should allocate at all. Then
+// allocations are made on purpose, one of them in a job on a
+// worker, to check they get caught.
+// --------------------------------------------------------
+void RunFrameArenaBenchmark(unsigned int entityCount, unsigned int frames)
+{
+	// A frame's worth of small arrays, made and freed over and over
+	const unsigned int arrays = 1000;
+	const unsigned int rounds = 100;
+	std::mt19937 random(1234);
+	std::uniform_int_distribution<unsigned int> countDist(1, 64);
+	std::vector<unsigned int> counts(arrays);
+	size_t totalBytes = 0;
+	for (unsigned int& count : counts)
+	{
+		count = countDist(random);
+		totalBytes += count * sizeof(XMFLOAT4);
+	}
+	std::vector<XMFLOAT4*> blocks(arrays);
+
+	BenchmarkClock::time_point start = BenchmarkClock::now();
+	for (unsigned int round = 0; round < rounds; round++)
+	{
+		for (unsigned int i = 0; i < arrays; i++)
+			blocks[i] = new XMFLOAT4[counts[i]];
+		for (unsigned int i = 0; i < arrays; i++)
+			delete[] blocks[i];
+	}
+	double heapMs = MillisecondsSince(start);
+
+	LinearArena arena(totalBytes);
+	start = BenchmarkClock::now();
+	for (unsigned int round = 0; round < rounds; round++)
+	{
+		for (unsigned int i = 0; i < arrays; i++)
+			blocks[i] = arena.AllocateArray<XMFLOAT4>(counts[i]);
+		arena.Reset();
+	}
+	double arenaMs = MillisecondsSince(start);
+	bool match = arena.GetPeak() == totalBytes && arena.GetUsed() == 0 && arena.GetOverflowCount() == 0;
+
+	// Alignment, even straight after an odd sized allocation
+	LinearArena small(4096);
+	for (size_t alignment = 1; alignment <= 256; alignment *= 2)
+	{
+		small.Allocate(1, 1);
+		match = match && ((size_t)small.Allocate(8, alignment) & (alignment - 1)) == 0;
+	}
+
+	// Rewinding hands back the same memory
+	LinearArena::Marker marker = small.GetMarker();
+	size_t usedAtMarker = small.GetUsed();
+	void* rewound = small.Allocate(100);
+	small.Rewind(marker);
+	match = match && small.GetUsed() == usedAtMarker && small.Allocate(100) == rewound;
+
+	// Past the end: a heap block until the next rewind, which after the
+	// first time (when the arena's list of them grows) is one allocation
+	small.Reset();
+	for (unsigned int pass = 0; pass < 2; pass++)
+	{
+		unsigned long long allocationsBefore = MemoryTracker::GetThreadAllocationCount();
+		unsigned char* inside = (unsigned char*)small.Allocate(3000);
+		unsigned char* outside = (unsigned char*)small.Allocate(3000);
+		memset(outside, 1, 3000);
+		match = match &&
+			(outside < inside || outside >= inside + 4096) &&
+			small.GetUsed() == 3000 &&
+			small.GetPeak() == 6000 &&
+			small.GetOverflowCount() == pass + 1 &&
+			(pass == 0 || MemoryTracker::GetThreadAllocationCount() - allocationsBefore == 1);
+		small.Reset();
+	}
+
+	// Scratch scopes nest, each putting back what it took
+	LinearArena& scratch = LinearArena::GetThreadScratch();
+	size_t scratchUsed = scratch.GetUsed();
+	{
+		ScratchScope outer;
+		outer.AllocateArray<float>(100);
+		size_t outerUsed = scratch.GetUsed();
+		{
+			ScratchScope inner;
+			inner.AllocateArray<float>(100);
+			match = match && scratch.GetUsed() > outerUsed;
+		}
+		match = match && scratch.GetUsed() == outerUsed;
+	}
+	match = match && scratch.GetUsed() == scratchUsed;
+
+	// Part two: a scene of spinning entities
+	std::uniform_real_distribution<float> positionDist(-100.0f, 100.0f);
+	TransformSystem transformSystem;
+	EntityWorld entities;
+	for (unsigned int i = 0; i < entityCount; i++)
+	{
+		TransformComponent transform = { transformSystem.Create(XMFLOAT3(positionDist(random), positionDist(random), positionDist(random))) };
+		transformSystem.SetLocalBounds(transform.handle, XMFLOAT4(0, 0, 0, 1));
+		BoundsComponent bounds = {};
+		FlagsComponent flags = { ENTITY_FLAG_VISIBLE | ENTITY_FLAG_SPINNING, RENDER_LAYER_WORLD };
+		entities.Spawn(transform, bounds, flags);
+	}
+
+	// And point lights among them
+	const unsigned int lightCount = 256;
+	std::vector<Light> lights(lightCount);
+	for (Light& light : lights)
+	{
+		light = {};
+		light.Type = LIGHT_TYPE_POINT;
+		light.Position = XMFLOAT3(positionDist(random), positionDist(random), positionDist(random));
+		light.Range = 20.0f;
+		light.intensity = 1.0f;
+		light.Color = XMFLOAT3(1, 1, 1);
+	}
+	std::vector<unsigned int> layers(entityCount, RENDER_LAYER_WORLD);
+
+	// What each slot's draw gets from its update
+	const XMFLOAT4* slotBounds[FRAME_PIPELINE_SLOTS] = {};
+	unsigned int slotCounts[FRAME_PIPELINE_SLOTS] = {};
+	XMFLOAT4X4 slotViews[FRAME_PIPELINE_SLOTS];
+	XMFLOAT4X4 slotViewProjections[FRAME_PIPELINE_SLOTS];
+	XMMATRIX projection = XMMatrixPerspectiveFovLH(XM_PIDIV2, 16.0f / 9.0f, 0.01f, 1000.0f);
+	XMFLOAT4X4 projectionFloats;
+	XMStoreFloat4x4(&projectionFloats, projection);
+
+	// Draw()'s culling and lighting
+	SceneBVH sceneBVH;
+	std::vector<unsigned int> inFrustum;
+	ContributionCulling contributionCulling;
+	LightSelection lightSelection;
+	ClusteredLighting clusteredLighting;
+	contributionCulling.SetThreshold(RENDER_LAYER_WORLD, 1.0f);
+	clusteredLighting.UpdateClusterBounds(projectionFloats, 0.01f, 1000.0f);
+
+	const unsigned int warmupFrames = 60;
+	FramePipeline pipeline;
+	unsigned long long drawnVisible = 0;
+	unsigned int warmupMaxVisible = 0;
+	unsigned int maxVisible = 0;
+	bool drawMatch = true;
+	bool reserved = false;
+	pipeline.SetDrawFunction([&](unsigned int slot)
+	{
+		bool warmedUp = pipeline.GetDrawFrame() >= warmupFrames;
+		ZERO_ALLOCATIONS(warmedUp);
+		PROFILE_ZONE("Draw");
+
+		// Lists sized for the whole scene once, on the render thread (like
+		// Game::ReserveDrawResults()), so the camera turning towards it
+		// after the warm-up doesn't grow them
+		if (!reserved)
+		{
+			ALLOW_ALLOCATIONS();
+			inFrustum.reserve(entityCount + 64);
+			LinearArena::GetThreadScratch();
+			contributionCulling.Reserve(entityCount);
+			lightSelection.Reserve(lightCount, entityCount);
+			clusteredLighting.Reserve(lightCount);
+			reserved = true;
+		}
+
+		sceneBVH.Update(slotBounds[slot], slotCounts[slot]);
+		sceneBVH.QueryFrustum(slotViewProjections[slot], inFrustum);
+		contributionCulling.Cull(slotViewProjections[slot], projectionFloats, 1080.0f,
+			slotBounds[slot], layers.data(), inFrustum.data(), (unsigned int)inFrustum.size());
+		const std::vector<unsigned int>& visible = contributionCulling.GetVisible();
+
+		// Packed up for light selection, like Draw() does
+		XMFLOAT4* visibleBounds = pipeline.GetFrameArena(slot).AllocateArray<XMFLOAT4>(visible.size());
+		for (size_t v = 0; v < visible.size(); v++)
+			visibleBounds[v] = slotBounds[slot][visible[v]];
+		lightSelection.SelectLights(lights.data(), lightCount, 0, slotViewProjections[slot], visibleBounds, (unsigned int)visible.size());
+		clusteredLighting.BinLights(lights.data(), lightCount, 0, slotViews[slot]);
+
+		drawMatch = drawMatch &&
+			slotCounts[slot] == entityCount &&
+			(visible.empty() || visibleBounds[0].w > 0) &&
+			lightSelection.GetObjectLights().size() == visible.size();
+		drawnVisible += visible.size();
+		unsigned int& mostVisible = warmedUp ? maxVisible : warmupMaxVisible;
+		mostVisible = std::max(mostVisible, (unsigned int)visible.size());
+	});
+	pipeline.Start();
+
+	unsigned long long totalBefore = 0;
+	unsigned long long forbiddenBefore = 0;
+	for (unsigned int f = 0; f < warmupFrames + frames; f++)
+	{
+		// Only frames drawn after the warm-up has been drawn are counted
+		if (f == warmupFrames)
+		{
+			pipeline.Flush();
+			for (unsigned int tag = 0; tag < MEMORY_TAG_COUNT; tag++)
+				totalBefore += MemoryTracker::GetCPUStats(tag).totalCount;
+			forbiddenBefore = MemoryTracker::GetForbiddenAllocationCount();
+			drawnVisible = 0;
+			start = BenchmarkClock::now();
+		}
+
+		ZERO_ALLOCATIONS(f >= warmupFrames);
+		PROFILE_ZONE("Update");
+		pipeline.BeginFrame();
+		unsigned int slot = pipeline.GetUpdateSlot();
+
+		float spin = 0.01f;
+		entities.ForEachChunkParallel<TransformComponent, FlagsComponent>(
+			[&](unsigned int count, Entity*, TransformComponent* transforms, FlagsComponent* flags)
+		{
+			for (unsigned int i = 0; i < count; i++)
+			{
+				if (flags[i].flags & ENTITY_FLAG_SPINNING)
+					transformSystem.Rotate(transforms[i].handle, XMFLOAT3(spin, spin, spin));
+			}
+		});
+		transformSystem.UpdateMatrices();
+		entities.ForEachChunkParallel<TransformComponent, BoundsComponent>(
+			[&](unsigned int count, Entity*, TransformComponent* transforms, BoundsComponent* bounds)
+		{
+			for (unsigned int i = 0; i < count; i++)
+				bounds[i].sphere = transformSystem.GetWorldBounds(transforms[i].handle);
+		});
+
+		// The snapshot lives in the slot's frame arena until the slot comes around again
+		XMFLOAT4* bounds = pipeline.GetFrameArena(slot).AllocateArray<XMFLOAT4>(entities.GetCount());
+		unsigned int boundsCount = 0;
+		entities.ForEachChunk<BoundsComponent>([&](unsigned int count, Entity*, BoundsComponent* chunkBounds)
+		{
+			memcpy(bounds + boundsCount, chunkBounds, sizeof(BoundsComponent) * count);
+			boundsCount += count;
+		});
+		slotBounds[slot] = bounds;
+		slotCounts[slot] = boundsCount;
+
+		// The camera looks away from the scene for the whole warm-up, then
+		// turns to face all of it, so the frames that are checked see far
+		// more than any frame that was let off
+		float turn = f < warmupFrames ? 0.0f : std::min((f - warmupFrames) / 60.0f, 1.0f);
+		float yaw = XM_PI * (1.0f - turn);
+		XMMATRIX view = XMMatrixLookToLH(XMVectorSet(0, 0, -300, 0), XMVectorSet(sinf(yaw), 0, cosf(yaw), 0), XMVectorSet(0, 1, 0, 0));
+		XMStoreFloat4x4(&slotViews[slot], view);
+		XMStoreFloat4x4(&slotViewProjections[slot], XMMatrixMultiply(view, projection));
+		pipeline.EndFrame();
+	}
+	pipeline.Flush();
+	double frameMs = MillisecondsSince(start) / frames;
+	pipeline.Stop();
+
+	unsigned long long totalAfter = 0;
+	for (unsigned int tag = 0; tag < MEMORY_TAG_COUNT; tag++)
+		totalAfter += MemoryTracker::GetCPUStats(tag).totalCount;
+	unsigned long long frameAllocations = totalAfter - totalBefore;
+	unsigned long long forbiddenAllocations = MemoryTracker::GetForbiddenAllocationCount() - forbiddenBefore;
+	size_t arenaPeak = 0;
+	unsigned long long arenaOverflows = 0;
+	for (unsigned int slot = 0; slot < FRAME_PIPELINE_SLOTS; slot++)
+	{
+		arenaPeak = std::max(arenaPeak, pipeline.GetFrameArena(slot).GetPeak());
+		arenaOverflows += pipeline.GetFrameArena(slot).GetOverflowCount();
+	}
+	match = match && drawMatch && maxVisible > warmupMaxVisible && frameAllocations == 0 && forbiddenAllocations == 0 && arenaOverflows == 0;
+
+	// And some on purpose (printed, but not asserted), with an allowed one
+	// inside, and one in a job that takes the rule along to a worker
+	// (a job pinned there first, so its queue has already grown)
+	JobSystem& jobs = JobSystem::GetInstance();
+	unsigned int worker = jobs.GetThreadCount() > 1 ? 1 : JOB_ANY_THREAD;
+	JobCounter warmedUp;
+	jobs.Run([](void*, unsigned int, unsigned int) {}, 0, 0, 0, &warmedUp, worker);
+	jobs.Wait(warmedUp);
+
+	MemoryTracker::SetForbiddenAllocationAsserts(false);
+	unsigned long long caughtBefore = MemoryTracker::GetForbiddenAllocationCount();
+	{
+		ZERO_ALLOCATIONS(true);
+		::operator delete(::operator new(64));
+		{
+			ALLOW_ALLOCATIONS();
+			::operator delete(::operator new(64));
+		}
+
+		JobCounter allocated;
+		jobs.Run([](void*, unsigned int, unsigned int) { ::operator delete(::operator new(64)); }, 0, 0, 0, &allocated, worker);
+		jobs.Wait(allocated);
+		match = match && MemoryTracker::GetThreadAllocationsForbidden();
+	}
+	unsigned long long caught = MemoryTracker::GetForbiddenAllocationCount() - caughtBefore;
+	MemoryTracker::SetForbiddenAllocationAsserts(true);
+	match = match && caught == 2 && !MemoryTracker::GetThreadAllocationsForbidden();
+
+	printf("Frame arenas (%u arrays a frame): new/delete %.1fns, arena %.1fns (%.0fx), %u frames of %u entities and %u lights: %.3fms/frame, %.1f visible (%u at most, %u during warm-up), arena peak %.0fKB, %llu allocations after warm-up (%llu forbidden), %llu caught on purpose, ",
+		arrays,
+		heapMs * 1000000.0 / (arrays * rounds),
+		arenaMs * 1000000.0 / (arrays * rounds),
+		heapMs / arenaMs,
+		frames,
+		entityCount,
+		lightCount,
+		frameMs,
+		(double)drawnVisible / frames,
+		maxVisible,
+		warmupMaxVisible,
+		arenaPeak / 1024.0,
+		frameAllocations,
+		forbiddenAllocations,
+		caught);
+	ReportCheck("Frame arenas", match);
+}
+
+// --------------------------------------------------------
+// Adds materials to a MaterialTable where each one shows up
+// several times (like materials that only differ by pipeline)
+// and checks they share entries, that changing any one field
+// makes a new entry, and that updates and reads are right
+// --------------------------------------------------------
+void RunMaterialTableBenchmark(unsigned int materialCount)
+{
+	const unsigned int distinct = materialCount / 4;
+	std::vector<MaterialData> materials(materialCount);
+	for (unsigned int i = 0; i < materialCount; i++)
+	{
+		unsigned int d = i % distinct;
+		MaterialData& data = materials[i];
+		data = {};
+		data.colorTint = XMFLOAT3(1.0f, d / (float)distinct, 0.5f);
+		data.albedoIndex = d * 4;
+		data.uvScale = XMFLOAT2(1.0f, 1.0f);
+		data.uvOffset = XMFLOAT2(0.0f, 0.0f);
+		data.normalIndex = d * 4 + 1;
+		data.metalnessIndex = d * 4 + 2;
+		data.roughnessIndex = d * 4 + 3;
+	}
+
+	// Nothing to update yet, and an update past the end is ignored
+	MaterialTable table;
+	table.UpdateMaterial(0, materials[0]);
+	bool match = table.GetMaterialCount() == 0 && !table.IsDirty();
+
+	std::vector<unsigned int> indices(materialCount);
+	BenchmarkClock::time_point start = BenchmarkClock::now();
+	for (unsigned int i = 0; i < materialCount; i++)
+		indices[i] = table.AddMaterial(materials[i]);
+	double addMs = MillisecondsSince(start);
+
+	// Repeats share the first one's entry, which reads back the same
+	match = match && table.IsDirty() && table.GetMaterialCount() == distinct;
+	for (unsigned int i = 0; i < materialCount; i++)
+	{
+		match = match && indices[i] == i % distinct;
+		MaterialData entry = table.GetMaterial(indices[i]);
+		match = match && memcmp(&entry, &materials[i], sizeof(MaterialData)) == 0;
+	}
+
+	// Any one field changed is a different material
+	const int fieldCount = 7;
+	MaterialData changed[fieldCount];
+	for (int f = 0; f < fieldCount; f++)
+		changed[f] = materials[0];
+	changed[0].colorTint.x += 0.5f;
+	changed[1].albedoIndex += 1000;
+	changed[2].uvScale.y *= 2.0f;
+	changed[3].uvOffset.x += 0.25f;
+	changed[4].normalIndex += 1000;
+	changed[5].metalnessIndex += 1000;
+	changed[6].roughnessIndex += 1000;
+	for (int f = 0; f < fieldCount; f++)
+	{
+		unsigned int count = table.GetMaterialCount();
+		match = match && table.AddMaterial(changed[f]) == count && table.GetMaterialCount() == count + 1;
+	}
+
+	// Updates land in place, and past the end they're ignored
+	unsigned int count = table.GetMaterialCount();
+	table.UpdateMaterial(1, changed[0]);
+	table.UpdateMaterial(count, changed[1]);
+	MaterialData updated = table.GetMaterial(1);
+	match = match &&
+		table.IsDirty() &&
+		table.GetMaterialCount() == count &&
+		memcmp(&updated, &changed[0], sizeof(MaterialData)) == 0;
+
+	printf("Material table (%u materials, %u entries): %.1fns/add, ",
+		materialCount,
+		table.GetMaterialCount(),
+		addMs * 1000000.0 / materialCount);
+	ReportCheck("Material table", match);
+}
+
+// --------------------------------------------------------
+// Hashes a pipeline description against copies of it that only
+// share values (not pointers) and copies with one thing changed,
+// then requests pipelines from a cache that was never given a
+// device, so they stay queued and resolve to the placeholder
+//
+// placeholder - Any pipeline, for requests to hand back until ready
+// --------------------------------------------------------
+void RunPipelineCacheBenchmark(Microsoft::WRL::ComPtr<ID3D12PipelineState> placeholder, unsigned int hashCount)
+{
+	// Stand-in shaders, which are only ever hashed
+	std::mt19937 random(1234);
+	std::uniform_int_distribution<unsigned int> byteDist(0, 255);
+	std::vector<unsigned char> vertexShader(2048);
+	std::vector<unsigned char> pixelShader(4096);
+	for (unsigned char& byte : vertexShader)
+		byte = (unsigned char)byteDist(random);
+	for (unsigned char& byte : pixelShader)
+		byte = (unsigned char)byteDist(random);
+
+	D3D12_INPUT_ELEMENT_DESC inputElements[2] = {};
+	inputElements[0].SemanticName = "POSITION";
+	inputElements[0].Format = DXGI_FORMAT_R32G32B32_FLOAT;
+	inputElements[0].AlignedByteOffset = D3D12_APPEND_ALIGNED_ELEMENT;
+	inputElements[1].SemanticName = "TEXCOORD";
+	inputElements[1].Format = DXGI_FORMAT_R32G32_FLOAT;
+	inputElements[1].AlignedByteOffset = D3D12_APPEND_ALIGNED_ELEMENT;
+
+	D3D12_GRAPHICS_PIPELINE_STATE_DESC desc = {};
+	desc.VS.pShaderBytecode = vertexShader.data();
+	desc.VS.BytecodeLength = vertexShader.size();
+	desc.PS.pShaderBytecode = pixelShader.data();
+	desc.PS.BytecodeLength = pixelShader.size();
+	desc.InputLayout.pInputElementDescs = inputElements;
+	desc.InputLayout.NumElements = 2;
+	desc.PrimitiveTopologyType = D3D12_PRIMITIVE_TOPOLOGY_TYPE_TRIANGLE;
+	desc.NumRenderTargets = 1;
+	desc.RTVFormats[0] = DXGI_FORMAT_R8G8B8A8_UNORM;
+	desc.DSVFormat = DXGI_FORMAT_D24_UNORM_S8_UINT;
+	desc.SampleDesc.Count = 1;
+	desc.RasterizerState.FillMode = D3D12_FILL_MODE_SOLID;
+	desc.RasterizerState.CullMode = D3D12_CULL_MODE_BACK;
+	desc.DepthStencilState.DepthEnable = true;
+	desc.DepthStencilState.DepthFunc = D3D12_COMPARISON_FUNC_LESS;
+	desc.DepthStencilState.DepthWriteMask = D3D12_DEPTH_WRITE_MASK_ALL;
+	desc.BlendState.RenderTarget[0].SrcBlend = D3D12_BLEND_ONE;
+	desc.BlendState.RenderTarget[0].DestBlend = D3D12_BLEND_ZERO;
+	desc.BlendState.RenderTarget[0].BlendOp = D3D12_BLEND_OP_ADD;
+	desc.BlendState.RenderTarget[0].RenderTargetWriteMask = D3D12_COLOR_WRITE_ENABLE_ALL;
+	desc.SampleMask = 0xffffffff;
+	const unsigned long long rootSignatureHash = PipelineCache::HashBytes("Root signature", 14);
+
+	// The same description, with everything it points to somewhere else
+	std::vector<unsigned char> vertexShaderCopy = vertexShader;
+	std::vector<unsigned char> pixelShaderCopy = pixelShader;
+	std::string semanticNames[2] = { inputElements[0].SemanticName, inputElements[1].SemanticName };
+	D3D12_INPUT_ELEMENT_DESC inputElementsCopy[2] = { inputElements[0], inputElements[1] };
+	inputElementsCopy[0].SemanticName = semanticNames[0].c_str();
+	inputElementsCopy[1].SemanticName = semanticNames[1].c_str();
+	D3D12_GRAPHICS_PIPELINE_STATE_DESC equal = desc;
+	equal.VS.pShaderBytecode = vertexShaderCopy.data();
+	equal.PS.pShaderBytecode = pixelShaderCopy.data();
+	equal.InputLayout.pInputElementDescs = inputElementsCopy;
+
+	BenchmarkClock::time_point start = BenchmarkClock::now();
+	unsigned long long keySum = 0;
+	for (unsigned int i = 0; i < hashCount; i++)
+		keySum += PipelineCache::HashPipelineDesc(i % 2 ? equal : desc, rootSignatureHash);
+	double hashMs = MillisecondsSince(start);
+
+	unsigned long long key = PipelineCache::HashPipelineDesc(desc, rootSignatureHash);
+	bool match =
+		PipelineCache::HashPipelineDesc(equal, rootSignatureHash) == key &&
+		keySum == key * hashCount;
+
+	// Each of these only changes one thing, and they all need different keys
+	std::vector<unsigned char> pixelShaderChanged = pixelShader;
+	pixelShaderChanged[pixelShaderChanged.size() / 2] ^= 1;
+	D3D12_INPUT_ELEMENT_DESC inputElementsChanged[2] = { inputElements[0], inputElements[1] };
+	inputElementsChanged[1].SemanticIndex = 1;
+
+	const int changeCount = 6;
+	D3D12_GRAPHICS_PIPELINE_STATE_DESC changed[changeCount];
+	for (int c = 0; c < changeCount; c++)
+		changed[c] = desc;
+	changed[0].RasterizerState.CullMode = D3D12_CULL_MODE_NONE;
+	changed[1].DepthStencilState.DepthFunc = D3D12_COMPARISON_FUNC_LESS_EQUAL;
+	changed[2].BlendState.RenderTarget[0].BlendEnable = true;
+	changed[3].DSVFormat = DXGI_FORMAT_D32_FLOAT;
+	changed[4].PS.pShaderBytecode = pixelShaderChanged.data();
+	changed[5].InputLayout.pInputElementDescs = inputElementsChanged;
+
+	std::vector<unsigned long long> keys;
+	keys.push_back(key);
+	keys.push_back(PipelineCache::HashPipelineDesc(desc, rootSignatureHash + 1));
+	for (int c = 0; c < changeCount; c++)
+		keys.push_back(PipelineCache::HashPipelineDesc(changed[c], rootSignatureHash));
+	std::sort(keys.begin(), keys.end());
+	match = match && std::unique(keys.begin(), keys.end()) == keys.end();
+
+	// Without a device nothing compiles, so requests keep their placeholder
+	PipelineCache cache;
+	PipelineHandle first = cache.RequestPipeline(desc, rootSignatureHash, placeholder);
+	PipelineHandle again = cache.RequestPipeline(equal, rootSignatureHash, placeholder);
+	PipelineHandle other = cache.RequestPipeline(changed[0], rootSignatureHash, placeholder);
+	match = match &&
+		first == again &&
+		other != first &&
+		cache.GetPipelineCount() == 2 &&
+		cache.GetPendingCount() == 2 &&
+		cache.GetMemoryHits() == 1 &&
+		!cache.IsReady(first) &&
+		!cache.IsReady(other) &&
+		cache.GetPipeline(first).Get() == placeholder.Get() &&
+		cache.GetPipeline(other).Get() == placeholder.Get() &&
+		!cache.GetPipeline(INVALID_PIPELINE_HANDLE).Get();
+
+	printf("Pipeline cache (%u hashes, %.1fKB of shaders): %.0fns/description, %u distinct keys, %u requests for %u pipelines, ",
+		hashCount,
+		(vertexShader.size() + pixelShader.size()) / 1024.0,
+		hashMs * 1000000.0 / hashCount,
+		(unsigned int)keys.size(),
+		3,
+		cache.GetPipelineCount());
+	ReportCheck("Pipeline cache", match);
+}
+
+// --------------------------------------------------------
+// Partitions shuffled lights by type and checks the ranges
+// against a plain count, then checks that each compiled shader
+// permutation has its own key and a file name matching its counts
+//
+// lightCount - Lights per shuffled list
+// rounds - How many lists to partition
+// --------------------------------------------------------
+void RunLightPartitionBenchmark(unsigned int lightCount, unsigned int rounds)
+{
+	// Random types, including some unknown ones that should be dropped,
+	// with the original index stashed in the padding to check stability
+	std::mt19937 random(1234);
+	std::uniform_int_distribution<int> typeDist(LIGHT_TYPE_DIRECTIONAL, LIGHT_TYPE_SPOT + 1);
+	std::vector<Light> lights(lightCount * rounds);
+	for (unsigned int i = 0; i < lights.size(); i++)
+	{
+		lights[i] = {};
+		lights[i].Type = typeDist(random);
+		lights[i].Padding.x = (float)(i % lightCount);
+	}
+
+	std::vector<Light> sorted(lights.size());
+	std::vector<LightCounts> counts(rounds);
+	BenchmarkClock::time_point start = BenchmarkClock::now();
+	for (unsigned int r = 0; r < rounds; r++)
+		counts[r] = PartitionLights(&lights[r * lightCount], lightCount, &sorted[r * lightCount]);
+	double partitionMs = MillisecondsSince(start);
+
+	bool match = true;
+	for (unsigned int r = 0; r < rounds && match; r++)
+	{
+		const Light* list = &lights[r * lightCount];
+		const Light* result = &sorted[r * lightCount];
+
+		int expected[3] = {};
+		for (unsigned int i = 0; i < lightCount; i++)
+			if (list[i].Type <= LIGHT_TYPE_SPOT)
+				expected[list[i].Type]++;
+		match = counts[r].directional == expected[0] &&
+			counts[r].point == expected[1] &&
+			counts[r].spot == expected[2];
+
+		// Each range holds only its type, in the original order
+		int rangeStart[3] = { 0, expected[0], expected[0] + expected[1] };
+		for (int type = LIGHT_TYPE_DIRECTIONAL; type <= LIGHT_TYPE_SPOT && match; type++)
+		{
+			int next = rangeStart[type];
+			for (unsigned int i = 0; i < lightCount && match; i++)
+			{
+				if (list[i].Type != type)
+					continue;
+				match = result[next].Type == type && result[next].Padding.x == (float)i;
+				next++;
+			}
+		}
+	}
+
+	// Every permutation has its own key, which is found from its counts,
+	// and its file is named after those same counts
+	std::vector<unsigned int> keys;
+	for (unsigned int i = 0; i < LIGHT_PERMUTATION_COUNT; i++)
+	{
+		LightCounts permutation = lightPermutationShaders[i].counts;
+		int d = -1, p = -1, s = -1;
+		match = match &&
+			swscanf(lightPermutationShaders[i].file, L"PixelShader_Lights_D%dP%dS%d.cso", &d, &p, &s) == 3 &&
+			d == permutation.directional &&
+			p == permutation.point &&
+			s == permutation.spot;
+		keys.push_back(GetLightPermutationKey(permutation));
+	}
+	std::sort(keys.begin(), keys.end());
+	match = match && std::unique(keys.begin(), keys.end()) == keys.end();
+
+	// Counts without a permutation must not land on one by accident
+	LightCounts missing[] = { { 0, 0, 0 }, { 2, 1, 0 }, { 1, 3, 0 }, { 1, 2, 1 }, { 255, 255, 255 }, { 300, 2, 0 } };
+	for (LightCounts m : missing)
+		match = match && !std::binary_search(keys.begin(), keys.end(), GetLightPermutationKey(m));
+
+	printf("Light partition (%u lights x %u lists, %u permutations): %.1fns/list, ",
+		lightCount,
+		rounds,
+		LIGHT_PERMUTATION_COUNT,
+		partitionMs * 1000000.0 / rounds);
+	ReportCheck("Light partition", match);
+}
\ No newline at end of file
@@ -0,0 +1,82 @@
+#pragma once
+#include "ResourceRegistry.h"
+
+// CPU microbenchmarks for engine systems. Each one prints its timings
+// to the console (debug builds have one) and checks that the optimized
+// path produces the same results as the path it replaces.
+
+// Quaternion Transform vs. the old Euler-angle Transform
+void RunTransformClassBenchmark(unsigned int objectCount = 100000, unsigned int frames = 10);
+
+// Per-object Transform matrices vs. TransformSystem batches
+void RunTransformBenchmark(unsigned int objectCount = 100000, unsigned int frames = 10);
+
+// Deep and wide transform hierarchies: propagation, reparenting, bulk changes
+void RunHierarchyBenchmark(unsigned int objectCount = 100000);
+
+// Per-frame update/draw-prep cost of entities vs. the old vector of Renderables
+// (uses a real mesh and material so the shared_ptr/ComPtr costs are the same)
+void RunEntityBenchmark(ResourceRegistry& resources, MeshHandle meshHandle, MaterialHandle materialHandle, unsigned int entityCount = 100000);
+
+// Handle lookups, deferred unloading and stale handle detection in a ResourcePool
+void RunResourcePoolBenchmark(unsigned int resourceCount = 100000);
+
+// SIMD, multithreaded frustum culling vs. testing one sphere at a time
+void RunCullingBenchmark(unsigned int objectCount = 1000000, unsigned int frames = 10);
+
+// Software occlusion culling in a city of box occluders, vs. brute force and a high resolution reference
+void RunOcclusionBenchmark(unsigned int objectCount = 100000, unsigned int frames = 30);
+
+// Screen space contribution culling with per-layer thresholds and grouping, vs. testing one sphere at a time
+void RunContributionBenchmark(unsigned int objectCount = 1000000, unsigned int frames = 10);
+
+// Clustered light binning with SIMD jobs vs. every light against every exact froxel, checking the fast path never misses a light
+void RunClusteredLightingBenchmark(unsigned int lightCount = 4000, unsigned int frames = 4);
+
+// Per-object light selection (SIMD frustum cull and running top few) vs. scoring every light and partial sorting, with lights per object
+void RunLightSelectionBenchmark(unsigned int objectCount = 10000, unsigned int lightCount = 2000, unsigned int frames = 4);
+
+// Scene BVH build/refit times and frustum, sphere, ray and nearest queries vs. linear scans
+void RunBVHBenchmark(unsigned int objectCount = 100000, unsigned int frames = 30, unsigned int queryCount = 1000);
+
+// Triangle BVH raycasts (millions of rays per second) on each mesh that kept its CPU geometry, vs. testing every triangle
+void RunMeshBVHBenchmark(ResourceRegistry& resources, const std::vector<MeshHandle>& meshHandles, unsigned int rayCount = 100000);
+
+// Job system scaling (1 thread up to one per core) on a parallel loop, plus the cost of queueing and running tiny jobs
+void RunJobSystemBenchmark(unsigned int elementCount = 4000000, unsigned int jobCount = 100000);
+
+// Serial vs. pipelined update/draw (FramePipeline) with simulated frame costs: throughput, latency and handoff correctness
+void RunFramePipelineBenchmark(unsigned int frames = 200);
+
+// Fixed timestep simulation across frame rates (same ticks, same results), and interpolating transforms between ticks
+void RunFixedTimestepBenchmark(unsigned int objectCount = 100000);
+
+// Frame limiter accuracy and CPU cost on simulated system timers (sleep + spin vs. sleeping or spinning alone), and input to present latency
+void RunFramePacingBenchmark(unsigned int frames = 600);
+
+// Dynamic resolution controller on synthetic frame time traces (light and heavy load, noise near the budget, a load spike, an impossible load)
+void RunDynamicResolutionBenchmark(unsigned int frames = 600);
+
+// Frame time recording cost, percentile and hitch summaries against a full sort, recording from a render thread, and CSV/JSON export
+void RunFrameStatsBenchmark(unsigned int frames = 100000);
+
+// Profiler zone cost inside and outside a capture, nesting and dropped zones, recording from every job system thread, GPU stand-in ranges, and Chrome trace export
+void RunProfilerBenchmark(unsigned int groups = 8192);
+
+// Render counter cost per add and per frame, per-frame counts and totals from a simulated renderer, and budget checks catching frames that overrun the constant buffer ring
+void RunRenderCountersBenchmark(unsigned int frames = 10000);
+
+// Memory tracker cost over malloc/free, allocations tagged and freed on different job system threads coming off the right totals, tag scopes nesting, and GPU stand-in allocations by heap and by use
+void RunMemoryTrackingBenchmark(unsigned int allocations = 100000);
+
+// Linear arena cost vs. new/delete per array, alignment, rewinding and heap fallback, then pipelined frames of entities, transforms, culling and lighting checked to make no heap allocations once warmed up, even when the camera turns to see more than it did during the warm-up
+void RunFrameArenaBenchmark(unsigned int entityCount = 10000, unsigned int frames = 500);
+
+// Material table entries shared between identical materials and not between ones that differ by a field, with updates and reads checked
+void RunMaterialTableBenchmark(unsigned int materialCount = 1024);
+
+// Pipeline description hashing (equal descriptions share a key, any one change doesn't) and requests resolving to their placeholder until compiled
+void RunPipelineCacheBenchmark(Microsoft::WRL::ComPtr<ID3D12PipelineState> placeholder, unsigned int hashCount = 10000);
+
+// Light partitioning (contiguous, stable ranges per type) and permutation keys for the compiled light shaders
+void RunLightPartitionBenchmark(unsigned int lightCount = 64, unsigned int rounds = 10000);
\ No newline at end of file
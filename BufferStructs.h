@@ -1,5 +1,6 @@
 #pragma once
 #include <DirectXMath.h>
+#include "Lights.h"
 
 struct VertexShaderExternalData
 {
@@ -8,11 +9,64 @@ struct VertexShaderExternalData
     DirectX::XMFLOAT4X4 projection;
     DirectX::XMFLOAT4X4 worldInvTranspose;
 };
+// Most lights a single object can be lit by in per-object light mode
+// (must match DrawData in PixelShader.hlsl)
+#define MAX_LIGHTS_PER_OBJECT 8
+
 struct PixelShaderExternalData
 {
+    DirectX::XMFLOAT3 cameraPosition;
+    int directionalLightCount;
+    int pointLightCount;
+    int spotLightCount;
+    float clusterSliceScale;
+    float clusterSliceBias;
+    unsigned int clusterCountX;
+    unsigned int clusterCountY;
+    unsigned int clusterCountZ;
+    float padding;
+    DirectX::XMFLOAT2 clusterTileSize; // In pixels
+    DirectX::XMFLOAT2 padding2;
+    Light lights[20]; // Sorted by type, see PartitionLights()
+};
+// One entry of the material table structured buffer (must match PixelShader.hlsl)
+// Texture indices are into the bindless texture range of the CBV/SRV heap
+struct MaterialData
+{
+    DirectX::XMFLOAT3 colorTint;
+    unsigned int albedoIndex;
     DirectX::XMFLOAT2 uvScale;
     DirectX::XMFLOAT2 uvOffset;
-    DirectX::XMFLOAT3 cameraPosition;
-    int lightCount;
-    Light lights[20];
+    unsigned int normalIndex;
+    unsigned int metalnessIndex;
+    unsigned int roughnessIndex;
+    unsigned int padding;
+};
+// Where a cluster's lights are in the light index list (must match PixelShader.hlsl)
+// Point light indices come first, followed by spot light indices
+struct LightCluster
+{
+    unsigned int offset;
+    unsigned int pointCount;
+    unsigned int spotCount;
+    unsigned int padding;
+};
+// Per-draw root constants for the pixel shader (must match PixelShader.hlsl)
+// Light indices are only used by the per-object light selection shader
+struct DrawData
+{
+    unsigned int materialIndex;
+    unsigned int pointLightCount;
+    unsigned int spotLightCount;
+    unsigned int padding;
+    unsigned int lightIndices[MAX_LIGHTS_PER_OBJECT];
+};
+// Root constants for the upscale pixel shader (must match PixelShaderUpscale.hlsl)
+// Uses the same root constant slot as DrawData, which is bigger
+struct UpscaleData
+{
+    DirectX::XMFLOAT2 uvScale;
+    DirectX::XMFLOAT2 uvMin;
+    DirectX::XMFLOAT2 uvMax;
+    unsigned int sceneIndex;
 };
\ No newline at end of file
@@ -39,11 +39,36 @@ DirectX::XMFLOAT4X4 Camera::GetProjection()
     return projectionMatrix;
 }
 
+// View then projection, for frustum culling
+DirectX::XMFLOAT4X4 Camera::GetViewProjection()
+{
+    DirectX::XMFLOAT4X4 viewProjection;
+    DirectX::XMStoreFloat4x4(&viewProjection, DirectX::XMMatrixMultiply(
+        DirectX::XMLoadFloat4x4(&viewMatrix),
+        DirectX::XMLoadFloat4x4(&projectionMatrix)));
+    return viewProjection;
+}
+
 DirectX::XMFLOAT3 Camera::GetPosition()
 {
     return transform.GetPosition();
 }
 
+float Camera::GetNearClip()
+{
+    return nearClip;
+}
+
+float Camera::GetFarClip()
+{
+    return farClip;
+}
+
+bool Camera::IsOrtho()
+{
+    return ortho;
+}
+
 void Camera::SetAspect(float _aspectRatio)
 {
     aspectRatio = _aspectRatio;
@@ -23,7 +23,11 @@ public:
 	// Needed for shaders later
 	DirectX::XMFLOAT4X4 GetView();
 	DirectX::XMFLOAT4X4 GetProjection();
+	DirectX::XMFLOAT4X4 GetViewProjection();
 	DirectX::XMFLOAT3 GetPosition();
+	float GetNearClip();
+	float GetFarClip();
+	bool IsOrtho();
 
 	// Setters
 
@@ -0,0 +1,636 @@
+#include "ClusteredLighting.h"
+#include "JobSystem.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cfloat>
+
+using namespace DirectX;
+
+// How much of the intensity counts as "no longer lit" at the edge
+// of a spot light's cone, used to turn SpotFalloff into an angle
+#define SPOT_CUTOFF_INTENSITY (1.0f / 256.0f)
+
+// Small expansion of each light's cluster range so lights that exactly
+// touch a cluster boundary aren't missed due to rounding
+#define CLUSTER_RANGE_EPSILON 0.001f
+
+ClusteredLighting::ClusteredLighting(
+	unsigned int clusterCountX,
+	unsigned int clusterCountY,
+	unsigned int clusterCountZ,
+	unsigned int maxLightsPerCluster) :
+	clusterCountX(clusterCountX),
+	clusterCountY(clusterCountY),
+	clusterCountZ(clusterCountZ),
+	maxLightsPerCluster(maxLightsPerCluster),
+	nearClip(0.01f),
+	farClip(1000.0f),
+	sliceScale(0),
+	sliceBias(0),
+	projScaleX(1),
+	projScaleY(1),
+	lastBinTimeMs(0),
+	overflowCount(0),
+	lastTestCount(0)
+{
+	unsigned int clusterCount = clusterCountX * clusterCountY * clusterCountZ;
+	unsigned int paddedCount = clusterCount + 4;
+
+	// Padding clusters are inverted boxes, which no sphere can touch.
+	// There are enough that a four wide load from the last cluster is safe
+	boundsMinX.resize(paddedCount, FLT_MAX);
+	boundsMinY.resize(paddedCount, FLT_MAX);
+	boundsMinZ.resize(paddedCount, FLT_MAX);
+	boundsMaxX.resize(paddedCount, -FLT_MAX);
+	boundsMaxY.resize(paddedCount, -FLT_MAX);
+	boundsMaxZ.resize(paddedCount, -FLT_MAX);
+
+	scratchCounts.resize(clusterCount);
+	scratchPointCounts.resize(clusterCount);
+	scratchRejected.resize(clusterCount);
+	scratchIndices.resize((size_t)clusterCount * maxLightsPerCluster);
+	clusters.resize(clusterCount);
+}
+
+// --------------------------------------------------------
+// Calculates the view space AABB of every cluster
+//
+// projection - The camera's (perspective) projection matrix
+// nearClip / farClip - The camera's clip plane distances
+// --------------------------------------------------------
+void ClusteredLighting::UpdateClusterBounds(XMFLOAT4X4 projection, float _nearClip, float _farClip)
+{
+	nearClip = _nearClip;
+	farClip = _farClip;
+	projScaleX = projection._11;
+	projScaleY = projection._22;
+
+	// Slice = log(depth) * scale + bias, so slice 0 starts at
+	// the near plane and the last slice ends at the far plane
+	float logDepthRange = logf(farClip / nearClip);
+	sliceScale = clusterCountZ / logDepthRange;
+	sliceBias = -(float)clusterCountZ * logf(nearClip) / logDepthRange;
+
+	for (unsigned int z = 0; z < clusterCountZ; z++)
+	{
+		float sliceNear = nearClip * powf(farClip / nearClip, (float)z / clusterCountZ);
+		float sliceFar = nearClip * powf(farClip / nearClip, (float)(z + 1) / clusterCountZ);
+
+		for (unsigned int y = 0; y < clusterCountY; y++)
+		{
+			// Row 0 is the top of the screen
+			float ndcTop = 1.0f - 2.0f * y / clusterCountY;
+			float ndcBottom = 1.0f - 2.0f * (y + 1) / clusterCountY;
+
+			for (unsigned int x = 0; x < clusterCountX; x++)
+			{
+				float ndcLeft = -1.0f + 2.0f * x / clusterCountX;
+				float ndcRight = -1.0f + 2.0f * (x + 1) / clusterCountX;
+
+				// View space x = ndc x * depth / projection scale, which is
+				// linear in depth so the extremes are at the slice planes
+				unsigned int c = x + y * clusterCountX + z * clusterCountX * clusterCountY;
+				boundsMinX[c] = std::min(ndcLeft * sliceNear, ndcLeft * sliceFar) / projScaleX;
+				boundsMaxX[c] = std::max(ndcRight * sliceNear, ndcRight * sliceFar) / projScaleX;
+				boundsMinY[c] = std::min(ndcBottom * sliceNear, ndcBottom * sliceFar) / projScaleY;
+				boundsMaxY[c] = std::max(ndcTop * sliceNear, ndcTop * sliceFar) / projScaleY;
+				boundsMinZ[c] = sliceNear;
+				boundsMaxZ[c] = sliceFar;
+			}
+		}
+	}
+}
+
+// --------------------------------------------------------
+// Each cluster keeps at most maxLightsPerCluster lights, so that
+// (or the light count, if it's lower) bounds every cluster's list
+// --------------------------------------------------------
+void ClusteredLighting::Reserve(unsigned int lightCount)
+{
+	viewLights.reserve(lightCount);
+	lightIndices.reserve(clusters.size() * std::min(lightCount, maxLightsPerCluster));
+}
+
+// --------------------------------------------------------
+// Bins point and spot lights into every cluster they touch
+//
+// lights - Point lights followed by spot lights, in world space
+// pointLightCount / spotLightCount - How many of each are in the array
+// view - The camera's view matrix
+//
+// The resulting index lists refer to positions in the lights array
+// --------------------------------------------------------
+void ClusteredLighting::BinLights(const Light* lights, unsigned int pointLightCount, unsigned int spotLightCount, XMFLOAT4X4 view)
+{
+	std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+
+	PrepareViewLights(lights, pointLightCount, spotLightCount, view);
+
+	// Each job owns a range of depth slices, so no two jobs
+	// ever write to the same cluster and no locking is needed
+	std::atomic<unsigned int> testCount(0);
+	JobSystem::GetInstance().ParallelFor(0, clusterCountZ, 1, [&](unsigned int first, unsigned int last)
+	{
+		testCount += BinSlices(first, last, pointLightCount);
+	});
+	lastTestCount = testCount;
+
+	CompactClusters();
+
+	std::chrono::duration<double, std::milli> elapsed = std::chrono::high_resolution_clock::now() - start;
+	lastBinTimeMs = elapsed.count();
+}
+
+// --------------------------------------------------------
+// Reference for BinLights(): every light against every cluster,
+// one pair at a time, with no screen or depth range narrowing
+// down which clusters a light is tried against.
+//
+// The test is against the froxel itself (the slice of the view
+// frustum the cluster covers), not the box around it BinLights()
+// uses. Those boxes stick out past the froxel, so BinLights() can
+// list a light that touches a cluster's box but not the froxel;
+// what it can't do is miss a light found here.
+// --------------------------------------------------------
+void ClusteredLighting::BinLightsBruteForce(const Light* lights, unsigned int pointLightCount, unsigned int spotLightCount, XMFLOAT4X4 view)
+{
+	std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+
+	PrepareViewLights(lights, pointLightCount, spotLightCount, view);
+
+	unsigned int clusterCount = clusterCountX * clusterCountY * clusterCountZ;
+	std::fill(scratchCounts.begin(), scratchCounts.end(), 0);
+	std::fill(scratchRejected.begin(), scratchRejected.end(), 0);
+	lastTestCount = 0;
+
+	for (unsigned int i = 0; i < viewLights.size(); i++)
+	{
+		if (i == pointLightCount)
+			std::copy(scratchCounts.begin(), scratchCounts.end(), scratchPointCounts.begin());
+
+		const ViewLight& light = viewLights[i];
+		for (unsigned int c = 0; c < clusterCount; c++)
+		{
+			lastTestCount++;
+			if (TestFroxel(light, c))
+				AddLightToCluster(c, i);
+		}
+	}
+	if (pointLightCount == viewLights.size())
+		std::copy(scratchCounts.begin(), scratchCounts.end(), scratchPointCounts.begin());
+
+	CompactClusters();
+
+	std::chrono::duration<double, std::milli> elapsed = std::chrono::high_resolution_clock::now() - start;
+	lastBinTimeMs = elapsed.count();
+}
+
+// --------------------------------------------------------
+// Runs both binning methods and compares their results
+// (leaves the brute force results behind)
+//
+// Returns true if BinLights() kept every light the exact froxel
+// test found, and every extra light it kept touches the cluster's
+// box. A cluster BinLights() filled up dropped lights in its own
+// way, so it only has to pass the second part.
+// --------------------------------------------------------
+bool ClusteredLighting::VerifyAgainstBruteForce(const Light* lights, unsigned int pointLightCount, unsigned int spotLightCount, XMFLOAT4X4 view)
+{
+	BinLights(lights, pointLightCount, spotLightCount, view);
+	std::vector<LightCluster> fastClusters = clusters;
+	std::vector<unsigned int> fastIndices = lightIndices;
+
+	BinLightsBruteForce(lights, pointLightCount, spotLightCount, view);
+
+	// Both add lights in index order, so the two lists
+	// can be walked together like a merge
+	for (size_t c = 0; c < clusters.size(); c++)
+	{
+		const LightCluster& fast = fastClusters[c];
+		const LightCluster& exact = clusters[c];
+		unsigned int fastCount = fast.pointCount + fast.spotCount;
+		unsigned int exactCount = exact.pointCount + exact.spotCount;
+
+		unsigned int found = 0;
+		for (unsigned int i = 0; i < fastCount; i++)
+		{
+			unsigned int light = fastIndices[fast.offset + i];
+			if (!TestCluster(viewLights[light], (unsigned int)c))
+				return false;
+			if (found < exactCount && lightIndices[exact.offset + found] == light)
+				found++;
+		}
+		if (fastCount < maxLightsPerCluster && found != exactCount)
+			return false;
+	}
+	return true;
+}
+
+const std::vector<LightCluster>& ClusteredLighting::GetClusters()
+{
+	return clusters;
+}
+
+const std::vector<unsigned int>& ClusteredLighting::GetLightIndices()
+{
+	return lightIndices;
+}
+
+unsigned int ClusteredLighting::GetClusterCountX()
+{
+	return clusterCountX;
+}
+
+unsigned int ClusteredLighting::GetClusterCountY()
+{
+	return clusterCountY;
+}
+
+unsigned int ClusteredLighting::GetClusterCountZ()
+{
+	return clusterCountZ;
+}
+
+float ClusteredLighting::GetSliceScale()
+{
+	return sliceScale;
+}
+
+float ClusteredLighting::GetSliceBias()
+{
+	return sliceBias;
+}
+
+double ClusteredLighting::GetLastBinTimeMs()
+{
+	return lastBinTimeMs;
+}
+
+unsigned int ClusteredLighting::GetOverflowCount()
+{
+	return overflowCount;
+}
+
+unsigned int ClusteredLighting::GetLastTestCount()
+{
+	return lastTestCount;
+}
+
+// --------------------------------------------------------
+// Moves every light into view space and works out the
+// (conservative) range of clusters it could overlap
+// --------------------------------------------------------
+void ClusteredLighting::PrepareViewLights(const Light* lights, unsigned int pointLightCount, unsigned int spotLightCount, XMFLOAT4X4 view)
+{
+	XMMATRIX viewMatrix = XMLoadFloat4x4(&view);
+	unsigned int lightCount = pointLightCount + spotLightCount;
+	viewLights.resize(lightCount);
+
+	for (unsigned int i = 0; i < lightCount; i++)
+	{
+		ViewLight& vl = viewLights[i];
+		XMStoreFloat3(&vl.center, XMVector3TransformCoord(XMLoadFloat3(&lights[i].Position), viewMatrix));
+		XMStoreFloat3(&vl.direction, XMVector3Normalize(XMVector3TransformNormal(XMLoadFloat3(&lights[i].Direction), viewMatrix)));
+		vl.radius = lights[i].Range;
+		vl.isSpot = i >= pointLightCount;
+
+		// Turn the falloff exponent into the angle where the light becomes negligible
+		vl.cosAngle = powf(SPOT_CUTOFF_INTENSITY, 1.0f / std::max(lights[i].SpotFalloff, 0.0001f));
+		vl.sinAngle = sqrtf(std::max(1.0f - vl.cosAngle * vl.cosAngle, 0.0f));
+
+		// Depth range, clamped to the frustum
+		float zLo = std::max(vl.center.z - vl.radius, nearClip) * (1.0f - CLUSTER_RANGE_EPSILON);
+		float zHi = std::min(vl.center.z + vl.radius, farClip) * (1.0f + CLUSTER_RANGE_EPSILON);
+
+		// Entirely in front of or behind the frustum
+		if (vl.center.z + vl.radius < nearClip || vl.center.z - vl.radius > farClip)
+		{
+			vl.minX = vl.minY = vl.minZ = 1;
+			vl.maxX = vl.maxY = vl.maxZ = 0;
+			continue;
+		}
+		vl.minZ = GetSlice(zLo);
+		vl.maxZ = GetSlice(zHi);
+
+		// Project the corners of the light's view space box. x / z over
+		// a box (with z > 0) is always most extreme at a corner
+		float xs[2] = { vl.center.x - vl.radius, vl.center.x + vl.radius };
+		float ys[2] = { vl.center.y - vl.radius, vl.center.y + vl.radius };
+		float zs[2] = { zLo, zHi };
+		float ndcMinX = FLT_MAX, ndcMaxX = -FLT_MAX;
+		float ndcMinY = FLT_MAX, ndcMaxY = -FLT_MAX;
+		for (int a = 0; a < 2; a++)
+		{
+			for (int b = 0; b < 2; b++)
+			{
+				float ndcX = xs[a] * projScaleX / zs[b];
+				float ndcY = ys[a] * projScaleY / zs[b];
+				ndcMinX = std::min(ndcMinX, ndcX);
+				ndcMaxX = std::max(ndcMaxX, ndcX);
+				ndcMinY = std::min(ndcMinY, ndcY);
+				ndcMaxY = std::max(ndcMaxY, ndcY);
+			}
+		}
+
+		// Off to the side of the frustum
+		if (ndcMaxX < -1 || ndcMinX > 1 || ndcMaxY < -1 || ndcMinY > 1)
+		{
+			vl.minX = vl.minY = vl.minZ = 1;
+			vl.maxX = vl.maxY = vl.maxZ = 0;
+			continue;
+		}
+
+		// Convert to tiles (rows count down from the top of the screen)
+		float tileMinX = (ndcMinX - CLUSTER_RANGE_EPSILON + 1.0f) * 0.5f * clusterCountX;
+		float tileMaxX = (ndcMaxX + CLUSTER_RANGE_EPSILON + 1.0f) * 0.5f * clusterCountX;
+		float tileMinY = (1.0f - ndcMaxY - CLUSTER_RANGE_EPSILON) * 0.5f * clusterCountY;
+		float tileMaxY = (1.0f - ndcMinY + CLUSTER_RANGE_EPSILON) * 0.5f * clusterCountY;
+		vl.minX = (unsigned int)std::max(0.0f, std::min(tileMinX, clusterCountX - 1.0f));
+		vl.maxX = (unsigned int)std::max(0.0f, std::min(tileMaxX, clusterCountX - 1.0f));
+		vl.minY = (unsigned int)std::max(0.0f, std::min(tileMinY, clusterCountY - 1.0f));
+		vl.maxY = (unsigned int)std::max(0.0f, std::min(tileMaxY, clusterCountY - 1.0f));
+	}
+}
+
+// --------------------------------------------------------
+// Bins every light into the clusters of a range of depth slices.
+// Sphere tests run on four neighbouring clusters at once; spot lights
+// that pass then get a scalar cone test.
+//
+// firstSlice / lastSlice - The slices to process, [first, last)
+// pointLightCount - Lights before this index are point lights
+//
+// Returns the number of light/cluster sphere tests performed
+// --------------------------------------------------------
+unsigned int ClusteredLighting::BinSlices(unsigned int firstSlice, unsigned int lastSlice, unsigned int pointLightCount)
+{
+	unsigned int sliceSize = clusterCountX * clusterCountY;
+	unsigned int firstCluster = firstSlice * sliceSize;
+	unsigned int lastCluster = lastSlice * sliceSize;
+	unsigned int tests = 0;
+
+	std::fill(scratchCounts.begin() + firstCluster, scratchCounts.begin() + lastCluster, 0);
+	std::fill(scratchRejected.begin() + firstCluster, scratchRejected.begin() + lastCluster, 0);
+
+	XMVECTOR zero = XMVectorZero();
+	for (unsigned int i = 0; i < viewLights.size(); i++)
+	{
+		// All point lights are done, so remember how many each cluster got
+		if (i == pointLightCount)
+			std::copy(scratchCounts.begin() + firstCluster, scratchCounts.begin() + lastCluster, scratchPointCounts.begin() + firstCluster);
+
+		const ViewLight& light = viewLights[i];
+		unsigned int minZ = std::max(light.minZ, firstSlice);
+		unsigned int maxZ = std::min(light.maxZ + 1, lastSlice);
+		if (minZ >= maxZ || light.minX > light.maxX || light.minY > light.maxY)
+			continue;
+
+		XMVECTOR cx = XMVectorReplicate(light.center.x);
+		XMVECTOR cy = XMVectorReplicate(light.center.y);
+		XMVECTOR cz = XMVectorReplicate(light.center.z);
+		XMVECTOR radiusSq = XMVectorReplicate(light.radius * light.radius);
+
+		for (unsigned int z = minZ; z < maxZ; z++)
+		{
+			for (unsigned int y = light.minY; y <= light.maxY; y++)
+			{
+				unsigned int row = y * clusterCountX + z * sliceSize;
+				for (unsigned int x = light.minX; x <= light.maxX; x += 4)
+				{
+					unsigned int c = row + x;
+
+					// Distance from the sphere center to each box, per axis
+					XMVECTOR dx = XMVectorAdd(
+						XMVectorMax(XMVectorSubtract(XMLoadFloat4((const XMFLOAT4*)&boundsMinX[c]), cx), zero),
+						XMVectorMax(XMVectorSubtract(cx, XMLoadFloat4((const XMFLOAT4*)&boundsMaxX[c])), zero));
+					XMVECTOR dy = XMVectorAdd(
+						XMVectorMax(XMVectorSubtract(XMLoadFloat4((const XMFLOAT4*)&boundsMinY[c]), cy), zero),
+						XMVectorMax(XMVectorSubtract(cy, XMLoadFloat4((const XMFLOAT4*)&boundsMaxY[c])), zero));
+					XMVECTOR dz = XMVectorAdd(
+						XMVectorMax(XMVectorSubtract(XMLoadFloat4((const XMFLOAT4*)&boundsMinZ[c]), cz), zero),
+						XMVectorMax(XMVectorSubtract(cz, XMLoadFloat4((const XMFLOAT4*)&boundsMaxZ[c])), zero));
+					XMVECTOR distSq = XMVectorAdd(XMVectorAdd(XMVectorMultiply(dx, dx), XMVectorMultiply(dy, dy)), XMVectorMultiply(dz, dz));
+					int hits = _mm_movemask_ps(XMVectorLessOrEqual(distSq, radiusSq));
+					tests += 4;
+
+					// Ignore lanes past the end of this light's tile range
+					unsigned int lanes = std::min(4u, light.maxX - x + 1);
+					hits &= (1 << lanes) - 1;
+
+					for (unsigned int lane = 0; hits != 0; lane++, hits >>= 1)
+					{
+						if (!(hits & 1))
+							continue;
+						if (light.isSpot && !TestCluster(light, c + lane))
+							continue;
+						AddLightToCluster(c + lane, i);
+					}
+				}
+			}
+		}
+	}
+	if (pointLightCount == viewLights.size())
+		std::copy(scratchCounts.begin() + firstCluster, scratchCounts.begin() + lastCluster, scratchPointCounts.begin() + firstCluster);
+
+	return tests;
+}
+
+void ClusteredLighting::AddLightToCluster(unsigned int cluster, unsigned int lightIndex)
+{
+	unsigned int& count = scratchCounts[cluster];
+	if (count >= maxLightsPerCluster)
+	{
+		scratchRejected[cluster]++;
+		return;
+	}
+	scratchIndices[(size_t)cluster * maxLightsPerCluster + count] = lightIndex;
+	count++;
+}
+
+// --------------------------------------------------------
+// Packs each cluster's fixed capacity list into one tight
+// index list, recording where each cluster's lights start
+// --------------------------------------------------------
+void ClusteredLighting::CompactClusters()
+{
+	unsigned int total = 0;
+	for (size_t c = 0; c < clusters.size(); c++)
+		total += scratchCounts[c];
+	lightIndices.resize(total);
+
+	unsigned int offset = 0;
+	overflowCount = 0;
+	for (size_t c = 0; c < clusters.size(); c++)
+	{
+		unsigned int count = scratchCounts[c];
+		clusters[c].offset = offset;
+		clusters[c].pointCount = scratchPointCounts[c];
+		clusters[c].spotCount = count - scratchPointCounts[c];
+		clusters[c].padding = 0;
+		overflowCount += scratchRejected[c];
+
+		if (count > 0)
+			memcpy(&lightIndices[offset], &scratchIndices[c * maxLightsPerCluster], sizeof(unsigned int) * count);
+		offset += count;
+	}
+}
+
+// --------------------------------------------------------
+// Scalar light vs cluster test: sphere vs AABB, then for spot
+// lights, cone vs the cluster's bounding sphere
+// --------------------------------------------------------
+bool ClusteredLighting::TestCluster(const ViewLight& light, unsigned int c)
+{
+	// Same operations (and order) as the SIMD version so both agree exactly
+	float dx = std::max(boundsMinX[c] - light.center.x, 0.0f) + std::max(light.center.x - boundsMaxX[c], 0.0f);
+	float dy = std::max(boundsMinY[c] - light.center.y, 0.0f) + std::max(light.center.y - boundsMaxY[c], 0.0f);
+	float dz = std::max(boundsMinZ[c] - light.center.z, 0.0f) + std::max(light.center.z - boundsMaxZ[c], 0.0f);
+	if ((dx * dx + dy * dy) + dz * dz > light.radius * light.radius)
+		return false;
+
+	if (!light.isSpot)
+		return true;
+
+	// Cone test against the box's bounding sphere
+	XMVECTOR boxMin = XMVectorSet(boundsMinX[c], boundsMinY[c], boundsMinZ[c], 0);
+	XMVECTOR boxMax = XMVectorSet(boundsMaxX[c], boundsMaxY[c], boundsMaxZ[c], 0);
+	XMVECTOR sphereCenter = XMVectorScale(XMVectorAdd(boxMin, boxMax), 0.5f);
+	float sphereRadius = XMVectorGetX(XMVector3Length(XMVectorSubtract(boxMax, boxMin))) * 0.5f;
+	return ConeReachesSphere(light, sphereCenter, sphereRadius);
+}
+
+// --------------------------------------------------------
+// Exact light vs froxel test for BinLightsBruteForce(): the
+// light's sphere against the eight cornered slice of the frustum,
+// then for spot lights, the cone against a sphere around it
+// --------------------------------------------------------
+bool ClusteredLighting::TestFroxel(const ViewLight& light, unsigned int c)
+{
+	// A sphere that misses the box misses the froxel inside it too
+	float dx = std::max(boundsMinX[c] - light.center.x, 0.0f) + std::max(light.center.x - boundsMaxX[c], 0.0f);
+	float dy = std::max(boundsMinY[c] - light.center.y, 0.0f) + std::max(light.center.y - boundsMaxY[c], 0.0f);
+	float dz = std::max(boundsMinZ[c] - light.center.z, 0.0f) + std::max(light.center.z - boundsMaxZ[c], 0.0f);
+	if ((dx * dx + dy * dy) + dz * dz > light.radius * light.radius)
+		return false;
+
+	// Corners worked out the same way UpdateClusterBounds() does, so they
+	// land exactly on the box. Bit 0 of the index is right, bit 1 top, bit 2 far.
+	unsigned int x = c % clusterCountX;
+	unsigned int y = (c / clusterCountX) % clusterCountY;
+	float ndcX[2] = { -1.0f + 2.0f * x / clusterCountX, -1.0f + 2.0f * (x + 1) / clusterCountX };
+	float ndcY[2] = { 1.0f - 2.0f * (y + 1) / clusterCountY, 1.0f - 2.0f * y / clusterCountY };
+	float depth[2] = { boundsMinZ[c], boundsMaxZ[c] };
+	XMVECTOR corners[8];
+	for (unsigned int i = 0; i < 8; i++)
+	{
+		float z = depth[i >> 2];
+		corners[i] = XMVectorSet(ndcX[i & 1] * z / projScaleX, ndcY[(i >> 1) & 1] * z / projScaleY, z, 0);
+	}
+
+	XMVECTOR center = XMLoadFloat3(&light.center);
+	if (FroxelDistanceSq(corners, center) > light.radius * light.radius)
+		return false;
+
+	if (!light.isSpot)
+		return true;
+
+	// Centered on the box like TestCluster()'s sphere, but only reaching
+	// the froxel's farthest corner, so it's never the bigger of the two
+	XMVECTOR sphereCenter = XMVectorScale(XMVectorAdd(
+		XMVectorSet(boundsMinX[c], boundsMinY[c], boundsMinZ[c], 0),
+		XMVectorSet(boundsMaxX[c], boundsMaxY[c], boundsMaxZ[c], 0)), 0.5f);
+	float sphereRadiusSq = 0;
+	for (unsigned int i = 0; i < 8; i++)
+		sphereRadiusSq = std::max(sphereRadiusSq, XMVectorGetX(XMVector3LengthSq(XMVectorSubtract(corners[i], sphereCenter))));
+	return ConeReachesSphere(light, sphereCenter, sqrtf(sphereRadiusSq));
+}
+
+// --------------------------------------------------------
+// Could any of a spot light's cone (out to its range) reach
+// inside the sphere? Bigger spheres never make it say no.
+// --------------------------------------------------------
+bool ClusteredLighting::ConeReachesSphere(const ViewLight& light, FXMVECTOR sphereCenter, float sphereRadius)
+{
+	XMVECTOR v = XMVectorSubtract(sphereCenter, XMLoadFloat3(&light.center));
+	float lengthSq = XMVectorGetX(XMVector3Dot(v, v));
+	float v1Length = XMVectorGetX(XMVector3Dot(v, XMLoadFloat3(&light.direction)));
+	float distanceClosest = light.cosAngle * sqrtf(std::max(lengthSq - v1Length * v1Length, 0.0f)) - v1Length * light.sinAngle;
+
+	bool angleCull = distanceClosest > sphereRadius;
+	bool frontCull = v1Length > sphereRadius + light.radius;
+	bool backCull = v1Length < -sphereRadius;
+	return !(angleCull || frontCull || backCull);
+}
+
+// --------------------------------------------------------
+// Squared distance from a point to a froxel (0 inside it). Outside,
+// the nearest point is on one of the six faces, so it's the nearest
+// of the point's distances to each face.
+// --------------------------------------------------------
+float ClusteredLighting::FroxelDistanceSq(const XMVECTOR corners[8], FXMVECTOR point)
+{
+	// Each face's corners in order around it
+	static const unsigned int faces[6][4] =
+	{
+		{ 0, 1, 3, 2 }, // Near
+		{ 4, 6, 7, 5 }, // Far
+		{ 0, 2, 6, 4 }, // Left
+		{ 1, 5, 7, 3 }, // Right
+		{ 0, 4, 5, 1 }, // Bottom
+		{ 2, 3, 7, 6 }  // Top
+	};
+
+	XMVECTOR middle = XMVectorZero();
+	for (unsigned int i = 0; i < 8; i++)
+		middle = XMVectorAdd(middle, corners[i]);
+	middle = XMVectorScale(middle, 1.0f / 8);
+
+	bool inside = true;
+	float nearestSq = FLT_MAX;
+	for (unsigned int f = 0; f < 6; f++)
+	{
+		XMVECTOR quad[4];
+		for (unsigned int i = 0; i < 4; i++)
+			quad[i] = corners[faces[f][i]];
+
+		// Facing out of the froxel, whichever way round the corners go
+		XMVECTOR normal = XMVector3Normalize(XMVector3Cross(
+			XMVectorSubtract(quad[1], quad[0]),
+			XMVectorSubtract(quad[3], quad[0])));
+		if (XMVectorGetX(XMVector3Dot(normal, XMVectorSubtract(middle, quad[0]))) > 0)
+			normal = XMVectorNegate(normal);
+
+		float planeDistance = XMVectorGetX(XMVector3Dot(normal, XMVectorSubtract(point, quad[0])));
+		inside = inside && planeDistance <= 0;
+
+		// Nearest point on the face: straight onto the plane if that lands
+		// inside the quad (on the same side of all four edges), otherwise
+		// somewhere on an edge
+		XMVECTOR onPlane = XMVectorSubtract(point, XMVectorScale(normal, planeDistance));
+		bool leftOfEdges = true;
+		bool rightOfEdges = true;
+		float edgeNearestSq = FLT_MAX;
+		for (unsigned int i = 0; i < 4; i++)
+		{
+			XMVECTOR a = quad[i];
+			XMVECTOR edge = XMVectorSubtract(quad[(i + 1) % 4], a);
+			float side = XMVectorGetX(XMVector3Dot(XMVector3Cross(edge, XMVectorSubtract(onPlane, a)), normal));
+			leftOfEdges = leftOfEdges && side >= 0;
+			rightOfEdges = rightOfEdges && side <= 0;
+
+			float t = XMVectorGetX(XMVector3Dot(XMVectorSubtract(point, a), edge)) / XMVectorGetX(XMVector3Dot(edge, edge));
+			XMVECTOR nearest = XMVectorAdd(a, XMVectorScale(edge, std::max(0.0f, std::min(t, 1.0f))));
+			edgeNearestSq = std::min(edgeNearestSq, XMVectorGetX(XMVector3LengthSq(XMVectorSubtract(point, nearest))));
+		}
+		nearestSq = std::min(nearestSq, leftOfEdges || rightOfEdges ? planeDistance * planeDistance : edgeNearestSq);
+	}
+	return inside ? 0.0f : nearestSq;
+}
+
+unsigned int ClusteredLighting::GetSlice(float viewDepth)
+{
+	float slice = logf(viewDepth) * sliceScale + sliceBias;
+	return (unsigned int)std::max(0.0f, std::min(slice, clusterCountZ - 1.0f));
+}
\ No newline at end of file
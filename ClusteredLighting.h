@@ -0,0 +1,119 @@
+#pragma once
+#include <DirectXMath.h>
+#include <vector>
+#include "Lights.h"
+#include "BufferStructs.h"
+
+// Splits the view frustum into a grid of clusters (froxels) and bins
+// point and spot lights into them on the CPU. The pixel shader then only
+// evaluates the lights in its own cluster, which lets the scene hold
+// thousands of lights instead of the 20 that fit in a constant buffer.
+//
+// Clusters are evenly sized tiles on screen and exponentially sized
+// slices in view space depth. Index = x + y * countX + z * countX * countY,
+// with tile row 0 at the top of the screen.
+class ClusteredLighting
+{
+public:
+	ClusteredLighting(
+		unsigned int clusterCountX = 16,
+		unsigned int clusterCountY = 9,
+		unsigned int clusterCountZ = 24,
+		unsigned int maxLightsPerCluster = 128);
+
+	// Rebuilds the view space bounds of every cluster (perspective only)
+	// Call whenever the projection changes
+	void UpdateClusterBounds(DirectX::XMFLOAT4X4 projection, float nearClip, float farClip);
+
+	// Bins lights into clusters using SIMD tests spread across threads
+	// lights - point lights followed by spot lights (see PartitionLights())
+	void BinLights(const Light* lights, unsigned int pointLightCount, unsigned int spotLightCount, DirectX::XMFLOAT4X4 view);
+
+	// Tests every light against every cluster's froxel (not the looser box
+	// BinLights() tests) one at a time, for verification
+	void BinLightsBruteForce(const Light* lights, unsigned int pointLightCount, unsigned int spotLightCount, DirectX::XMFLOAT4X4 view);
+
+	// Bins with both methods and checks that BinLights() kept every light
+	// the exact test found, and nothing that misses the cluster's box
+	bool VerifyAgainstBruteForce(const Light* lights, unsigned int pointLightCount, unsigned int spotLightCount, DirectX::XMFLOAT4X4 view);
+
+	// Makes room for binning this many lights, so the index list never
+	// grows because the camera turned to see more of them. Call when the
+	// light count changes, outside any ZERO_ALLOCATIONS scope.
+	void Reserve(unsigned int lightCount);
+
+	// Results of the last binning
+	const std::vector<LightCluster>& GetClusters();
+	const std::vector<unsigned int>& GetLightIndices();
+
+	// Values the pixel shader needs to find its cluster
+	unsigned int GetClusterCountX();
+	unsigned int GetClusterCountY();
+	unsigned int GetClusterCountZ();
+	float GetSliceScale();
+	float GetSliceBias();
+
+	// Stats
+	double GetLastBinTimeMs();
+	unsigned int GetOverflowCount();  // Light/cluster pairs dropped because the cluster was full
+	unsigned int GetLastTestCount();
+
+private:
+	// A light's bounding sphere (and cone, for spots) in view space,
+	// plus the range of clusters it could possibly touch
+	struct ViewLight
+	{
+		DirectX::XMFLOAT3 center;
+		float radius;
+		DirectX::XMFLOAT3 direction;
+		float cosAngle;
+		float sinAngle;
+		bool isSpot;
+		unsigned int minX, maxX;
+		unsigned int minY, maxY;
+		unsigned int minZ, maxZ;
+	};
+
+	unsigned int clusterCountX;
+	unsigned int clusterCountY;
+	unsigned int clusterCountZ;
+	unsigned int maxLightsPerCluster;
+	float nearClip;
+	float farClip;
+	float sliceScale;
+	float sliceBias;
+	float projScaleX;
+	float projScaleY;
+
+	// Cluster bounds in view space, structure of arrays so four
+	// neighbouring clusters can be loaded into one SIMD register.
+	// Four inverted boxes follow the last cluster for loads that
+	// start near the end.
+	std::vector<float> boundsMinX, boundsMinY, boundsMinZ;
+	std::vector<float> boundsMaxX, boundsMaxY, boundsMaxZ;
+
+	// Scratch space: fixed capacity light list per cluster
+	std::vector<unsigned int> scratchCounts;
+	std::vector<unsigned int> scratchPointCounts;
+	std::vector<unsigned int> scratchRejected;
+	std::vector<unsigned int> scratchIndices;
+	std::vector<ViewLight> viewLights;
+
+	// Final, compacted results
+	std::vector<LightCluster> clusters;
+	std::vector<unsigned int> lightIndices;
+
+	double lastBinTimeMs;
+	unsigned int overflowCount;
+	unsigned int lastTestCount;
+
+	void PrepareViewLights(const Light* lights, unsigned int pointLightCount, unsigned int spotLightCount, DirectX::XMFLOAT4X4 view);
+	unsigned int BinSlices(unsigned int firstSlice, unsigned int lastSlice, unsigned int pointLightCount);
+	void AddLightToCluster(unsigned int cluster, unsigned int lightIndex);
+	void CompactClusters();
+	bool TestCluster(const ViewLight& light, unsigned int cluster);
+	bool TestFroxel(const ViewLight& light, unsigned int cluster);
+	static bool ConeReachesSphere(const ViewLight& light, DirectX::FXMVECTOR sphereCenter, float sphereRadius);
+	static float FroxelDistanceSq(const DirectX::XMVECTOR corners[8], DirectX::FXMVECTOR point);
+	unsigned int GetSlice(float viewDepth);
+};
\ No newline at end of file
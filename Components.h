@@ -0,0 +1,55 @@
+#pragma once
+#include <DirectXMath.h>
+#include "TransformSystem.h"
+#include "ResourceRegistry.h"
+
+// Component types stored in an EntityWorld. Meshes and materials are
+// owned by the ResourceRegistry, so these only keep handles and the
+// draw loop doesn't pay for shared_ptr reference counting.
+
+// Where the entity is (matrices and bounds live in the TransformSystem)
+struct TransformComponent
+{
+	TransformHandle handle;
+};
+
+struct MeshComponent
+{
+	MeshHandle mesh;
+};
+
+// Material index and pipeline are copied out of the material when
+// spawning so drawing doesn't have to touch the material at all
+struct MaterialComponent
+{
+	MaterialHandle material;
+	ID3D12PipelineState* pipelineState;
+	unsigned int materialIndex;
+};
+
+// World space bounding sphere (xyz = center, w = radius), kept next to
+// the other render data so culling and light selection read it linearly
+struct BoundsComponent
+{
+	DirectX::XMFLOAT4 sphere;
+};
+
+// Entity also hides what's behind it, using this OcclusionCulling shape
+struct OccluderComponent
+{
+	unsigned int shape;
+};
+
+#define ENTITY_FLAG_VISIBLE 0x1
+#define ENTITY_FLAG_SPINNING 0x2
+
+// Render layers, which have their own contribution culling thresholds
+#define RENDER_LAYER_WORLD 0
+#define RENDER_LAYER_PROPS 1
+#define RENDER_LAYER_DETAIL 2
+
+struct FlagsComponent
+{
+	unsigned int flags;
+	unsigned int layer;
+};
\ No newline at end of file
@@ -0,0 +1,330 @@
+#include "ContributionCulling.h"
+#include <algorithm>
+#include <cfloat>
+#include <chrono>
+#include <cmath>
+
+using namespace DirectX;
+
+ContributionCulling::ContributionCulling() :
+	groupCellSize(0),
+	testedCount(0),
+	standInCount(0),
+	lastCullTimeMs(0)
+{
+	for (unsigned int layer = 0; layer < MAX_RENDER_LAYERS; layer++)
+	{
+		thresholds[layer] = 0;
+		droppedCount[layer] = 0;
+	}
+}
+
+void ContributionCulling::SetThreshold(unsigned int layer, float pixelArea)
+{
+	thresholds[std::min(layer, MAX_RENDER_LAYERS - 1u)] = std::max(pixelArea, 0.0f);
+}
+
+float ContributionCulling::GetThreshold(unsigned int layer)
+{
+	return thresholds[std::min(layer, MAX_RENDER_LAYERS - 1u)];
+}
+
+void ContributionCulling::SetGroupCellSize(float cellSize)
+{
+	groupCellSize = std::max(cellSize, 0.0f);
+}
+
+float ContributionCulling::GetGroupCellSize()
+{
+	return groupCellSize;
+}
+
+// Stand ins only ever replace dropped candidates, so the visible
+// list can't outgrow the candidates either
+void ContributionCulling::Reserve(unsigned int objectCount)
+{
+	visible.reserve(objectCount);
+	dropped.reserve(objectCount);
+}
+
+// --------------------------------------------------------
+// Keeps the candidates that cover at least their layer's threshold
+// in pixels, four at a time
+//
+// An object's projected radius is radius * pixelScale / w, where w is
+// its clip space w (the view space depth), so comparing
+// pi * (radius * pixelScale)^2 against threshold * w^2 tests the area
+// without a divide. Spheres the camera is inside (or nearly) are kept.
+// --------------------------------------------------------
+void ContributionCulling::Cull(
+	XMFLOAT4X4 viewProjection,
+	XMFLOAT4X4 projection,
+	float viewportHeight,
+	const XMFLOAT4* spheres,
+	const unsigned int* layers,
+	const unsigned int* candidates,
+	unsigned int candidateCount)
+{
+	std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+
+	float pixelScale = projection._22 * viewportHeight * 0.5f;
+	XMVECTOR wX = XMVectorReplicate(viewProjection._14);
+	XMVECTOR wY = XMVectorReplicate(viewProjection._24);
+	XMVECTOR wZ = XMVectorReplicate(viewProjection._34);
+	XMVECTOR wW = XMVectorReplicate(viewProjection._44);
+	XMVECTOR areaScale = XMVectorReplicate(XM_PI * pixelScale * pixelScale);
+
+	visible.resize(candidateCount);
+	dropped.resize(candidateCount);
+	unsigned int visibleCount = 0;
+	unsigned int droppedTotal = 0;
+	for (unsigned int i = 0; i < candidateCount; i += 4)
+	{
+		// Gather four candidates (repeating the last one if we run out)
+		unsigned int index[4];
+		for (unsigned int lane = 0; lane < 4; lane++)
+			index[lane] = candidates[std::min(i + lane, candidateCount - 1)];
+
+		XMMATRIX group = XMMatrixTranspose(XMMATRIX(
+			XMLoadFloat4(&spheres[index[0]]),
+			XMLoadFloat4(&spheres[index[1]]),
+			XMLoadFloat4(&spheres[index[2]]),
+			XMLoadFloat4(&spheres[index[3]])));
+		XMVECTOR threshold = XMVectorSet(
+			GetThreshold(layers[index[0]]),
+			GetThreshold(layers[index[1]]),
+			GetThreshold(layers[index[2]]),
+			GetThreshold(layers[index[3]]));
+
+		XMVECTOR w = XMVectorAdd(
+			XMVectorMultiplyAdd(group.r[0], wX,
+			XMVectorMultiplyAdd(group.r[1], wY,
+			XMVectorMultiply(group.r[2], wZ))),
+			wW);
+		XMVECTOR radius = group.r[3];
+		XMVECTOR keep = XMVectorOrInt(
+			XMVectorLessOrEqual(w, radius),
+			XMVectorGreaterOrEqual(
+				XMVectorMultiply(XMVectorMultiply(radius, radius), areaScale),
+				XMVectorMultiply(threshold, XMVectorMultiply(w, w))));
+		int kept = _mm_movemask_ps(keep);
+
+		if (i + 4 <= candidateCount)
+		{
+			// Write each index to both lists and only advance the one it
+			// belongs in, so splitting kept from dropped costs no branches
+			for (unsigned int lane = 0; lane < 4; lane++)
+			{
+				unsigned int laneKept = (kept >> lane) & 1;
+				visible[visibleCount] = index[lane];
+				dropped[droppedTotal] = index[lane];
+				visibleCount += laneKept;
+				droppedTotal += laneKept ^ 1;
+			}
+		}
+		else
+		{
+			for (unsigned int lane = 0; i + lane < candidateCount; lane++)
+			{
+				if (kept & (1 << lane))
+					visible[visibleCount++] = index[lane];
+				else
+					dropped[droppedTotal++] = index[lane];
+			}
+		}
+	}
+	visible.resize(visibleCount);
+	dropped.resize(droppedTotal);
+
+	FinishCull(viewProjection, pixelScale, spheres, layers, candidateCount);
+
+	std::chrono::duration<double, std::milli> elapsed = std::chrono::high_resolution_clock::now() - start;
+	lastCullTimeMs = elapsed.count();
+}
+
+// --------------------------------------------------------
+// Reference for Cull(): the same keep test written out as one
+// scalar expression per sphere
+// --------------------------------------------------------
+void ContributionCulling::CullBruteForce(
+	XMFLOAT4X4 viewProjection,
+	XMFLOAT4X4 projection,
+	float viewportHeight,
+	const XMFLOAT4* spheres,
+	const unsigned int* layers,
+	const unsigned int* candidates,
+	unsigned int candidateCount)
+{
+	std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+
+	float pixelScale = projection._22 * viewportHeight * 0.5f;
+	float areaScale = XM_PI * pixelScale * pixelScale;
+
+	visible.clear();
+	dropped.clear();
+	for (unsigned int i = 0; i < candidateCount; i++)
+	{
+		// Same order of operations as the SIMD version
+		const XMFLOAT4& sphere = spheres[candidates[i]];
+		float w = (sphere.x * viewProjection._14 + (sphere.y * viewProjection._24 + sphere.z * viewProjection._34)) + viewProjection._44;
+		float threshold = GetThreshold(layers[candidates[i]]);
+		bool keep = w <= sphere.w || (sphere.w * sphere.w) * areaScale >= threshold * (w * w);
+
+		if (keep)
+			visible.push_back(candidates[i]);
+		else
+			dropped.push_back(candidates[i]);
+	}
+
+	FinishCull(viewProjection, pixelScale, spheres, layers, candidateCount);
+
+	std::chrono::duration<double, std::milli> elapsed = std::chrono::high_resolution_clock::now() - start;
+	lastCullTimeMs = elapsed.count();
+}
+
+// --------------------------------------------------------
+// Runs both versions and compares their visible lists
+// (leaves the brute force results and timing behind)
+// --------------------------------------------------------
+bool ContributionCulling::VerifyAgainstBruteForce(
+	XMFLOAT4X4 viewProjection,
+	XMFLOAT4X4 projection,
+	float viewportHeight,
+	const XMFLOAT4* spheres,
+	const unsigned int* layers,
+	const unsigned int* candidates,
+	unsigned int candidateCount)
+{
+	Cull(viewProjection, projection, viewportHeight, spheres, layers, candidates, candidateCount);
+	std::vector<unsigned int> fast = visible;
+	CullBruteForce(viewProjection, projection, viewportHeight, spheres, layers, candidates, candidateCount);
+	return fast == visible;
+}
+
+const std::vector<unsigned int>& ContributionCulling::GetVisible()
+{
+	return visible;
+}
+
+unsigned int ContributionCulling::GetTestedCount()
+{
+	return testedCount;
+}
+
+unsigned int ContributionCulling::GetVisibleCount()
+{
+	return (unsigned int)visible.size();
+}
+
+// Objects that aren't drawn (stand ins count as drawn)
+unsigned int ContributionCulling::GetDroppedCount()
+{
+	unsigned int total = 0;
+	for (unsigned int layer = 0; layer < MAX_RENDER_LAYERS; layer++)
+		total += droppedCount[layer];
+	return total;
+}
+
+unsigned int ContributionCulling::GetDroppedCount(unsigned int layer)
+{
+	return droppedCount[std::min(layer, MAX_RENDER_LAYERS - 1u)];
+}
+
+unsigned int ContributionCulling::GetStandInCount()
+{
+	return standInCount;
+}
+
+double ContributionCulling::GetLastCullTimeMs()
+{
+	return lastCullTimeMs;
+}
+
+// --------------------------------------------------------
+// Area a sphere covers on screen in pixels, or FLT_MAX
+// if the camera is inside it
+// --------------------------------------------------------
+float ContributionCulling::GetPixelArea(XMFLOAT4X4 viewProjection, float pixelScale, XMFLOAT4 sphere)
+{
+	float w = (sphere.x * viewProjection._14 + (sphere.y * viewProjection._24 + sphere.z * viewProjection._34)) + viewProjection._44;
+	if (w <= sphere.w)
+		return FLT_MAX;
+
+	float pixelRadius = sphere.w * pixelScale / w;
+	return XM_PI * pixelRadius * pixelRadius;
+}
+
+// --------------------------------------------------------
+// Shared by both versions: counts what was dropped on each layer,
+// then picks stand ins for groups of dropped objects that are big
+// enough together
+// --------------------------------------------------------
+void ContributionCulling::FinishCull(
+	XMFLOAT4X4 viewProjection,
+	float pixelScale,
+	const XMFLOAT4* spheres,
+	const unsigned int* layers,
+	unsigned int candidateCount)
+{
+	testedCount = candidateCount;
+	standInCount = 0;
+	for (unsigned int layer = 0; layer < MAX_RENDER_LAYERS; layer++)
+		droppedCount[layer] = 0;
+	for (unsigned int index : dropped)
+		droppedCount[std::min(layers[index], MAX_RENDER_LAYERS - 1u)]++;
+
+	if (groupCellSize <= 0 || dropped.empty())
+		return;
+
+	// Key is 20 bits of each cell coordinate plus the layer, so groups
+	// never mix layers with different thresholds
+	groups.clear();
+	groups.reserve(dropped.size());
+	float cellScale = 1.0f / groupCellSize;
+	for (unsigned int index : dropped)
+	{
+		const XMFLOAT4& sphere = spheres[index];
+		unsigned int layer = std::min(layers[index], MAX_RENDER_LAYERS - 1u);
+		unsigned long long key =
+			((unsigned long long)((int)floorf(sphere.x * cellScale) & 0xFFFFF) << 43) |
+			((unsigned long long)((int)floorf(sphere.y * cellScale) & 0xFFFFF) << 23) |
+			((unsigned long long)((int)floorf(sphere.z * cellScale) & 0xFFFFF) << 3) |
+			layer;
+
+		float area = GetPixelArea(viewProjection, pixelScale, sphere);
+		std::unordered_map<unsigned long long, Group>::iterator found = groups.find(key);
+		if (found == groups.end())
+		{
+			Group group = { area, index, area };
+			groups[key] = group;
+		}
+		else
+		{
+			Group& group = found->second;
+			group.pixelArea += area;
+			if (area > group.standInArea)
+			{
+				group.standIn = index;
+				group.standInArea = area;
+			}
+		}
+	}
+
+	size_t keptCount = visible.size();
+	for (const std::pair<const unsigned long long, Group>& entry : groups)
+	{
+		const Group& group = entry.second;
+		unsigned int layer = std::min(layers[group.standIn], MAX_RENDER_LAYERS - 1u);
+		if (group.pixelArea < thresholds[layer])
+			continue;
+
+		visible.push_back(group.standIn);
+		droppedCount[layer]--;
+		standInCount++;
+	}
+
+	// Stand ins come out of the map in no particular order, so sort
+	// just them and merge them in
+	std::sort(visible.begin() + keptCount, visible.end());
+	std::inplace_merge(visible.begin(), visible.begin() + keptCount, visible.end());
+}
\ No newline at end of file
@@ -0,0 +1,116 @@
+#pragma once
+#include <DirectXMath.h>
+#include <unordered_map>
+#include <vector>
+
+// Layers with their own contribution thresholds (layer numbers past
+// the last one share its threshold)
+#define MAX_RENDER_LAYERS 8
+
+// --------------------------------------------------------
+// Drops objects that would cover too few pixels to be worth a draw.
+// Each bounding sphere is projected to find its area on screen, and
+// anything under its layer's threshold is left out.
+//
+// Dropped objects can optionally be grouped by world space cell: if a
+// group adds up to enough pixels, its biggest member is drawn to stand
+// in for the rest, so a distant crowd of props doesn't just vanish.
+//
+// Like FrustumCulling, spheres are tested four at a time with SSE and
+// the visible list stays in ascending order.
+// --------------------------------------------------------
+class ContributionCulling
+{
+public:
+	ContributionCulling();
+
+	// Objects on this layer covering fewer pixels than this are dropped
+	// (0, the default, keeps everything)
+	void SetThreshold(unsigned int layer, float pixelArea);
+	float GetThreshold(unsigned int layer);
+
+	// World space size of the cells dropped objects are grouped by
+	// (0, the default, turns grouping off)
+	void SetGroupCellSize(float cellSize);
+	float GetGroupCellSize();
+
+	// Makes room for this many candidates, so the lists never grow
+	// because the camera turned to see more. Call when the object count
+	// changes, outside any ZERO_ALLOCATIONS scope. (Grouping's map still
+	// allocates as it fills.)
+	void Reserve(unsigned int objectCount);
+
+	// viewProjection, projection - The camera's matrices
+	// viewportHeight - In pixels
+	// spheres - World space bounding spheres (xyz = center, w = radius)
+	// layers - Render layer of each sphere
+	// candidates - Which spheres to test (usually what frustum culling kept)
+	void Cull(
+		DirectX::XMFLOAT4X4 viewProjection,
+		DirectX::XMFLOAT4X4 projection,
+		float viewportHeight,
+		const DirectX::XMFLOAT4* spheres,
+		const unsigned int* layers,
+		const unsigned int* candidates,
+		unsigned int candidateCount);
+
+	// Tests one sphere at a time with scalar code, for verification
+	void CullBruteForce(
+		DirectX::XMFLOAT4X4 viewProjection,
+		DirectX::XMFLOAT4X4 projection,
+		float viewportHeight,
+		const DirectX::XMFLOAT4* spheres,
+		const unsigned int* layers,
+		const unsigned int* candidates,
+		unsigned int candidateCount);
+
+	// Culls with both methods and checks the visible lists are the same
+	bool VerifyAgainstBruteForce(
+		DirectX::XMFLOAT4X4 viewProjection,
+		DirectX::XMFLOAT4X4 projection,
+		float viewportHeight,
+		const DirectX::XMFLOAT4* spheres,
+		const unsigned int* layers,
+		const unsigned int* candidates,
+		unsigned int candidateCount);
+
+	// Indices of the spheres that are drawn (including stand ins), in ascending order
+	const std::vector<unsigned int>& GetVisible();
+
+	// Stats
+	unsigned int GetTestedCount();
+	unsigned int GetVisibleCount();
+	unsigned int GetDroppedCount();
+	unsigned int GetDroppedCount(unsigned int layer);
+	unsigned int GetStandInCount();
+	double GetLastCullTimeMs();
+
+private:
+	// Dropped objects in one cell of one layer
+	struct Group
+	{
+		float pixelArea;
+		unsigned int standIn;
+		float standInArea;
+	};
+
+	float thresholds[MAX_RENDER_LAYERS];
+	float groupCellSize;
+
+	std::vector<unsigned int> visible;
+	std::vector<unsigned int> dropped;
+	std::unordered_map<unsigned long long, Group> groups;
+
+	unsigned int testedCount;
+	unsigned int droppedCount[MAX_RENDER_LAYERS];
+	unsigned int standInCount;
+	double lastCullTimeMs;
+
+	float GetPixelArea(DirectX::XMFLOAT4X4 viewProjection, float pixelScale, DirectX::XMFLOAT4 sphere);
+	void FinishCull(
+		DirectX::XMFLOAT4X4 viewProjection,
+		float pixelScale,
+		const DirectX::XMFLOAT4* spheres,
+		const unsigned int* layers,
+		unsigned int candidateCount);
+};
\ No newline at end of file
@@ -2,6 +2,9 @@
 #include "WICTextureLoader.h"
 #include "ResourceUploadBatch.h"
 #include "PathHelpers.h"
+#include "Profiler.h"
+#include <atomic>
+#include <cstdio>
 using namespace DirectX;
 
 // Singleton requirement
@@ -9,6 +12,67 @@ DX12Helper* DX12Helper::instance;
 
 #define ASSET_PATH L"../../Assets/"
 
+// Marks GPU ranges that weren't timed, and ranges not ended yet
+#define NO_GPU_RANGE 0xFFFFFFFF
+
+// Private data slot holding each tracked object's GpuAllocationRecord
+// {6B1D4C2E-93A7-4F0B-8E52-1C7D0A94F3B6}
+static const GUID gpuAllocationRecordGuid =
+	{ 0x6b1d4c2e, 0x93a7, 0x4f0b, { 0x8e, 0x52, 0x1c, 0x7d, 0x0a, 0x94, 0xf3, 0xb6 } };
+
+// --------------------------------------------------------
+// Counts a GPU allocation for as long as it's alive. One is
+// attached to each tracked object as private data, which D3D
+// releases when the object is destroyed, however that happens.
+// --------------------------------------------------------
+class GpuAllocationRecord : public IUnknown
+{
+public:
+	GpuAllocationRecord(unsigned int heap, unsigned int category, unsigned long long bytes) :
+		refCount(1),
+		heap(heap),
+		category(category),
+		bytes(bytes)
+	{
+		MemoryTracker::AddGpuAllocation(heap, category, bytes);
+	}
+
+	HRESULT STDMETHODCALLTYPE QueryInterface(REFIID riid, void** object) override
+	{
+		if (riid != __uuidof(IUnknown))
+		{
+			*object = 0;
+			return E_NOINTERFACE;
+		}
+
+		*object = this;
+		AddRef();
+		return S_OK;
+	}
+
+	ULONG STDMETHODCALLTYPE AddRef() override
+	{
+		return ++refCount;
+	}
+
+	ULONG STDMETHODCALLTYPE Release() override
+	{
+		ULONG count = --refCount;
+		if (count == 0)
+		{
+			MemoryTracker::RemoveGpuAllocation(heap, category, bytes);
+			delete this;
+		}
+		return count;
+	}
+
+private:
+	std::atomic<ULONG> refCount;
+	unsigned int heap;
+	unsigned int category;
+	unsigned long long bytes;
+};
+
 DX12Helper::~DX12Helper()
 {
 }
@@ -34,7 +98,17 @@ void DX12Helper::Initialize(
 	waitFenceCounter = 0;
 
 	CreateConstantBufferUploadHeap();
+	CreateDynamicUploadHeap();
 	CreateCBVSRVDescriptorHeap();
+	CreateTimestampQueries();
+
+	// Past these a frame is overwriting data it's still using. The ring
+	// starting over once in a frame is fine, since the last frame is done.
+	renderCounters.SetBudget(RENDER_COUNTER_CBVS_CREATED, maxConstantBuffers);
+	renderCounters.SetBudget(RENDER_COUNTER_CB_BYTES_COPIED, cbUploadHeapSizeInBytes);
+	renderCounters.SetBudget(RENDER_COUNTER_CB_RING_WRAPS, 1);
+	renderCounters.SetBudget(RENDER_COUNTER_DYNAMIC_BYTES_COPIED, dynamicUploadHeapSizeInBytes);
+	renderCounters.SetBudget(RENDER_COUNTER_DYNAMIC_RING_WRAPS, 1);
 }
 
 // --------------------------------------------------------
@@ -44,6 +118,18 @@ void DX12Helper::Initialize(
 // --------------------------------------------------------
 void DX12Helper::CloseExecuteAndResetCommandList()
 {
+	PROFILE_FUNCTION();
+
+	// Copy out any GPU timestamps taken during this list
+	if (timestampCount > 0)
+	{
+		commandList->ResolveQueryData(
+			timestampQueryHeap.Get(),
+			D3D12_QUERY_TYPE_TIMESTAMP,
+			0, timestampCount,
+			timestampReadbackBuffer.Get(), 0);
+	}
+
 	// Close the current list and execute it as our only list
 	commandList->Close();
 	ID3D12CommandList* lists[] = { commandList.Get() };
@@ -55,6 +141,9 @@ void DX12Helper::CloseExecuteAndResetCommandList()
 	WaitForGPU();
 	commandAllocator->Reset();
 	commandList->Reset(commandAllocator.Get(), 0);
+
+	if (timestampCount > 0)
+		ReadGpuRanges();
 }
 
 // --------------------------------------------------------
@@ -63,22 +152,98 @@ void DX12Helper::CloseExecuteAndResetCommandList()
 // --------------------------------------------------------
 void DX12Helper::WaitForGPU()
 {
+	PROFILE_FUNCTION();
+
 	// Update our ongoing fence value (a unique index for each "stop sign")
 	// and then place that value into the GPU's command queue
-	waitFenceCounter++;
-	commandQueue->Signal(waitFence.Get(), waitFenceCounter);
+	UINT64 fenceValue = ++waitFenceCounter;
+	commandQueue->Signal(waitFence.Get(), fenceValue);
 
 	// Check to see if the most recently completed fence value
 	// is less than the one we just set.
-	if (waitFence->GetCompletedValue() < waitFenceCounter)
+	if (waitFence->GetCompletedValue() < fenceValue)
 	{
 		// Tell the fence to let us know when it's hit, and then
 		// sit an wait until that fence is hit.
-		waitFence->SetEventOnCompletion(waitFenceCounter, waitFenceEvent);
+		waitFence->SetEventOnCompletion(fenceValue, waitFenceEvent);
 		WaitForSingleObject(waitFenceEvent, INFINITE);
 	}
 }
 
+// --------------------------------------------------------
+// Puts a timestamp query at the start of a range. Ranges past
+// the limit (or while the Profiler isn't capturing) are skipped,
+// but still have to be ended.
+// --------------------------------------------------------
+void DX12Helper::BeginGpuRange(const char* name)
+{
+	if (!timestampQueryHeap || !Profiler::GetInstance().IsCapturing() || gpuRanges.size() == maxGpuRanges)
+	{
+		openGpuRanges.push_back(NO_GPU_RANGE);
+		return;
+	}
+
+	commandList->EndQuery(timestampQueryHeap.Get(), D3D12_QUERY_TYPE_TIMESTAMP, timestampCount);
+	GpuRange range = { name, timestampCount++, NO_GPU_RANGE };
+	openGpuRanges.push_back((unsigned int)gpuRanges.size());
+	gpuRanges.push_back(range);
+}
+
+// --------------------------------------------------------
+// Puts a timestamp query at the end of the innermost open range
+// --------------------------------------------------------
+void DX12Helper::EndGpuRange()
+{
+	if (openGpuRanges.empty())
+		return;
+
+	unsigned int rangeIndex = openGpuRanges.back();
+	openGpuRanges.pop_back();
+	if (rangeIndex == NO_GPU_RANGE)
+		return;
+
+	commandList->EndQuery(timestampQueryHeap.Get(), D3D12_QUERY_TYPE_TIMESTAMP, timestampCount);
+	gpuRanges[rangeIndex].endQuery = timestampCount++;
+}
+
+RenderCounters& DX12Helper::GetRenderCounters()
+{
+	return renderCounters;
+}
+
+// --------------------------------------------------------
+// Attaches a record of the resource's size to it, which counts
+// towards the MemoryTracker until D3D destroys the resource
+// --------------------------------------------------------
+void DX12Helper::TrackGpuMemory(ID3D12Resource* resource, unsigned int category)
+{
+	D3D12_HEAP_PROPERTIES heapProps = {};
+	D3D12_HEAP_FLAGS heapFlags = D3D12_HEAP_FLAG_NONE;
+	unsigned int heap = GPU_HEAP_DEFAULT;
+	if (SUCCEEDED(resource->GetHeapProperties(&heapProps, &heapFlags)))
+	{
+		switch (heapProps.Type)
+		{
+		case D3D12_HEAP_TYPE_UPLOAD: heap = GPU_HEAP_UPLOAD; break;
+		case D3D12_HEAP_TYPE_READBACK: heap = GPU_HEAP_READBACK; break;
+		default: heap = GPU_HEAP_DEFAULT; break;
+		}
+	}
+
+	// What the resource actually takes up, alignment and all
+	D3D12_RESOURCE_DESC desc = resource->GetDesc();
+	D3D12_RESOURCE_ALLOCATION_INFO info = device->GetResourceAllocationInfo(0, 1, &desc);
+	TrackGpuMemory(resource, heap, category, info.SizeInBytes);
+}
+
+void DX12Helper::TrackGpuMemory(ID3D12Object* object, unsigned int heap, unsigned int category, unsigned long long bytes)
+{
+	// The object holds its own reference (or none, if this fails)
+	GpuAllocationRecord* record = new GpuAllocationRecord(heap, category, bytes);
+	object->SetPrivateDataInterface(gpuAllocationRecordGuid, record);
+	record->Release();
+}
+
 Microsoft::WRL::ComPtr<ID3D12DescriptorHeap> DX12Helper::GetCBVSRVDescriptorHeap()
 {
 	return cbvSrvDescriptorHeap;
@@ -102,7 +267,10 @@ D3D12_GPU_DESCRIPTOR_HANDLE DX12Helper::FillNextConstantBufferAndGetGPUDescripto
 	
 	// Ensure this upload will fit in the remaining space. If not, reset to beginning.
 	if (cbUploadHeapOffsetInBytes + reservationSize >= cbUploadHeapSizeInBytes)
+	{
 		cbUploadHeapOffsetInBytes = 0;
+		renderCounters.Add(RENDER_COUNTER_CB_RING_WRAPS);
+	}
 	
 	// Where in the upload heap will this data go?
 	D3D12_GPU_VIRTUAL_ADDRESS virtualGPUAddress = cbUploadHeap->GetGPUVirtualAddress() + cbUploadHeapOffsetInBytes;
@@ -116,12 +284,16 @@ D3D12_GPU_DESCRIPTOR_HANDLE DX12Helper::FillNextConstantBufferAndGetGPUDescripto
 		
 		// Perform the mem copy to put new data into this part of the heap
 		memcpy(uploadAddress, data, dataSizeInBytes);
+		renderCounters.Add(RENDER_COUNTER_CB_BYTES_COPIED, dataSizeInBytes);
 		
 		// Increment the offset and loop back to the beginning if necessary,
 		// allowing us to treat the upload heap like a ring buffer
 		cbUploadHeapOffsetInBytes += reservationSize;
 		if (cbUploadHeapOffsetInBytes >= cbUploadHeapSizeInBytes)
+		{
 			cbUploadHeapOffsetInBytes = 0;
+			renderCounters.Add(RENDER_COUNTER_CB_RING_WRAPS);
+		}
 	}
 	
 	// Create a CBV for this section of the heap
@@ -142,6 +314,8 @@ D3D12_GPU_DESCRIPTOR_HANDLE DX12Helper::FillNextConstantBufferAndGetGPUDescripto
 		
 		// Create the CBV, which is a lightweight operation in DX12
 		device->CreateConstantBufferView(&cbvDesc, cpuHandle);
+		renderCounters.Add(RENDER_COUNTER_CBVS_CREATED);
+		renderCounters.Add(RENDER_COUNTER_DESCRIPTORS_CONSUMED);
 		
 		// Increment the offset and loop back to the beginning if necessary
 		// which allows us to treat the descriptor heap as a ring buffer
@@ -155,74 +329,176 @@ D3D12_GPU_DESCRIPTOR_HANDLE DX12Helper::FillNextConstantBufferAndGetGPUDescripto
 	}
 }
 
-D3D12_CPU_DESCRIPTOR_HANDLE DX12Helper::LoadTexture(const wchar_t* file, bool generateMips)
+// --------------------------------------------------------
+// Copies the given data into the next "unused" spot in the dynamic upload
+// heap (wrapping at the end, like the CB upload heap) and returns the GPU
+// address of the copy. No descriptor is created; the address is meant to
+// be bound directly as a root SRV.
+//
+// data - The data to copy to the GPU
+// dataSizeInBytes - The byte size of the data to copy
+//
+// Note: Since we wait for the GPU at the end of every frame, the only
+// requirement is that a single frame never uses more than the whole heap
+// --------------------------------------------------------
+D3D12_GPU_VIRTUAL_ADDRESS DX12Helper::FillNextDynamicBuffer(
+	const void* data, unsigned int dataSizeInBytes)
 {
-	// Helper function from DXTK for uploading a resource
-	// (like a texture) to the appropriate GPU memory
-	ResourceUploadBatch upload(device.Get());
-	upload.Begin();
+	// Keep every buffer 256 byte aligned, same as constant buffers
+	UINT64 reservationSize = ((UINT64)dataSizeInBytes + 255) / 256 * 256;
+	if (reservationSize == 0 || reservationSize > dynamicUploadHeapSizeInBytes)
+		return 0;
+
+	// Not enough room left before the end? Start over at the beginning
+	if (dynamicUploadHeapOffsetInBytes + reservationSize > dynamicUploadHeapSizeInBytes)
+	{
+		dynamicUploadHeapOffsetInBytes = 0;
+		renderCounters.Add(RENDER_COUNTER_DYNAMIC_RING_WRAPS);
+	}
+
+	D3D12_GPU_VIRTUAL_ADDRESS virtualGPUAddress =
+		dynamicUploadHeap->GetGPUVirtualAddress() + dynamicUploadHeapOffsetInBytes;
 
-	std::wstring path = ASSET_PATH;
-	path += L"Textures/";
-	path += file;
+	void* uploadAddress = reinterpret_cast<void*>(
+		(SIZE_T)dynamicUploadHeapStartAddress + dynamicUploadHeapOffsetInBytes);
+	memcpy(uploadAddress, data, dataSizeInBytes);
+	renderCounters.Add(RENDER_COUNTER_DYNAMIC_BYTES_COPIED, dataSizeInBytes);
+
+	dynamicUploadHeapOffsetInBytes += reservationSize;
+	return virtualGPUAddress;
+}
+
+// --------------------------------------------------------
+// Loads a texture from the asset folder, uploads it to the GPU and
+// creates its SRV directly in the next slot of the bindless texture range.
+//
+// file - The file name, relative to the texture asset folder
+// generateMips - Should mip maps be generated for the texture?
+// resource - Optional place to hand the texture to. If null, the helper
+//            keeps the texture alive for the lifetime of the program
+//
+// Returns the index of the texture within the bindless range, which is
+// what the material table stores and the pixel shader indexes with, or
+// INVALID_TEXTURE_INDEX if the range is full
+// --------------------------------------------------------
+unsigned int DX12Helper::LoadTexture(
+	const wchar_t* file,
+	bool generateMips,
+	Microsoft::WRL::ComPtr<ID3D12Resource>* resource)
+{
+	PROFILE_FUNCTION();
 
-	// Attempt to create the texture
 	Microsoft::WRL::ComPtr<ID3D12Resource> texture;
-	CreateWICTextureFromFile(device.Get(), upload, FixPath(path).c_str(), texture.GetAddressOf(), generateMips);
-	
-	// Perform the upload and wait for it to finish before returning the texture
-	auto finish = upload.End(commandQueue.Get());
-	finish.wait();
-	
-	// Now that we have the texture, add to our list and make a CPU-side descriptor heap
-	// just for this texture's SRV. Note that it would probably be better to put all
-	// texture SRVs into the same descriptor heap, but we don't know how many we'll need
-	// until they're all loaded and this is a quick and dirty implementation!
-	textures.push_back(texture);
+	{
+		// Decoding and uploading, not the helper's own bookkeeping
+		MEMORY_TAG(MEMORY_TAG_TEXTURE);
+
+		// Helper function from DXTK for uploading a resource
+		// (like a texture) to the appropriate GPU memory
+		ResourceUploadBatch upload(device.Get());
+		upload.Begin();
+
+		std::wstring path = ASSET_PATH;
+		path += L"Textures/";
+		path += file;
+
+		// Attempt to create the texture
+		CreateWICTextureFromFile(device.Get(), upload, FixPath(path).c_str(), texture.GetAddressOf(), generateMips);
+
+		// Perform the upload and wait for it to finish before returning the texture
+		auto finish = upload.End(commandQueue.Get());
+		finish.wait();
+	}
+	if (texture)
+		TrackGpuMemory(texture.Get(), GPU_MEMORY_TEXTURE);
 	
-	// Create the CPU-SIDE descriptor heap for our descriptor
-	D3D12_DESCRIPTOR_HEAP_DESC dhDesc = {};
-	dhDesc.Flags = D3D12_DESCRIPTOR_HEAP_FLAG_NONE; // Non-shader visible for CPU-side-only desc heap
-	dhDesc.NodeMask = 0;
-	dhDesc.NumDescriptors = 1;
-	dhDesc.Type = D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV;
+	unsigned int textureIndex;
+	if (!AllocateTextureIndex(textureIndex))
+	{
+		// Out of room in the bindless range. The caller gets no resource,
+		// so it won't try to release a slot it doesn't own.
+		printf("Bindless texture range is full (%u textures), %ls has no index\n", maxTextureDescriptors, file);
+		textures.push_back(texture);
+		return INVALID_TEXTURE_INDEX;
+	}
+
+	// Either the caller owns the texture or it lives as long as we do
+	if (resource)
+		*resource = texture;
+	else
+		textures.push_back(texture);
 	
-	Microsoft::WRL::ComPtr<ID3D12DescriptorHeap> descHeap;
-	device->CreateDescriptorHeap(&dhDesc, IID_PPV_ARGS(descHeap.GetAddressOf()));
-	cpuSideTextureDescriptorHeaps.push_back(descHeap);
+	CreateBindlessSRV(texture.Get(), textureIndex);
+	return textureIndex;
+}
+
+// --------------------------------------------------------
+// Gives a texture the caller already has (like a render target
+// it wants to sample later) a slot in the bindless range
+// --------------------------------------------------------
+unsigned int DX12Helper::CreateTextureSRV(ID3D12Resource* texture)
+{
+	unsigned int textureIndex;
+	if (!AllocateTextureIndex(textureIndex))
+		return INVALID_TEXTURE_INDEX;
+
+	CreateBindlessSRV(texture, textureIndex);
+	return textureIndex;
+}
+
+// --------------------------------------------------------
+// Returns a bindless slot to the free list. The descriptor is left
+// as is until the slot is handed out again, so the caller has to be
+// sure no in-flight work still samples through it.
+// --------------------------------------------------------
+void DX12Helper::ReleaseTextureIndex(unsigned int textureIndex)
+{
+	if (textureIndex < srvDescriptorCount)
+		freeTextureIndices.push_back(textureIndex);
+}
+
+// --------------------------------------------------------
+// Finds a free slot in the bindless range, reusing a released
+// one first. Returns false if the range is full.
+// --------------------------------------------------------
+bool DX12Helper::AllocateTextureIndex(unsigned int& textureIndex)
+{
+	if (!freeTextureIndices.empty())
+	{
+		textureIndex = freeTextureIndices.back();
+		freeTextureIndices.pop_back();
+		return true;
+	}
+	if (srvDescriptorCount < maxTextureDescriptors)
+	{
+		textureIndex = srvDescriptorCount++;
+		return true;
+	}
+	return false;
+}
+
+// --------------------------------------------------------
+// Creates a texture's SRV straight into its slot of the bindless
+// range, which starts right after all possible CBVs
+// --------------------------------------------------------
+void DX12Helper::CreateBindlessSRV(ID3D12Resource* texture, unsigned int textureIndex)
+{
+	D3D12_CPU_DESCRIPTOR_HANDLE cpuHandle = cbvSrvDescriptorHeap->GetCPUDescriptorHandleForHeapStart();
+	cpuHandle.ptr += (SIZE_T)(maxConstantBuffers + textureIndex) * cbvSrvDescriptorHeapIncrementSize;
 	
-	// Create the SRV on this descriptor heap
 	// Note: Using a null description results in the "default" SRV (same format, all mips, all array slices, etc.)
-	D3D12_CPU_DESCRIPTOR_HANDLE cpuHandle = descHeap->GetCPUDescriptorHandleForHeapStart();
-	device->CreateShaderResourceView(texture.Get(), 0, cpuHandle);
-	
-	// Return the CPU descriptor handle, which can be used to
-	// copy the descriptor to a shader-visible heap later
-	return cpuHandle;
-
+	device->CreateShaderResourceView(texture, 0, cpuHandle);
+	renderCounters.Add(RENDER_COUNTER_DESCRIPTORS_CONSUMED);
 }
 
-D3D12_GPU_DESCRIPTOR_HANDLE DX12Helper::CopySRVsToDescriptorHeapAndGetGPUDescriptorHandle(D3D12_CPU_DESCRIPTOR_HANDLE firstDescriptorToCopy, unsigned int numDescriptorsToCopy)
+// --------------------------------------------------------
+// Gets the GPU handle to the start of the bindless texture range,
+// which is bound once per frame as the texture descriptor table
+// --------------------------------------------------------
+D3D12_GPU_DESCRIPTOR_HANDLE DX12Helper::GetBindlessTextureTableGPUHandle()
 {
-	// Grab the actual heap start on both sides and offset to the next open SRV portion
-	D3D12_CPU_DESCRIPTOR_HANDLE cpuHandle =
-		cbvSrvDescriptorHeap->GetCPUDescriptorHandleForHeapStart();
-	D3D12_GPU_DESCRIPTOR_HANDLE gpuHandle =
-		cbvSrvDescriptorHeap->GetGPUDescriptorHandleForHeapStart();
-
-	cpuHandle.ptr += (SIZE_T)srvDescriptorOffset * cbvSrvDescriptorHeapIncrementSize;
-	gpuHandle.ptr += (SIZE_T)srvDescriptorOffset * cbvSrvDescriptorHeapIncrementSize;
-
-	// We know where to copy these descriptors, so copy all of them and remember the new offset
-	device->CopyDescriptorsSimple(
-		numDescriptorsToCopy,
-		cpuHandle,
-		firstDescriptorToCopy,
-		D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV);
-	srvDescriptorOffset += numDescriptorsToCopy;
-
-	// Pass back the GPU handle to the start of this section
-	// in the final CBV/SRV heap so the caller can use it later
+	D3D12_GPU_DESCRIPTOR_HANDLE gpuHandle = cbvSrvDescriptorHeap->GetGPUDescriptorHandleForHeapStart();
+	gpuHandle.ptr += (SIZE_T)maxConstantBuffers * cbvSrvDescriptorHeapIncrementSize;
 	return gpuHandle;
 }
 
@@ -274,11 +550,56 @@ void DX12Helper::CreateConstantBufferUploadHeap()
 		0,
 		IID_PPV_ARGS(cbUploadHeap.GetAddressOf()));
 	
+	TrackGpuMemory(cbUploadHeap.Get(), GPU_MEMORY_UPLOAD_RING);
+
 	// Keep mapped!
 	D3D12_RANGE range{ 0, 0 };
 	cbUploadHeap->Map(0, &range, &cbUploadHeapStartAddress);
 }
 
+// --------------------------------------------------------
+// Creates the upload heap used by FillNextDynamicBuffer(),
+// which stays mapped for the lifetime of the program
+// --------------------------------------------------------
+void DX12Helper::CreateDynamicUploadHeap()
+{
+	dynamicUploadHeapOffsetInBytes = 0;
+
+	D3D12_HEAP_PROPERTIES heapProps = {};
+	heapProps.CPUPageProperty = D3D12_CPU_PAGE_PROPERTY_UNKNOWN;
+	heapProps.CreationNodeMask = 1;
+	heapProps.MemoryPoolPreference = D3D12_MEMORY_POOL_UNKNOWN;
+	heapProps.Type = D3D12_HEAP_TYPE_UPLOAD;
+	heapProps.VisibleNodeMask = 1;
+
+	D3D12_RESOURCE_DESC resDesc = {};
+	resDesc.Alignment = 0;
+	resDesc.DepthOrArraySize = 1;
+	resDesc.Dimension = D3D12_RESOURCE_DIMENSION_BUFFER;
+	resDesc.Flags = D3D12_RESOURCE_FLAG_NONE;
+	resDesc.Format = DXGI_FORMAT_UNKNOWN;
+	resDesc.Height = 1;
+	resDesc.Layout = D3D12_TEXTURE_LAYOUT_ROW_MAJOR;
+	resDesc.MipLevels = 1;
+	resDesc.SampleDesc.Count = 1;
+	resDesc.SampleDesc.Quality = 0;
+	resDesc.Width = dynamicUploadHeapSizeInBytes;
+
+	device->CreateCommittedResource(
+		&heapProps,
+		D3D12_HEAP_FLAG_NONE,
+		&resDesc,
+		D3D12_RESOURCE_STATE_GENERIC_READ,
+		0,
+		IID_PPV_ARGS(dynamicUploadHeap.GetAddressOf()));
+
+	TrackGpuMemory(dynamicUploadHeap.Get(), GPU_MEMORY_UPLOAD_RING);
+
+	// Keep mapped!
+	D3D12_RANGE range{ 0, 0 };
+	dynamicUploadHeap->Map(0, &range, &dynamicUploadHeapStartAddress);
+}
+
 // --------------------------------------------------------
 // Creates a single CBV descriptor heap which will store all
 // CBVs and SRVs for the entire program. Like the CBV upload heap,
@@ -300,13 +621,111 @@ void DX12Helper::CreateCBVSRVDescriptorHeap()
 	dhDesc.Type = D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV; // This heap can store CBVs, SRVs and UAVs
 	
 	device->CreateDescriptorHeap(&dhDesc, IID_PPV_ARGS(cbvSrvDescriptorHeap.GetAddressOf()));
+	TrackGpuMemory(
+		cbvSrvDescriptorHeap.Get(),
+		GPU_HEAP_DESCRIPTOR,
+		GPU_MEMORY_DESCRIPTORS,
+		dhDesc.NumDescriptors * cbvSrvDescriptorHeapIncrementSize);
 	
 	// Assume the first CBV will be at the beginning of the heap
 	// This will increase as we use more CBVs and will wrap back to 0
 	cbvDescriptorOffset = 0;
 
-	// Assume the first SRV will be after all possible CBVs
-	srvDescriptorOffset = maxConstantBuffers;
+	// Texture SRVs go after all possible CBVs, in the bindless range
+	srvDescriptorCount = 0;
+	freeTextureIndices.clear();
+}
+
+// --------------------------------------------------------
+// Creates the timestamp query heap (two queries per profiler
+// range) and the readback buffer they're resolved into
+// --------------------------------------------------------
+void DX12Helper::CreateTimestampQueries()
+{
+	gpuRanges.reserve(maxGpuRanges);
+	openGpuRanges.reserve(maxGpuRanges);
+	timestampCount = 0;
+
+	D3D12_QUERY_HEAP_DESC queryHeapDesc = {};
+	queryHeapDesc.Type = D3D12_QUERY_HEAP_TYPE_TIMESTAMP;
+	queryHeapDesc.Count = maxGpuRanges * 2;
+	queryHeapDesc.NodeMask = 0;
+	if (FAILED(device->CreateQueryHeap(&queryHeapDesc, IID_PPV_ARGS(timestampQueryHeap.GetAddressOf()))))
+		return;
+	TrackGpuMemory(timestampQueryHeap.Get(), GPU_HEAP_DESCRIPTOR, GPU_MEMORY_DESCRIPTORS, sizeof(UINT64) * queryHeapDesc.Count);
+
+	D3D12_HEAP_PROPERTIES heapProps = {};
+	heapProps.CPUPageProperty = D3D12_CPU_PAGE_PROPERTY_UNKNOWN;
+	heapProps.CreationNodeMask = 1;
+	heapProps.MemoryPoolPreference = D3D12_MEMORY_POOL_UNKNOWN;
+	heapProps.Type = D3D12_HEAP_TYPE_READBACK; // The CPU reads these back
+	heapProps.VisibleNodeMask = 1;
+
+	D3D12_RESOURCE_DESC resDesc = {};
+	resDesc.Alignment = 0;
+	resDesc.DepthOrArraySize = 1;
+	resDesc.Dimension = D3D12_RESOURCE_DIMENSION_BUFFER;
+	resDesc.Flags = D3D12_RESOURCE_FLAG_NONE;
+	resDesc.Format = DXGI_FORMAT_UNKNOWN;
+	resDesc.Height = 1;
+	resDesc.Layout = D3D12_TEXTURE_LAYOUT_ROW_MAJOR;
+	resDesc.MipLevels = 1;
+	resDesc.SampleDesc.Count = 1;
+	resDesc.SampleDesc.Quality = 0;
+	resDesc.Width = sizeof(UINT64) * queryHeapDesc.Count;
+
+	if (FAILED(device->CreateCommittedResource(
+		&heapProps,
+		D3D12_HEAP_FLAG_NONE,
+		&resDesc,
+		D3D12_RESOURCE_STATE_COPY_DEST,
+		0,
+		IID_PPV_ARGS(timestampReadbackBuffer.GetAddressOf()))))
+	{
+		timestampQueryHeap.Reset();
+		return;
+	}
+	TrackGpuMemory(timestampReadbackBuffer.Get(), GPU_MEMORY_READBACK);
+}
+
+// --------------------------------------------------------
+// Hands the ranges from the list that just finished to the
+// Profiler, along with a fresh pairing of the GPU's clock and
+// ours (QueryPerformanceCounter, which the Profiler's clock is
+// built on, converted to nanoseconds)
+// --------------------------------------------------------
+void DX12Helper::ReadGpuRanges()
+{
+	UINT64 gpuFrequency = 0;
+	UINT64 gpuTimestamp = 0;
+	UINT64 cpuTimestamp = 0;
+	LARGE_INTEGER cpuFrequency = {};
+	commandQueue->GetTimestampFrequency(&gpuFrequency);
+	commandQueue->GetClockCalibration(&gpuTimestamp, &cpuTimestamp);
+	QueryPerformanceFrequency(&cpuFrequency);
+	UINT64 ticksPerSecond = (UINT64)cpuFrequency.QuadPart;
+	UINT64 cpuTime = cpuTimestamp / ticksPerSecond * 1000000000ULL + cpuTimestamp % ticksPerSecond * 1000000000ULL / ticksPerSecond;
+
+	Profiler& profiler = Profiler::GetInstance();
+	profiler.SetGpuClock((double)gpuFrequency, gpuTimestamp, cpuTime);
+
+	D3D12_RANGE readRange = { 0, sizeof(UINT64) * timestampCount };
+	UINT64* timestamps = 0;
+	if (SUCCEEDED(timestampReadbackBuffer->Map(0, &readRange, (void**)&timestamps)))
+	{
+		for (const GpuRange& range : gpuRanges)
+		{
+			if (range.endQuery != NO_GPU_RANGE)
+				profiler.AddGpuRange(range.name, timestamps[range.startQuery], timestamps[range.endQuery]);
+		}
+
+		D3D12_RANGE writeRange = { 0, 0 };
+		timestampReadbackBuffer->Unmap(0, &writeRange);
+	}
+
+	gpuRanges.clear();
+	openGpuRanges.clear();
+	timestampCount = 0;
 }
 
 // --------------------------------------------------------
@@ -320,6 +739,8 @@ void DX12Helper::CreateCBVSRVDescriptorHeap()
 Microsoft::WRL::ComPtr<ID3D12Resource> DX12Helper::CreateStaticBuffer(
 	unsigned int dataStride, unsigned int dataCount, void* data)
 {
+	PROFILE_FUNCTION();
+
 	// The overall buffer we'll be creating
 	Microsoft::WRL::ComPtr<ID3D12Resource> buffer;
 
@@ -351,6 +772,7 @@ Microsoft::WRL::ComPtr<ID3D12Resource> DX12Helper::CreateStaticBuffer(
 		D3D12_RESOURCE_STATE_COPY_DEST, // Will eventually be "common", but we're copying first
 		0,
 		IID_PPV_ARGS(buffer.GetAddressOf()));
+	TrackGpuMemory(buffer.Get(), GPU_MEMORY_BUFFER);
 
 	// Now create an intermediate upload heap for copying initial data
 	D3D12_HEAP_PROPERTIES uploadProps = {};
@@ -368,6 +790,7 @@ Microsoft::WRL::ComPtr<ID3D12Resource> DX12Helper::CreateStaticBuffer(
 		D3D12_RESOURCE_STATE_GENERIC_READ,
 		0,
 		IID_PPV_ARGS(uploadHeap.GetAddressOf()));
+	TrackGpuMemory(uploadHeap.Get(), GPU_MEMORY_STAGING);
 
 	// Do a straight map/memcpy/unmap
 	void* gpuAddress = 0;
@@ -2,6 +2,12 @@
 #include <d3d12.h>
 #include <wrl/client.h>
 #include <vector>
+#include <atomic>
+#include "RenderCounters.h"
+#include "MemoryTracker.h"
+
+// Returned instead of a bindless index when there's no room left
+#define INVALID_TEXTURE_INDEX 0xFFFFFFFF
 
 class DX12Helper
 {
@@ -46,16 +52,54 @@ public:
 	void CloseExecuteAndResetCommandList();
 	void WaitForGPU();
 
+
+	// Times the commands recorded between these on the GPU, for the
+	// Profiler (only while it's capturing). Ranges can nest, and are
+	// handed over once the command list has run.
+	void BeginGpuRange(const char* name);
+	void EndGpuRange();
+
+	// Per-frame counts of what the helper and the renderer do, with
+	// budgets set from the sizes of the rings. Whoever draws adds to
+	// them and ends each frame.
+	RenderCounters& GetRenderCounters();
+
+	// Counts a resource towards the MemoryTracker's GPU totals (in the
+	// heap it lives in) until it's destroyed. The helper does this for
+	// everything it makes; this is for resources made elsewhere, like
+	// render targets. See GPU_MEMORY_* for categories.
+	void TrackGpuMemory(ID3D12Resource* resource, unsigned int category);
+
 	Microsoft::WRL::ComPtr<ID3D12DescriptorHeap> GetCBVSRVDescriptorHeap();
 
 	D3D12_GPU_DESCRIPTOR_HANDLE FillNextConstantBufferAndGetGPUDescriptorHandle(
 		void* data,
 		unsigned int dataSizeInBytes);
 
-	D3D12_CPU_DESCRIPTOR_HANDLE LoadTexture(const wchar_t* file, bool generateMips = true);
-	D3D12_GPU_DESCRIPTOR_HANDLE CopySRVsToDescriptorHeapAndGetGPUDescriptorHandle(
-		D3D12_CPU_DESCRIPTOR_HANDLE firstDescriptorToCopy,
-		unsigned int numDescriptorsToCopy);
+	// Copies per-frame data (like light lists) that is too big for a constant
+	// buffer into upload memory, returning an address usable as a root SRV
+	D3D12_GPU_VIRTUAL_ADDRESS FillNextDynamicBuffer(
+		const void* data,
+		unsigned int dataSizeInBytes);
+
+	// Loads a texture and places its SRV in the bindless texture range,
+	// returning the index shaders use to look it up (INVALID_TEXTURE_INDEX
+	// if the range is full). If resource is given the caller owns the
+	// texture, otherwise it's kept until shutdown.
+	unsigned int LoadTexture(
+		const wchar_t* file,
+		bool generateMips = true,
+		Microsoft::WRL::ComPtr<ID3D12Resource>* resource = 0);
+
+	// Places an SRV for a texture the caller made (like a render target)
+	// in the bindless range, returning its index, or INVALID_TEXTURE_INDEX
+	// if the range is full. The caller keeps the texture alive.
+	unsigned int CreateTextureSRV(ID3D12Resource* texture);
+
+	// Lets a bindless slot be reused by a later LoadTexture() call
+	// - Only once the GPU is done with anything that read it
+	void ReleaseTextureIndex(unsigned int textureIndex);
+	D3D12_GPU_DESCRIPTOR_HANDLE GetBindlessTextureTableGPUHandle();
 
 private:
 	// Overall device
@@ -72,7 +116,10 @@ private:
 	// Basic CPU/GPU synchronization
 	Microsoft::WRL::ComPtr<ID3D12Fence> waitFence;
 	HANDLE waitFenceEvent = 0;
-	unsigned long waitFenceCounter = 0;
+
+	// Bumped by the render thread, but read by whichever thread
+	// retires resources, so it's atomic
+	std::atomic<UINT64> waitFenceCounter{ 0 };
 
 	// Maximum number of constant buffers, assuming each buffer
 	// is 256 bytes or less. Larger buffers are fine, but will
@@ -85,26 +132,58 @@ private:
 	UINT64 cbUploadHeapOffsetInBytes = 0;
 	void* cbUploadHeapStartAddress = NULL;
 
+	// GPU-side upload heap for larger per-frame buffers, also a ring buffer
+	const UINT64 dynamicUploadHeapSizeInBytes = 16 * 1024 * 1024;
+	Microsoft::WRL::ComPtr<ID3D12Resource> dynamicUploadHeap;
+	UINT64 dynamicUploadHeapOffsetInBytes = 0;
+	void* dynamicUploadHeapStartAddress = NULL;
+
 	// GPU-side CBV/SRV descriptor heap
 	Microsoft::WRL::ComPtr<ID3D12DescriptorHeap> cbvSrvDescriptorHeap;
 	SIZE_T cbvSrvDescriptorHeapIncrementSize = 0;
 	unsigned int cbvDescriptorOffset = 0;
 
 	void CreateConstantBufferUploadHeap();
+	void CreateDynamicUploadHeap();
 	void CreateCBVSRVDescriptorHeap();
 
+	// GPU timestamps for profiler ranges, two per range, copied to
+	// the readback buffer at the end of each command list
+	const unsigned int maxGpuRanges = 64;
+	Microsoft::WRL::ComPtr<ID3D12QueryHeap> timestampQueryHeap;
+	Microsoft::WRL::ComPtr<ID3D12Resource> timestampReadbackBuffer;
+	struct GpuRange
+	{
+		const char* name;
+		unsigned int startQuery;
+		unsigned int endQuery;
+	};
+	std::vector<GpuRange> gpuRanges;
+	std::vector<unsigned int> openGpuRanges; // Indices into gpuRanges (or skipped)
+	unsigned int timestampCount = 0;
+	void CreateTimestampQueries();
+	void ReadGpuRanges();
+
+	RenderCounters renderCounters;
+
+	// For objects with no heap properties to ask (descriptor and query heaps)
+	void TrackGpuMemory(ID3D12Object* object, unsigned int heap, unsigned int category, unsigned long long bytes);
+
 	// Maximum number of texture descriptors (SRVs) we can have.
-	// Each material will have a chunk of this,
-	// Note: If we delayed the creation of this heap until
-	// after all textures and materials were created,
-	// we could come up with an exact amount. The following
-	// constant ensures we (hopefully) never run out of room.
+	// All of them live in one contiguous range right after the CBVs,
+	// which is bound once as an unbounded texture array (bindless)
+	// and indexed by the material table in the pixel shader.
 	const unsigned int maxTextureDescriptors = 1000;
 
-	unsigned int srvDescriptorOffset;
+	// Number of SRVs placed in the bindless range so far
+	unsigned int srvDescriptorCount = 0;
+
+	// Released slots in the bindless range, reused before new ones
+	std::vector<unsigned int> freeTextureIndices;
+	bool AllocateTextureIndex(unsigned int& textureIndex);
+	void CreateBindlessSRV(ID3D12Resource* texture, unsigned int textureIndex);
 
 	// Texture resources we need to keep alive
 	std::vector<Microsoft::WRL::ComPtr<ID3D12Resource>> textures;
-	std::vector<Microsoft::WRL::ComPtr<ID3D12DescriptorHeap>> cpuSideTextureDescriptorHeaps;
 };
 
@@ -2,7 +2,12 @@
 #include "Input.h"
 
 #include "DX12Helper.h"
+#include "JobSystem.h"
+#include "PathHelpers.h"
+#include "Profiler.h"
+#include "MemoryTracker.h"
 #include <WindowsX.h>
+#include <timeapi.h>
 #include <sstream>
 
 // Define the static instance variable so our OS-level 
@@ -44,7 +49,18 @@ DXCore::DXCore(
 	vsync(vsync),
 	isFullscreen(false),
 	deviceSupportsTearing(false),
+	pipelinedRendering(false),
+	simulationTime(0),
+	fpsTickCount(0),
+	maxFrameLatency(1),
+	backBufferCount(2),
+	frameLatencyWaitable(0),
 	titleBarStats(debugTitleBarStats),
+#if defined(DEBUG) || defined(_DEBUG)
+	zeroAllocationFrames(true),
+#else
+	zeroAllocationFrames(false),
+#endif
 	dxFeatureLevel(D3D_FEATURE_LEVEL_12_0),
 	fpsTimeElapsed(0),
 	fpsFrameCount(0),
@@ -59,7 +75,11 @@ DXCore::DXCore(
 	rtvDescriptorSize(0),
 	dsvHandle({}),
 	rtvHandles(),
-	scissorRect({})
+	scissorRect({}),
+	renderScale(1.0f),
+	allocationWarmupStart(0),
+	frameDeltaTimes(),
+	frameTotalTimes()
 {
 	// Save a static reference to this object.
 	//  - Since the OS-level message function must be a non-member (global) function, 
@@ -83,9 +103,13 @@ DXCore::~DXCore()
 	// - If we weren't using smart pointers, we'd need to call
 	//   Release() on each Direct3D object created in DXCore
 
+	if (frameLatencyWaitable)
+		CloseHandle(frameLatencyWaitable);
+
 	// Delete input manager singleton
 	delete& Input::GetInstance();
 	delete& DX12Helper::GetInstance();
+	delete& JobSystem::GetInstance();
 }
 
 // --------------------------------------------------------
@@ -164,6 +188,10 @@ HRESULT DXCore::InitWindow()
 	// Initialize the input manager now that we definitely have a window
 	Input::GetInstance().Initialize(hWnd);
 
+	// Start the worker threads (this thread becomes the job system's main thread)
+	Profiler::GetInstance().SetThreadName("Main thread");
+	JobSystem::GetInstance().Initialize();
+
 	// Return an "everything is ok" HRESULT value
 	return S_OK;
 }
@@ -249,7 +277,7 @@ HRESULT DXCore::InitDirect3D()
 	{
 		// Create a description of how our swap chain should work
 		DXGI_SWAP_CHAIN_DESC swapDesc = {};
-		swapDesc.BufferCount = numBackBuffers;
+		swapDesc.BufferCount = backBufferCount;
 		swapDesc.BufferDesc.Width = windowWidth;
 		swapDesc.BufferDesc.Height = windowHeight;
 		swapDesc.BufferDesc.RefreshRate.Numerator = 60;
@@ -258,7 +286,8 @@ HRESULT DXCore::InitDirect3D()
 		swapDesc.BufferDesc.ScanlineOrdering = DXGI_MODE_SCANLINE_ORDER_UNSPECIFIED;
 		swapDesc.BufferDesc.Scaling = DXGI_MODE_SCALING_UNSPECIFIED;
 		swapDesc.BufferUsage = DXGI_USAGE_RENDER_TARGET_OUTPUT;
-		swapDesc.Flags = deviceSupportsTearing ? DXGI_SWAP_CHAIN_FLAG_ALLOW_TEARING : 0;
+		swapDesc.Flags = DXGI_SWAP_CHAIN_FLAG_FRAME_LATENCY_WAITABLE_OBJECT |
+			(deviceSupportsTearing ? DXGI_SWAP_CHAIN_FLAG_ALLOW_TEARING : 0);
 		swapDesc.OutputWindow = hWnd;
 		swapDesc.SampleDesc.Count = 1;
 		swapDesc.SampleDesc.Quality = 0;
@@ -267,7 +296,14 @@ HRESULT DXCore::InitDirect3D()
 		// Create a DXGI factory, which is what we use to create a swap chain
 		Microsoft::WRL::ComPtr<IDXGIFactory> dxgiFactory;
 		CreateDXGIFactory(IID_PPV_ARGS(dxgiFactory.GetAddressOf()));
-		hr = dxgiFactory->CreateSwapChain(commandQueue.Get(), &swapDesc, swapChain.GetAddressOf());
+		Microsoft::WRL::ComPtr<IDXGISwapChain> baseSwapChain;
+		hr = dxgiFactory->CreateSwapChain(commandQueue.Get(), &swapDesc, baseSwapChain.GetAddressOf());
+		if (FAILED(hr)) return hr;
+		baseSwapChain.As(&swapChain);
+
+		// Signalled whenever the swap chain has room for another frame
+		swapChain->SetMaximumFrameLatency(maxFrameLatency);
+		frameLatencyWaitable = swapChain->GetFrameLatencyWaitableObject();
 	}
 
 	// Still inside DXCore::InitDirectX()! Create back buffers
@@ -279,15 +315,16 @@ HRESULT DXCore::InitDirect3D()
 
 		// First create a descriptor heap for RTVs
 		D3D12_DESCRIPTOR_HEAP_DESC rtvHeapDesc = {};
-		rtvHeapDesc.NumDescriptors = numBackBuffers;
+		rtvHeapDesc.NumDescriptors = MAX_BACK_BUFFERS; // Room for any back buffer count
 		rtvHeapDesc.Type = D3D12_DESCRIPTOR_HEAP_TYPE_RTV;
 		device->CreateDescriptorHeap(&rtvHeapDesc, IID_PPV_ARGS(rtvHeap.GetAddressOf()));
 
 		// Now create the RTV handles for each buffer (buffers were created by the swap chain)
-		for (unsigned int i = 0; i < numBackBuffers; i++)
+		for (unsigned int i = 0; i < backBufferCount; i++)
 		{
 			// Grab this buffer from the swap chain
 			swapChain->GetBuffer(i, IID_PPV_ARGS(backBuffers[i].GetAddressOf()));
+			DX12Helper::GetInstance().TrackGpuMemory(backBuffers[i].Get(), GPU_MEMORY_RENDER_TARGET);
 
 			// Make a handle for it
 			rtvHandles[i] = rtvHeap->GetCPUDescriptorHandleForHeapStart();
@@ -344,6 +381,7 @@ HRESULT DXCore::InitDirect3D()
 			D3D12_RESOURCE_STATE_DEPTH_WRITE,
 			&clear,
 			IID_PPV_ARGS(depthStencilBuffer.GetAddressOf()));
+		DX12Helper::GetInstance().TrackGpuMemory(depthStencilBuffer.Get(), GPU_MEMORY_RENDER_TARGET);
 
 		// Get the handle to the Depth Stencil View that we'll
 		// be using for the depth buffer. The DSV is stored in
@@ -395,29 +433,36 @@ HRESULT DXCore::InitDirect3D()
 // --------------------------------------------------------
 void DXCore::OnResize()
 {
-	// Wait for the GPU to finish all work, since we'll
-	// be destroying and recreating resources
+	// The render thread may be using the back buffers, so let it
+	// finish, then wait for the GPU to finish all work, since
+	// we'll be destroying and recreating resources
+	framePipeline.Flush();
 	DX12Helper::GetInstance().WaitForGPU();
+	RestartAllocationWarmup();
 
 	// Release the back buffers using ComPtr's Reset()
-	for (unsigned int i = 0; i < numBackBuffers; i++)
+	// (all of them, since the count may be changing)
+	for (unsigned int i = 0; i < MAX_BACK_BUFFERS; i++)
 		backBuffers[i].Reset();
 
 	// Resize the swap chain (assuming a basic color format here)
+	// - The flags have to match the ones it was created with
 	swapChain->ResizeBuffers(
-		numBackBuffers,
+		backBufferCount,
 		windowWidth,
 		windowHeight,
 		DXGI_FORMAT_R8G8B8A8_UNORM,
-		deviceSupportsTearing ? DXGI_SWAP_CHAIN_FLAG_ALLOW_TEARING : 0);
+		DXGI_SWAP_CHAIN_FLAG_FRAME_LATENCY_WAITABLE_OBJECT |
+			(deviceSupportsTearing ? DXGI_SWAP_CHAIN_FLAG_ALLOW_TEARING : 0));
 
 	// Go through the steps to setup the back buffers again
 	// Note: This assumes the descriptor heap already exists
 	// and that the rtvDescriptorSize was previously set
-	for (unsigned int i = 0; i < numBackBuffers; i++)
+	for (unsigned int i = 0; i < backBufferCount; i++)
 	{
 		// Grab this buffer from the swap chain
 		swapChain->GetBuffer(i, IID_PPV_ARGS(backBuffers[i].GetAddressOf()));
+		DX12Helper::GetInstance().TrackGpuMemory(backBuffers[i].Get(), GPU_MEMORY_RENDER_TARGET);
 
 		// Make a handle for it
 		rtvHandles[i] = rtvHeap->GetCPUDescriptorHandleForHeapStart();
@@ -426,8 +471,8 @@ void DXCore::OnResize()
 		// Create the render target view
 		device->CreateRenderTargetView(backBuffers[i].Get(), 0, rtvHandles[i]);
 	}
-	// Reset back to the first back buffer
-	currentSwapBuffer = 0;
+	// Start from whichever buffer the swap chain wants next
+	currentSwapBuffer = swapChain->GetCurrentBackBufferIndex();
 
 	// Reset the depth buffer and create it again
 	{
@@ -471,6 +516,7 @@ void DXCore::OnResize()
 			D3D12_RESOURCE_STATE_DEPTH_WRITE,
 			&clear,
 			IID_PPV_ARGS(depthStencilBuffer.GetAddressOf()));
+		DX12Helper::GetInstance().TrackGpuMemory(depthStencilBuffer.Get(), GPU_MEMORY_RENDER_TARGET);
 
 		// Now recreate the depth stencil view
 		dsvHandle = dsvHeap->GetCPUDescriptorHandleForHeapStart();
@@ -499,6 +545,33 @@ void DXCore::OnResize()
 	DX12Helper::GetInstance().WaitForGPU();
 }
 
+// --------------------------------------------------------
+// Changes how many back buffers the swap chain has, which
+// means recreating them (the same way a resize does)
+// --------------------------------------------------------
+void DXCore::SetBackBufferCount(unsigned int count)
+{
+	count = max(2u, min(count, (unsigned int)MAX_BACK_BUFFERS));
+	if (count == backBufferCount)
+		return;
+
+	backBufferCount = count;
+	if (swapChain)
+		OnResize();
+}
+
+// --------------------------------------------------------
+// Changes how many frames can be waiting to be presented before
+// the next one waits to start. 1 means input is read as late as
+// possible, at the cost of the GPU sometimes sitting idle.
+// --------------------------------------------------------
+void DXCore::SetMaxFrameLatency(unsigned int frames)
+{
+	maxFrameLatency = max(1u, min(frames, 16u));
+	if (swapChain)
+		swapChain->SetMaximumFrameLatency(maxFrameLatency);
+}
+
 
 // --------------------------------------------------------
 // This is the main game loop, handling the following:
@@ -518,6 +591,21 @@ HRESULT DXCore::Run()
 	// Give subclass a chance to initialize
 	Init();
 
+	// Frames are drawn with the timing they were simulated with
+	framePipeline.SetDrawFunction([this](unsigned int slot)
+	{
+		unsigned int frame = framePipeline.GetDrawFrame();
+		{
+			ZERO_ALLOCATIONS(FrameForbidsAllocations(frame));
+			Draw(frameDeltaTimes[slot], frameTotalTimes[slot]);
+		}
+		framePacer.RecordPresent(frameInputTimes[slot]);
+		frameStats.EndFrame(frame, framePacer.Now());
+	});
+
+	// Ask for 1ms timer resolution, so the frame limiter's sleeps are short
+	timeBeginPeriod(1);
+
 	// Our overall game and message loop
 	MSG msg = {};
 	while (msg.message != WM_QUIT)
@@ -532,29 +620,96 @@ HRESULT DXCore::Run()
 		}
 		else
 		{
+			PROFILE_ZONE("Frame");
+
+			// Wait until it's time to start the next frame
+			double waitStartTime = framePacer.Now();
+			WaitForNextFrame();
+			double waitEndTime = framePacer.Now();
+
 			// Update timer and title bar (if necessary)
 			UpdateTimer();
 			if(titleBarStats)
 				UpdateTitleBarStats();
 
-			// Update the input manager
-			Input::GetInstance().Update();
+			// Switch between drawing here and on the render thread
+			if (pipelinedRendering != framePipeline.IsRunning())
+			{
+				if (pipelinedRendering)
+					framePipeline.Start();
+				else
+					framePipeline.Stop();
+			}
 
-			// The game loop
-			Update(deltaTime, totalTime);
-			Draw(deltaTime, totalTime);
+			// Update the input manager
+			double inputStartTime = framePacer.Now();
+			{
+				PROFILE_ZONE("Input");
+				Input::GetInstance().Update();
+			}
+			double inputTime = framePacer.Now();
+
+			// The game loop: Draw() runs here once Update() is done, or
+			// on the render thread while the next Update() runs
+			{
+				PROFILE_ZONE("Wait for render thread");
+				framePipeline.BeginFrame();
+			}
+			unsigned int slot = framePipeline.GetUpdateSlot();
+			unsigned int frame = framePipeline.GetUpdateFrame();
+			frameDeltaTimes[slot] = deltaTime;
+			frameTotalTimes[slot] = totalTime;
+			frameInputTimes[slot] = inputTime;
+			frameStats.BeginFrame(frame);
+			frameStats.AddPhaseTime(frame, FRAME_PHASE_PRESENT, (waitEndTime - waitStartTime) * 1000.0);
+			frameStats.AddPhaseTime(frame, FRAME_PHASE_INPUT, (inputTime - inputStartTime) * 1000.0);
+
+			double updateStartTime = framePacer.Now();
+			{
+				ZERO_ALLOCATIONS(FrameForbidsAllocations(frame));
+				{
+					PROFILE_ZONE("Fixed ticks");
+					RunTicks();
+				}
+				Update(deltaTime, totalTime);
+			}
+			frameStats.AddPhaseTime(frame, FRAME_PHASE_UPDATE, (framePacer.Now() - updateStartTime) * 1000.0);
+			framePipeline.EndFrame();
 
 			// Frame is over, notify the input manager
 			Input::GetInstance().EndOfFrame();
 		}
 	}
 
+	// Draw whatever is still in flight before the game shuts down
+	framePipeline.Stop();
+	timeEndPeriod(1);
+	ExportFrameStats();
+	if (Profiler::GetInstance().IsCapturing())
+		ToggleProfilerCapture();
+
 	// We'll end up here once we get a WM_QUIT message,
 	// which usually comes from the user closing the window
 	return (HRESULT)msg.wParam;
 }
 
 
+// --------------------------------------------------------
+// Frames from this one on get ZERO_ALLOCATION_WARMUP_FRAMES to
+// settle, and this frame can allocate from here on
+// --------------------------------------------------------
+void DXCore::RestartAllocationWarmup()
+{
+	allocationWarmupStart = framePipeline.GetUpdateFrame();
+	MemoryTracker::SetThreadAllocationsForbidden(false);
+}
+
+// Frames still being drawn from before a restart compare as negative
+bool DXCore::FrameForbidsAllocations(unsigned int frame)
+{
+	return zeroAllocationFrames && (int)(frame - allocationWarmupStart) >= ZERO_ALLOCATION_WARMUP_FRAMES;
+}
+
 // --------------------------------------------------------
 // Sends an OS-level window close message to our process, which
 // will be handled by our message processing function
@@ -564,6 +719,83 @@ void DXCore::Quit()
 	PostMessage(this->hWnd, WM_CLOSE, NULL, NULL);
 }
 
+// --------------------------------------------------------
+// Saves the frames FrameStats has kept next to the executable,
+// as CSV (for a spreadsheet) and JSON (with a summary up top)
+// --------------------------------------------------------
+void DXCore::ExportFrameStats()
+{
+	std::string csvFile = FixPath("FrameStats.csv");
+	std::string jsonFile = FixPath("FrameStats.json");
+	bool saved = frameStats.ExportCSV(csvFile) && frameStats.ExportJSON(jsonFile);
+	printf("%s %u frames of stats to %s and %s\n",
+		saved ? "Saved" : "Couldn't save",
+		frameStats.GetFrameCount(),
+		csvFile.c_str(),
+		jsonFile.c_str());
+}
+
+// --------------------------------------------------------
+// Starts a profiler capture, or stops the current one and saves
+// it next to the executable as a Chrome trace (open it in
+// chrome://tracing or ui.perfetto.dev)
+// --------------------------------------------------------
+void DXCore::ToggleProfilerCapture()
+{
+	Profiler& profiler = Profiler::GetInstance();
+	if (!profiler.IsCapturing())
+	{
+		profiler.StartCapture();
+		printf("Profiler capture started\n");
+		return;
+	}
+
+	profiler.StopCapture();
+	unsigned int eventCount = 0;
+	unsigned int droppedCount = 0;
+	for (unsigned int t = 0; t < profiler.GetTrackCount(); t++)
+	{
+		eventCount += profiler.GetEventCount(t);
+		droppedCount += profiler.GetDroppedCount(t);
+	}
+
+	std::string traceFile = FixPath("ProfilerCapture.json");
+	bool saved = profiler.ExportChromeTrace(traceFile);
+	printf("%s %u zones (%u dropped) to %s\n",
+		saved ? "Saved" : "Couldn't save",
+		eventCount,
+		droppedCount,
+		traceFile.c_str());
+}
+
+// --------------------------------------------------------
+// Waits for the swap chain to have room for another frame (so
+// frames never queue up behind each other, adding latency), then
+// for the frame limiter, if there is one
+// --------------------------------------------------------
+void DXCore::WaitForNextFrame()
+{
+	PROFILE_FUNCTION();
+	if (frameLatencyWaitable)
+		WaitForSingleObjectEx(frameLatencyWaitable, 1000, true);
+
+	framePacer.WaitForNextFrame();
+}
+
+// --------------------------------------------------------
+// Runs a FixedUpdate() for each tick this frame's time adds up to
+// --------------------------------------------------------
+void DXCore::RunTicks()
+{
+	unsigned int ticks = fixedTimestep.Advance(deltaTime);
+	double tickTime = fixedTimestep.GetTickTime();
+	for (unsigned int tick = 0; tick < ticks; tick++)
+	{
+		simulationTime += tickTime;
+		FixedUpdate((float)tickTime, (float)simulationTime);
+	}
+	fpsTickCount += ticks;
+}
 
 // --------------------------------------------------------
 // Uses high resolution time stamps to get very accurate
@@ -615,7 +847,38 @@ void DXCore::UpdateTitleBarStats()
 		"    Width: "		<< windowWidth <<
 		"    Height: "		<< windowHeight <<
 		"    FPS: "			<< fpsFrameCount <<
-		"    Frame Time: "	<< mspf << "ms";
+		"    Frame Time: "	<< mspf << "ms" <<
+		"    Ticks: "		<< fpsTickCount;
+
+	// The spread of recent frame times, which averages hide
+	FrameTimeSummary frameTimes = frameStats.Summarize();
+	output.precision(3);
+	output <<
+		"    p50/p95/p99/max: " << frameTimes.p50Ms << "/" << frameTimes.p95Ms << "/" << frameTimes.p99Ms << "/" << frameTimes.maxMs << "ms" <<
+		"    Hitches: "		<< frameTimes.hitchCount;
+
+	// Where the frame time goes, and how long input takes to reach the screen
+	output.precision(3);
+	output <<
+		(framePipeline.IsRunning() ? "    Pipelined" : "    Serial") <<
+		"    Update: "		<< framePipeline.GetAverageUpdateTimeMs() << "ms" <<
+		"    Draw: "		<< framePipeline.GetAverageDrawTimeMs() << "ms" <<
+		"    Latency: "		<< framePipeline.GetAverageLatencyMs() << "ms" <<
+		"    Input to Present: " << framePacer.GetAverageLatencyMs() << "ms (max " << framePacer.GetMaxLatencyMs() << "ms)" <<
+		"    Render Scale: " << renderScale.load() * 100 << "%" <<
+		"    Buffers: "		<< backBufferCount <<
+		"    Max Queued: "	<< maxFrameLatency;
+	if (framePacer.GetTargetFrameRate() > 0)
+		output << "    Limit: " << framePacer.GetTargetFrameRate() << "fps";
+
+	// What the last frame asked of the GPU
+	RenderCounters& counters = DX12Helper::GetInstance().GetRenderCounters();
+	output <<
+		"    Draws: "		<< counters.GetLastFrame(RENDER_COUNTER_DRAW_CALLS) <<
+		"    PSO Changes: "	<< counters.GetLastFrame(RENDER_COUNTER_PSO_CHANGES) <<
+		"    CB Bytes: "	<< counters.GetLastFrame(RENDER_COUNTER_CB_BYTES_COPIED);
+	framePipeline.ResetStats();
+	framePacer.ResetStats();
 	
 	// Append the version of Direct3D the app is using
 	switch (dxFeatureLevel)
@@ -635,6 +898,7 @@ void DXCore::UpdateTitleBarStats()
 	// Actually update the title bar and reset fps data
 	SetWindowText(hWnd, output.str().c_str());
 	fpsFrameCount = 0;
+	fpsTickCount = 0;
 	fpsTimeElapsed += 1.0f;
 }
 
@@ -712,7 +976,9 @@ LRESULT DXCore::ProcessMessage(HWND hWnd, UINT uMsg, WPARAM wParam, LPARAM lPara
 		if (wParam == SIZE_MINIMIZED)
 			return 0;
 		
-		// Save the new client area dimensions.
+		// Save the new client area dimensions (once the
+		// render thread is done with the old ones)
+		framePipeline.Flush();
 		windowWidth = LOWORD(lParam);
 		windowHeight = HIWORD(lParam);
 
@@ -1,15 +1,28 @@
 #pragma once
 
 #include <Windows.h>
+#include <atomic>
 #include <d3d12.h>
 #include <dxgi1_6.h>
 #include <string>
 #include <wrl/client.h> // Used for ComPtr - a smart pointer for COM objects
+#include "FramePipeline.h"
+#include "FixedTimestep.h"
+#include "FramePacer.h"
+#include "FrameStats.h"
 
 // We can include the correct library files here
 // instead of in Visual Studio settings if we want
 #pragma comment(lib, "d3d12.lib")
 #pragma comment(lib, "dxgi.lib")
+#pragma comment(lib, "winmm.lib")
+
+// Most back buffers the swap chain can be given
+#define MAX_BACK_BUFFERS 4
+
+// Frames to let the game's vectors and arenas grow before frames
+// are expected not to allocate
+#define ZERO_ALLOCATION_WARMUP_FRAMES 120
 
 class DXCore
 {
@@ -42,8 +55,16 @@ public:
 	void Quit();
 	virtual void OnResize();
 
+	// Swap chain pacing, changeable at any time
+	// - Back buffers: 2 (lowest latency) up to MAX_BACK_BUFFERS (smoother)
+	// - Max frame latency: frames that can be queued up for presenting
+	//   before the next frame waits to start (and read its input)
+	void SetBackBufferCount(unsigned int count);
+	void SetMaxFrameLatency(unsigned int frames);
+
 	// Pure virtual methods for setup and game functionality
 	virtual void Init() = 0;
+	virtual void FixedUpdate(float deltaTime, float totalTime) = 0;
 	virtual void Update(float deltaTime, float totalTime) = 0;
 	virtual void Draw(float deltaTime, float totalTime) = 0;
 
@@ -67,13 +88,53 @@ protected:
 	bool deviceSupportsTearing;
 	BOOL isFullscreen; // Due to alt+enter key combination (must be BOOL typedef)
 
+	// Draw each frame on a render thread while the next one is simulated?
+	// Update() fills framePipeline.GetUpdateSlot()'s render state and Draw()
+	// must only read framePipeline.GetDrawSlot()'s, since it may be running
+	// on the render thread at the same time.
+	bool pipelinedRendering;
+	FramePipeline framePipeline;
+
+	// The simulation steps in fixed ticks: each frame, FixedUpdate() runs
+	// once per tick fixedTimestep says is due (always with the same
+	// deltaTime), then Update() runs once. Key presses belong in Update(),
+	// since a frame can have any number of ticks, including none.
+	// fixedTimestep.GetInterpolation() is how far the frame is between
+	// the last two ticks, for drawing state blended between them.
+	FixedTimestep fixedTimestep;
+
+	// Each frame waits for the swap chain to have room for it, then for
+	// the frame limiter (framePacer.SetTargetFrameRate()), and only then
+	// reads input, so the input is as fresh as possible when the frame
+	// is presented. framePacer measures how long that takes.
+	FramePacer framePacer;
+	unsigned int maxFrameLatency;
+
+	// Every recent frame's time and where it went (FRAME_PHASE_*). The
+	// loop times input, update and the wait for the swap chain, and Draw()
+	// adds the rest to framePipeline.GetDrawFrame(). Saved on exit.
+	FrameStats frameStats;
+	void ExportFrameStats();
+
+	// Profiler captures (see Profiler.h), saved when they stop or on exit
+	void ToggleProfilerCapture();
+
+	// Once the game has warmed up, heap allocations in FixedUpdate(),
+	// Update() and Draw() are errors (see ZERO_ALLOCATIONS), unless they're
+	// in an ALLOW_ALLOCATIONS() scope. On by default in debug builds.
+	// Anything that changes what frames do should restart the warm-up,
+	// which allows allocations for the rest of the frame too.
+	std::atomic<bool> zeroAllocationFrames;
+	void RestartAllocationWarmup();
+
 	// DirectX related objects and variables
-	static const unsigned int numBackBuffers = 2;
+	unsigned int backBufferCount;
 	unsigned int currentSwapBuffer;
 
 	D3D_FEATURE_LEVEL dxFeatureLevel;
 	Microsoft::WRL::ComPtr<ID3D12Device> device;
-	Microsoft::WRL::ComPtr<IDXGISwapChain> swapChain;
+	Microsoft::WRL::ComPtr<IDXGISwapChain3> swapChain;
+	HANDLE frameLatencyWaitable;
 
 	Microsoft::WRL::ComPtr<ID3D12CommandAllocator> commandAllocator;
 	Microsoft::WRL::ComPtr<ID3D12CommandQueue> commandQueue;
@@ -83,15 +144,20 @@ protected:
 	Microsoft::WRL::ComPtr<ID3D12DescriptorHeap> rtvHeap;
 	Microsoft::WRL::ComPtr<ID3D12DescriptorHeap> dsvHeap;
 
-	D3D12_CPU_DESCRIPTOR_HANDLE rtvHandles[numBackBuffers];
+	D3D12_CPU_DESCRIPTOR_HANDLE rtvHandles[MAX_BACK_BUFFERS];
 	D3D12_CPU_DESCRIPTOR_HANDLE dsvHandle;
 
-	Microsoft::WRL::ComPtr<ID3D12Resource> backBuffers[numBackBuffers];
+	Microsoft::WRL::ComPtr<ID3D12Resource> backBuffers[MAX_BACK_BUFFERS];
 	Microsoft::WRL::ComPtr<ID3D12Resource> depthStencilBuffer;
 
 	D3D12_VIEWPORT viewport;
 	D3D12_RECT scissorRect;
 
+	// Fraction of the window's width and height the last frame was
+	// rendered at (dynamic resolution), for the title bar. Written
+	// by Draw(), which may be on the render thread.
+	std::atomic<float> renderScale;
+
 	// Helper function for allocating a console window
 	void CreateConsoleWindow(int bufferLines, int bufferColumns, int windowLines, int windowColumns);
 
@@ -104,11 +170,26 @@ private:
 	__int64 currentTime;
 	__int64 previousTime;
 
+	// Timing each slot's frame was simulated with, for its Draw()
+	float frameDeltaTimes[FRAME_PIPELINE_SLOTS];
+	float frameTotalTimes[FRAME_PIPELINE_SLOTS];
+	double frameInputTimes[FRAME_PIPELINE_SLOTS];
+
+	// Simulated time so far
+	double simulationTime;
+
+	// First frame of the allocation warm-up (frames before it don't count)
+	std::atomic<unsigned int> allocationWarmupStart;
+	bool FrameForbidsAllocations(unsigned int frame);
+
 	// FPS calculation
 	int fpsFrameCount;
+	int fpsTickCount;
 	float fpsTimeElapsed;
 
+	void WaitForNextFrame();	// Paces the start of each frame
 	void UpdateTimer();			// Updates the timer for this frame
+	void RunTicks();			// Runs the fixed ticks this frame owes
 	void UpdateTitleBarStats();	// Puts debug info in the title bar
 };
 
@@ -0,0 +1,121 @@
+#include "DynamicResolution.h"
+#include <algorithm>
+#include <cmath>
+
+DynamicResolution::DynamicResolution(float budgetMs, float minScale, float maxScale) :
+	budget(budgetMs),
+	scale(maxScale)
+{
+	SetScaleRange(minScale, maxScale);
+	Reset();
+}
+
+// The scale is kept, and the next frames decide whether it still fits
+void DynamicResolution::SetBudget(float budgetMs)
+{
+	budget = budgetMs;
+}
+
+float DynamicResolution::GetBudget()
+{
+	return budget;
+}
+
+void DynamicResolution::SetScaleRange(float minScale, float maxScale)
+{
+	this->minScale = std::max(minScale, 0.01f);
+	this->maxScale = std::max(maxScale, this->minScale);
+	scale = std::min(std::max(scale, this->minScale), this->maxScale);
+}
+
+float DynamicResolution::GetMinScale()
+{
+	return minScale;
+}
+
+float DynamicResolution::GetMaxScale()
+{
+	return maxScale;
+}
+
+// --------------------------------------------------------
+// Folds the frame time into the average, then moves the scale
+// if the average is over budget (straight away) or well under
+// it (after a run of such frames). The step is whatever would
+// land the average at DYNAMIC_RESOLUTION_TARGET of the budget if
+// cost went with pixel count, clamped to the max step sizes.
+// --------------------------------------------------------
+float DynamicResolution::Update(float frameTimeMs)
+{
+	float smoothing = frameTimeMs > smoothedFrameTime ? DYNAMIC_RESOLUTION_SMOOTHING_UP : DYNAMIC_RESOLUTION_SMOOTHING_DOWN;
+	smoothedFrameTime = hasFrameTime ?
+		smoothedFrameTime + (frameTimeMs - smoothedFrameTime) * smoothing :
+		frameTimeMs;
+	hasFrameTime = true;
+
+	if (cooldown > 0)
+	{
+		cooldown--;
+		return scale;
+	}
+
+	float step = sqrtf(DYNAMIC_RESOLUTION_TARGET * budget / smoothedFrameTime);
+	float newScale = scale;
+	if (smoothedFrameTime > budget)
+	{
+		framesWithHeadroom = 0;
+		newScale = scale * std::max(step, DYNAMIC_RESOLUTION_MAX_STEP_DOWN);
+	}
+	else if (smoothedFrameTime < budget * DYNAMIC_RESOLUTION_HEADROOM)
+	{
+		if (framesWithHeadroom < DYNAMIC_RESOLUTION_UPSCALE_FRAMES)
+			framesWithHeadroom++;
+		if (framesWithHeadroom == DYNAMIC_RESOLUTION_UPSCALE_FRAMES)
+			newScale = scale * std::min(step, DYNAMIC_RESOLUTION_MAX_STEP_UP);
+	}
+	else
+	{
+		// Close enough to the budget to leave alone
+		framesWithHeadroom = 0;
+	}
+
+	newScale = std::min(std::max(newScale, minScale), maxScale);
+	if (newScale != scale)
+	{
+		// Assume the frames already averaged would have scaled the same
+		// way, rather than waiting for the average to catch up
+		float ratio = newScale / scale;
+		smoothedFrameTime *= ratio * ratio;
+
+		scale = newScale;
+		framesWithHeadroom = 0;
+		cooldown = DYNAMIC_RESOLUTION_COOLDOWN_FRAMES;
+		changeCount++;
+	}
+	return scale;
+}
+
+float DynamicResolution::GetScale()
+{
+	return scale;
+}
+
+float DynamicResolution::GetSmoothedFrameTime()
+{
+	return smoothedFrameTime;
+}
+
+unsigned int DynamicResolution::GetChangeCount()
+{
+	return changeCount;
+}
+
+void DynamicResolution::Reset()
+{
+	scale = maxScale;
+	smoothedFrameTime = 0;
+	hasFrameTime = false;
+	framesWithHeadroom = 0;
+	cooldown = 0;
+	changeCount = 0;
+}
\ No newline at end of file
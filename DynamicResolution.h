@@ -0,0 +1,75 @@
+#pragma once
+
+// Weight of each new frame time in the running average: frames
+// slower than the average count for more, so the scale drops soon
+// after the load goes up but doesn't go back up on a few fast frames
+#define DYNAMIC_RESOLUTION_SMOOTHING_UP 0.5f
+#define DYNAMIC_RESOLUTION_SMOOTHING_DOWN 0.1f
+
+// Where in the budget the scale aims when it changes, leaving some
+// room for noise before the next frame is over again
+#define DYNAMIC_RESOLUTION_TARGET 0.9f
+
+// Frames have to come in under this much of the budget, this many
+// frames in a row, before the scale goes back up
+#define DYNAMIC_RESOLUTION_HEADROOM 0.8f
+#define DYNAMIC_RESOLUTION_UPSCALE_FRAMES 30
+
+// Largest change to the scale in one step, down and up
+#define DYNAMIC_RESOLUTION_MAX_STEP_DOWN 0.75f
+#define DYNAMIC_RESOLUTION_MAX_STEP_UP 1.25f
+
+// Frames to wait after a change before changing again, so the
+// average has taken in some frames at the new scale
+#define DYNAMIC_RESOLUTION_COOLDOWN_FRAMES 4
+
+// --------------------------------------------------------
+// Picks the fraction of the output resolution (on each axis) to
+// render at, from measured frame times, so frames stay inside a
+// time budget by giving up sharpness rather than frame rate.
+//
+// Frame times are smoothed, and the cost of a frame is assumed to
+// go with the number of pixels (the scale squared) when working
+// out what scale would hit the budget. That's never quite true
+// (some of a frame doesn't depend on resolution), so it takes a
+// few steps to settle, each one smaller than the last.
+//
+// Going over the budget lowers the scale right away. Raising it
+// again waits for a run of frames with real headroom, and anything
+// in between holds the scale where it is, so a frame time hovering
+// near the budget doesn't make the resolution flicker.
+// --------------------------------------------------------
+class DynamicResolution
+{
+public:
+	DynamicResolution(float budgetMs = 16.667f, float minScale = 0.5f, float maxScale = 1.0f);
+
+	void SetBudget(float budgetMs);
+	float GetBudget();
+	void SetScaleRange(float minScale, float maxScale);
+	float GetMinScale();
+	float GetMaxScale();
+
+	// Takes the time the last frame took, returning the scale for the next one
+	float Update(float frameTimeMs);
+
+	float GetScale();
+	float GetSmoothedFrameTime();
+
+	// Times the scale has changed since construction or Reset()
+	unsigned int GetChangeCount();
+
+	// Back to full scale with no frame history
+	void Reset();
+
+private:
+	float budget;
+	float minScale;
+	float maxScale;
+	float scale;
+	float smoothedFrameTime;
+	bool hasFrameTime;
+	unsigned int framesWithHeadroom;
+	unsigned int cooldown;
+	unsigned int changeCount;
+};
\ No newline at end of file
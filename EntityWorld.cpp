@@ -0,0 +1,197 @@
+#include "EntityWorld.h"
+#include <cstring>
+
+// Component arrays in a chunk start on 16 byte boundaries for SIMD loads
+#define COMPONENT_ARRAY_ALIGNMENT 16
+
+unsigned int ComponentTypes::GetSize(unsigned int id)
+{
+	return GetSizes()[id];
+}
+
+unsigned int ComponentTypes::Register(unsigned int size)
+{
+	std::vector<unsigned int>& sizes = GetSizes();
+	sizes.push_back(size);
+	return (unsigned int)sizes.size() - 1;
+}
+
+std::vector<unsigned int>& ComponentTypes::GetSizes()
+{
+	static std::vector<unsigned int> sizes;
+	return sizes;
+}
+
+EntityWorld::EntityWorld() :
+	count(0)
+{
+}
+
+// --------------------------------------------------------
+// Adds an entity with the given components (all zeroed) to the end
+// of its archetype's storage
+// --------------------------------------------------------
+Entity EntityWorld::Spawn(ComponentMask mask)
+{
+	unsigned int archetypeIndex = GetArchetype(mask);
+	Archetype& archetype = archetypes[archetypeIndex];
+
+	// Move on to the next chunk (allocating one if needed) when the last is full
+	if (archetype.chunkCount == 0 || archetype.chunks[archetype.chunkCount - 1].count == archetype.capacity)
+	{
+		if (archetype.chunkCount == archetype.chunks.size())
+		{
+			EntityChunk chunk;
+			chunk.data.reset(new unsigned char[ENTITY_CHUNK_SIZE]);
+			chunk.count = 0;
+			archetype.chunks.push_back(std::move(chunk));
+		}
+		archetype.chunkCount++;
+	}
+	unsigned int chunkIndex = archetype.chunkCount - 1;
+	EntityChunk& chunk = archetype.chunks[chunkIndex];
+	unsigned int row = chunk.count++;
+
+	Entity entity;
+	if (!freeIndices.empty())
+	{
+		entity.index = freeIndices.back();
+		freeIndices.pop_back();
+	}
+	else
+	{
+		entity.index = (unsigned int)locations.size();
+		locations.push_back(EntityLocation());
+		generations.push_back(0);
+	}
+	entity.generation = generations[entity.index];
+	locations[entity.index] = { archetypeIndex, chunkIndex, row };
+
+	((Entity*)chunk.data.get())[row] = entity;
+	for (unsigned int id = 0; id < MAX_COMPONENT_TYPES; id++)
+	{
+		if (mask & (1u << id))
+		{
+			unsigned int size = ComponentTypes::GetSize(id);
+			memset(chunk.data.get() + archetype.offsets[id] + row * size, 0, size);
+		}
+	}
+
+	count++;
+	return entity;
+}
+
+// --------------------------------------------------------
+// Removes an entity by moving the last entity of the same
+// archetype into its place
+// --------------------------------------------------------
+void EntityWorld::Despawn(Entity entity)
+{
+	if (!IsAlive(entity))
+		return;
+
+	EntityLocation location = locations[entity.index];
+	Archetype& archetype = archetypes[location.archetype];
+	unsigned int lastChunkIndex = archetype.chunkCount - 1;
+	EntityChunk& lastChunk = archetype.chunks[lastChunkIndex];
+	unsigned int lastRow = lastChunk.count - 1;
+
+	if (location.chunk != lastChunkIndex || location.row != lastRow)
+	{
+		EntityChunk& chunk = archetype.chunks[location.chunk];
+		for (unsigned int id = 0; id < MAX_COMPONENT_TYPES; id++)
+		{
+			if (archetype.mask & (1u << id))
+			{
+				unsigned int size = ComponentTypes::GetSize(id);
+				memcpy(
+					chunk.data.get() + archetype.offsets[id] + location.row * size,
+					lastChunk.data.get() + archetype.offsets[id] + lastRow * size,
+					size);
+			}
+		}
+
+		Entity moved = ((Entity*)lastChunk.data.get())[lastRow];
+		((Entity*)chunk.data.get())[location.row] = moved;
+		locations[moved.index] = location;
+	}
+
+	// Keep emptied chunks around for the next spawn
+	lastChunk.count--;
+	if (lastChunk.count == 0)
+		archetype.chunkCount--;
+
+	generations[entity.index]++;
+	freeIndices.push_back(entity.index);
+	count--;
+}
+
+bool EntityWorld::IsAlive(Entity entity)
+{
+	// Despawning bumps the generation, so old handles no longer match
+	return entity.index < generations.size() && generations[entity.index] == entity.generation;
+}
+
+unsigned int EntityWorld::GetCount()
+{
+	return count;
+}
+
+// --------------------------------------------------------
+// Finds the archetype for exactly this set of components,
+// creating it (and working out its chunk layout) if needed
+// --------------------------------------------------------
+unsigned int EntityWorld::GetArchetype(ComponentMask mask)
+{
+	for (unsigned int i = 0; i < archetypes.size(); i++)
+	{
+		if (archetypes[i].mask == mask)
+			return i;
+	}
+
+	Archetype archetype = {};
+	archetype.mask = mask;
+
+	// Bytes per entity: its handle plus one of each component
+	unsigned int rowSize = sizeof(Entity);
+	unsigned int componentCount = 0;
+	for (unsigned int id = 0; id < MAX_COMPONENT_TYPES; id++)
+	{
+		if (mask & (1u << id))
+		{
+			rowSize += ComponentTypes::GetSize(id);
+			componentCount++;
+		}
+	}
+
+	// Fit as many entities as possible, leaving room to align each array
+	archetype.capacity = (ENTITY_CHUNK_SIZE - componentCount * COMPONENT_ARRAY_ALIGNMENT) / rowSize;
+	unsigned int offset = archetype.capacity * sizeof(Entity);
+	for (unsigned int id = 0; id < MAX_COMPONENT_TYPES; id++)
+	{
+		if (mask & (1u << id))
+		{
+			offset = (offset + COMPONENT_ARRAY_ALIGNMENT - 1) & ~(COMPONENT_ARRAY_ALIGNMENT - 1);
+			archetype.offsets[id] = offset;
+			offset += archetype.capacity * ComponentTypes::GetSize(id);
+		}
+	}
+
+	archetypes.push_back(std::move(archetype));
+	return (unsigned int)archetypes.size() - 1;
+}
+
+void* EntityWorld::GetComponent(Entity entity, unsigned int componentId)
+{
+	if (!IsAlive(entity))
+		return 0;
+
+	const EntityLocation& location = locations[entity.index];
+	Archetype& archetype = archetypes[location.archetype];
+	if (!(archetype.mask & (1u << componentId)))
+		return 0;
+
+	return archetype.chunks[location.chunk].data.get() +
+		archetype.offsets[componentId] +
+		location.row * ComponentTypes::GetSize(componentId);
+}
\ No newline at end of file
@@ -0,0 +1,209 @@
+#pragma once
+#include <memory>
+#include <utility>
+#include <vector>
+#include "JobSystem.h"
+#include "LinearArena.h"
+
+// Up to 32 component types, one bit each
+#define MAX_COMPONENT_TYPES 32
+typedef unsigned int ComponentMask;
+
+// Size of one block of entity storage
+#define ENTITY_CHUNK_SIZE (16 * 1024)
+
+// Identifies an entity. The generation changes whenever an index is
+// reused, so handles to despawned entities stop being valid.
+struct Entity
+{
+	unsigned int index;
+	unsigned int generation;
+};
+
+// Gives each component type a small id the first time it's used
+class ComponentTypes
+{
+public:
+	template<typename T>
+	static unsigned int GetId()
+	{
+		static unsigned int id = Register(sizeof(T));
+		return id;
+	}
+
+	template<typename... Components>
+	static ComponentMask GetMask()
+	{
+		ComponentMask mask = 0;
+		ComponentMask unused[] = { 0u, (mask |= 1u << GetId<Components>())... };
+		(void)unused;
+		return mask;
+	}
+
+	static unsigned int GetSize(unsigned int id);
+
+private:
+	static unsigned int Register(unsigned int size);
+	static std::vector<unsigned int>& GetSizes();
+};
+
+// --------------------------------------------------------
+// Entity/component store grouped by archetype (the exact set of
+// components an entity has). Each archetype keeps its entities in
+// fixed size chunks, and within a chunk every component type is a
+// tightly packed array, so queries walk contiguous memory.
+//
+// Components must be plain data (they're moved with memcpy and start
+// zeroed). Chunks are kept full except the last one in each archetype:
+// despawning moves that archetype's last entity into the hole.
+// --------------------------------------------------------
+class EntityWorld
+{
+public:
+	EntityWorld();
+
+	// Creates an entity with exactly these components
+	template<typename... Components>
+	Entity Spawn(const Components&... components)
+	{
+		Entity entity = Spawn(ComponentTypes::GetMask<Components...>());
+		int unused[] = { 0, (*Get<Components>(entity) = components, 0)... };
+		(void)unused;
+		return entity;
+	}
+	Entity Spawn(ComponentMask mask);
+	void Despawn(Entity entity);
+	bool IsAlive(Entity entity);
+	unsigned int GetCount();
+
+	// Component of one entity, or null if it doesn't have that component
+	template<typename T>
+	T* Get(Entity entity)
+	{
+		return (T*)GetComponent(entity, ComponentTypes::GetId<T>());
+	}
+
+	// --------------------------------------------------------
+	// Calls function(count, Entity*, Components*...) once for every
+	// chunk whose archetype has all of the requested components, with
+	// a pointer to the start of each component array in that chunk
+	// --------------------------------------------------------
+	template<typename... Components, typename Function>
+	void ForEachChunk(Function function)
+	{
+		ComponentMask mask = ComponentTypes::GetMask<Components...>();
+		for (Archetype& archetype : archetypes)
+		{
+			if ((archetype.mask & mask) != mask)
+				continue;
+
+			for (unsigned int c = 0; c < archetype.chunkCount; c++)
+			{
+				EntityChunk& chunk = archetype.chunks[c];
+				function(
+					chunk.count,
+					(Entity*)chunk.data.get(),
+					(Components*)(chunk.data.get() + archetype.offsets[ComponentTypes::GetId<Components>()])...);
+			}
+		}
+	}
+
+	// --------------------------------------------------------
+	// Same as ForEachChunk(), but chunks are handed out as jobs, so
+	// function runs on several threads at once. Each chunk is only
+	// visited by one call, so writing to its own components is safe;
+	// spawning or despawning from inside function is not.
+	// --------------------------------------------------------
+	template<typename... Components, typename Function>
+	void ForEachChunkParallel(Function function)
+	{
+		// Looked up here so every component type is registered before any job runs
+		ComponentMask mask = ComponentTypes::GetMask<Components...>();
+		unsigned int chunkCount = 0;
+		for (Archetype& archetype : archetypes)
+		{
+			if ((archetype.mask & mask) == mask)
+				chunkCount += archetype.chunkCount;
+		}
+
+		// The list of chunks only lives as long as this call
+		ScratchScope scratch;
+		ChunkRef* chunks = scratch.AllocateArray<ChunkRef>(chunkCount);
+		unsigned int chunkIndex = 0;
+		for (Archetype& archetype : archetypes)
+		{
+			if ((archetype.mask & mask) != mask)
+				continue;
+
+			for (unsigned int c = 0; c < archetype.chunkCount; c++)
+			{
+				chunks[chunkIndex].archetype = &archetype;
+				chunks[chunkIndex].chunk = &archetype.chunks[c];
+				chunkIndex++;
+			}
+		}
+
+		JobSystem::GetInstance().ParallelFor(0, chunkCount, 1, [&](unsigned int first, unsigned int last)
+		{
+			for (unsigned int c = first; c < last; c++)
+			{
+				Archetype& archetype = *chunks[c].archetype;
+				EntityChunk& chunk = *chunks[c].chunk;
+				function(
+					chunk.count,
+					(Entity*)chunk.data.get(),
+					(Components*)(chunk.data.get() + archetype.offsets[ComponentTypes::GetId<Components>()])...);
+			}
+		});
+	}
+
+	// Calls function(Entity, Components&...) for every matching entity
+	template<typename... Components, typename Function>
+	void ForEach(Function function)
+	{
+		ForEachChunk<Components...>([&function](unsigned int count, Entity* entities, Components*... components)
+		{
+			for (unsigned int i = 0; i < count; i++)
+				function(entities[i], components[i]...);
+		});
+	}
+
+private:
+	struct EntityChunk
+	{
+		std::unique_ptr<unsigned char[]> data;
+		unsigned int count;
+	};
+
+	struct Archetype
+	{
+		ComponentMask mask;
+		unsigned int capacity;                              // Entities per chunk
+		unsigned int offsets[MAX_COMPONENT_TYPES];          // Start of each component array in a chunk
+		std::vector<EntityChunk> chunks;
+		unsigned int chunkCount;                            // Chunks in use (empty ones are kept for reuse)
+	};
+
+	// A chunk to visit in ForEachChunkParallel()
+	struct ChunkRef
+	{
+		Archetype* archetype;
+		EntityChunk* chunk;
+	};
+
+	struct EntityLocation
+	{
+		unsigned int archetype;
+		unsigned int chunk;
+		unsigned int row;
+	};
+
+	std::vector<Archetype> archetypes;
+	std::vector<EntityLocation> locations;
+	std::vector<unsigned int> generations;
+	std::vector<unsigned int> freeIndices;
+	unsigned int count;
+
+	unsigned int GetArchetype(ComponentMask mask);
+	void* GetComponent(Entity entity, unsigned int componentId);
+};
\ No newline at end of file
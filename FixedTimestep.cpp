@@ -0,0 +1,77 @@
+#include "FixedTimestep.h"
+#include <cmath>
+
+FixedTimestep::FixedTimestep(float ticksPerSecond, unsigned int maxTicksPerFrame) :
+	tickTime(1.0 / ticksPerSecond),
+	maxTicksPerFrame(maxTicksPerFrame)
+{
+	Reset();
+}
+
+// Time already built up carries over to the new rate
+void FixedTimestep::SetTickRate(float ticksPerSecond)
+{
+	tickTime = 1.0 / ticksPerSecond;
+}
+
+void FixedTimestep::SetMaxTicksPerFrame(unsigned int maxTicks)
+{
+	maxTicksPerFrame = maxTicks;
+}
+
+float FixedTimestep::GetTickRate()
+{
+	return (float)(1.0 / tickTime);
+}
+
+double FixedTimestep::GetTickTime()
+{
+	return tickTime;
+}
+
+// --------------------------------------------------------
+// Counts the whole ticks built up, up to maxTicksPerFrame. Whole
+// ticks beyond that are dropped, keeping only the part of a tick
+// that's left over (so interpolation stays smooth).
+// --------------------------------------------------------
+unsigned int FixedTimestep::Advance(double frameTime)
+{
+	accumulator += frameTime;
+
+	unsigned int ticks = 0;
+	while (accumulator >= tickTime && ticks < maxTicksPerFrame)
+	{
+		accumulator -= tickTime;
+		ticks++;
+	}
+	if (accumulator >= tickTime)
+	{
+		droppedTickCount += (unsigned long long)(accumulator / tickTime);
+		accumulator = fmod(accumulator, tickTime);
+	}
+
+	tickCount += ticks;
+	return ticks;
+}
+
+float FixedTimestep::GetInterpolation()
+{
+	return (float)(accumulator / tickTime);
+}
+
+unsigned long long FixedTimestep::GetTotalTicks()
+{
+	return tickCount;
+}
+
+unsigned long long FixedTimestep::GetDroppedTicks()
+{
+	return droppedTickCount;
+}
+
+void FixedTimestep::Reset()
+{
+	accumulator = 0;
+	tickCount = 0;
+	droppedTickCount = 0;
+}
\ No newline at end of file
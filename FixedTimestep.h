@@ -0,0 +1,45 @@
+#pragma once
+
+// --------------------------------------------------------
+// Turns variable frame times into a whole number of fixed length
+// simulation ticks, so the simulation behaves the same at any frame
+// rate and each step costs the same no matter how long a frame took.
+//
+// Real time builds up in an accumulator and each whole tick in it is
+// run. What's left over is how far the frame is towards the next
+// tick, which rendering uses to blend between the last two.
+//
+// A frame never runs more than maxTicksPerFrame ticks. If the ticks
+// themselves are what's slow, catching up on every one would make the
+// next frame slower still (and so on), so past the limit the extra
+// time is dropped and the simulation falls behind real time instead.
+// --------------------------------------------------------
+class FixedTimestep
+{
+public:
+	FixedTimestep(float ticksPerSecond = 60, unsigned int maxTicksPerFrame = 5);
+
+	void SetTickRate(float ticksPerSecond);
+	void SetMaxTicksPerFrame(unsigned int maxTicks);
+	float GetTickRate();
+	double GetTickTime();
+
+	// Adds a frame's real time, returning how many ticks to run for it
+	unsigned int Advance(double frameTime);
+
+	// How far (0-1) the last Advance() left things from the latest tick
+	// to the next one
+	float GetInterpolation();
+
+	// Totals since construction or Reset()
+	unsigned long long GetTotalTicks();
+	unsigned long long GetDroppedTicks();
+	void Reset();
+
+private:
+	double tickTime;
+	unsigned int maxTicksPerFrame;
+	double accumulator;
+	unsigned long long tickCount;
+	unsigned long long droppedTickCount;
+};
\ No newline at end of file
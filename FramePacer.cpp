@@ -0,0 +1,140 @@
+#include "FramePacer.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <thread>
+
+// How long the limiter asks to sleep at a time, in seconds
+#define FRAME_PACER_SLEEP_STEP 0.001
+
+// How quickly the sleep estimate follows new measurements (the first
+// few are simply averaged, so it settles quickly)
+#define FRAME_PACER_SLEEP_SMOOTHING 0.05
+
+double SystemFrameClock::Now()
+{
+	return std::chrono::duration<double>(std::chrono::high_resolution_clock::now().time_since_epoch()).count();
+}
+
+void SystemFrameClock::Sleep(double seconds)
+{
+	std::this_thread::sleep_for(std::chrono::duration<double>(seconds));
+}
+
+FramePacer::FramePacer(FrameClock* clock) :
+	clock(clock ? clock : &systemClock),
+	frameInterval(0),
+	nextDeadline(0),
+	sleepMean(FRAME_PACER_SLEEP_STEP),
+	sleepVariance(0),
+	sleepCount(0)
+{
+	ResetStats();
+}
+
+void FramePacer::SetTargetFrameRate(float framesPerSecond)
+{
+	frameInterval = framesPerSecond > 0 ? 1.0 / framesPerSecond : 0;
+	nextDeadline = 0;
+}
+
+float FramePacer::GetTargetFrameRate()
+{
+	return frameInterval > 0 ? (float)(1.0 / frameInterval) : 0;
+}
+
+// --------------------------------------------------------
+// Sleeps while another sleep should still wake up before the
+// deadline, then spins the rest of the way. A frame that's more
+// than a whole interval late starts the schedule over, rather
+// than rushing out frames to catch up.
+// --------------------------------------------------------
+void FramePacer::WaitForNextFrame()
+{
+	if (frameInterval <= 0)
+		return;
+
+	double now = clock->Now();
+	if (now - nextDeadline > frameInterval)
+		nextDeadline = now;
+
+	double sleepStart = now;
+	while (nextDeadline - now > sleepMean + 2 * sqrt(sleepVariance))
+	{
+		Sleep();
+		now = clock->Now();
+	}
+	sleepTotal += now - sleepStart;
+
+	double spinStart = now;
+	while (now < nextDeadline)
+		now = clock->Now();
+	spinTotal += now - spinStart;
+
+	waitCount++;
+	nextDeadline += frameInterval;
+}
+
+double FramePacer::Now()
+{
+	return clock->Now();
+}
+
+void FramePacer::RecordPresent(double inputTime)
+{
+	unsigned long long latency = (unsigned long long)(std::max(clock->Now() - inputTime, 0.0) * 1000000000.0);
+	latencyTotal += latency;
+	presentCount++;
+
+	unsigned long long worst = latencyMax.load();
+	while (latency > worst && !latencyMax.compare_exchange_weak(worst, latency))
+	{
+	}
+}
+
+double FramePacer::GetAverageLatencyMs()
+{
+	return presentCount == 0 ? 0 : latencyTotal / 1000000.0 / presentCount;
+}
+
+double FramePacer::GetMaxLatencyMs()
+{
+	return latencyMax / 1000000.0;
+}
+
+double FramePacer::GetAverageSleepMs()
+{
+	return waitCount == 0 ? 0 : sleepTotal * 1000.0 / waitCount;
+}
+
+double FramePacer::GetAverageSpinMs()
+{
+	return waitCount == 0 ? 0 : spinTotal * 1000.0 / waitCount;
+}
+
+void FramePacer::ResetStats()
+{
+	latencyTotal = 0;
+	latencyMax = 0;
+	presentCount = 0;
+	sleepTotal = 0;
+	spinTotal = 0;
+	waitCount = 0;
+}
+
+// --------------------------------------------------------
+// Sleeps for one step and folds how long it really took into
+// the estimate
+// --------------------------------------------------------
+void FramePacer::Sleep()
+{
+	double start = clock->Now();
+	clock->Sleep(FRAME_PACER_SLEEP_STEP);
+	double slept = clock->Now() - start;
+
+	sleepCount++;
+	double weight = std::max(1.0 / sleepCount, FRAME_PACER_SLEEP_SMOOTHING);
+	double difference = slept - sleepMean;
+	sleepMean += weight * difference;
+	sleepVariance = (1 - weight) * (sleepVariance + weight * difference * difference);
+}
\ No newline at end of file
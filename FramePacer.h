@@ -0,0 +1,89 @@
+#pragma once
+
+#include <atomic>
+
+// --------------------------------------------------------
+// Where a FramePacer gets the time, in seconds, and how it sleeps.
+// The default uses the real clock; tests can pass in a simulated
+// one whose sleeps oversleep however they like.
+// --------------------------------------------------------
+class FrameClock
+{
+public:
+	virtual ~FrameClock() {}
+	virtual double Now() = 0;
+	virtual void Sleep(double seconds) = 0;
+};
+
+class SystemFrameClock : public FrameClock
+{
+public:
+	double Now();
+	void Sleep(double seconds);
+};
+
+// --------------------------------------------------------
+// Frame limiter and input-to-present latency tracking.
+//
+// The limiter aims every frame at a deadline one frame interval
+// after the last one (not after whenever the last frame happened to
+// end, so small errors don't add up). The OS only wakes a sleeping
+// thread roughly when asked, so it sleeps in short steps for as long
+// as another sleep is sure to wake up in time, then spins for the
+// rest. How long a sleep really takes is learned as it goes (mean
+// plus two standard deviations), so it copes with coarse system
+// timers without burning a whole core spinning.
+//
+// Latency is measured from when a frame's input was read to when the
+// frame was presented. The presenting thread reports it, so this is
+// safe to use from the render thread.
+// --------------------------------------------------------
+class FramePacer
+{
+public:
+	// clock - Used instead of the system clock, if not 0 (not owned)
+	FramePacer(FrameClock* clock = 0);
+
+	// Frames per second to hold to (0 = as fast as possible)
+	void SetTargetFrameRate(float framesPerSecond);
+	float GetTargetFrameRate();
+
+	// Returns once it's time to start the next frame
+	void WaitForNextFrame();
+
+	// The pacer's clock, in seconds
+	double Now();
+
+	// A frame whose input was read at inputTime (from Now()) was just presented
+	void RecordPresent(double inputTime);
+
+	// Averages (and the worst latency) since the last ResetStats()
+	double GetAverageLatencyMs();
+	double GetMaxLatencyMs();
+	double GetAverageSleepMs();
+	double GetAverageSpinMs();
+	void ResetStats();
+
+private:
+	SystemFrameClock systemClock;
+	FrameClock* clock;
+
+	double frameInterval;
+	double nextDeadline;
+
+	// What one short sleep really takes: a moving mean and variance,
+	// so it keeps up if the system timer's resolution changes
+	double sleepMean;
+	double sleepVariance;
+	unsigned int sleepCount;
+
+	// Totals in nanoseconds, so either thread can add to them
+	std::atomic<unsigned long long> latencyTotal;
+	std::atomic<unsigned long long> latencyMax;
+	std::atomic<unsigned int> presentCount;
+	double sleepTotal;
+	double spinTotal;
+	unsigned int waitCount;
+
+	void Sleep();
+};
\ No newline at end of file
@@ -0,0 +1,200 @@
+#include "FramePipeline.h"
+#include "Profiler.h"
+
+FramePipeline::FramePipeline() :
+	stopRenderThread(false),
+	publishedFrames(0),
+	drawnFrames(0)
+{
+	for (unsigned int slot = 0; slot < FRAME_PIPELINE_SLOTS; slot++)
+		frameArenas[slot].reset(new LinearArena(FRAME_ARENA_BYTES));
+	ResetStats();
+}
+
+FramePipeline::~FramePipeline()
+{
+	Stop();
+}
+
+void FramePipeline::SetDrawFunction(const std::function<void(unsigned int)>& draw)
+{
+	drawFunction = draw;
+}
+
+void FramePipeline::Start()
+{
+	if (renderThread.joinable())
+		return;
+
+	stopRenderThread = false;
+	renderThread = std::thread(&FramePipeline::RenderThreadMain, this);
+}
+
+void FramePipeline::Stop()
+{
+	if (!renderThread.joinable())
+		return;
+
+	stopRenderThread = true;
+	Wake(framePublished);
+	renderThread.join();
+}
+
+bool FramePipeline::IsRunning()
+{
+	return renderThread.joinable();
+}
+
+// --------------------------------------------------------
+// Waits (only when drawing is the slower side) until the frame
+// that last used the next slot has been drawn
+// --------------------------------------------------------
+void FramePipeline::BeginFrame()
+{
+	unsigned int frame = publishedFrames.load(std::memory_order_relaxed);
+	Clock::time_point waitStart = Clock::now();
+	if (frame - drawnFrames.load(std::memory_order_acquire) >= FRAME_PIPELINE_SLOTS)
+	{
+		std::unique_lock<std::mutex> lock(waitMutex);
+		frameDrawn.wait(lock, [&]() { return frame - drawnFrames.load(std::memory_order_acquire) < FRAME_PIPELINE_SLOTS; });
+	}
+	waitTimeTotal += NanosecondsSince(waitStart);
+
+	// Whatever the slot's last frame left in its arena is done with
+	frameArenas[frame % FRAME_PIPELINE_SLOTS]->Reset();
+	frameStarts[frame % FRAME_PIPELINE_SLOTS] = Clock::now();
+}
+
+void FramePipeline::EndFrame()
+{
+	unsigned int frame = publishedFrames.load(std::memory_order_relaxed);
+	updateTimeTotal += NanosecondsSince(frameStarts[frame % FRAME_PIPELINE_SLOTS]);
+
+	// Everything written to the slot is visible to whoever sees the new count
+	publishedFrames.store(frame + 1, std::memory_order_release);
+	if (IsRunning())
+		Wake(framePublished);
+	else
+		DrawFrame(frame);
+}
+
+void FramePipeline::Flush()
+{
+	std::unique_lock<std::mutex> lock(waitMutex);
+	frameDrawn.wait(lock, [&]() { return drawnFrames.load(std::memory_order_acquire) == publishedFrames.load(std::memory_order_relaxed); });
+}
+
+unsigned int FramePipeline::GetUpdateSlot()
+{
+	return publishedFrames.load(std::memory_order_relaxed) % FRAME_PIPELINE_SLOTS;
+}
+
+// Frames are drawn in order, so the one being drawn is the next one to finish
+unsigned int FramePipeline::GetDrawSlot()
+{
+	return drawnFrames.load(std::memory_order_relaxed) % FRAME_PIPELINE_SLOTS;
+}
+
+LinearArena& FramePipeline::GetFrameArena(unsigned int slot)
+{
+	return *frameArenas[slot];
+}
+
+unsigned int FramePipeline::GetUpdateFrame()
+{
+	return publishedFrames.load(std::memory_order_relaxed);
+}
+
+unsigned int FramePipeline::GetDrawFrame()
+{
+	return drawnFrames.load(std::memory_order_relaxed);
+}
+
+unsigned int FramePipeline::GetFrameCount()
+{
+	return statsFrameCount;
+}
+
+double FramePipeline::GetAverageUpdateTimeMs()
+{
+	return statsFrameCount == 0 ? 0 : updateTimeTotal / 1000000.0 / statsFrameCount;
+}
+
+double FramePipeline::GetAverageDrawTimeMs()
+{
+	return statsFrameCount == 0 ? 0 : drawTimeTotal / 1000000.0 / statsFrameCount;
+}
+
+double FramePipeline::GetAverageLatencyMs()
+{
+	return statsFrameCount == 0 ? 0 : latencyTotal / 1000000.0 / statsFrameCount;
+}
+
+double FramePipeline::GetAverageWaitTimeMs()
+{
+	return statsFrameCount == 0 ? 0 : waitTimeTotal / 1000000.0 / statsFrameCount;
+}
+
+void FramePipeline::ResetStats()
+{
+	updateTimeTotal = 0;
+	drawTimeTotal = 0;
+	latencyTotal = 0;
+	waitTimeTotal = 0;
+	statsFrameCount = 0;
+}
+
+void FramePipeline::DrawFrame(unsigned int frame)
+{
+	unsigned int slot = frame % FRAME_PIPELINE_SLOTS;
+	Clock::time_point drawStart = Clock::now();
+	drawFunction(slot);
+	drawTimeTotal += NanosecondsSince(drawStart);
+	latencyTotal += NanosecondsSince(frameStarts[slot]);
+	statsFrameCount++;
+
+	// Hands the slot back to the simulation
+	drawnFrames.store(frame + 1, std::memory_order_release);
+	Wake(frameDrawn);
+}
+
+// --------------------------------------------------------
+// Draws each frame as soon as it's published. Anything already
+// published when the thread is told to stop is still drawn.
+// --------------------------------------------------------
+void FramePipeline::RenderThreadMain()
+{
+	Profiler::GetInstance().SetThreadName("Render thread");
+	while (true)
+	{
+		unsigned int frame = drawnFrames.load(std::memory_order_relaxed);
+		if (publishedFrames.load(std::memory_order_acquire) != frame)
+		{
+			DrawFrame(frame);
+			continue;
+		}
+		if (stopRenderThread)
+			return;
+
+		std::unique_lock<std::mutex> lock(waitMutex);
+		framePublished.wait(lock, [&]() { return stopRenderThread || publishedFrames.load(std::memory_order_acquire) != frame; });
+	}
+}
+
+// --------------------------------------------------------
+// Wakes whoever is waiting on signal. Taking the mutex first
+// means a waiter is either still before its check (and will
+// see the new count) or already asleep (and gets notified).
+// --------------------------------------------------------
+void FramePipeline::Wake(std::condition_variable& signal)
+{
+	{
+		std::lock_guard<std::mutex> lock(waitMutex);
+	}
+	signal.notify_all();
+}
+
+unsigned long long FramePipeline::NanosecondsSince(Clock::time_point start)
+{
+	return (unsigned long long)std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start).count();
+}
\ No newline at end of file
@@ -0,0 +1,117 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include "LinearArena.h"
+
+// Frames in flight between simulation and rendering: one being
+// simulated while the one before it is drawn
+#define FRAME_PIPELINE_SLOTS 2
+
+// --------------------------------------------------------
+// Hands frames from the simulation (the thread calling BeginFrame()
+// and EndFrame()) to a draw function, either right away on the same
+// thread or, once Start() is called, on a render thread of its own.
+//
+// Each frame's render state lives in one of two slots the caller
+// owns. The simulation fills slot GetUpdateSlot() between BeginFrame()
+// and EndFrame(), and the draw function only reads slot GetDrawSlot(),
+// so frame N+1 can be simulated while frame N is drawn. The handoff is
+// two atomic frame counters: the simulation waits for the draw of the
+// frame that last used its slot, and the render thread waits for the
+// next frame to be published. Whichever side has to wait sleeps on a
+// condition variable instead of spinning, so a GPU-bound or frame
+// limited app doesn't keep a core busy doing nothing.
+//
+// Each slot also has a frame arena: linear memory for whatever a frame
+// needs from its Update() to the end of its Draw(). It's reset when
+// the slot is next used, so neither side ever frees anything.
+//
+// Latency is measured from the start of a frame's simulation to the
+// end of its draw, so pipelining shows up as added latency alongside
+// (hopefully) better throughput.
+// --------------------------------------------------------
+class FramePipeline
+{
+public:
+	FramePipeline();
+	~FramePipeline();
+
+	// Called with the slot to draw, on the render thread if there is one
+	void SetDrawFunction(const std::function<void(unsigned int)>& draw);
+
+	// Starts or stops the render thread. Stopping draws any frame
+	// that's been published but not drawn yet.
+	void Start();
+	void Stop();
+	bool IsRunning();
+
+	// Simulation side: waits until the next frame's slot is free (its
+	// last frame has been drawn), then publishes it once it's filled.
+	// Without a render thread, EndFrame() draws the frame itself.
+	void BeginFrame();
+	void EndFrame();
+
+	// Waits until every published frame has been drawn, so the render
+	// thread is idle until the next EndFrame()
+	void Flush();
+
+	unsigned int GetUpdateSlot();
+	unsigned int GetDrawSlot();
+
+	// Only the side that has the slot uses its arena: the simulation
+	// until the frame is published, then the draw function
+	LinearArena& GetFrameArena(unsigned int slot);
+
+	// Numbers of the frames in those slots (counting from 0)
+	unsigned int GetUpdateFrame();
+	unsigned int GetDrawFrame();
+
+	// Averages since the last ResetStats()
+	unsigned int GetFrameCount();
+	double GetAverageUpdateTimeMs();
+	double GetAverageDrawTimeMs();
+	double GetAverageLatencyMs();
+	double GetAverageWaitTimeMs();   // Simulation waiting on the render thread
+	void ResetStats();
+
+private:
+	typedef std::chrono::high_resolution_clock Clock;
+
+	std::function<void(unsigned int)> drawFunction;
+	std::thread renderThread;
+	std::atomic<bool> stopRenderThread;
+
+	// Frames published by the simulation and finished by the draw function
+	std::atomic<unsigned int> publishedFrames;
+	std::atomic<unsigned int> drawnFrames;
+
+	// For sleeping until the other side moves its counter. The mutex
+	// only makes sure a wake up can't land between a waiter checking
+	// the counters and going to sleep; nothing else is behind it.
+	std::mutex waitMutex;
+	std::condition_variable frameDrawn;
+	std::condition_variable framePublished;
+
+	// When each slot's frame started simulating (written before it's published)
+	Clock::time_point frameStarts[FRAME_PIPELINE_SLOTS];
+
+	std::unique_ptr<LinearArena> frameArenas[FRAME_PIPELINE_SLOTS];
+
+	// Totals in nanoseconds, so either thread can add to them
+	std::atomic<unsigned long long> updateTimeTotal;
+	std::atomic<unsigned long long> drawTimeTotal;
+	std::atomic<unsigned long long> latencyTotal;
+	std::atomic<unsigned long long> waitTimeTotal;
+	std::atomic<unsigned int> statsFrameCount;
+
+	void DrawFrame(unsigned int frame);
+	void RenderThreadMain();
+	void Wake(std::condition_variable& signal);
+	static unsigned long long NanosecondsSince(Clock::time_point start);
+};
\ No newline at end of file
@@ -0,0 +1,189 @@
+#include "FrameStats.h"
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+
+static const char* phaseNames[FRAME_PHASE_COUNT] = { "input", "update", "draw", "submit", "present" };
+
+FrameStats::FrameStats() :
+	records(FRAME_STATS_CAPACITY),
+	lastFrame(0),
+	frameCount(0)
+{
+	// Summaries never allocate
+	sortScratch.reserve(FRAME_STATS_CAPACITY);
+	Reset();
+}
+
+// Clears the record this frame is about to reuse
+void FrameStats::BeginFrame(unsigned int frame)
+{
+	FrameRecord& record = records[frame % FRAME_STATS_CAPACITY];
+	record.frameMs = 0;
+	for (unsigned int p = 0; p < FRAME_PHASE_COUNT; p++)
+		record.phaseMs[p] = 0;
+}
+
+// Adds to whatever the phase already has, so a phase can be split up
+void FrameStats::AddPhaseTime(unsigned int frame, unsigned int phase, double milliseconds)
+{
+	records[frame % FRAME_STATS_CAPACITY].phaseMs[phase] += (float)milliseconds;
+}
+
+void FrameStats::EndFrame(unsigned int frame, double presentTime)
+{
+	if (!hasPresentTime)
+	{
+		lastPresentTime = presentTime;
+		hasPresentTime = true;
+		return;
+	}
+
+	records[frame % FRAME_STATS_CAPACITY].frameMs = (float)((presentTime - lastPresentTime) * 1000.0);
+	lastPresentTime = presentTime;
+
+	lastFrame.store(frame, std::memory_order_release);
+	unsigned int count = frameCount.load(std::memory_order_relaxed);
+	if (count < FRAME_STATS_CAPACITY)
+		frameCount.store(count + 1, std::memory_order_release);
+}
+
+// Leaves out the newest records, which may be for frames still in progress
+unsigned int FrameStats::GetFrameCount()
+{
+	return std::min(frameCount.load(std::memory_order_acquire), (unsigned int)(FRAME_STATS_CAPACITY - FRAME_STATS_WRITE_AHEAD));
+}
+
+FrameTimeSummary FrameStats::Summarize(unsigned int frames)
+{
+	return SummarizeColumn(FRAME_PHASE_COUNT, frames);
+}
+
+FrameTimeSummary FrameStats::SummarizePhase(unsigned int phase, unsigned int frames)
+{
+	return SummarizeColumn(phase, frames);
+}
+
+bool FrameStats::ExportCSV(const std::string& file)
+{
+	std::ofstream output(file, std::ios::trunc);
+	if (!output)
+		return false;
+
+	output << "frame,frame_ms";
+	for (unsigned int p = 0; p < FRAME_PHASE_COUNT; p++)
+		output << "," << phaseNames[p] << "_ms";
+	output << "\n";
+
+	unsigned int count = GetFrameCount();
+	unsigned int last = lastFrame.load(std::memory_order_acquire);
+	for (unsigned int f = last - count + 1; f != last + 1; f++)
+	{
+		output << f << "," << GetValue(f, FRAME_PHASE_COUNT);
+		for (unsigned int p = 0; p < FRAME_PHASE_COUNT; p++)
+			output << "," << GetValue(f, p);
+		output << "\n";
+	}
+	return output.good();
+}
+
+bool FrameStats::ExportJSON(const std::string& file)
+{
+	std::ofstream output(file, std::ios::trunc);
+	if (!output)
+		return false;
+
+	// Summaries first, then the frames they came from
+	unsigned int count = GetFrameCount();
+	unsigned int last = lastFrame.load(std::memory_order_acquire);
+	output << "{\n  \"summary\": {";
+	for (unsigned int column = 0; column <= FRAME_PHASE_COUNT; column++)
+	{
+		FrameTimeSummary summary = SummarizeColumn(column, count);
+		output << (column == 0 ? "\n" : ",\n") <<
+			"    \"" << GetPhaseName(column) << "\": { " <<
+			"\"frames\": " << summary.frameCount <<
+			", \"average_ms\": " << summary.averageMs <<
+			", \"p50_ms\": " << summary.p50Ms <<
+			", \"p95_ms\": " << summary.p95Ms <<
+			", \"p99_ms\": " << summary.p99Ms <<
+			", \"max_ms\": " << summary.maxMs <<
+			", \"hitches\": " << summary.hitchCount << " }";
+	}
+	output << "\n  },\n  \"frames\": [";
+	for (unsigned int f = last - count + 1; f != last + 1; f++)
+	{
+		output << (f == last - count + 1 ? "\n" : ",\n") << "    { \"frame\": " << f << ", \"frame_ms\": " << GetValue(f, FRAME_PHASE_COUNT);
+		for (unsigned int p = 0; p < FRAME_PHASE_COUNT; p++)
+			output << ", \"" << phaseNames[p] << "_ms\": " << GetValue(f, p);
+		output << " }";
+	}
+	output << "\n  ]\n}\n";
+	return output.good();
+}
+
+const char* FrameStats::GetPhaseName(unsigned int phase)
+{
+	return phase < FRAME_PHASE_COUNT ? phaseNames[phase] : "frame";
+}
+
+void FrameStats::Reset()
+{
+	lastFrame.store(0);
+	frameCount.store(0);
+	lastPresentTime = 0;
+	hasPresentTime = false;
+}
+
+float FrameStats::GetValue(unsigned int frame, unsigned int column)
+{
+	const FrameRecord& record = records[frame % FRAME_STATS_CAPACITY];
+	return column < FRAME_PHASE_COUNT ? record.phaseMs[column] : record.frameMs;
+}
+
+// --------------------------------------------------------
+// Copies the column's last few values out and partially sorts
+// them for each percentile (nearest rank), which is cheaper than
+// a full sort. Hitches are frames over FRAME_STATS_HITCH_FACTOR
+// times the median of the same frames.
+// --------------------------------------------------------
+FrameTimeSummary FrameStats::SummarizeColumn(unsigned int column, unsigned int frames)
+{
+	FrameTimeSummary summary = {};
+
+	// The count first, so the frames up to whichever is last by now are all done
+	unsigned int count = std::min(frames, GetFrameCount());
+	unsigned int last = lastFrame.load(std::memory_order_acquire);
+	if (count == 0)
+		return summary;
+
+	sortScratch.clear();
+	double total = 0;
+	for (unsigned int f = last - count + 1; f != last + 1; f++)
+	{
+		float value = GetValue(f, column);
+		sortScratch.push_back(value);
+		total += value;
+	}
+
+	// Each percentile only needs the part above the last one sorted
+	const float percentiles[] = { 0.50f, 0.95f, 0.99f };
+	float* results[] = { &summary.p50Ms, &summary.p95Ms, &summary.p99Ms };
+	std::vector<float>::iterator sortedUpTo = sortScratch.begin();
+	for (int i = 0; i < 3; i++)
+	{
+		unsigned int rank = std::max((unsigned int)ceil(percentiles[i] * count), 1u) - 1;
+		std::vector<float>::iterator nth = sortScratch.begin() + rank;
+		std::nth_element(sortedUpTo, nth, sortScratch.end());
+		*results[i] = *nth;
+		sortedUpTo = nth;
+	}
+
+	summary.frameCount = count;
+	summary.averageMs = (float)(total / count);
+	summary.maxMs = *std::max_element(sortedUpTo, sortScratch.end());
+
+	float hitchMs = summary.p50Ms * FRAME_STATS_HITCH_FACTOR;
+	summary.hitchCount = (unsigned int)std::count_if(sortScratch.begin(), sortScratch.end(), [=](float value) { return value > hitchMs; });
+	return summary;
+}
\ No newline at end of file
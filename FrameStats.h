@@ -0,0 +1,101 @@
+#pragma once
+
+#include <atomic>
+#include <string>
+#include <vector>
+
+// Where a frame's CPU time goes
+#define FRAME_PHASE_INPUT 0    // Reading input
+#define FRAME_PHASE_UPDATE 1   // Fixed ticks and Update()
+#define FRAME_PHASE_DRAW 2     // Recording the frame's commands
+#define FRAME_PHASE_SUBMIT 3   // Executing them and waiting for the GPU
+#define FRAME_PHASE_PRESENT 4  // Present() and waiting for the swap chain (and frame limiter)
+#define FRAME_PHASE_COUNT 5
+
+// Frames kept, and how many of the newest may still be being written
+// to (a frame is recorded while the few before it are finishing), which
+// summaries leave out
+#define FRAME_STATS_CAPACITY 1024
+#define FRAME_STATS_WRITE_AHEAD 4
+
+// A frame is a hitch if it takes this many times as long as the median
+#define FRAME_STATS_HITCH_FACTOR 2.0f
+
+// Distribution of a frame time (or one phase of it) over recent frames
+struct FrameTimeSummary
+{
+	unsigned int frameCount;
+	float averageMs;
+	float p50Ms;
+	float p95Ms;
+	float p99Ms;
+	float maxMs;
+	unsigned int hitchCount;
+};
+
+// --------------------------------------------------------
+// Keeps every recent frame's time, and the time of each phase
+// of it, in a ring buffer, so stutter that an average hides
+// shows up in the percentiles and hitch count.
+//
+// Recording a frame is a handful of stores. The phases of a
+// frame can come from different threads, as long as each one is
+// handed to the next in order (like FramePipeline does), and the
+// frame is finished by EndFrame() with the time it was presented.
+// Summaries sort a copy of the recent frames, so they're only
+// worth doing now and then (like once a second for the title bar).
+// --------------------------------------------------------
+class FrameStats
+{
+public:
+	FrameStats();
+
+	// Frame numbers only have to go up by one each frame
+	void BeginFrame(unsigned int frame);
+	void AddPhaseTime(unsigned int frame, unsigned int phase, double milliseconds);
+
+	// presentTime is in seconds, on any clock, and the frame's time is
+	// the time since the last frame was presented (so the first frame
+	// after a Reset() only starts the clock)
+	void EndFrame(unsigned int frame, double presentTime);
+
+	// Frames with a time since the last Reset() (up to the capacity)
+	unsigned int GetFrameCount();
+
+	// Over the last frameCount frames (at most what's kept), from the
+	// thread that's calling EndFrame() or the one that hands it frames
+	FrameTimeSummary Summarize(unsigned int frameCount = FRAME_STATS_CAPACITY);
+	FrameTimeSummary SummarizePhase(unsigned int phase, unsigned int frameCount = FRAME_STATS_CAPACITY);
+
+	// Every frame kept, oldest first, with a summary of each column
+	// in the JSON. Returns false if the file can't be written.
+	bool ExportCSV(const std::string& file);
+	bool ExportJSON(const std::string& file);
+
+	static const char* GetPhaseName(unsigned int phase);
+
+	// Forgets every frame (only while no frame is in progress)
+	void Reset();
+
+private:
+	struct FrameRecord
+	{
+		float frameMs;
+		float phaseMs[FRAME_PHASE_COUNT];
+	};
+
+	std::vector<FrameRecord> records;
+	std::vector<float> sortScratch;
+
+	// The newest finished frame is lastFrame, and the frameCount frames
+	// up to it are in the ring. Both are stored once the frame's record
+	// is, so a reader that sees them sees the records too.
+	std::atomic<unsigned int> lastFrame;
+	std::atomic<unsigned int> frameCount;
+	double lastPresentTime;
+	bool hasPresentTime;
+
+	// column is a phase, or FRAME_PHASE_COUNT for the whole frame
+	float GetValue(unsigned int frame, unsigned int column);
+	FrameTimeSummary SummarizeColumn(unsigned int column, unsigned int frames);
+};
\ No newline at end of file
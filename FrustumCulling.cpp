@@ -0,0 +1,207 @@
+#include "FrustumCulling.h"
+#include "JobSystem.h"
+#include "LinearArena.h"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+
+using namespace DirectX;
+
+// Objects per job; below this, queueing a job costs more than it saves
+#define MIN_OBJECTS_PER_CULL_JOB 16384
+
+void ExtractFrustumPlanes(XMFLOAT4X4 viewProjection, XMVECTOR planes[6])
+{
+	XMMATRIX columns = XMMatrixTranspose(XMLoadFloat4x4(&viewProjection));
+	planes[0] = XMVectorAdd(columns.r[3], columns.r[0]);		// Left
+	planes[1] = XMVectorSubtract(columns.r[3], columns.r[0]);	// Right
+	planes[2] = XMVectorAdd(columns.r[3], columns.r[1]);		// Bottom
+	planes[3] = XMVectorSubtract(columns.r[3], columns.r[1]);	// Top
+	planes[4] = columns.r[2];									// Near (0 to 1 depth)
+	planes[5] = XMVectorSubtract(columns.r[3], columns.r[2]);	// Far
+	for (int p = 0; p < 6; p++)
+		planes[p] = XMPlaneNormalize(planes[p]);
+}
+
+FrustumCulling::FrustumCulling() :
+	testedCount(0),
+	lastCullTimeMs(0)
+{
+}
+
+// --------------------------------------------------------
+// Finds every sphere that's at least partly inside the frustum
+//
+// viewProjection - The camera's combined view and projection matrix
+// spheres - World space bounding spheres (xyz = center, w = radius)
+// count - Number of spheres
+// --------------------------------------------------------
+void FrustumCulling::Cull(XMFLOAT4X4 viewProjection, const XMFLOAT4* spheres, unsigned int count)
+{
+	std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+
+	XMVECTOR planes[6];
+	ExtractFrustumPlanes(viewProjection, planes);
+
+	// Each job writes its results at the start of its own range of
+	// the output, so nothing is shared until they're packed together
+	visible.resize(count);
+	unsigned int rangeCount = std::max(1u, (count + MIN_OBJECTS_PER_CULL_JOB - 1) / MIN_OBJECTS_PER_CULL_JOB);
+	ScratchScope scratch;
+	unsigned int* rangeVisible = scratch.AllocateArray<unsigned int>(rangeCount);
+	JobSystem::GetInstance().ParallelFor(0, rangeCount, 1, [&](unsigned int firstRange, unsigned int lastRange)
+	{
+		for (unsigned int r = firstRange; r < lastRange; r++)
+		{
+			unsigned int first = r * MIN_OBJECTS_PER_CULL_JOB;
+			unsigned int last = std::min(first + MIN_OBJECTS_PER_CULL_JOB, count);
+			rangeVisible[r] = CullRange(planes, spheres, first, last, visible.data() + first);
+		}
+	});
+
+	unsigned int visibleCount = rangeVisible[0];
+	for (unsigned int r = 1; r < rangeCount; r++)
+	{
+		memmove(visible.data() + visibleCount, visible.data() + r * MIN_OBJECTS_PER_CULL_JOB, sizeof(unsigned int) * rangeVisible[r]);
+		visibleCount += rangeVisible[r];
+	}
+	visible.resize(visibleCount);
+	testedCount = count;
+
+	std::chrono::duration<double, std::milli> elapsed = std::chrono::high_resolution_clock::now() - start;
+	lastCullTimeMs = elapsed.count();
+}
+
+// --------------------------------------------------------
+// Reference for Cull(): each sphere against each plane in turn,
+// stopping at the first plane it's entirely behind
+// --------------------------------------------------------
+void FrustumCulling::CullBruteForce(XMFLOAT4X4 viewProjection, const XMFLOAT4* spheres, unsigned int count)
+{
+	std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+
+	XMVECTOR planes[6];
+	ExtractFrustumPlanes(viewProjection, planes);
+	XMFLOAT4 planeValues[6];
+	for (int p = 0; p < 6; p++)
+		XMStoreFloat4(&planeValues[p], planes[p]);
+
+	visible.clear();
+	for (unsigned int i = 0; i < count; i++)
+	{
+		const XMFLOAT4& sphere = spheres[i];
+		bool outside = false;
+		for (int p = 0; p < 6 && !outside; p++)
+		{
+			// Same order of operations as the SIMD version
+			const XMFLOAT4& plane = planeValues[p];
+			float distance = (sphere.x * plane.x + (sphere.y * plane.y + sphere.z * plane.z)) + plane.w;
+			outside = distance < -sphere.w;
+		}
+
+		if (!outside)
+			visible.push_back(i);
+	}
+	testedCount = count;
+
+	std::chrono::duration<double, std::milli> elapsed = std::chrono::high_resolution_clock::now() - start;
+	lastCullTimeMs = elapsed.count();
+}
+
+// --------------------------------------------------------
+// Runs both versions and compares their visible lists
+// (leaves the brute force results and timing behind)
+// --------------------------------------------------------
+bool FrustumCulling::VerifyAgainstBruteForce(XMFLOAT4X4 viewProjection, const XMFLOAT4* spheres, unsigned int count)
+{
+	Cull(viewProjection, spheres, count);
+	std::vector<unsigned int> fast = visible;
+	CullBruteForce(viewProjection, spheres, count);
+	return fast == visible;
+}
+
+const std::vector<unsigned int>& FrustumCulling::GetVisible()
+{
+	return visible;
+}
+
+unsigned int FrustumCulling::GetTestedCount()
+{
+	return testedCount;
+}
+
+unsigned int FrustumCulling::GetVisibleCount()
+{
+	return (unsigned int)visible.size();
+}
+
+double FrustumCulling::GetLastCullTimeMs()
+{
+	return lastCullTimeMs;
+}
+
+// --------------------------------------------------------
+// Tests spheres [first, last) four at a time and writes the
+// indices of the visible ones to visibleOut
+//
+// Returns how many were visible
+// --------------------------------------------------------
+unsigned int FrustumCulling::CullRange(
+	const XMVECTOR planes[6],
+	const XMFLOAT4* spheres,
+	unsigned int first,
+	unsigned int last,
+	unsigned int* visibleOut)
+{
+	unsigned int visibleCount = 0;
+	for (unsigned int i = first; i < last; i += 4)
+	{
+		// Load four spheres (repeating the last one if we run out)
+		// and turn them into x, y, z and radius vectors
+		XMMATRIX group = XMMatrixTranspose(XMMATRIX(
+			XMLoadFloat4(&spheres[i]),
+			XMLoadFloat4(&spheres[std::min(i + 1, last - 1)]),
+			XMLoadFloat4(&spheres[std::min(i + 2, last - 1)]),
+			XMLoadFloat4(&spheres[std::min(i + 3, last - 1)])));
+		XMVECTOR negRadius = XMVectorNegate(group.r[3]);
+
+		// A sphere is outside if it's entirely behind any one plane
+		XMVECTOR outside = XMVectorFalseInt();
+		for (int p = 0; p < 6; p++)
+		{
+			XMVECTOR distance = XMVectorAdd(
+				XMVectorMultiplyAdd(group.r[0], XMVectorSplatX(planes[p]),
+				XMVectorMultiplyAdd(group.r[1], XMVectorSplatY(planes[p]),
+				XMVectorMultiply(group.r[2], XMVectorSplatZ(planes[p])))),
+				XMVectorSplatW(planes[p]));
+			outside = XMVectorOrInt(outside, XMVectorLess(distance, negRadius));
+		}
+		int inside = ~_mm_movemask_ps(outside) & 0xF;
+
+		if (i + 4 <= last)
+		{
+			// Write all four and only advance past the visible ones.
+			// Whether the next object is on screen has no pattern the
+			// branch predictor could learn, so an if here would miss a lot.
+			visibleOut[visibleCount] = i;
+			visibleCount += inside & 1;
+			visibleOut[visibleCount] = i + 1;
+			visibleCount += (inside >> 1) & 1;
+			visibleOut[visibleCount] = i + 2;
+			visibleCount += (inside >> 2) & 1;
+			visibleOut[visibleCount] = i + 3;
+			visibleCount += (inside >> 3) & 1;
+		}
+		else
+		{
+			// Partial group at the end, where the extra writes could
+			// land in the next job's part of the output
+			for (unsigned int lane = 0; i + lane < last; lane++)
+			{
+				if (inside & (1 << lane))
+					visibleOut[visibleCount++] = i + lane;
+			}
+		}
+	}
+	return visibleCount;
+}
\ No newline at end of file
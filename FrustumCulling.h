@@ -0,0 +1,51 @@
+#pragma once
+#include <DirectXMath.h>
+#include <vector>
+
+// Frustum planes from the columns of a view projection matrix
+// (Gribb & Hartmann), normalized so plane distances are real distances.
+// Order is left, right, bottom, top, near, far, all facing inwards.
+void ExtractFrustumPlanes(DirectX::XMFLOAT4X4 viewProjection, DirectX::XMVECTOR planes[6]);
+
+// --------------------------------------------------------
+// Tests object bounding spheres against the camera frustum and keeps
+// a compact list of the ones that could be visible.
+//
+// Spheres are tested four at a time with SSE, and large arrays are
+// split across threads. The visible list is in the same (ascending)
+// order as the input, so it can index parallel arrays of draw data.
+// --------------------------------------------------------
+class FrustumCulling
+{
+public:
+	FrustumCulling();
+
+	// spheres - World space bounding spheres (xyz = center, w = radius)
+	void Cull(DirectX::XMFLOAT4X4 viewProjection, const DirectX::XMFLOAT4* spheres, unsigned int count);
+
+	// Tests one sphere at a time with scalar code, for verification
+	void CullBruteForce(DirectX::XMFLOAT4X4 viewProjection, const DirectX::XMFLOAT4* spheres, unsigned int count);
+
+	// Culls with both methods and checks the visible lists are the same
+	bool VerifyAgainstBruteForce(DirectX::XMFLOAT4X4 viewProjection, const DirectX::XMFLOAT4* spheres, unsigned int count);
+
+	// Indices of the spheres that passed, in ascending order
+	const std::vector<unsigned int>& GetVisible();
+
+	// Stats
+	unsigned int GetTestedCount();
+	unsigned int GetVisibleCount();
+	double GetLastCullTimeMs();
+
+private:
+	std::vector<unsigned int> visible;
+	unsigned int testedCount;
+	double lastCullTimeMs;
+
+	static unsigned int CullRange(
+		const DirectX::XMVECTOR planes[6],
+		const DirectX::XMFLOAT4* spheres,
+		unsigned int first,
+		unsigned int last,
+		unsigned int* visibleOut);
+};
\ No newline at end of file
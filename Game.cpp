@@ -4,14 +4,25 @@
 #include "PathHelpers.h"
 #include "BufferStructs.h"
 #include "WICTextureLoader.h"
+#include "Benchmarks.h"
+#include "JobSystem.h"
+#include "Profiler.h"
+#include "MemoryTracker.h"
 
 // Needed for a helper function to load pre-compiled shader files
 #pragma comment(lib, "d3dcompiler.lib")
 #include <d3dcompiler.h>
+#include <cfloat>
 
 // For the DirectX Math library
 using namespace DirectX;
 
+// How fast spinning entities turn around each axis, in radians per second
+static const float spinSpeed = 0.6f;
+
+// Background color (Cornflower Blue in this case) for clearing
+static const float backgroundColor[] = { 0.4f, 0.6f, 0.75f, 1.0f };
+
 // --------------------------------------------------------
 // Constructor
 //
@@ -30,6 +41,15 @@ Game::Game(HINSTANCE hInstance)
 		true),  			// Show extra stats (fps) in title bar?
 	ibView({}),
 	vbView({}),
+	clusteredPipeline(INVALID_PIPELINE_HANDLE),
+	perObjectLightPipeline(INVALID_PIPELINE_HANDLE),
+	baseLightCount(0),
+	useClusteredLighting(true),
+	useOcclusionCulling(true),
+	resolutionBudget(16.667f),
+	reservedObjectCount(0),
+	reservedLightCount(0),
+	sceneTargetIndex(INVALID_TEXTURE_INDEX),
 	dx12Helper(DX12Helper::GetInstance())
 {
 #if defined(DEBUG) || defined(_DEBUG)
@@ -56,6 +76,9 @@ Game::~Game()
 	// We need to wait here until the GPU
 	// is actually done with its work
 	dx12Helper.WaitForGPU();
+
+	// Stop background compiles and save any new pipelines to disk
+	pipelineCache.Shutdown();
 }
 
 // --------------------------------------------------------
@@ -68,13 +91,26 @@ void Game::Init()
 	// geometry to draw and some simple camera matrices.
 	// - You'll be expanding and/or replacing these later
 	CreateRootSigAndPipelineState();
+	CreateSceneTarget();
 	CreateBasicGeometry();
+
+	// Everything just spawned needs matrices before the first tick
+	UpdateTransforms();
+
 	camera = std::make_shared<Camera>(
 		windowWidth / (float)windowHeight, 
 		XMFLOAT3(0, 0, -3), 
 		XMFLOAT3(), 
 		3.14f / 2);
+	clusteredLighting.UpdateClusterBounds(camera->GetProjection(), camera->GetNearClip(), camera->GetFarClip());
+
+	// Skip draws that would cover less than about a pixel, or a few
+	// pixels for small props and details nobody will miss
+	contributionCulling.SetThreshold(RENDER_LAYER_WORLD, 1.0f);
+	contributionCulling.SetThreshold(RENDER_LAYER_PROPS, 4.0f);
+	contributionCulling.SetThreshold(RENDER_LAYER_DETAIL, 16.0f);
 	
+	lights.resize(5);
 	lights[0].Type = LIGHT_TYPE_DIRECTIONAL;
 	lights[0].Direction = XMFLOAT3(0, -0.8f, 0.2f);
 	lights[0].Color = XMFLOAT3(1.0f, 1.0f, 1.0f);
@@ -102,7 +138,35 @@ void Game::Init()
 	lights[4].intensity = 0.4f;
 	lights[4].Range = 5;
 
-	lightCount = 5;
+	baseLightCount = (unsigned int)lights.size();
+}
+
+// --------------------------------------------------------
+// Scatters a large number of small point and spot lights around
+// the scene, far more than fit in the pixel shader's constant
+// buffer, to exercise clustered lighting
+// --------------------------------------------------------
+void Game::AddDemoLights()
+{
+	MEMORY_TAG(MEMORY_TAG_SCENE);
+
+	const int gridSize = 32;
+	const float spacing = 0.5f;
+	for (int z = 0; z < gridSize; z++)
+	{
+		for (int x = 0; x < gridSize; x++)
+		{
+			Light light = {};
+			light.Type = (x + z) % 8 == 0 ? LIGHT_TYPE_SPOT : LIGHT_TYPE_POINT;
+			light.Position = XMFLOAT3((x - gridSize / 2) * spacing, -4.5f + (x % 3) * 3.5f, (z - gridSize / 2) * spacing);
+			light.Direction = XMFLOAT3(0, light.Position.y > 0 ? -1.0f : 1.0f, 0);
+			light.Color = XMFLOAT3(0.2f + (x % 4) * 0.25f, 0.2f + (z % 4) * 0.25f, 0.2f + ((x + z) % 3) * 0.4f);
+			light.intensity = 0.5f;
+			light.Range = 1.5f;
+			light.SpotFalloff = 8.0f;
+			lights.push_back(light);
+		}
+	}
 }
 
 // --------------------------------------------------------
@@ -114,6 +178,8 @@ void Game::CreateRootSigAndPipelineState()
 	// Blobs to hold raw shader byte code used in several steps below
 	Microsoft::WRL::ComPtr<ID3DBlob> vertexShaderByteCode;
 	Microsoft::WRL::ComPtr<ID3DBlob> pixelShaderByteCode;
+	Microsoft::WRL::ComPtr<ID3DBlob> clusteredPixelShaderByteCode;
+	Microsoft::WRL::ComPtr<ID3DBlob> perObjectLightsPixelShaderByteCode;
 
 	// Load shaders
 	{
@@ -121,8 +187,13 @@ void Game::CreateRootSigAndPipelineState()
 		// - Essentially just "open the file and plop its contents here"
 		D3DReadFileToBlob(FixPath(L"VertexShader.cso").c_str(), vertexShaderByteCode.GetAddressOf());
 		D3DReadFileToBlob(FixPath(L"PixelShader.cso").c_str(), pixelShaderByteCode.GetAddressOf());
+		D3DReadFileToBlob(FixPath(L"PixelShaderClustered.cso").c_str(), clusteredPixelShaderByteCode.GetAddressOf());
+		D3DReadFileToBlob(FixPath(L"PixelShaderPerObjectLights.cso").c_str(), perObjectLightsPixelShaderByteCode.GetAddressOf());
 	}
 
+	// Hash of the serialized root signature, which is part of every pipeline's cache key
+	unsigned long long rootSignatureHash = 0;
+
 	// Input layout
 	const unsigned int inputElementCount = 4;
 	D3D12_INPUT_ELEMENT_DESC inputElements[inputElementCount] = {};
@@ -172,16 +243,17 @@ void Game::CreateRootSigAndPipelineState()
 		cbvRangePS.RegisterSpace = 0;
 		cbvRangePS.OffsetInDescriptorsFromTableStart = D3D12_DESCRIPTOR_RANGE_OFFSET_APPEND;
 		
-		// Create a range of SRV's for textures
+		// Create one big range of SRVs covering every texture (bindless)
+		// The pixel shader indexes into it with the material table
 		D3D12_DESCRIPTOR_RANGE srvRange = {};
 		srvRange.RangeType = D3D12_DESCRIPTOR_RANGE_TYPE_SRV;
-		srvRange.NumDescriptors = 4; // Set to max number of textures at once (match pixel shader!)
-		srvRange.BaseShaderRegister = 0; // Starts at s0 (match pixel shader!)
+		srvRange.NumDescriptors = UINT_MAX; // Unbounded, matching Textures[] in the pixel shader
+		srvRange.BaseShaderRegister = 0; // Starts at t0 (match pixel shader!)
 		srvRange.RegisterSpace = 0;
 		srvRange.OffsetInDescriptorsFromTableStart = D3D12_DESCRIPTOR_RANGE_OFFSET_APPEND;
 		
 		// Create the root parameters
-		D3D12_ROOT_PARAMETER rootParams[3] = {};
+		D3D12_ROOT_PARAMETER rootParams[8] = {};
 		
 		// CBV table param for vertex shader
 		rootParams[0].ParameterType = D3D12_ROOT_PARAMETER_TYPE_DESCRIPTOR_TABLE;
@@ -195,12 +267,36 @@ void Game::CreateRootSigAndPipelineState()
 		rootParams[1].DescriptorTable.NumDescriptorRanges = 1;
 		rootParams[1].DescriptorTable.pDescriptorRanges = &cbvRangePS;
 		
-		// SRV table param
+		// Bindless SRV table param (set once per frame)
 		rootParams[2].ParameterType = D3D12_ROOT_PARAMETER_TYPE_DESCRIPTOR_TABLE;
 		rootParams[2].ShaderVisibility = D3D12_SHADER_VISIBILITY_PIXEL;
 		rootParams[2].DescriptorTable.NumDescriptorRanges = 1;
 		rootParams[2].DescriptorTable.pDescriptorRanges = &srvRange;
 		
+		// Material table structured buffer as a root SRV at t0, space1
+		rootParams[3].ParameterType = D3D12_ROOT_PARAMETER_TYPE_SRV;
+		rootParams[3].ShaderVisibility = D3D12_SHADER_VISIBILITY_PIXEL;
+		rootParams[3].Descriptor.ShaderRegister = 0;
+		rootParams[3].Descriptor.RegisterSpace = 1;
+		
+		// Per draw pixel shader data as root constants at b1: the material
+		// index (the only per-draw material state) and the object's light list
+		rootParams[4].ParameterType = D3D12_ROOT_PARAMETER_TYPE_32BIT_CONSTANTS;
+		rootParams[4].ShaderVisibility = D3D12_SHADER_VISIBILITY_PIXEL;
+		rootParams[4].Constants.Num32BitValues = sizeof(DrawData) / sizeof(unsigned int);
+		rootParams[4].Constants.ShaderRegister = 1;
+		rootParams[4].Constants.RegisterSpace = 0;
+		
+		// Local light buffers as root SRVs at t1-t3, space1 (lights, clusters and
+		// light indices - only the clustered and per-object shaders read them)
+		for (unsigned int i = 5; i < 8; i++)
+		{
+			rootParams[i].ParameterType = D3D12_ROOT_PARAMETER_TYPE_SRV;
+			rootParams[i].ShaderVisibility = D3D12_SHADER_VISIBILITY_PIXEL;
+			rootParams[i].Descriptor.ShaderRegister = i - 4;
+			rootParams[i].Descriptor.RegisterSpace = 1;
+		}
+		
 		// Create a single static sampler (available to all pixel shaders at the same slot)
 		D3D12_STATIC_SAMPLER_DESC anisoWrap = {};
 		anisoWrap.AddressU = D3D12_TEXTURE_ADDRESS_MODE_WRAP;
@@ -236,6 +332,10 @@ void Game::CreateRootSigAndPipelineState()
 			OutputDebugString((wchar_t*)errors->GetBufferPointer());
 		}
 
+		rootSignatureHash = PipelineCache::HashBytes(
+			serializedRootSig->GetBufferPointer(),
+			serializedRootSig->GetBufferSize());
+
 		// Actually create the root sig
 		device->CreateRootSignature(
 			0,
@@ -287,17 +387,142 @@ void Game::CreateRootSigAndPipelineState()
 		// -- Misc ---
 		psoDesc.SampleMask = 0xffffffff;
 
-		// Create the pipe state object
-		device->CreateGraphicsPipelineState(&psoDesc,
-			IID_PPV_ARGS(pipelineState.GetAddressOf()));
+		// Create the pipe state object, or load it from the on-disk library
+		// This one is needed right away (and is the placeholder for any
+		// pipelines requested asynchronously later) so it's synchronous
+		pipelineCache.Initialize(device, FixPath(L"PipelineCache.bin"));
+		pipelineState = pipelineCache.GetPipeline(psoDesc, rootSignatureHash);
+
+		// Queue up the light count permutations of the pixel shader. They compile
+		// in the background and the generic pipeline is used until they're ready.
+		for (unsigned int i = 0; i < ARRAYSIZE(lightPermutationShaders); i++)
+		{
+			Microsoft::WRL::ComPtr<ID3DBlob> permutationByteCode;
+			if (FAILED(D3DReadFileToBlob(FixPath(lightPermutationShaders[i].file).c_str(), permutationByteCode.GetAddressOf())))
+				continue;
+
+			psoDesc.PS.pShaderBytecode = permutationByteCode->GetBufferPointer();
+			psoDesc.PS.BytecodeLength = permutationByteCode->GetBufferSize();
+
+			unsigned int key = GetLightPermutationKey(lightPermutationShaders[i].counts);
+			lightPermutations[key] = pipelineCache.RequestPipeline(psoDesc, rootSignatureHash, pipelineState);
+		}
+
+		// The clustered pipeline isn't needed until there are lots of lights
+		if (clusteredPixelShaderByteCode)
+		{
+			psoDesc.PS.pShaderBytecode = clusteredPixelShaderByteCode->GetBufferPointer();
+			psoDesc.PS.BytecodeLength = clusteredPixelShaderByteCode->GetBufferSize();
+			clusteredPipeline = pipelineCache.RequestPipeline(psoDesc, rootSignatureHash, pipelineState);
+		}
+		if (perObjectLightsPixelShaderByteCode)
+		{
+			psoDesc.PS.pShaderBytecode = perObjectLightsPixelShaderByteCode->GetBufferPointer();
+			psoDesc.PS.BytecodeLength = perObjectLightsPixelShaderByteCode->GetBufferSize();
+			perObjectLightPipeline = pipelineCache.RequestPipeline(psoDesc, rootSignatureHash, pipelineState);
+		}
+	}
+
+	// Full screen pass that stretches the scene over the back buffer when
+	// it's drawn at a lower resolution. The triangle comes from the vertex
+	// IDs, so there's no input layout, and there's no depth or culling.
+	{
+		Microsoft::WRL::ComPtr<ID3DBlob> fullscreenVertexShaderByteCode;
+		Microsoft::WRL::ComPtr<ID3DBlob> upscalePixelShaderByteCode;
+		D3DReadFileToBlob(FixPath(L"VertexShaderFullscreen.cso").c_str(), fullscreenVertexShaderByteCode.GetAddressOf());
+		D3DReadFileToBlob(FixPath(L"PixelShaderUpscale.cso").c_str(), upscalePixelShaderByteCode.GetAddressOf());
+		if (fullscreenVertexShaderByteCode && upscalePixelShaderByteCode)
+		{
+			D3D12_GRAPHICS_PIPELINE_STATE_DESC psoDesc = {};
+			psoDesc.PrimitiveTopologyType = D3D12_PRIMITIVE_TOPOLOGY_TYPE_TRIANGLE;
+			psoDesc.pRootSignature = rootSignature.Get();
+			psoDesc.VS.pShaderBytecode = fullscreenVertexShaderByteCode->GetBufferPointer();
+			psoDesc.VS.BytecodeLength = fullscreenVertexShaderByteCode->GetBufferSize();
+			psoDesc.PS.pShaderBytecode = upscalePixelShaderByteCode->GetBufferPointer();
+			psoDesc.PS.BytecodeLength = upscalePixelShaderByteCode->GetBufferSize();
+			psoDesc.NumRenderTargets = 1;
+			psoDesc.RTVFormats[0] = DXGI_FORMAT_R8G8B8A8_UNORM;
+			psoDesc.DSVFormat = DXGI_FORMAT_UNKNOWN;
+			psoDesc.SampleDesc.Count = 1;
+			psoDesc.SampleDesc.Quality = 0;
+			psoDesc.RasterizerState.FillMode = D3D12_FILL_MODE_SOLID;
+			psoDesc.RasterizerState.CullMode = D3D12_CULL_MODE_NONE;
+			psoDesc.RasterizerState.DepthClipEnable = true;
+			psoDesc.BlendState.RenderTarget[0].SrcBlend = D3D12_BLEND_ONE;
+			psoDesc.BlendState.RenderTarget[0].DestBlend = D3D12_BLEND_ZERO;
+			psoDesc.BlendState.RenderTarget[0].BlendOp = D3D12_BLEND_OP_ADD;
+			psoDesc.BlendState.RenderTarget[0].RenderTargetWriteMask = D3D12_COLOR_WRITE_ENABLE_ALL;
+			psoDesc.SampleMask = 0xffffffff;
+			upscalePipelineState = pipelineCache.GetPipeline(psoDesc, rootSignatureHash);
+		}
 	}
 }
 
+// --------------------------------------------------------
+// (Re)creates the window sized render target the scene is drawn
+// into at lower resolutions, with an RTV of its own and an SRV in
+// the bindless range so the upscale pass can read it. Any old one
+// is released right away, so the GPU has to be idle.
+// --------------------------------------------------------
+void Game::CreateSceneTarget()
+{
+	dx12Helper.ReleaseTextureIndex(sceneTargetIndex);
+	sceneTargetIndex = INVALID_TEXTURE_INDEX;
+	sceneTarget.Reset();
+
+	if (!sceneTargetRTVHeap)
+	{
+		D3D12_DESCRIPTOR_HEAP_DESC rtvHeapDesc = {};
+		rtvHeapDesc.NumDescriptors = 1;
+		rtvHeapDesc.Type = D3D12_DESCRIPTOR_HEAP_TYPE_RTV;
+		device->CreateDescriptorHeap(&rtvHeapDesc, IID_PPV_ARGS(sceneTargetRTVHeap.GetAddressOf()));
+	}
+
+	D3D12_RESOURCE_DESC desc = {};
+	desc.Alignment = 0;
+	desc.DepthOrArraySize = 1;
+	desc.Dimension = D3D12_RESOURCE_DIMENSION_TEXTURE2D;
+	desc.Flags = D3D12_RESOURCE_FLAG_ALLOW_RENDER_TARGET;
+	desc.Format = DXGI_FORMAT_R8G8B8A8_UNORM;
+	desc.Height = windowHeight;
+	desc.Layout = D3D12_TEXTURE_LAYOUT_UNKNOWN;
+	desc.MipLevels = 1;
+	desc.SampleDesc.Count = 1;
+	desc.SampleDesc.Quality = 0;
+	desc.Width = windowWidth;
+
+	D3D12_CLEAR_VALUE clear = {};
+	clear.Format = DXGI_FORMAT_R8G8B8A8_UNORM;
+	memcpy(clear.Color, backgroundColor, sizeof(clear.Color));
+
+	D3D12_HEAP_PROPERTIES props = {};
+	props.CPUPageProperty = D3D12_CPU_PAGE_PROPERTY_UNKNOWN;
+	props.CreationNodeMask = 1;
+	props.MemoryPoolPreference = D3D12_MEMORY_POOL_UNKNOWN;
+	props.Type = D3D12_HEAP_TYPE_DEFAULT;
+	props.VisibleNodeMask = 1;
+
+	// Sits in the pixel shader resource state between frames
+	device->CreateCommittedResource(
+		&props,
+		D3D12_HEAP_FLAG_NONE,
+		&desc,
+		D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE,
+		&clear,
+		IID_PPV_ARGS(sceneTarget.GetAddressOf()));
+	dx12Helper.TrackGpuMemory(sceneTarget.Get(), GPU_MEMORY_RENDER_TARGET);
+
+	device->CreateRenderTargetView(sceneTarget.Get(), 0, sceneTargetRTVHeap->GetCPUDescriptorHandleForHeapStart());
+	sceneTargetIndex = dx12Helper.CreateTextureSRV(sceneTarget.Get());
+}
+
 // --------------------------------------------------------
 // Creates the geometry we're going to draw - a single triangle for now
 // --------------------------------------------------------
 void Game::CreateBasicGeometry()
 {
+	MEMORY_TAG(MEMORY_TAG_SCENE);
+
 	// Create some temporary variables to represent colors
 	// - Not necessary, just makes things more readable
 	XMFLOAT4 red	= XMFLOAT4(1.0f, 0.0f, 0.0f, 1.0f);
@@ -346,44 +571,154 @@ void Game::CreateBasicGeometry()
 	ibView.BufferLocation = indexBuffer->GetGPUVirtualAddress();
 	*/
 	// ^^ use meshes now. i should prob just delet this but thats a later problem
-	D3D12_CPU_DESCRIPTOR_HANDLE cobblestoneAlbedo = dx12Helper.LoadTexture(L"cobblestone_albedo.png");
-	D3D12_CPU_DESCRIPTOR_HANDLE cobblestoneMetal = dx12Helper.LoadTexture(L"cobblestone_metal.png");
-	D3D12_CPU_DESCRIPTOR_HANDLE cobblestoneNormals = dx12Helper.LoadTexture(L"cobblestone_normals.png");
-	D3D12_CPU_DESCRIPTOR_HANDLE cobblestoneRoughness = dx12Helper.LoadTexture(L"cobblestone_roughness.png");
-	D3D12_CPU_DESCRIPTOR_HANDLE scratchedAlbedo = dx12Helper.LoadTexture(L"scratched_albedo.png");
-	D3D12_CPU_DESCRIPTOR_HANDLE scratchedMetal = dx12Helper.LoadTexture(L"scratched_metal.png");
-	D3D12_CPU_DESCRIPTOR_HANDLE scratchedNormals = dx12Helper.LoadTexture(L"scratched_normals.png");
-	D3D12_CPU_DESCRIPTOR_HANDLE scratchedRoughness = dx12Helper.LoadTexture(L"scratched_roughness.png");
-
-	std::shared_ptr<Material> cobbleMaterial = std::make_shared<Material>(pipelineState, XMFLOAT3(1, 1, 1), XMFLOAT2(1, 1), XMFLOAT2(0, 0));
-	cobbleMaterial->AddTexture(cobblestoneAlbedo, 0);
-	cobbleMaterial->AddTexture(cobblestoneNormals, 1);
-	cobbleMaterial->AddTexture(cobblestoneMetal, 2);
-	cobbleMaterial->AddTexture(cobblestoneRoughness, 3);
-	cobbleMaterial->FinalizeMaterial();
-
-	std::shared_ptr<Material> scratchedMaterial = std::make_shared<Material>(pipelineState, XMFLOAT3(1, 1, 1), XMFLOAT2(1, 1), XMFLOAT2(0, 0));
-	scratchedMaterial->AddTexture(scratchedAlbedo, 0);
-	scratchedMaterial->AddTexture(scratchedNormals, 1);
-	scratchedMaterial->AddTexture(scratchedMetal, 2);
-	scratchedMaterial->AddTexture(scratchedRoughness, 3);
-	scratchedMaterial->FinalizeMaterial();
-
-	meshList.push_back(std::make_shared<Mesh>(FixPath(L"../../Assets/Models/cube.obj").c_str()));
-	meshList.push_back(std::make_shared<Mesh>(FixPath(L"../../Assets/Models/cylinder.obj").c_str()));
-	meshList.push_back(std::make_shared<Mesh>(FixPath(L"../../Assets/Models/helix.obj").c_str()));
-	meshList.push_back(std::make_shared<Mesh>(FixPath(L"../../Assets/Models/quad.obj").c_str()));
-	meshList.push_back(std::make_shared<Mesh>(FixPath(L"../../Assets/Models/quad_double_sided.obj").c_str()));
-	meshList.push_back(std::make_shared<Mesh>(FixPath(L"../../Assets/Models/sphere.obj").c_str()));
-	meshList.push_back(std::make_shared<Mesh>(FixPath(L"../../Assets/Models/torus.obj").c_str()));
-
-	renderableList.push_back(Renderable(meshList[0], cobbleMaterial, XMFLOAT3(0, 0, 0)));
-	renderableList.push_back(Renderable(meshList[1], cobbleMaterial, XMFLOAT3(0, 3, 0)));
-	renderableList.push_back(Renderable(meshList[2], cobbleMaterial, XMFLOAT3(3, 0, 0)));
-	renderableList.push_back(Renderable(meshList[3], cobbleMaterial, XMFLOAT3(-3, 3, 0)));
-	renderableList.push_back(Renderable(meshList[4], scratchedMaterial, XMFLOAT3(3, 3, 0)));
-	renderableList.push_back(Renderable(meshList[5], scratchedMaterial, XMFLOAT3(-3, 0, 0)));
-	renderableList.push_back(Renderable(meshList[6], scratchedMaterial, XMFLOAT3(0, -3, 0)));
+	TextureHandle cobblestoneAlbedo = resources.LoadTexture(L"cobblestone_albedo.png");
+	TextureHandle cobblestoneMetal = resources.LoadTexture(L"cobblestone_metal.png");
+	TextureHandle cobblestoneNormals = resources.LoadTexture(L"cobblestone_normals.png");
+	TextureHandle cobblestoneRoughness = resources.LoadTexture(L"cobblestone_roughness.png");
+	TextureHandle scratchedAlbedo = resources.LoadTexture(L"scratched_albedo.png");
+	TextureHandle scratchedMetal = resources.LoadTexture(L"scratched_metal.png");
+	TextureHandle scratchedNormals = resources.LoadTexture(L"scratched_normals.png");
+	TextureHandle scratchedRoughness = resources.LoadTexture(L"scratched_roughness.png");
+
+	Material cobbleMaterial(pipelineState, XMFLOAT3(1, 1, 1), XMFLOAT2(1, 1), XMFLOAT2(0, 0));
+	cobbleMaterial.AddTexture(resources.GetBindlessIndex(cobblestoneAlbedo), 0);
+	cobbleMaterial.AddTexture(resources.GetBindlessIndex(cobblestoneNormals), 1);
+	cobbleMaterial.AddTexture(resources.GetBindlessIndex(cobblestoneMetal), 2);
+	cobbleMaterial.AddTexture(resources.GetBindlessIndex(cobblestoneRoughness), 3);
+	cobbleMaterial.FinalizeMaterial(materialTable);
+
+	Material scratchedMaterial(pipelineState, XMFLOAT3(1, 1, 1), XMFLOAT2(1, 1), XMFLOAT2(0, 0));
+	scratchedMaterial.AddTexture(resources.GetBindlessIndex(scratchedAlbedo), 0);
+	scratchedMaterial.AddTexture(resources.GetBindlessIndex(scratchedNormals), 1);
+	scratchedMaterial.AddTexture(resources.GetBindlessIndex(scratchedMetal), 2);
+	scratchedMaterial.AddTexture(resources.GetBindlessIndex(scratchedRoughness), 3);
+	scratchedMaterial.FinalizeMaterial(materialTable);
+
+	// All materials are registered, so send the table to the GPU
+	materialTable.Upload();
+
+	// Parse the models in parallel, then create the meshes (and their GPU
+	// buffers) here, since the upload path isn't thread safe
+	const wchar_t* modelFiles[] =
+	{
+		L"../../Assets/Models/cube.obj",
+		L"../../Assets/Models/cylinder.obj",
+		L"../../Assets/Models/helix.obj",
+		L"../../Assets/Models/quad.obj",
+		L"../../Assets/Models/quad_double_sided.obj",
+		L"../../Assets/Models/sphere.obj",
+		L"../../Assets/Models/torus.obj",
+	};
+	const unsigned int modelCount = ARRAYSIZE(modelFiles);
+	std::wstring modelPaths[modelCount];
+	std::vector<Vertex> modelVerts[modelCount];
+	std::vector<unsigned int> modelIndices[modelCount];
+	for (unsigned int m = 0; m < modelCount; m++)
+		modelPaths[m] = FixPath(modelFiles[m]);
+
+	JobSystem::GetInstance().ParallelFor(0, modelCount, 1, [&](unsigned int first, unsigned int last)
+	{
+		for (unsigned int m = first; m < last; m++)
+			Mesh::LoadOBJ(modelPaths[m].c_str(), modelVerts[m], modelIndices[m]);
+	});
+
+	// Meshes keep a CPU copy of their triangles so they can be picked
+	for (unsigned int m = 0; m < modelCount; m++)
+	{
+		meshList.push_back(resources.AddMesh(Mesh(
+			modelVerts[m].data(), (unsigned int)modelVerts[m].size(),
+			modelIndices[m].data(), (unsigned int)modelIndices[m].size(),
+			true)));
+	}
+
+	materialList.push_back(resources.AddMaterial(cobbleMaterial));
+	materialList.push_back(resources.AddMaterial(scratchedMaterial));
+
+	SpawnRenderable(meshList[0], materialList[0], XMFLOAT3(0, 0, 0), true);
+	SpawnRenderable(meshList[1], materialList[0], XMFLOAT3(0, 3, 0));
+	SpawnRenderable(meshList[2], materialList[0], XMFLOAT3(3, 0, 0));
+	SpawnRenderable(meshList[3], materialList[0], XMFLOAT3(-3, 3, 0));
+	SpawnRenderable(meshList[4], materialList[1], XMFLOAT3(3, 3, 0));
+	SpawnRenderable(meshList[5], materialList[1], XMFLOAT3(-3, 0, 0));
+	SpawnRenderable(meshList[6], materialList[1], XMFLOAT3(0, -3, 0));
+}
+
+// --------------------------------------------------------
+// Creates an entity with everything needed to draw a mesh
+// - Entities whose mesh is unloaded later just stop drawing
+// - Occluders hide things behind them using their mesh's bounding
+//   box, so only solid, boxy meshes make good occluders
+// --------------------------------------------------------
+Entity Game::SpawnRenderable(MeshHandle meshHandle, MaterialHandle materialHandle, XMFLOAT3 position, bool occluder)
+{
+	MEMORY_TAG(MEMORY_TAG_SCENE);
+
+	Mesh* mesh = resources.GetMesh(meshHandle);
+	Material* material = resources.GetMaterial(materialHandle);
+
+	TransformComponent transform = { transformSystem.Create(position) };
+	XMFLOAT3 center = mesh->GetBoundingSphereCenter();
+	transformSystem.SetLocalBounds(transform.handle, XMFLOAT4(center.x, center.y, center.z, mesh->GetBoundingSphereRadius()));
+
+	MeshComponent meshComponent = { meshHandle };
+	MaterialComponent materialComponent = { materialHandle, material->GetPipelineState().Get(), material->GetMaterialIndex() };
+	BoundsComponent bounds = {};
+	FlagsComponent flags = { ENTITY_FLAG_VISIBLE | ENTITY_FLAG_SPINNING, RENDER_LAYER_WORLD };
+	if (occluder)
+	{
+		OccluderComponent occluderComponent = { occlusionCulling.AddOccluderBox(mesh->GetBoundsMin(), mesh->GetBoundsMax()) };
+		return entities.Spawn(transform, meshComponent, materialComponent, bounds, flags, occluderComponent);
+	}
+	return entities.Spawn(transform, meshComponent, materialComponent, bounds, flags);
+}
+
+// --------------------------------------------------------
+// Finds the nearest triangle a world space ray hits among a
+// snapshot's draw items, using the scene BVH to skip everything
+// whose bounding sphere is missed or farther than a hit so far.
+// The ray is moved into each candidate mesh's local space with
+// the inverse of its world matrix and tested against the mesh's
+// triangle BVH (meshes without CPU geometry count their sphere).
+//
+// drawItem - Index in the snapshot's drawItems of what was hit
+// triangle - Triangle of its mesh that was hit (UINT_MAX for a sphere)
+// --------------------------------------------------------
+bool Game::Pick(const RenderSnapshot& snapshot, XMFLOAT3 origin, XMFLOAT3 direction, float maxDistance, unsigned int& drawItem, unsigned int& triangle, float& distance)
+{
+	XMStoreFloat3(&direction, XMVector3Normalize(XMLoadFloat3(&direction)));
+
+	// The mesh's own distance along the ray (or FLT_MAX for a miss)
+	auto intersectMesh = [&](unsigned int item, float sphereDistance, float nearest, unsigned int& meshTriangle)
+	{
+		meshTriangle = UINT_MAX;
+		MeshBVH* triangleBVH = snapshot.drawItems[item].triangleBVH;
+		if (!triangleBVH)
+			return sphereDistance;
+
+		// Local space direction isn't normalized, so distances stay in world units
+		XMMATRIX inverseWorld = XMMatrixInverse(0, XMLoadFloat4x4(&snapshot.drawItems[item].world));
+		XMFLOAT3 localOrigin, localDirection;
+		XMStoreFloat3(&localOrigin, XMVector3TransformCoord(XMLoadFloat3(&origin), inverseWorld));
+		XMStoreFloat3(&localDirection, XMVector3TransformNormal(XMLoadFloat3(&direction), inverseWorld));
+
+		float meshDistance;
+		if (!triangleBVH->Raycast(localOrigin, localDirection, nearest, meshTriangle, meshDistance))
+			return FLT_MAX;
+		return meshDistance;
+	};
+
+	bool hit = sceneBVH.Raycast(origin, direction, maxDistance,
+		[&](unsigned int item, float sphereDistance, float nearest)
+	{
+		unsigned int meshTriangle;
+		return intersectMesh(item, sphereDistance, nearest, meshTriangle);
+	}, drawItem, distance);
+	if (!hit)
+		return false;
+
+	// Only the nearest object's triangle matters, so look it up once at the end
+	intersectMesh(drawItem, distance, distance, triangle);
+	return true;
 }
 
 
@@ -396,7 +731,9 @@ void Game::OnResize()
 {
 	// Handle base-level DX resize stuff
 	DXCore::OnResize();
-	camera->SetAspect((float)(windowWidth / windowHeight));
+	CreateSceneTarget();
+	camera->SetAspect(windowWidth / (float)windowHeight);
+	clusteredLighting.UpdateClusterBounds(camera->GetProjection(), camera->GetNearClip(), camera->GetFarClip());
 }
 
 // --------------------------------------------------------
@@ -404,16 +741,294 @@ void Game::OnResize()
 // --------------------------------------------------------
 void Game::Update(float deltaTime, float totalTime)
 {
+	PROFILE_FUNCTION();
+	MEMORY_TAG(MEMORY_TAG_FRAME);
+
 	// Example input checking: Quit if the escape key is pressed
 	if (Input::GetInstance().KeyDown(VK_ESCAPE))
 		Quit();
 
-	for (size_t i = 0; i < renderableList.size(); i++)
+	// Anything below that changes what a frame does (so the vectors and
+	// arenas it uses may need to grow again) restarts the allocation
+	// warm-up, which also allows allocations for the rest of this frame
+
+	// Toggle the demo light field (clustered lighting kicks in automatically)
+	if (Input::GetInstance().KeyPress('L'))
 	{
-		renderableList[i].GetTransform().Rotate(0.01f, 0.01f, 0.01f);
+		RestartAllocationWarmup();
+		if (lights.size() > baseLightCount)
+			lights.resize(baseLightCount);
+		else
+			AddDemoLights();
 	}
 
+	// Switch between clustered and per-object lighting for large light counts
+	if (Input::GetInstance().KeyPress('C'))
+	{
+		RestartAllocationWarmup();
+		useClusteredLighting = !useClusteredLighting;
+	}
+
+	// Toggle CPU occlusion culling, to compare against frustum culling alone
+	if (Input::GetInstance().KeyPress('O'))
+	{
+		RestartAllocationWarmup();
+		useOcclusionCulling = !useOcclusionCulling;
+	}
+
+	// Draw on a render thread while the next frame is simulated (or not)
+	if (Input::GetInstance().KeyPress('P'))
+	{
+		RestartAllocationWarmup();
+		pipelinedRendering = !pipelinedRendering;
+	}
+
+	// Frame pacing: back buffers (2 to 4), frames that can be queued up
+	// for presenting (1 to 3) and the frame limiter (off, 60 or 144fps)
+	if (Input::GetInstance().KeyPress('K'))
+	{
+		RestartAllocationWarmup();
+		SetBackBufferCount(backBufferCount == MAX_BACK_BUFFERS ? 2 : backBufferCount + 1);
+	}
+	if (Input::GetInstance().KeyPress('N'))
+	{
+		RestartAllocationWarmup();
+		SetMaxFrameLatency(maxFrameLatency == 3 ? 1 : maxFrameLatency + 1);
+	}
+	if (Input::GetInstance().KeyPress('F'))
+	{
+		float targetFrameRate = framePacer.GetTargetFrameRate();
+		framePacer.SetTargetFrameRate(targetFrameRate == 0 ? 60.0f : targetFrameRate < 100 ? 144.0f : 0);
+	}
+
+	// Dynamic resolution budget: 60fps, 120fps or off (full resolution)
+	if (Input::GetInstance().KeyPress('R'))
+	{
+		RestartAllocationWarmup();
+		resolutionBudget = resolutionBudget == 0 ? 16.667f : resolutionBudget > 10 ? 8.333f : 0;
+	}
+
+	// Save the recent frame times now (they're also saved on exit)
+	if (Input::GetInstance().KeyPress('T'))
+	{
+		RestartAllocationWarmup();
+		ExportFrameStats();
+	}
+
+	// Start a profiler capture, or stop it and save the trace
+	if (Input::GetInstance().KeyPress('Y'))
+	{
+		RestartAllocationWarmup();
+		ToggleProfilerCapture();
+	}
+
+	// Turn the zero-allocation frame checks on or off
+	if (Input::GetInstance().KeyPress('Z'))
+	{
+		zeroAllocationFrames = !zeroAllocationFrames;
+		printf("Zero-allocation frames: %s\n", zeroAllocationFrames ? "on" : "off");
+	}
+
+	// Print the render counters (draws, state changes, upload traffic) every frame, or stop
+	if (Input::GetInstance().KeyPress('G'))
+	{
+		RenderCounters& counters = dx12Helper.GetRenderCounters();
+		counters.SetDumpEveryFrame(!counters.GetDumpEveryFrame());
+	}
+
+	// Print live and peak memory, CPU by tag and GPU by heap and use
+	if (Input::GetInstance().KeyPress('M'))
+		MemoryTracker::PrintReport();
+
+	// Free anything unloaded that no frame in flight still draws with
+	resources.Collect(framePipeline.GetUpdateFrame(), framePipeline.GetDrawFrame());
+
+#if defined(DEBUG) || defined(_DEBUG)
+	// Run the CPU microbenchmarks (results go to the console)
+	if (Input::GetInstance().KeyPress('B'))
+	{
+		// Some of these create GPU resources, so the render thread can't be busy
+		RestartAllocationWarmup();
+		framePipeline.Flush();
+		RunTransformClassBenchmark();
+		RunTransformBenchmark();
+		RunHierarchyBenchmark();
+		RunEntityBenchmark(resources, meshList[0], materialList[0]);
+		RunResourcePoolBenchmark();
+		RunCullingBenchmark();
+		RunOcclusionBenchmark();
+		RunContributionBenchmark();
+		RunClusteredLightingBenchmark();
+		RunLightSelectionBenchmark();
+		RunBVHBenchmark();
+		RunMeshBVHBenchmark(resources, meshList);
+		RunJobSystemBenchmark();
+		RunFramePipelineBenchmark();
+		RunFixedTimestepBenchmark();
+		RunFramePacingBenchmark();
+		RunDynamicResolutionBenchmark();
+		RunFrameStatsBenchmark();
+		RunProfilerBenchmark();
+		RunRenderCountersBenchmark();
+		RunMemoryTrackingBenchmark();
+		RunFrameArenaBenchmark();
+		RunMaterialTableBenchmark();
+		RunPipelineCacheBenchmark(pipelineState);
+		RunLightPartitionBenchmark();
+	}
+#endif
+
+	// The camera follows input every frame rather than every tick, so it
+	// stays responsive (its movement already scales with deltaTime)
 	camera->Update(deltaTime);
+
+	// Draw everything partway between the last two ticks, so motion is
+	// smooth at any frame rate
+	transformSystem.UpdateInterpolatedMatrices(fixedTimestep.GetInterpolation());
+
+	// Hand everything Draw() needs over to it
+	CaptureRenderSnapshot(renderSnapshots[framePipeline.GetUpdateSlot()]);
+}
+
+// --------------------------------------------------------
+// Steps the simulation by one fixed tick (deltaTime is always
+// the same), however many times per frame that takes
+// --------------------------------------------------------
+void Game::FixedUpdate(float deltaTime, float totalTime)
+{
+	PROFILE_FUNCTION();
+	MEMORY_TAG(MEMORY_TAG_FRAME);
+	transformSystem.BeginTick();
+
+	// Each entity only touches its own transform, so chunks can go to different threads
+	float spin = spinSpeed * deltaTime;
+	entities.ForEachChunkParallel<TransformComponent, FlagsComponent>(
+		[&](unsigned int count, Entity*, TransformComponent* transforms, FlagsComponent* flags)
+	{
+		for (unsigned int i = 0; i < count; i++)
+		{
+			if (flags[i].flags & ENTITY_FLAG_SPINNING)
+				transformSystem.Rotate(transforms[i].handle, XMFLOAT3(spin, spin, spin));
+		}
+	});
+
+	UpdateTransforms();
+}
+
+// --------------------------------------------------------
+// Rebuilds the matrices of everything that moved, in batches,
+// then copies the new bounds next to the rest of each entity's
+// render data
+// --------------------------------------------------------
+void Game::UpdateTransforms()
+{
+	transformSystem.UpdateMatrices();
+
+	entities.ForEachChunkParallel<TransformComponent, BoundsComponent>(
+		[&](unsigned int count, Entity*, TransformComponent* transforms, BoundsComponent* bounds)
+	{
+		for (unsigned int i = 0; i < count; i++)
+			bounds[i].sphere = transformSystem.GetWorldBounds(transforms[i].handle);
+	});
+}
+
+// --------------------------------------------------------
+// Sizes the lists culling and lighting fill each frame for the
+// whole scene, so turning the camera to see more of it never grows
+// them inside a zero-allocation frame. Only does anything (and only
+// allocates) on the frame the scene grows.
+// --------------------------------------------------------
+void Game::ReserveDrawResults(unsigned int objectCount, unsigned int lightCount)
+{
+	if (objectCount <= reservedObjectCount && lightCount <= reservedLightCount)
+		return;
+
+	ALLOW_ALLOCATIONS();
+	reservedObjectCount = max(objectCount, reservedObjectCount);
+	reservedLightCount = max(lightCount, reservedLightCount);
+
+	// The BVH sorts its results with 64 entries of room past the end,
+	// and a bitmap from this thread's scratch arena (made on first use)
+	inFrustum.reserve(reservedObjectCount + 64);
+	LinearArena::GetThreadScratch();
+	contributionCulling.Reserve(reservedObjectCount);
+	occlusionCulling.Reserve(reservedObjectCount);
+	lightSelection.Reserve(reservedLightCount, reservedObjectCount);
+	clusteredLighting.Reserve(reservedLightCount);
+}
+
+// --------------------------------------------------------
+// Copies the camera, lights and everything that could be drawn
+// into a snapshot Draw() can use while the simulation moves on.
+// The vectors are reused, so this doesn't allocate once they've
+// grown to fit the scene.
+// --------------------------------------------------------
+void Game::CaptureRenderSnapshot(RenderSnapshot& snapshot)
+{
+	PROFILE_FUNCTION();
+	snapshot.view = camera->GetView();
+	snapshot.projection = camera->GetProjection();
+	snapshot.viewProjection = camera->GetViewProjection();
+	snapshot.cameraPosition = camera->GetPosition();
+	snapshot.cameraOrtho = camera->IsOrtho();
+	snapshot.lights = lights;
+	snapshot.useClusteredLighting = useClusteredLighting;
+	snapshot.useOcclusionCulling = useOcclusionCulling;
+	snapshot.resolutionBudget = resolutionBudget;
+
+	snapshot.drawItems.clear();
+	snapshot.objectBounds.clear();
+	snapshot.objectLayers.clear();
+	entities.ForEachChunk<TransformComponent, MeshComponent, MaterialComponent, BoundsComponent, FlagsComponent>(
+		[&](unsigned int count, Entity* chunkEntities, TransformComponent* transforms, MeshComponent* meshes, MaterialComponent* materials, BoundsComponent* bounds, FlagsComponent* flags)
+	{
+		for (unsigned int i = 0; i < count; i++)
+		{
+			if (!(flags[i].flags & ENTITY_FLAG_VISIBLE))
+				continue;
+
+			// Skip anything whose mesh has been unloaded
+			Mesh* mesh = resources.GetMesh(meshes[i].mesh);
+			if (!mesh)
+				continue;
+
+			DrawItem item;
+			item.entity = chunkEntities[i];
+			item.world = transformSystem.GetInterpolatedWorldMatrix(transforms[i].handle);
+			item.worldInvTranspose = transformSystem.GetInterpolatedWorldInverseTransposeMatrix(transforms[i].handle);
+			item.vbView = mesh->GetvbView();
+			item.ibView = mesh->GetibView();
+			item.indexCount = mesh->GetIndexCount();
+			item.triangleBVH = mesh->GetTriangleBVH();
+			item.pipelineState = materials[i].pipelineState;
+			item.materialIndex = materials[i].materialIndex;
+			snapshot.drawItems.push_back(item);
+			snapshot.objectBounds.push_back(bounds[i].sphere);
+			snapshot.objectLayers.push_back(flags[i].layer);
+		}
+	});
+
+	snapshot.occluders.clear();
+	if (useOcclusionCulling)
+	{
+		entities.ForEach<TransformComponent, BoundsComponent, OccluderComponent>(
+			[&](Entity entity, TransformComponent& transform, BoundsComponent& bounds, OccluderComponent& occluder)
+		{
+			OccluderItem item = { entity.index, occluder.shape, transformSystem.GetInterpolatedWorldMatrix(transform.handle), bounds.sphere };
+			snapshot.occluders.push_back(item);
+		});
+	}
+
+	snapshot.verify = false;
+	snapshot.pick = false;
+#if defined(DEBUG) || defined(_DEBUG)
+	Input& input = Input::GetInstance();
+	snapshot.verify = input.KeyPress('V');
+	snapshot.pick = input.MouseRightPress();
+	snapshot.pickPosition = XMFLOAT2(
+		input.GetMouseX() / (float)windowWidth * 2.0f - 1.0f,
+		1.0f - input.GetMouseY() / (float)windowHeight * 2.0f);
+#endif
 }
 
 // --------------------------------------------------------
@@ -421,29 +1036,75 @@ void Game::Update(float deltaTime, float totalTime)
 // --------------------------------------------------------
 void Game::Draw(float deltaTime, float totalTime)
 {
+	PROFILE_FUNCTION();
+	MEMORY_TAG(MEMORY_TAG_FRAME);
+
+	// Everything this frame needs from the simulation (which may already
+	// be working on the next frame)
+	const RenderSnapshot& snapshot = renderSnapshots[framePipeline.GetDrawSlot()];
+	const std::vector<DrawItem>& drawItems = snapshot.drawItems;
+	const std::vector<XMFLOAT4>& objectBounds = snapshot.objectBounds;
+	const std::vector<unsigned int>& objectLayers = snapshot.objectLayers;
+	LinearArena& frameArena = framePipeline.GetFrameArena(framePipeline.GetDrawSlot());
+	RenderCounters& counters = dx12Helper.GetRenderCounters();
+	ReserveDrawResults((unsigned int)objectBounds.size(), (unsigned int)snapshot.lights.size());
+
 	// Grab the current back buffer for this frame
 	Microsoft::WRL::ComPtr<ID3D12Resource> currentBackBuffer = backBuffers[currentSwapBuffer];
 
+	// How much of the window to render, from how long the last few frames
+	// took (this frame's own time is measured once the GPU is done with it)
+	double drawStartTime = framePacer.Now();
+	float scale = 1.0f;
+	if (snapshot.resolutionBudget > 0 && sceneTargetIndex != INVALID_TEXTURE_INDEX && upscalePipelineState)
+	{
+		dynamicResolution.SetBudget(snapshot.resolutionBudget);
+		scale = dynamicResolution.GetScale();
+	}
+	else
+	{
+		dynamicResolution.Reset();
+	}
+	renderScale = scale;
+
+	// Below full scale the scene goes into the top left of the scene
+	// target instead of straight into the back buffer
+	bool upscale = scale < 1.0f;
+	unsigned int renderWidth = max(1u, (unsigned int)(windowWidth * scale + 0.5f));
+	unsigned int renderHeight = max(1u, (unsigned int)(windowHeight * scale + 0.5f));
+	D3D12_CPU_DESCRIPTOR_HANDLE sceneRTV = upscale ?
+		sceneTargetRTVHeap->GetCPUDescriptorHandleForHeapStart() :
+		rtvHandles[currentSwapBuffer];
+	D3D12_VIEWPORT sceneViewport = viewport;
+	sceneViewport.Width = (float)renderWidth;
+	sceneViewport.Height = (float)renderHeight;
+	D3D12_RECT sceneScissorRect = { 0, 0, (LONG)renderWidth, (LONG)renderHeight };
+
 	// Clearing the render target
 	{
 		// Transition the back buffer from present to render target
-		D3D12_RESOURCE_BARRIER rb = {};
-		rb.Type = D3D12_RESOURCE_BARRIER_TYPE_TRANSITION;
-		rb.Flags = D3D12_RESOURCE_BARRIER_FLAG_NONE;
-		rb.Transition.pResource = currentBackBuffer.Get();
-		rb.Transition.StateBefore = D3D12_RESOURCE_STATE_PRESENT;
-		rb.Transition.StateAfter = D3D12_RESOURCE_STATE_RENDER_TARGET;
-		rb.Transition.Subresource = D3D12_RESOURCE_BARRIER_ALL_SUBRESOURCES;
-		commandList->ResourceBarrier(1, &rb);
+		D3D12_RESOURCE_BARRIER rb[2] = {};
+		rb[0].Type = D3D12_RESOURCE_BARRIER_TYPE_TRANSITION;
+		rb[0].Flags = D3D12_RESOURCE_BARRIER_FLAG_NONE;
+		rb[0].Transition.pResource = currentBackBuffer.Get();
+		rb[0].Transition.StateBefore = D3D12_RESOURCE_STATE_PRESENT;
+		rb[0].Transition.StateAfter = D3D12_RESOURCE_STATE_RENDER_TARGET;
+		rb[0].Transition.Subresource = D3D12_RESOURCE_BARRIER_ALL_SUBRESOURCES;
 
-		// Background color (Cornflower Blue in this case) for clearing
-		float color[] = { 0.4f, 0.6f, 0.75f, 1.0f };
+		// And the scene target, if it's being used, from being read last frame
+		rb[1] = rb[0];
+		rb[1].Transition.pResource = sceneTarget.Get();
+		rb[1].Transition.StateBefore = D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE;
+		commandList->ResourceBarrier(upscale ? 2 : 1, rb);
+		dx12Helper.BeginGpuRange("Frame");
+		dx12Helper.BeginGpuRange("Scene");
 
-		// Clear the RTV
+		// Clear the RTV (the back buffer doesn't need it when the
+		// upscale pass is going to cover all of it anyway)
 		commandList->ClearRenderTargetView(
-			rtvHandles[currentSwapBuffer],
-			color,
-			0, 0); // No scissor rectangles
+			sceneRTV,
+			backgroundColor,
+			1, &sceneScissorRect);
 
 		// Clear the depth buffer, too
 		commandList->ClearDepthStencilView(
@@ -466,61 +1127,364 @@ void Game::Draw(float deltaTime, float totalTime)
 		commandList->SetDescriptorHeaps(1, descriptorHeap.GetAddressOf());
 
 		// Set up other commands for rendering
-		commandList->OMSetRenderTargets(1, &rtvHandles[currentSwapBuffer], true, &dsvHandle);
-		commandList->RSSetViewports(1, &viewport);
-		commandList->RSSetScissorRects(1, &scissorRect);
+		commandList->OMSetRenderTargets(1, &sceneRTV, true, &dsvHandle);
+		commandList->RSSetViewports(1, &sceneViewport);
+		commandList->RSSetScissorRects(1, &sceneScissorRect);
 		commandList->IASetPrimitiveTopology(D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
 
-		// Draw
-		for (size_t i = 0; i < renderableList.size(); i++)
+		// Bindless textures and the material table are shared by every draw
+		commandList->SetGraphicsRootDescriptorTable(2, dx12Helper.GetBindlessTextureTableGPUHandle());
+		counters.Add(RENDER_COUNTER_DESCRIPTOR_TABLE_BINDS);
+		commandList->SetGraphicsRootShaderResourceView(3, materialTable.GetGPUAddress());
+
+		// The BVH is refit to wherever things moved (and rebuilt when
+		// that has made it too loose), then walked for the frustum
+		XMFLOAT4X4 viewProjection = snapshot.viewProjection;
 		{
-			std::shared_ptr<Material> mat = renderableList[i].GetMaterial();
-			commandList->SetPipelineState(mat->GetPipelineState().Get());
-			// Set the SRV descriptor handle for this material's textures
-			// Note: This assumes that descriptor table 2 is for textures (as per our root sig)
-			commandList->SetGraphicsRootDescriptorTable(2, mat->GetFinalGPUHandleForSRVs());
-			
-			// Pixel shader data and cbuffer setup
+			PROFILE_ZONE("Frustum culling");
+			sceneBVH.Update(objectBounds.data(), (unsigned int)objectBounds.size());
+			sceneBVH.QueryFrustum(viewProjection, inFrustum);
+		}
+		const std::vector<unsigned int>* survivors = &inFrustum;
+
+#if defined(DEBUG) || defined(_DEBUG)
+		// Right click prints what's under the cursor
+		if (snapshot.pick)
+		{
+			ALLOW_ALLOCATIONS();
+			XMMATRIX inverseViewProjection = XMMatrixInverse(0, XMLoadFloat4x4(&viewProjection));
+			float x = snapshot.pickPosition.x;
+			float y = snapshot.pickPosition.y;
+			XMVECTOR nearPoint = XMVector3TransformCoord(XMVectorSet(x, y, 0, 1), inverseViewProjection);
+			XMVECTOR farPoint = XMVector3TransformCoord(XMVectorSet(x, y, 1, 1), inverseViewProjection);
+			XMFLOAT3 origin, direction;
+			XMStoreFloat3(&origin, nearPoint);
+			XMStoreFloat3(&direction, XMVectorSubtract(farPoint, nearPoint));
+
+			unsigned int drawItem, triangle;
+			float distance;
+			if (Pick(snapshot, origin, direction, XMVectorGetX(XMVector3Length(XMVectorSubtract(farPoint, nearPoint))), drawItem, triangle, distance))
+				printf("Picked entity %u, triangle %u, %.2f units away\n", drawItems[drawItem].entity.index, triangle, distance);
+			else
+				printf("Picked nothing\n");
+		}
+#endif
+
+		// Then drop what's too small on screen to be worth drawing
+		XMFLOAT4X4 projection = snapshot.projection;
+		{
+			PROFILE_ZONE("Contribution culling");
+			contributionCulling.Cull(viewProjection, projection, (float)renderHeight,
+				objectBounds.data(), objectLayers.data(), survivors->data(), (unsigned int)survivors->size());
+		}
+		survivors = &contributionCulling.GetVisible();
+
+		// And what's hidden behind the occluders
+		if (snapshot.useOcclusionCulling)
+		{
+			PROFILE_ZONE("Occlusion culling");
+			occlusionCulling.BeginFrame(viewProjection);
+			for (const OccluderItem& occluder : snapshot.occluders)
+				occlusionCulling.AddOccluder(occluder.id, occluder.shape, occluder.world, occluder.sphere);
+			occlusionCulling.RasterizeOccluders();
+			occlusionCulling.Cull(objectBounds.data(), survivors->data(), (unsigned int)survivors->size());
+			survivors = &occlusionCulling.GetVisible();
+		}
+		const std::vector<unsigned int>& visible = *survivors;
+
+#if defined(DEBUG) || defined(_DEBUG)
+		if (snapshot.verify)
+		{
+			ALLOW_ALLOCATIONS();
+			frustumCulling.CullBruteForce(viewProjection, objectBounds.data(), (unsigned int)objectBounds.size());
+			bool match = inFrustum == frustumCulling.GetVisible();
+			printf("Frustum culling: %u of %u objects visible, BVH of %u nodes (SAH cost %.1f, %.1f when built, %u rebuilds, refit %.3fms), brute force %.3fms, %s\n",
+				(unsigned int)inFrustum.size(),
+				sceneBVH.GetObjectCount(),
+				sceneBVH.GetNodeCount(),
+				sceneBVH.GetCost(),
+				sceneBVH.GetBuildCost(),
+				sceneBVH.GetRebuildCount(),
+				sceneBVH.GetLastRefitTimeMs(),
+				frustumCulling.GetLastCullTimeMs(),
+				match ? "results match" : "RESULTS DIFFER");
+
+			double contributionTime = contributionCulling.GetLastCullTimeMs();
+			match = contributionCulling.VerifyAgainstBruteForce(viewProjection, projection, (float)renderHeight,
+				objectBounds.data(), objectLayers.data(), inFrustum.data(), (unsigned int)inFrustum.size());
+			printf("Contribution culling: %u of %u objects big enough (%u dropped: %u world, %u props, %u detail), culled in %.3fms (brute force %.3fms), %s\n",
+				contributionCulling.GetVisibleCount(),
+				contributionCulling.GetTestedCount(),
+				contributionCulling.GetDroppedCount(),
+				contributionCulling.GetDroppedCount(RENDER_LAYER_WORLD),
+				contributionCulling.GetDroppedCount(RENDER_LAYER_PROPS),
+				contributionCulling.GetDroppedCount(RENDER_LAYER_DETAIL),
+				contributionTime,
+				contributionCulling.GetLastCullTimeMs(),
+				match ? "results match" : "RESULTS DIFFER");
+
+			if (snapshot.useOcclusionCulling)
+			{
+				double rasterTime = occlusionCulling.GetLastRasterTimeMs();
+				double testTime = occlusionCulling.GetLastTestTimeMs();
+				const std::vector<unsigned int>& candidates = contributionCulling.GetVisible();
+				match = occlusionCulling.VerifyAgainstBruteForce(objectBounds.data(), candidates.data(), (unsigned int)candidates.size());
+				printf("Occlusion culling: %u of %u objects visible, %u occluders (%u skipped, %u triangles), raster %.3fms + test %.3fms (brute force %.3fms), %s\n",
+					occlusionCulling.GetVisibleCount(),
+					occlusionCulling.GetTestedCount(),
+					occlusionCulling.GetOccluderCount(),
+					occlusionCulling.GetSkippedOccluderCount(),
+					occlusionCulling.GetTriangleCount(),
+					rasterTime,
+					testTime,
+					occlusionCulling.GetLastRasterTimeMs() + occlusionCulling.GetLastTestTimeMs(),
+					match ? "results match" : "RESULTS DIFFER");
+			}
+		}
+#endif
+
+		// Pixel shader data and cbuffer setup
+		// Nothing in here changes per object, so it's only filled once per frame
+		Microsoft::WRL::ComPtr<ID3D12PipelineState> litPipeline = pipelineState;
+		bool perObjectLights = false;
+		{
+			PROFILE_ZONE("Lighting");
+
+			// Lights are sorted by type so the shader can loop over each type's range
+			PixelShaderExternalData psData = {};
+			const std::vector<Light>& lights = snapshot.lights;
+			Light* sortedLights = frameArena.AllocateArray<Light>(lights.size());
+			LightCounts counts = PartitionLights(lights.data(), (int)lights.size(), sortedLights);
+			psData.cameraPosition = snapshot.cameraPosition;
+			psData.directionalLightCount = counts.directional;
+			psData.pointLightCount = counts.point;
+			psData.spotLightCount = counts.spot;
+
+			// Too many lights for the constant buffer, so point and spot lights
+			// are binned into clusters and the pixel shader reads them from there.
+			// Otherwise, if there are more local lights than any one object should
+			// pay for, each object gets its own short list of the lights that matter.
+			const unsigned int maxConstantBufferLights = ARRAYSIZE(psData.lights);
+			const Light* localLights = sortedLights + counts.directional;
+			unsigned int localLightCount = counts.point + counts.spot;
+			bool clustered =
+				lights.size() > maxConstantBufferLights &&
+				snapshot.useClusteredLighting &&
+				!snapshot.cameraOrtho &&
+				pipelineCache.IsReady(clusteredPipeline);
+			perObjectLights =
+				!clustered &&
+				localLightCount > MAX_LIGHTS_PER_OBJECT &&
+				pipelineCache.IsReady(perObjectLightPipeline);
+
+			if (clustered)
 			{
-				PixelShaderExternalData psData = {};
-				psData.uvScale = mat->GetUVScale();
-				psData.uvOffset = mat->GetUVOffset();
-				psData.cameraPosition = camera->GetPosition();
-				psData.lightCount = lightCount;
-				memcpy(psData.lights, &lights[0], sizeof(Light) * 20);
-				
-				// Send this to a chunk of the constant buffer heap
-				// and grab the GPU handle for it so we can set it for this draw
-				D3D12_GPU_DESCRIPTOR_HANDLE cbHandlePS =
-					dx12Helper.FillNextConstantBufferAndGetGPUDescriptorHandle(
-						(void*)(&psData), sizeof(PixelShaderExternalData));
-				
-				// Set this constant buffer handle
-				// Note: This assumes that descriptor table 1 is the
-				// place to put this particular descriptor. This
-				// is based on how we set up our root signature.
-				commandList->SetGraphicsRootDescriptorTable(1, cbHandlePS);
+				clusteredLighting.BinLights(localLights, counts.point, counts.spot, snapshot.view);
+
+#if defined(DEBUG) || defined(_DEBUG)
+				// Check the binning against the brute force version on demand
+				if (snapshot.verify)
+				{
+					ALLOW_ALLOCATIONS();
+					double binTime = clusteredLighting.GetLastBinTimeMs();
+					bool match = clusteredLighting.VerifyAgainstBruteForce(localLights, counts.point, counts.spot, snapshot.view);
+					printf("Clustered lighting: %d lights binned in %.3fms (brute force %.3fms), %s, %u lights dropped from full clusters\n",
+						counts.point + counts.spot,
+						binTime,
+						clusteredLighting.GetLastBinTimeMs(),
+						match ? "results match" : "RESULTS DIFFER",
+						clusteredLighting.GetOverflowCount());
+				}
+#endif
+
+				psData.clusterSliceScale = clusteredLighting.GetSliceScale();
+				psData.clusterSliceBias = clusteredLighting.GetSliceBias();
+				psData.clusterCountX = clusteredLighting.GetClusterCountX();
+				psData.clusterCountY = clusteredLighting.GetClusterCountY();
+				psData.clusterCountZ = clusteredLighting.GetClusterCountZ();
+				psData.clusterTileSize = XMFLOAT2(
+					(float)renderWidth / psData.clusterCountX,
+					(float)renderHeight / psData.clusterCountY);
+
+				// Root SRVs need a valid address even when a buffer would be empty
+				const std::vector<LightCluster>& clusters = clusteredLighting.GetClusters();
+				const std::vector<unsigned int>& indices = clusteredLighting.GetLightIndices();
+				unsigned int zero = 0;
+				commandList->SetGraphicsRootShaderResourceView(6, dx12Helper.FillNextDynamicBuffer(
+					clusters.data(), (unsigned int)(sizeof(LightCluster) * clusters.size())));
+				commandList->SetGraphicsRootShaderResourceView(7, indices.empty() ?
+					dx12Helper.FillNextDynamicBuffer(&zero, sizeof(unsigned int)) :
+					dx12Helper.FillNextDynamicBuffer(indices.data(), (unsigned int)(sizeof(unsigned int) * indices.size())));
+
+				litPipeline = pipelineCache.GetPipeline(clusteredPipeline);
 			}
+			else if (perObjectLights)
+			{
+				// Only objects that will actually be drawn, in draw order
+				XMFLOAT4* visibleBounds = frameArena.AllocateArray<XMFLOAT4>(visible.size());
+				for (size_t v = 0; v < visible.size(); v++)
+					visibleBounds[v] = objectBounds[visible[v]];
+
+				lightSelection.SelectLights(
+					localLights, counts.point, counts.spot,
+					viewProjection,
+					visibleBounds, (unsigned int)visible.size());
+
+#if defined(DEBUG) || defined(_DEBUG)
+				if (snapshot.verify)
+				{
+					ALLOW_ALLOCATIONS();
+					double selectTime = lightSelection.GetLastSelectTimeMs();
+					bool match = lightSelection.VerifyAgainstBruteForce(
+						localLights, counts.point, counts.spot,
+						viewProjection,
+						visibleBounds, (unsigned int)visible.size());
+					printf("Per-object lighting: %u of %u lights visible, %.2f lights per object, selected in %.3fms (brute force %.3fms), %s\n",
+						lightSelection.GetVisibleLightCount(),
+						localLightCount,
+						lightSelection.GetAverageLightsPerObject(),
+						selectTime,
+						lightSelection.GetLastSelectTimeMs(),
+						match ? "results match" : "RESULTS DIFFER");
+				}
+#endif
+
+				litPipeline = pipelineCache.GetPipeline(perObjectLightPipeline);
+			}
+			else
+			{
+				// Whatever doesn't fit in the constant buffer is dropped
+				counts.directional = min(counts.directional, (int)maxConstantBufferLights);
+				counts.point = min(counts.point, (int)maxConstantBufferLights - counts.directional);
+				counts.spot = min(counts.spot, (int)maxConstantBufferLights - counts.directional - counts.point);
+				psData.pointLightCount = counts.point;
+				psData.spotLightCount = counts.spot;
+
+				// Use the permutation compiled for exactly these counts, if there is one
+				std::unordered_map<unsigned int, PipelineHandle>::iterator permutation =
+					lightPermutations.find(GetLightPermutationKey(counts));
+				if (permutation != lightPermutations.end())
+					litPipeline = pipelineCache.GetPipeline(permutation->second);
+			}
+
+			// Clustered and per-object shaders read local lights from a buffer
+			// (which still needs to exist if every light is directional)
+			if (clustered || perObjectLights)
+			{
+				Light emptyLight = {};
+				commandList->SetGraphicsRootShaderResourceView(5, dx12Helper.FillNextDynamicBuffer(
+					localLightCount > 0 ? localLights : &emptyLight,
+					sizeof(Light) * max(localLightCount, 1u)));
+			}
+
+			// Directional lights (and in forward mode, everything else) go in the constant buffer
+			psData.directionalLightCount = min(counts.directional, (int)maxConstantBufferLights);
+			unsigned int cbLightCount = (clustered || perObjectLights) ?
+				psData.directionalLightCount :
+				psData.directionalLightCount + psData.pointLightCount + psData.spotLightCount;
+			if (cbLightCount > 0)
+				memcpy(psData.lights, sortedLights, sizeof(Light) * cbLightCount);
 			
+			// Send this to a chunk of the constant buffer heap
+			// and grab the GPU handle for it so we can set it for this frame
+			D3D12_GPU_DESCRIPTOR_HANDLE cbHandlePS =
+				dx12Helper.FillNextConstantBufferAndGetGPUDescriptorHandle(
+					(void*)(&psData), sizeof(PixelShaderExternalData));
+			
+			// Set this constant buffer handle
+			// Note: This assumes that descriptor table 1 is the
+			// place to put this particular descriptor. This
+			// is based on how we set up our root signature.
+			commandList->SetGraphicsRootDescriptorTable(1, cbHandlePS);
+			counters.Add(RENDER_COUNTER_DESCRIPTOR_TABLE_BINDS);
+		}
+
+		// Draw everything that survived culling
+		PROFILE_ZONE("Record draws");
+		ID3D12PipelineState* currentPipeline = 0;
+		XMFLOAT4X4 view = snapshot.view;
+		for (unsigned int v = 0; v < visible.size(); v++)
+		{
+			const DrawItem& item = drawItems[visible[v]];
+
+			// Materials using the standard lit pipeline get the light permutation instead
+			ID3D12PipelineState* matPipeline = item.pipelineState;
+			if (matPipeline == pipelineState.Get())
+				matPipeline = litPipeline.Get();
+			if (matPipeline != currentPipeline)
+			{
+				commandList->SetPipelineState(matPipeline);
+				currentPipeline = matPipeline;
+				counters.Add(RENDER_COUNTER_PSO_CHANGES);
+			}
+			// The material is just an index into the material table now, and
+			// in per-object light mode the object's lights are indices too
+			// Note: This assumes that root param 4 is the draw data constants (as per our root sig)
+			DrawData drawData = {};
+			drawData.materialIndex = item.materialIndex;
+			if (perObjectLights)
+			{
+				const ObjectLightList& objectLights = lightSelection.GetObjectLights()[v];
+				drawData.pointLightCount = objectLights.pointCount;
+				drawData.spotLightCount = objectLights.spotCount;
+				memcpy(drawData.lightIndices, objectLights.indices, sizeof(drawData.lightIndices));
+			}
+			commandList->SetGraphicsRoot32BitConstants(4, sizeof(DrawData) / sizeof(unsigned int), &drawData, 0);
+
 			VertexShaderExternalData vertexShaderData = {};
-			vertexShaderData.world = renderableList[i].GetTransform().GetWorldMatrix();
-			vertexShaderData.view = camera->GetView();
-			vertexShaderData.projection = camera->GetProjection();
-			vertexShaderData.worldInvTranspose = renderableList[i].GetTransform().GetWorldInverseTransposeMatrix();
+			vertexShaderData.world = item.world;
+			vertexShaderData.view = view;
+			vertexShaderData.projection = projection;
+			vertexShaderData.worldInvTranspose = item.worldInvTranspose;
 
 			D3D12_GPU_DESCRIPTOR_HANDLE vsbDescriptorHandle = dx12Helper.FillNextConstantBufferAndGetGPUDescriptorHandle(&vertexShaderData, sizeof(VertexShaderExternalData));
 			commandList->SetGraphicsRootDescriptorTable(0, vsbDescriptorHandle);
+			counters.Add(RENDER_COUNTER_DESCRIPTOR_TABLE_BINDS);
 
-			D3D12_VERTEX_BUFFER_VIEW vbView = renderableList[i].GetMesh()->GetvbView();
-			D3D12_INDEX_BUFFER_VIEW ibView = renderableList[i].GetMesh()->GetibView();
+			commandList->IASetVertexBuffers(0, 1, &item.vbView);
+			commandList->IASetIndexBuffer(&item.ibView);
 
-			commandList->IASetVertexBuffers(0, 1, &vbView);
-			commandList->IASetIndexBuffer(&ibView);
-
-			commandList->DrawIndexedInstanced(renderableList[i].GetMesh()->GetIndexCount(), 1, 0, 0, 0);
+			commandList->DrawIndexedInstanced(item.indexCount, 1, 0, 0, 0);
+			counters.Add(RENDER_COUNTER_DRAW_CALLS);
 		}
 	}
 
+	// Stretch the scene over the whole back buffer
+	dx12Helper.EndGpuRange();
+	if (upscale)
+	{
+		PROFILE_ZONE("Upscale");
+		dx12Helper.BeginGpuRange("Upscale");
+
+		D3D12_RESOURCE_BARRIER rb = {};
+		rb.Type = D3D12_RESOURCE_BARRIER_TYPE_TRANSITION;
+		rb.Flags = D3D12_RESOURCE_BARRIER_FLAG_NONE;
+		rb.Transition.pResource = sceneTarget.Get();
+		rb.Transition.StateBefore = D3D12_RESOURCE_STATE_RENDER_TARGET;
+		rb.Transition.StateAfter = D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE;
+		rb.Transition.Subresource = D3D12_RESOURCE_BARRIER_ALL_SUBRESOURCES;
+		commandList->ResourceBarrier(1, &rb);
+
+		commandList->OMSetRenderTargets(1, &rtvHandles[currentSwapBuffer], true, 0);
+		commandList->RSSetViewports(1, &viewport);
+		commandList->RSSetScissorRects(1, &scissorRect);
+		commandList->SetPipelineState(upscalePipelineState.Get());
+		counters.Add(RENDER_COUNTER_PSO_CHANGES);
+
+		// Only the rendered corner is sampled, and never closer to its
+		// edges than half a texel, so nothing outside it bleeds in
+		// Note: This assumes that root param 4 is the draw data constants (as per our root sig)
+		UpscaleData upscaleData = {};
+		upscaleData.uvScale = XMFLOAT2(renderWidth / (float)windowWidth, renderHeight / (float)windowHeight);
+		upscaleData.uvMin = XMFLOAT2(0.5f / windowWidth, 0.5f / windowHeight);
+		upscaleData.uvMax = XMFLOAT2((renderWidth - 0.5f) / windowWidth, (renderHeight - 0.5f) / windowHeight);
+		upscaleData.sceneIndex = sceneTargetIndex;
+		commandList->SetGraphicsRoot32BitConstants(4, sizeof(UpscaleData) / sizeof(unsigned int), &upscaleData, 0);
+		commandList->DrawInstanced(3, 1, 0, 0);
+		counters.Add(RENDER_COUNTER_DRAW_CALLS);
+		dx12Helper.EndGpuRange();
+	}
+
 	// Present
 	{
 		// Transition back to present
@@ -532,16 +1496,32 @@ void Game::Draw(float deltaTime, float totalTime)
 		rb.Transition.StateAfter = D3D12_RESOURCE_STATE_PRESENT;
 		rb.Transition.Subresource = D3D12_RESOURCE_BARRIER_ALL_SUBRESOURCES;
 		commandList->ResourceBarrier(1, &rb);
+		dx12Helper.EndGpuRange();
+
 		// Must occur BEFORE present
+		double submitStartTime = framePacer.Now();
 		DX12Helper::GetInstance().CloseExecuteAndResetCommandList();
+		double presentStartTime = framePacer.Now();
+		counters.EndFrame();
+
+		// That waited for the GPU, so this is the whole frame's cost up to
+		// presenting (CPU and GPU), which picks the next frame's resolution
+		if (snapshot.resolutionBudget > 0)
+			dynamicResolution.Update((float)((presentStartTime - drawStartTime) * 1000.0));
 		// Present the current back buffer
 		bool vsyncNecessary = vsync || !deviceSupportsTearing || isFullscreen;
-		swapChain->Present(
-			vsyncNecessary ? 1 : 0,
-			vsyncNecessary ? 0 : DXGI_PRESENT_ALLOW_TEARING);
+		{
+			PROFILE_ZONE("Present");
+			swapChain->Present(
+				vsyncNecessary ? 1 : 0,
+				vsyncNecessary ? 0 : DXGI_PRESENT_ALLOW_TEARING);
+		}
+
+		unsigned int frame = framePipeline.GetDrawFrame();
+		frameStats.AddPhaseTime(frame, FRAME_PHASE_DRAW, (submitStartTime - drawStartTime) * 1000.0);
+		frameStats.AddPhaseTime(frame, FRAME_PHASE_SUBMIT, (presentStartTime - submitStartTime) * 1000.0);
+		frameStats.AddPhaseTime(frame, FRAME_PHASE_PRESENT, (framePacer.Now() - presentStartTime) * 1000.0);
 		// Figure out which buffer is next
-		currentSwapBuffer++;
-		if (currentSwapBuffer >= numBackBuffers)
-			currentSwapBuffer = 0;
+		currentSwapBuffer = swapChain->GetCurrentBackBufferIndex();
 	}
 }
\ No newline at end of file
@@ -7,9 +7,22 @@
 #include <memory>
 #include <vector>
 #include "Mesh.h"
-#include "Renderable.h"
+#include "EntityWorld.h"
+#include "Components.h"
+#include "ResourceRegistry.h"
 #include "DX12Helper.h"
 #include "Lights.h"
+#include "MaterialTable.h"
+#include "PipelineCache.h"
+#include "LightPartition.h"
+#include "ClusteredLighting.h"
+#include "LightSelection.h"
+#include "FrustumCulling.h"
+#include "OcclusionCulling.h"
+#include "ContributionCulling.h"
+#include "SceneBVH.h"
+#include "DynamicResolution.h"
+#include <unordered_map>
 
 class Game 
 	: public DXCore
@@ -23,6 +36,7 @@ public:
 	// will be called automatically
 	void Init();
 	void OnResize();
+	void FixedUpdate(float deltaTime, float totalTime);
 	void Update(float deltaTime, float totalTime);
 	void Draw(float deltaTime, float totalTime);
 
@@ -31,6 +45,10 @@ private:
 	// Initialization helper methods - feel free to customize, combine, remove, etc.
 	void CreateRootSigAndPipelineState();
 	void CreateBasicGeometry();
+	void AddDemoLights();
+	void CreateSceneTarget();
+	Entity SpawnRenderable(MeshHandle mesh, MaterialHandle material, DirectX::XMFLOAT3 position, bool occluder = false);
+	void UpdateTransforms();
 
 	// Note the usage of ComPtr below
 	//  - This is a smart pointer for objects that abide by the
@@ -39,6 +57,18 @@ private:
 
 	Microsoft::WRL::ComPtr<ID3D12RootSignature> rootSignature;
 	Microsoft::WRL::ComPtr<ID3D12PipelineState> pipelineState;
+	PipelineCache pipelineCache;
+
+	// Pipelines for pixel shader permutations, by light permutation key
+	std::unordered_map<unsigned int, PipelineHandle> lightPermutations;
+
+	// Pipeline using the clustered pixel shader, for scenes with too many
+	// lights to fit in the constant buffer
+	PipelineHandle clusteredPipeline;
+
+	// Pipeline using the per-object light list pixel shader, for when there
+	// are more local lights than one object should pay for
+	PipelineHandle perObjectLightPipeline;
 
 	Microsoft::WRL::ComPtr<ID3D12Resource> vertexBuffer;
 	Microsoft::WRL::ComPtr<ID3D12Resource> indexBuffer;
@@ -48,11 +78,93 @@ private:
 
 	std::shared_ptr<Camera> camera;
 
-	std::vector<std::shared_ptr<Mesh>> meshList;
-	std::vector<Renderable> renderableList;
+	ResourceRegistry resources;
+	std::vector<MeshHandle> meshList;
+	std::vector<MaterialHandle> materialList;
+	TransformSystem transformSystem;
+	EntityWorld entities;
+	MaterialTable materialTable;
+
+	std::vector<Light> lights;
+	unsigned int baseLightCount;
+	ClusteredLighting clusteredLighting;
+	bool useClusteredLighting;
+	bool useOcclusionCulling;
+	LightSelection lightSelection;
+
+	// Frame time budget (ms) for dynamic resolution, or 0 to always
+	// render at the window's full size
+	float resolutionBudget;
+
+	// Everything Draw() needs from the simulation, copied out at the end
+	// of Update(). Draw() only reads its frame's snapshot, so the next
+	// frame can be simulated while this one is drawn on the render thread.
+	struct DrawItem
+	{
+		Entity entity;
+		DirectX::XMFLOAT4X4 world;
+		DirectX::XMFLOAT4X4 worldInvTranspose;
+		D3D12_VERTEX_BUFFER_VIEW vbView;
+		D3D12_INDEX_BUFFER_VIEW ibView;
+		unsigned int indexCount;
+		MeshBVH* triangleBVH;           // Kept alive by the mesh, which isn't freed until this frame is drawn
+		ID3D12PipelineState* pipelineState;
+		unsigned int materialIndex;
+	};
+	struct OccluderItem
+	{
+		unsigned int id;
+		unsigned int shape;
+		DirectX::XMFLOAT4X4 world;
+		DirectX::XMFLOAT4 sphere;
+	};
+	struct RenderSnapshot
+	{
+		DirectX::XMFLOAT4X4 view;
+		DirectX::XMFLOAT4X4 projection;
+		DirectX::XMFLOAT4X4 viewProjection;
+		DirectX::XMFLOAT3 cameraPosition;
+		bool cameraOrtho;
+		std::vector<Light> lights;
+
+		// Gathered from the entities so culling can run over flat arrays
+		std::vector<DrawItem> drawItems;
+		std::vector<DirectX::XMFLOAT4> objectBounds;
+		std::vector<unsigned int> objectLayers;
+		std::vector<OccluderItem> occluders;
+
+		bool useClusteredLighting;
+		bool useOcclusionCulling;
+		float resolutionBudget;
+
+		// Debug requests, since Draw() can't read input from the render thread
+		bool verify;
+		bool pick;
+		DirectX::XMFLOAT2 pickPosition;
+	};
+	RenderSnapshot renderSnapshots[FRAME_PIPELINE_SLOTS];
+	void CaptureRenderSnapshot(RenderSnapshot& snapshot);
+	bool Pick(const RenderSnapshot& snapshot, DirectX::XMFLOAT3 origin, DirectX::XMFLOAT3 direction, float maxDistance, unsigned int& drawItem, unsigned int& triangle, float& distance);
+
+	// Only used by Draw()
+	SceneBVH sceneBVH;
+	std::vector<unsigned int> inFrustum;
+	FrustumCulling frustumCulling;
+	ContributionCulling contributionCulling;
+	OcclusionCulling occlusionCulling;
+	void ReserveDrawResults(unsigned int objectCount, unsigned int lightCount);
+	unsigned int reservedObjectCount;
+	unsigned int reservedLightCount;
 
-	Light lights[20];
-	int lightCount;
+	// Dynamic resolution: below full scale, the scene is drawn into the
+	// top left corner of sceneTarget (which is the size of the window,
+	// so changing the scale never reallocates it) and then stretched
+	// over the back buffer by a full screen pass
+	DynamicResolution dynamicResolution;
+	Microsoft::WRL::ComPtr<ID3D12Resource> sceneTarget;
+	Microsoft::WRL::ComPtr<ID3D12DescriptorHeap> sceneTargetRTVHeap;
+	unsigned int sceneTargetIndex;
+	Microsoft::WRL::ComPtr<ID3D12PipelineState> upscalePipelineState;
 
 	DX12Helper& dx12Helper;
 };
@@ -0,0 +1,458 @@
+#include "JobSystem.h"
+#include "Profiler.h"
+#include "MemoryTracker.h"
+#include <algorithm>
+#include <cassert>
+#include <cstdio>
+
+// Singleton requirement
+JobSystem* JobSystem::instance;
+
+// Which of our threads this is (JOB_ANY_THREAD if it isn't one)
+static thread_local unsigned int currentThreadIndex = JOB_ANY_THREAD;
+
+// Times an idle worker looks for work again before going to sleep,
+// since waking a sleeping thread costs far more than a few yields
+#define JOB_IDLE_SPINS 64
+
+JobCounter::JobCounter() :
+	count(0)
+{
+}
+
+bool JobCounter::IsDone()
+{
+	return count.load() == 0;
+}
+
+JobSystem::JobSystem() :
+	threadCount(1),
+	nextQueue(0),
+	queuedCount(0),
+	sleepingCount(0),
+	stopWorkers(false)
+{
+}
+
+JobSystem::~JobSystem()
+{
+	Shutdown();
+}
+
+// --------------------------------------------------------
+// Starts the workers. The calling thread becomes thread 0
+// (the main thread), which only runs jobs while it waits.
+//
+// totalThreads - Threads that run jobs, counting this one
+//                (0 means one per core)
+// --------------------------------------------------------
+void JobSystem::Initialize(unsigned int totalThreads)
+{
+	Shutdown();
+
+	if (totalThreads == 0)
+		totalThreads = std::thread::hardware_concurrency();
+
+	threadCount = std::max(totalThreads, 1u);
+	queues.reset(new ThreadQueue[threadCount]);
+	for (unsigned int t = 0; t < threadCount; t++)
+	{
+		queues[t].pinnedCount = 0;
+		queues[t].jobCount = 0;
+		queues[t].stealCount = 0;
+	}
+	currentThreadIndex = 0;
+
+	stopWorkers = false;
+	queuedCount = 0;
+	sleepingCount = 0;
+	for (unsigned int t = 1; t < threadCount; t++)
+		workers.push_back(std::thread(&JobSystem::WorkerMain, this, t));
+}
+
+// --------------------------------------------------------
+// Runs anything still queued, then stops the workers. Jobs
+// pinned to a worker can only run there, so each worker runs
+// its own before it returns.
+// --------------------------------------------------------
+void JobSystem::Shutdown()
+{
+	if (!queues)
+		return;
+
+	Job job;
+	while (FindJob(0, job))
+		Execute(job);
+
+	{
+		std::lock_guard<std::mutex> lock(sleepMutex);
+		stopWorkers = true;
+	}
+	wakeSignal.notify_all();
+	for (std::thread& worker : workers)
+		worker.join();
+	workers.clear();
+
+	// The workers' last jobs may have queued more for this thread
+	while (FindJob(0, job))
+		Execute(job);
+	for (unsigned int t = 0; t < threadCount; t++)
+		assert(queues[t].jobs.IsEmpty() && queues[t].pinnedJobs.IsEmpty() && "Jobs still queued after Shutdown()");
+
+	queues.reset();
+	threadCount = 1;
+}
+
+void JobSystem::Run(JobFunction function, void* data, unsigned int first, unsigned int last, JobCounter* counter, unsigned int affinity)
+{
+	if (counter)
+		counter->count++;
+
+	Job job = { function, data, first, last, counter, affinity, MemoryTracker::GetThreadAllocationsForbidden() };
+	Push(job);
+}
+
+void JobSystem::Run(const std::function<void()>& job, JobCounter* counter, unsigned int affinity)
+{
+	Run(&JobSystem::RunFunction, new std::function<void()>(job), 0, 0, counter, affinity);
+}
+
+// --------------------------------------------------------
+// Parks the job on the dependency until it reaches zero (or
+// queues it now if it already has). The counter goes up now,
+// so waiting on it covers jobs that haven't been queued yet.
+// --------------------------------------------------------
+void JobSystem::RunAfter(JobCounter& dependency, JobFunction function, void* data, unsigned int first, unsigned int last, JobCounter* counter, unsigned int affinity)
+{
+	if (counter)
+		counter->count++;
+
+	Job job = { function, data, first, last, counter, affinity, MemoryTracker::GetThreadAllocationsForbidden() };
+	{
+		std::lock_guard<std::mutex> lock(dependency.waitingMutex);
+		if (dependency.count.load() > 0)
+		{
+			dependency.waiting.push_back(job);
+			return;
+		}
+	}
+	Push(job);
+}
+
+void JobSystem::RunAfter(JobCounter& dependency, const std::function<void()>& job, JobCounter* counter, unsigned int affinity)
+{
+	RunAfter(dependency, &JobSystem::RunFunction, new std::function<void()>(job), 0, 0, counter, affinity);
+}
+
+// --------------------------------------------------------
+// Runs other jobs (or yields, if there are none this thread
+// can run) until every job counted by counter is done
+// --------------------------------------------------------
+void JobSystem::Wait(JobCounter& counter)
+{
+	unsigned int threadIndex = currentThreadIndex;
+	while (!counter.IsDone())
+	{
+		Job job;
+		if (FindJob(threadIndex, job))
+			Execute(job);
+		else
+			std::this_thread::yield();
+	}
+
+	// The thread that finished the last job may still be holding the
+	// counter's lock, and the counter can go away once we return
+	std::lock_guard<std::mutex> lock(counter.waitingMutex);
+}
+
+// --------------------------------------------------------
+// Splits the range into batches (at most a few per thread, so
+// tiny ranges aren't spread thinner than is worth it), queues
+// all but the first and runs that one here before waiting
+// --------------------------------------------------------
+void JobSystem::ParallelFor(unsigned int first, unsigned int last, unsigned int minBatchSize, JobFunction batch, void* data)
+{
+	if (last <= first)
+		return;
+
+	unsigned int count = last - first;
+	minBatchSize = std::max(minBatchSize, 1u);
+	unsigned int batchCount = std::min((count + minBatchSize - 1) / minBatchSize, threadCount * JOB_BATCHES_PER_THREAD);
+	if (batchCount <= 1)
+	{
+		batch(data, first, last);
+		return;
+	}
+
+	unsigned int batchSize = (count + batchCount - 1) / batchCount;
+	JobCounter counter;
+	for (unsigned int batchFirst = first + batchSize; batchFirst < last; batchFirst += batchSize)
+		Run(batch, data, batchFirst, std::min(batchFirst + batchSize, last), &counter);
+
+	batch(data, first, first + batchSize);
+	Wait(counter);
+}
+
+unsigned int JobSystem::GetThreadCount()
+{
+	return threadCount;
+}
+
+unsigned int JobSystem::GetThreadIndex()
+{
+	return currentThreadIndex;
+}
+
+unsigned int JobSystem::GetJobCount()
+{
+	unsigned int total = 0;
+	for (unsigned int t = 0; queues && t < threadCount; t++)
+		total += queues[t].jobCount;
+	return total;
+}
+
+unsigned int JobSystem::GetStealCount()
+{
+	unsigned int total = 0;
+	for (unsigned int t = 0; queues && t < threadCount; t++)
+		total += queues[t].stealCount;
+	return total;
+}
+
+// --------------------------------------------------------
+// Puts a job on the queue it belongs on: its pinned thread's,
+// else the current thread's (threads that aren't ours take
+// turns), then wakes a worker if any are asleep
+// --------------------------------------------------------
+void JobSystem::Push(const Job& job)
+{
+	// No workers: just run it
+	if (threadCount <= 1)
+	{
+		Execute(job);
+		return;
+	}
+
+	bool pinned = job.affinity != JOB_ANY_THREAD;
+	unsigned int target;
+	if (pinned)
+		target = std::min(job.affinity, threadCount - 1);
+	else if (currentThreadIndex < threadCount)
+		target = currentThreadIndex;
+	else
+		target = nextQueue++ % threadCount;
+
+	ThreadQueue& queue = queues[target];
+	{
+		std::lock_guard<std::mutex> lock(queue.mutex);
+		if (pinned)
+		{
+			queue.pinnedJobs.PushBack(job);
+			queue.pinnedCount++;
+		}
+		else
+		{
+			queue.jobs.PushBack(job);
+			queuedCount++;
+		}
+	}
+
+	// Sleepers count themselves before checking for work, so either
+	// they see this job or we see them. Taking the lock means the
+	// sleeper is really waiting before it's signalled. The main thread
+	// never sleeps (it picks up its jobs the next time it waits).
+	if (sleepingCount.load() > 0 && !(pinned && target == JOB_MAIN_THREAD))
+	{
+		{
+			std::lock_guard<std::mutex> lock(sleepMutex);
+		}
+		if (pinned)
+			wakeSignal.notify_all();
+		else
+			wakeSignal.notify_one();
+	}
+}
+
+// --------------------------------------------------------
+// Jobs pinned to this thread first, then this thread's newest
+// job, then the oldest job on any other thread's queue
+// --------------------------------------------------------
+bool JobSystem::FindJob(unsigned int threadIndex, Job& job)
+{
+	if (!queues)
+		return false;
+
+	if (threadIndex < threadCount)
+	{
+		ThreadQueue& own = queues[threadIndex];
+		std::lock_guard<std::mutex> lock(own.mutex);
+		if (!own.pinnedJobs.IsEmpty())
+		{
+			job = own.pinnedJobs.PopFront();
+			own.pinnedCount--;
+			return true;
+		}
+		if (!own.jobs.IsEmpty())
+		{
+			job = own.jobs.PopBack();
+			queuedCount--;
+			return true;
+		}
+	}
+
+	if (queuedCount.load() == 0)
+		return false;
+
+	// Start with the next thread along, so thieves spread out
+	unsigned int start = threadIndex < threadCount ? threadIndex + 1 : nextQueue.load();
+	for (unsigned int t = 0; t < threadCount; t++)
+	{
+		unsigned int victim = (start + t) % threadCount;
+		if (victim == threadIndex)
+			continue;
+
+		ThreadQueue& queue = queues[victim];
+		std::lock_guard<std::mutex> lock(queue.mutex);
+		if (queue.jobs.IsEmpty())
+			continue;
+
+		job = queue.jobs.PopFront();
+		queuedCount--;
+		if (threadIndex < threadCount)
+			queues[threadIndex].stealCount++;
+		return true;
+	}
+	return false;
+}
+
+void JobSystem::Execute(const Job& job)
+{
+	PROFILE_ZONE("Job");
+
+	// Whichever thread runs it, a job follows the allocation rules
+	// of the code that queued it
+	ZeroAllocationScope allocations(job.forbidAllocations);
+	job.function(job.data, job.first, job.last);
+	if (queues && currentThreadIndex < threadCount)
+		queues[currentThreadIndex].jobCount++;
+	Finish(job.counter);
+}
+
+// --------------------------------------------------------
+// Counts a job as done, queueing whatever was waiting on its
+// counter if it was the last one. The decrement happens under
+// the counter's lock so RunAfter() and Wait() never see a
+// counter in the middle of this.
+// --------------------------------------------------------
+void JobSystem::Finish(JobCounter* counter)
+{
+	if (!counter)
+		return;
+
+	std::vector<Job> ready;
+	{
+		std::lock_guard<std::mutex> lock(counter->waitingMutex);
+		if (--counter->count == 0)
+			ready.swap(counter->waiting);
+	}
+	for (const Job& job : ready)
+		Push(job);
+}
+
+// --------------------------------------------------------
+// Runs jobs until there are none, spins for a moment in case
+// more are on the way, then sleeps until one is queued
+// --------------------------------------------------------
+void JobSystem::WorkerMain(unsigned int threadIndex)
+{
+	currentThreadIndex = threadIndex;
+	char name[PROFILER_TRACK_NAME_LENGTH];
+	sprintf_s(name, "Job worker %u", threadIndex);
+	Profiler::GetInstance().SetThreadName(name);
+
+	ThreadQueue& own = queues[threadIndex];
+	unsigned int idleSpins = 0;
+	while (true)
+	{
+		Job job;
+		if (FindJob(threadIndex, job))
+		{
+			Execute(job);
+			idleSpins = 0;
+			continue;
+		}
+
+		if (idleSpins++ < JOB_IDLE_SPINS)
+		{
+			std::this_thread::yield();
+			continue;
+		}
+
+		std::unique_lock<std::mutex> lock(sleepMutex);
+		sleepingCount++;
+		wakeSignal.wait(lock, [&]() { return stopWorkers || queuedCount.load() > 0 || own.pinnedCount.load() > 0; });
+		sleepingCount--;
+		if (stopWorkers)
+		{
+			lock.unlock();
+			while (FindJob(threadIndex, job))
+				Execute(job);
+			return;
+		}
+		idleSpins = 0;
+	}
+}
+
+// Jobs queued as std::functions own a heap copy of it
+void JobSystem::RunFunction(void* data, unsigned int, unsigned int)
+{
+	std::function<void()>* function = (std::function<void()>*)data;
+	(*function)();
+	delete function;
+}
+
+JobSystem::JobRing::JobRing() :
+	head(0),
+	count(0)
+{
+}
+
+bool JobSystem::JobRing::IsEmpty()
+{
+	return count == 0;
+}
+
+// --------------------------------------------------------
+// Doubles the ring when it's full, unwrapping the jobs so
+// the oldest is first again
+// --------------------------------------------------------
+void JobSystem::JobRing::PushBack(const Job& job)
+{
+	unsigned int capacity = (unsigned int)jobs.size();
+	if (count == capacity)
+	{
+		std::vector<Job> grown(std::max(capacity * 2, 64u));
+		for (unsigned int i = 0; i < count; i++)
+			grown[i] = jobs[(head + i) % capacity];
+		jobs.swap(grown);
+		head = 0;
+		capacity = (unsigned int)jobs.size();
+	}
+
+	jobs[(head + count) % capacity] = job;
+	count++;
+}
+
+JobSystem::Job JobSystem::JobRing::PopFront()
+{
+	Job job = jobs[head];
+	head = (head + 1) % (unsigned int)jobs.size();
+	count--;
+	return job;
+}
+
+JobSystem::Job JobSystem::JobRing::PopBack()
+{
+	count--;
+	return jobs[(head + count) % (unsigned int)jobs.size()];
+}
\ No newline at end of file
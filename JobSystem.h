@@ -0,0 +1,196 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Affinity hints: any thread may run the job, or only the given thread
+// (0 is the main thread, workers are 1 and up)
+#define JOB_ANY_THREAD 0xFFFFFFFF
+#define JOB_MAIN_THREAD 0
+
+// How many pieces ParallelFor splits a range into per thread, so
+// uneven pieces still balance out through stealing
+#define JOB_BATCHES_PER_THREAD 4
+
+// A job's entry point: runs [first, last) of whatever data points to
+typedef void(*JobFunction)(void* data, unsigned int first, unsigned int last);
+
+// --------------------------------------------------------
+// Counts jobs that haven't finished yet. Jobs can be told to
+// decrement one when they're done, and to wait for one to hit
+// zero before they start, which is how dependencies are built.
+// --------------------------------------------------------
+class JobCounter
+{
+public:
+	JobCounter();
+	bool IsDone();
+
+private:
+	friend class JobSystem;
+
+	struct Job
+	{
+		JobFunction function;
+		void* data;
+		unsigned int first;
+		unsigned int last;
+		JobCounter* counter;
+		unsigned int affinity;
+		bool forbidAllocations; // Whether the thread that queued it was in a ZERO_ALLOCATIONS scope
+	};
+
+	std::atomic<unsigned int> count;
+	std::mutex waitingMutex;
+	std::vector<Job> waiting; // Queued once count reaches zero
+};
+
+// --------------------------------------------------------
+// Work stealing job scheduler. Every thread (workers and the main
+// thread) has its own queue: it pushes and pops its newest jobs at
+// the back, and threads with nothing to do steal the oldest job
+// from the front of someone else's, which tends to be the biggest
+// piece of work left. Workers with nothing to steal sleep until a
+// job is queued.
+//
+// Jobs are plain function pointers plus a range, so queueing one
+// doesn't allocate. Waiting for a counter runs other jobs instead
+// of blocking, so jobs can wait on jobs they queue, and the main
+// thread helps out whenever it waits.
+// --------------------------------------------------------
+class JobSystem
+{
+#pragma region Singleton
+public:
+	// Gets the one and only instance of this class
+	static JobSystem& GetInstance()
+	{
+		if (!instance)
+		{
+			instance = new JobSystem();
+		}
+
+		return *instance;
+	}
+
+	// Remove these functions (C++ 11 version)
+	JobSystem(JobSystem const&) = delete;
+	void operator=(JobSystem const&) = delete;
+
+private:
+	static JobSystem* instance;
+	JobSystem();
+#pragma endregion
+
+public:
+	~JobSystem();
+
+	// Starts the worker threads, so jobs run on totalThreads threads
+	// counting this one (0 means one per core). Until then, or with
+	// just one thread, every job runs on the thread that queues it.
+	void Initialize(unsigned int totalThreads = 0);
+
+	// Finishes every queued job and stops the workers. Safe to call more than once.
+	void Shutdown();
+
+	// Queues function(data, first, last). counter (optional) goes up by one
+	// now and back down when the job is done.
+	void Run(JobFunction function, void* data, unsigned int first, unsigned int last, JobCounter* counter = 0, unsigned int affinity = JOB_ANY_THREAD);
+
+	// Queues a copy of any callable (this one allocates)
+	void Run(const std::function<void()>& job, JobCounter* counter = 0, unsigned int affinity = JOB_ANY_THREAD);
+
+	// Same as Run, but the job isn't queued until dependency reaches zero
+	void RunAfter(JobCounter& dependency, JobFunction function, void* data, unsigned int first, unsigned int last, JobCounter* counter = 0, unsigned int affinity = JOB_ANY_THREAD);
+	void RunAfter(JobCounter& dependency, const std::function<void()>& job, JobCounter* counter = 0, unsigned int affinity = JOB_ANY_THREAD);
+
+	// Runs other jobs until counter reaches zero
+	void Wait(JobCounter& counter);
+
+	// Calls body(first, last) over pieces of [first, last) of at least
+	// minBatchSize (except maybe the last) across every thread, including
+	// this one, and returns once they're all done. The body is used where
+	// it is rather than copied, so this doesn't allocate.
+	template<typename Body>
+	void ParallelFor(unsigned int first, unsigned int last, unsigned int minBatchSize, const Body& body)
+	{
+		ParallelFor(first, last, minBatchSize, &RunParallelForBatch<Body>, (void*)&body);
+	}
+	void ParallelFor(unsigned int first, unsigned int last, unsigned int minBatchSize, JobFunction batch, void* data);
+
+	// Threads that run jobs, counting the main thread
+	unsigned int GetThreadCount();
+
+	// 0 on the main thread, 1 and up on workers, JOB_ANY_THREAD on
+	// threads the job system didn't start (like PipelineCache's)
+	unsigned int GetThreadIndex();
+
+	// Stats since Initialize()
+	unsigned int GetJobCount();
+	unsigned int GetStealCount();
+
+private:
+	typedef JobCounter::Job Job;
+
+	// Jobs in a ring that can be pushed at the back and popped at
+	// either end. It only ever grows, so once it's as big as a frame
+	// needs, queueing doesn't allocate (std::deque allocates and frees
+	// blocks as jobs come and go).
+	class JobRing
+	{
+	public:
+		JobRing();
+		bool IsEmpty();
+		void PushBack(const Job& job);
+		Job PopFront();
+		Job PopBack();
+
+	private:
+		std::vector<Job> jobs;
+		unsigned int head;
+		unsigned int count;
+	};
+
+	// One per thread
+	struct ThreadQueue
+	{
+		std::mutex mutex;
+		JobRing jobs;                // Anyone may steal these
+		JobRing pinnedJobs;          // Only this thread runs these
+		std::atomic<unsigned int> pinnedCount;
+		std::atomic<unsigned int> jobCount;
+		std::atomic<unsigned int> stealCount;
+		unsigned char padding[64];   // Keeps neighbouring queues off each other's cache lines
+	};
+
+	std::vector<std::thread> workers;
+	std::unique_ptr<ThreadQueue[]> queues;
+	unsigned int threadCount;
+	std::atomic<unsigned int> nextQueue; // Round robin for threads that aren't ours
+
+	// Sleeping workers
+	std::mutex sleepMutex;
+	std::condition_variable wakeSignal;
+	std::atomic<unsigned int> queuedCount; // Jobs anyone may steal
+	std::atomic<unsigned int> sleepingCount;
+	bool stopWorkers;
+
+	void Push(const Job& job);
+	bool FindJob(unsigned int threadIndex, Job& job);
+	void Execute(const Job& job);
+	void Finish(JobCounter* counter);
+	void WorkerMain(unsigned int threadIndex);
+
+	static void RunFunction(void* data, unsigned int first, unsigned int last);
+
+	template<typename Body>
+	static void RunParallelForBatch(void* data, unsigned int first, unsigned int last)
+	{
+		(*(const Body*)data)(first, last);
+	}
+};
\ No newline at end of file
@@ -0,0 +1,62 @@
+#include "LightPartition.h"
+
+// Each file name spells out the counts it was compiled with
+const LightPermutationShader lightPermutationShaders[LIGHT_PERMUTATION_COUNT] =
+{
+	{ { 1, 0, 0 }, L"PixelShader_Lights_D1P0S0.cso" },
+	{ { 1, 1, 0 }, L"PixelShader_Lights_D1P1S0.cso" },
+	{ { 1, 2, 0 }, L"PixelShader_Lights_D1P2S0.cso" },
+	{ { 1, 4, 0 }, L"PixelShader_Lights_D1P4S0.cso" },
+	{ { 2, 2, 0 }, L"PixelShader_Lights_D2P2S0.cso" },
+	{ { 3, 2, 0 }, L"PixelShader_Lights_D3P2S0.cso" },
+	{ { 1, 2, 2 }, L"PixelShader_Lights_D1P2S2.cso" },
+};
+
+// --------------------------------------------------------
+// Partitions lights by type into contiguous ranges
+//
+// lights - The unsorted lights
+// lightCount - Number of lights in the array
+// sortedLights - Output array, must hold at least lightCount lights
+//
+// Returns the number of lights in each range. Lights of an
+// unknown type are dropped.
+// --------------------------------------------------------
+LightCounts PartitionLights(const Light* lights, int lightCount, Light* sortedLights)
+{
+	LightCounts counts = {};
+	for (int i = 0; i < lightCount; i++)
+	{
+		switch (lights[i].Type)
+		{
+		case LIGHT_TYPE_DIRECTIONAL: counts.directional++; break;
+		case LIGHT_TYPE_POINT:       counts.point++;       break;
+		case LIGHT_TYPE_SPOT:        counts.spot++;        break;
+		}
+	}
+
+	// Write each light to the next slot of its range
+	int next[3] = { 0, counts.directional, counts.directional + counts.point };
+	for (int i = 0; i < lightCount; i++)
+	{
+		int type = lights[i].Type;
+		if (type < LIGHT_TYPE_DIRECTIONAL || type > LIGHT_TYPE_SPOT)
+			continue;
+		sortedLights[next[type]++] = lights[i];
+	}
+
+	return counts;
+}
+
+// --------------------------------------------------------
+// Builds a permutation key from light counts, 8 bits per type
+// (counts are clamped, and anything that large will never have
+// a matching permutation anyway)
+// --------------------------------------------------------
+unsigned int GetLightPermutationKey(LightCounts counts)
+{
+	unsigned int d = counts.directional > 255 ? 255 : (unsigned int)counts.directional;
+	unsigned int p = counts.point > 255 ? 255 : (unsigned int)counts.point;
+	unsigned int s = counts.spot > 255 ? 255 : (unsigned int)counts.spot;
+	return d | (p << 8) | (s << 16);
+}
\ No newline at end of file
@@ -0,0 +1,30 @@
+#pragma once
+#include "Lights.h"
+
+// How many lights of each type are in a partitioned light list
+struct LightCounts
+{
+	int directional;
+	int point;
+	int spot;
+};
+
+// Sorts lights into contiguous directional, point and spot ranges (in that
+// order, keeping their relative order) so the pixel shader can loop over
+// each type separately without branching on the light type
+LightCounts PartitionLights(const Light* lights, int lightCount, Light* sortedLights);
+
+// Packs light counts into the key used to look up a shader permutation
+unsigned int GetLightPermutationKey(LightCounts counts);
+
+// A pixel shader permutation with its light counts compiled in
+struct LightPermutationShader
+{
+	LightCounts counts;
+	const wchar_t* file;
+};
+
+// Every compiled permutation
+// - Must match the PixelShader_Lights_*.hlsl files in the project
+#define LIGHT_PERMUTATION_COUNT 7
+extern const LightPermutationShader lightPermutationShaders[LIGHT_PERMUTATION_COUNT];
\ No newline at end of file
@@ -0,0 +1,353 @@
+#include "LightSelection.h"
+#include "FrustumCulling.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+
+using namespace DirectX;
+
+LightSelection::LightSelection() :
+	visibleLightCount(0),
+	averageLightsPerObject(0),
+	lastSelectTimeMs(0)
+{
+}
+
+// --------------------------------------------------------
+// Culls lights against the camera and picks each object's lights
+//
+// lights - Point lights followed by spot lights, in world space
+// pointLightCount / spotLightCount - How many of each are in the array
+// viewProjection - The camera's combined view and projection matrix
+// objectSpheres - World space bounding spheres (xyz = center, w = radius)
+// objectCount - Number of spheres
+// --------------------------------------------------------
+void LightSelection::SelectLights(
+	const Light* lights,
+	unsigned int pointLightCount,
+	unsigned int spotLightCount,
+	XMFLOAT4X4 viewProjection,
+	const XMFLOAT4* objectSpheres,
+	unsigned int objectCount)
+{
+	std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+
+	CullLights(lights, pointLightCount + spotLightCount, viewProjection);
+
+	objectLights.resize(objectCount);
+	unsigned int totalSelected = 0;
+	for (unsigned int i = 0; i < objectCount; i++)
+	{
+		SelectForObject(objectSpheres[i], pointLightCount, objectLights[i]);
+		totalSelected += objectLights[i].pointCount + objectLights[i].spotCount;
+	}
+	averageLightsPerObject = objectCount > 0 ? (float)totalSelected / objectCount : 0.0f;
+
+	std::chrono::duration<double, std::milli> elapsed = std::chrono::high_resolution_clock::now() - start;
+	lastSelectTimeMs = elapsed.count();
+}
+
+// --------------------------------------------------------
+// Reference for SelectLights(): no structure of arrays and no
+// running top few. Every light in view gets a score for every
+// object it reaches, and a partial sort picks the best.
+// Scores use the same operations in the same order as the SIMD
+// version, and ties go to the lower index in both.
+// --------------------------------------------------------
+void LightSelection::SelectLightsBruteForce(
+	const Light* lights,
+	unsigned int pointLightCount,
+	unsigned int spotLightCount,
+	XMFLOAT4X4 viewProjection,
+	const XMFLOAT4* objectSpheres,
+	unsigned int objectCount)
+{
+	std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+
+	XMVECTOR planes[6];
+	ExtractFrustumPlanes(viewProjection, planes);
+	XMFLOAT4 planeValues[6];
+	for (int p = 0; p < 6; p++)
+		XMStoreFloat4(&planeValues[p], planes[p]);
+
+	unsigned int lightCount = pointLightCount + spotLightCount;
+	std::vector<unsigned int> inView;
+	for (unsigned int i = 0; i < lightCount; i++)
+	{
+		const Light& light = lights[i];
+		bool outside = false;
+		for (int p = 0; p < 6 && !outside; p++)
+		{
+			const XMFLOAT4& plane = planeValues[p];
+			float distance = (light.Position.x * plane.x + (light.Position.y * plane.y + light.Position.z * plane.z)) + plane.w;
+			outside = distance < -light.Range;
+		}
+		if (!outside)
+			inView.push_back(i);
+	}
+	visibleLightCount = (unsigned int)inView.size();
+
+	objectLights.resize(objectCount);
+	std::vector<std::pair<float, unsigned int>> scored;
+	unsigned int totalSelected = 0;
+	for (unsigned int o = 0; o < objectCount; o++)
+	{
+		const XMFLOAT4& sphere = objectSpheres[o];
+		scored.clear();
+		for (unsigned int index : inView)
+		{
+			const Light& light = lights[index];
+			float dx = light.Position.x - sphere.x;
+			float dy = light.Position.y - sphere.y;
+			float dz = light.Position.z - sphere.z;
+			float distSq = (dx * dx + dy * dy) + dz * dz;
+			float reach = light.Range + sphere.w;
+			if (distSq > reach * reach)
+				continue;
+
+			float closest = std::max(sqrtf(distSq) - sphere.w, 0.0f);
+			float falloff = std::min(std::max(1.0f - (closest * closest) / (light.Range * light.Range), 0.0f), 1.0f);
+			float weight = light.intensity * std::max(light.Color.x, std::max(light.Color.y, light.Color.z));
+			scored.push_back(std::make_pair((falloff * falloff) * weight, index));
+		}
+
+		unsigned int chosenCount = std::min((unsigned int)scored.size(), (unsigned int)MAX_LIGHTS_PER_OBJECT);
+		std::partial_sort(scored.begin(), scored.begin() + chosenCount, scored.end(),
+			[](const std::pair<float, unsigned int>& a, const std::pair<float, unsigned int>& b)
+		{
+			return a.first > b.first || (a.first == b.first && a.second < b.second);
+		});
+
+		unsigned int chosen[MAX_LIGHTS_PER_OBJECT];
+		for (unsigned int i = 0; i < chosenCount; i++)
+			chosen[i] = scored[i].second;
+		FillList(chosen, chosenCount, pointLightCount, objectLights[o]);
+		totalSelected += chosenCount;
+	}
+	averageLightsPerObject = objectCount > 0 ? (float)totalSelected / objectCount : 0.0f;
+
+	std::chrono::duration<double, std::milli> elapsed = std::chrono::high_resolution_clock::now() - start;
+	lastSelectTimeMs = elapsed.count();
+}
+
+// --------------------------------------------------------
+// Runs both versions and compares every object's list
+// (leaves the brute force results and timing behind)
+// --------------------------------------------------------
+bool LightSelection::VerifyAgainstBruteForce(
+	const Light* lights,
+	unsigned int pointLightCount,
+	unsigned int spotLightCount,
+	XMFLOAT4X4 viewProjection,
+	const XMFLOAT4* objectSpheres,
+	unsigned int objectCount)
+{
+	SelectLights(lights, pointLightCount, spotLightCount, viewProjection, objectSpheres, objectCount);
+	std::vector<ObjectLightList> fast = objectLights;
+	unsigned int fastVisible = visibleLightCount;
+
+	SelectLightsBruteForce(lights, pointLightCount, spotLightCount, viewProjection, objectSpheres, objectCount);
+	if (fastVisible != visibleLightCount)
+		return false;
+	for (unsigned int o = 0; o < objectCount; o++)
+	{
+		if (memcmp(&fast[o], &objectLights[o], sizeof(ObjectLightList)) != 0)
+			return false;
+	}
+	return true;
+}
+
+const std::vector<ObjectLightList>& LightSelection::GetObjectLights()
+{
+	return objectLights;
+}
+
+void LightSelection::Reserve(unsigned int lightCount, unsigned int objectCount)
+{
+	size_t paddedCount = (size_t)lightCount + 4;
+	lightX.reserve(paddedCount);
+	lightY.reserve(paddedCount);
+	lightZ.reserve(paddedCount);
+	lightRange.reserve(paddedCount);
+	lightWeight.reserve(paddedCount);
+	lightIndex.reserve(paddedCount);
+	objectLights.reserve(objectCount);
+}
+
+unsigned int LightSelection::GetVisibleLightCount()
+{
+	return visibleLightCount;
+}
+
+float LightSelection::GetAverageLightsPerObject()
+{
+	return averageLightsPerObject;
+}
+
+double LightSelection::GetLastSelectTimeMs()
+{
+	return lastSelectTimeMs;
+}
+
+// --------------------------------------------------------
+// Tests the bounding sphere of each light against the six frustum
+// planes, four lights at a time, and keeps the ones that could be
+// visible in structure of arrays form for SelectForObject()
+// --------------------------------------------------------
+void LightSelection::CullLights(const Light* lights, unsigned int lightCount, XMFLOAT4X4 viewProjection)
+{
+	XMVECTOR planes[6];
+	ExtractFrustumPlanes(viewProjection, planes);
+
+	size_t paddedCount = (size_t)lightCount + 4;
+	lightX.resize(paddedCount);
+	lightY.resize(paddedCount);
+	lightZ.resize(paddedCount);
+	lightRange.resize(paddedCount);
+	lightWeight.resize(paddedCount);
+	lightIndex.resize(paddedCount);
+	visibleLightCount = 0;
+
+	for (unsigned int first = 0; first < lightCount; first += 4)
+	{
+		// Gather four lights (repeating the last one if we run out)
+		const Light& l0 = lights[first];
+		const Light& l1 = lights[std::min(first + 1, lightCount - 1)];
+		const Light& l2 = lights[std::min(first + 2, lightCount - 1)];
+		const Light& l3 = lights[std::min(first + 3, lightCount - 1)];
+		XMVECTOR x = XMVectorSet(l0.Position.x, l1.Position.x, l2.Position.x, l3.Position.x);
+		XMVECTOR y = XMVectorSet(l0.Position.y, l1.Position.y, l2.Position.y, l3.Position.y);
+		XMVECTOR z = XMVectorSet(l0.Position.z, l1.Position.z, l2.Position.z, l3.Position.z);
+		XMVECTOR negRange = XMVectorNegate(XMVectorSet(l0.Range, l1.Range, l2.Range, l3.Range));
+
+		// A sphere is outside if it's entirely behind any one plane
+		XMVECTOR outside = XMVectorFalseInt();
+		for (int p = 0; p < 6; p++)
+		{
+			XMVECTOR distance = XMVectorAdd(
+				XMVectorMultiplyAdd(x, XMVectorSplatX(planes[p]),
+				XMVectorMultiplyAdd(y, XMVectorSplatY(planes[p]),
+				XMVectorMultiply(z, XMVectorSplatZ(planes[p])))),
+				XMVectorSplatW(planes[p]));
+			outside = XMVectorOrInt(outside, XMVectorLess(distance, negRange));
+		}
+
+		// Compact the survivors
+		int visible = ~_mm_movemask_ps(outside) & 0xF;
+		unsigned int lanes = std::min(4u, lightCount - first);
+		for (unsigned int lane = 0; lane < lanes; lane++)
+		{
+			if (!(visible & (1 << lane)))
+				continue;
+
+			const Light& light = lights[first + lane];
+			lightX[visibleLightCount] = light.Position.x;
+			lightY[visibleLightCount] = light.Position.y;
+			lightZ[visibleLightCount] = light.Position.z;
+			lightRange[visibleLightCount] = light.Range;
+			lightWeight[visibleLightCount] = light.intensity * std::max(light.Color.x, std::max(light.Color.y, light.Color.z));
+			lightIndex[visibleLightCount] = first + lane;
+			visibleLightCount++;
+		}
+	}
+
+	// Padding lights have no range and no weight, and are also masked off below
+	for (unsigned int i = visibleLightCount; i < visibleLightCount + 4; i++)
+	{
+		lightX[i] = lightY[i] = lightZ[i] = 0;
+		lightRange[i] = 1;
+		lightWeight[i] = 0;
+		lightIndex[i] = 0;
+	}
+}
+
+// --------------------------------------------------------
+// Finds the visible lights that reach an object's bounding sphere,
+// four at a time, and keeps the strongest few
+//
+// sphere - World space bounding sphere (xyz = center, w = radius)
+// pointLightCount - Light indices below this are point lights
+// list - Receives the chosen lights, point lights first
+// --------------------------------------------------------
+void LightSelection::SelectForObject(XMFLOAT4 sphere, unsigned int pointLightCount, ObjectLightList& list)
+{
+	// Best lights so far, strongest first
+	float bestScore[MAX_LIGHTS_PER_OBJECT];
+	unsigned int bestLight[MAX_LIGHTS_PER_OBJECT];
+	unsigned int bestCount = 0;
+
+	XMVECTOR cx = XMVectorReplicate(sphere.x);
+	XMVECTOR cy = XMVectorReplicate(sphere.y);
+	XMVECTOR cz = XMVectorReplicate(sphere.z);
+	XMVECTOR radius = XMVectorReplicate(sphere.w);
+	XMVECTOR zero = XMVectorZero();
+	XMVECTOR one = XMVectorSplatOne();
+
+	for (unsigned int first = 0; first < visibleLightCount; first += 4)
+	{
+		XMVECTOR dx = XMVectorSubtract(XMLoadFloat4((const XMFLOAT4*)&lightX[first]), cx);
+		XMVECTOR dy = XMVectorSubtract(XMLoadFloat4((const XMFLOAT4*)&lightY[first]), cy);
+		XMVECTOR dz = XMVectorSubtract(XMLoadFloat4((const XMFLOAT4*)&lightZ[first]), cz);
+		XMVECTOR range = XMLoadFloat4((const XMFLOAT4*)&lightRange[first]);
+		XMVECTOR distSq = XMVectorAdd(XMVectorAdd(XMVectorMultiply(dx, dx), XMVectorMultiply(dy, dy)), XMVectorMultiply(dz, dz));
+
+		// Does the light's range reach the sphere at all?
+		XMVECTOR reach = XMVectorAdd(range, radius);
+		int hits = _mm_movemask_ps(XMVectorLessOrEqual(distSq, XMVectorMultiply(reach, reach)));
+		hits &= (1 << std::min(4u, visibleLightCount - first)) - 1;
+		if (hits == 0)
+			continue;
+
+		// Same falloff as Attenuate() in the shader, at the closest point of the sphere
+		XMVECTOR closest = XMVectorMax(XMVectorSubtract(XMVectorSqrt(distSq), radius), zero);
+		XMVECTOR falloff = XMVectorSaturate(XMVectorSubtract(one,
+			XMVectorDivide(XMVectorMultiply(closest, closest), XMVectorMultiply(range, range))));
+		XMVECTOR score = XMVectorMultiply(XMVectorMultiply(falloff, falloff), XMLoadFloat4((const XMFLOAT4*)&lightWeight[first]));
+
+		XMFLOAT4 scores;
+		XMStoreFloat4(&scores, score);
+		const float* laneScores = &scores.x;
+		for (unsigned int lane = 0; hits != 0; lane++, hits >>= 1)
+		{
+			if (!(hits & 1))
+				continue;
+
+			// Insertion into the small sorted list, dropping the weakest when full
+			float s = laneScores[lane];
+			if (bestCount == MAX_LIGHTS_PER_OBJECT && s <= bestScore[bestCount - 1])
+				continue;
+
+			unsigned int slot = bestCount < MAX_LIGHTS_PER_OBJECT ? bestCount++ : bestCount - 1;
+			while (slot > 0 && bestScore[slot - 1] < s)
+			{
+				bestScore[slot] = bestScore[slot - 1];
+				bestLight[slot] = bestLight[slot - 1];
+				slot--;
+			}
+			bestScore[slot] = s;
+			bestLight[slot] = lightIndex[first + lane];
+		}
+	}
+
+	FillList(bestLight, bestCount, pointLightCount, list);
+}
+
+// --------------------------------------------------------
+// Writes the chosen lights into an object's list. The shader
+// wants point lights first, which is just index order.
+// --------------------------------------------------------
+void LightSelection::FillList(unsigned int* chosen, unsigned int chosenCount, unsigned int pointLightCount, ObjectLightList& list)
+{
+	std::sort(chosen, chosen + chosenCount);
+	list.pointCount = 0;
+	for (unsigned int i = 0; i < chosenCount; i++)
+	{
+		list.indices[i] = chosen[i];
+		if (chosen[i] < pointLightCount)
+			list.pointCount++;
+	}
+	list.spotCount = chosenCount - list.pointCount;
+	for (unsigned int i = chosenCount; i < MAX_LIGHTS_PER_OBJECT; i++)
+		list.indices[i] = 0;
+}
\ No newline at end of file
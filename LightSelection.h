@@ -0,0 +1,87 @@
+#pragma once
+#include <DirectXMath.h>
+#include <vector>
+#include "Lights.h"
+#include "BufferStructs.h"
+
+// The lights picked for one object. Indices refer to the light array given
+// to SelectLights(), with point light indices first and spot lights after.
+struct ObjectLightList
+{
+	unsigned int pointCount;
+	unsigned int spotCount;
+	unsigned int indices[MAX_LIGHTS_PER_OBJECT];
+};
+
+// Picks the few point and spot lights that matter most to each object,
+// so the pixel shader only loops over those instead of every light.
+//
+// Lights outside the camera frustum are culled first. Each object then
+// keeps the (at most) MAX_LIGHTS_PER_OBJECT lights whose range reaches its
+// bounding sphere, ranked by the light's estimated intensity at the sphere.
+class LightSelection
+{
+public:
+	LightSelection();
+
+	// lights - Point lights followed by spot lights (see PartitionLights())
+	// viewProjection - Used to cull lights against the camera frustum
+	// objectSpheres - World space bounding spheres (xyz = center, w = radius)
+	void SelectLights(
+		const Light* lights,
+		unsigned int pointLightCount,
+		unsigned int spotLightCount,
+		DirectX::XMFLOAT4X4 viewProjection,
+		const DirectX::XMFLOAT4* objectSpheres,
+		unsigned int objectCount);
+
+	// Scores every light against every object with scalar code and keeps
+	// each object's best with a partial sort, for verification
+	void SelectLightsBruteForce(
+		const Light* lights,
+		unsigned int pointLightCount,
+		unsigned int spotLightCount,
+		DirectX::XMFLOAT4X4 viewProjection,
+		const DirectX::XMFLOAT4* objectSpheres,
+		unsigned int objectCount);
+
+	// Selects with both methods and checks every object got the same lights
+	bool VerifyAgainstBruteForce(
+		const Light* lights,
+		unsigned int pointLightCount,
+		unsigned int spotLightCount,
+		DirectX::XMFLOAT4X4 viewProjection,
+		const DirectX::XMFLOAT4* objectSpheres,
+		unsigned int objectCount);
+
+	// One list per object, in the same order as the spheres
+	const std::vector<ObjectLightList>& GetObjectLights();
+
+	// Makes room for this many lights and objects, so selection never
+	// grows its arrays because the camera turned to see more. Call when
+	// either count changes, outside any ZERO_ALLOCATIONS scope.
+	void Reserve(unsigned int lightCount, unsigned int objectCount);
+
+	// Stats
+	unsigned int GetVisibleLightCount();
+	float GetAverageLightsPerObject();
+	double GetLastSelectTimeMs();
+
+private:
+	// Lights that survived frustum culling, as structure of arrays
+	// so four lights can be tested against an object at once. The
+	// last group of four is filled out with lights that reach nothing.
+	std::vector<float> lightX, lightY, lightZ;
+	std::vector<float> lightRange;
+	std::vector<float> lightWeight;
+	std::vector<unsigned int> lightIndex;
+	unsigned int visibleLightCount;
+
+	std::vector<ObjectLightList> objectLights;
+	float averageLightsPerObject;
+	double lastSelectTimeMs;
+
+	void CullLights(const Light* lights, unsigned int lightCount, DirectX::XMFLOAT4X4 viewProjection);
+	void SelectForObject(DirectX::XMFLOAT4 sphere, unsigned int pointLightCount, ObjectLightList& list);
+	static void FillList(unsigned int* chosen, unsigned int chosenCount, unsigned int pointLightCount, ObjectLightList& list);
+};
\ No newline at end of file
@@ -269,4 +269,14 @@ float3 HandlePointLightPBR(float3 normal, Light light, float3 toCamera, float ro
 	// No ambient so just add spec and diff
     return (specular + diffuse) * light.intensity * light.Color * Attenuate(light, worldPos);
 }
+
+// A point light that only shines within a cone around its direction
+// SpotFalloff is the exponent that tightens the cone
+float3 HandleSpotLightPBR(float3 normal, Light light, float3 toCamera, float roughness, float metalness, float3 specColor, float3 diffColor, float3 worldPos)
+{
+    float3 toSpotLight = normalize(light.Position - worldPos);
+    float spotAmount = pow(saturate(dot(-toSpotLight, normalize(light.Direction))), light.SpotFalloff);
+	
+    return HandlePointLightPBR(normal, light, toCamera, roughness, metalness, specColor, diffColor, worldPos) * spotAmount;
+}
 #endif
\ No newline at end of file
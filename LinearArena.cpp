@@ -0,0 +1,95 @@
+#include "LinearArena.h"
+#include "MemoryTracker.h"
+
+LinearArena::LinearArena(size_t capacity) :
+	memory(new unsigned char[capacity]),
+	capacity(capacity),
+	used(0),
+	overflowBytes(0),
+	peak(0),
+	overflowCount(0)
+{
+}
+
+LinearArena::~LinearArena()
+{
+	Reset();
+	delete[] memory;
+}
+
+// --------------------------------------------------------
+// Aligns the address rather than the offset, so alignments
+// bigger than the block's own still work
+// --------------------------------------------------------
+void* LinearArena::Allocate(size_t bytes, size_t alignment)
+{
+	size_t address = (size_t)(memory + used);
+	size_t padding = (alignment - (address & (alignment - 1))) & (alignment - 1);
+	if (padding + bytes <= capacity - used)
+	{
+		void* block = memory + used + padding;
+		used += padding + bytes;
+		if (used + overflowBytes > peak)
+			peak = used + overflowBytes;
+		return block;
+	}
+
+	// Doesn't fit, so it comes from the heap until the next Reset() or
+	// Rewind(), through the tracker so it counts as an allocation (its
+	// blocks are 16 byte aligned, which covers anything plain data needs)
+	OverflowBlock overflowBlock = { MemoryTracker::Allocate(bytes), bytes };
+	overflow.push_back(overflowBlock);
+	overflowBytes += bytes;
+	overflowCount++;
+	if (used + overflowBytes > peak)
+		peak = used + overflowBytes;
+	return overflowBlock.block;
+}
+
+void LinearArena::Reset()
+{
+	Rewind(Marker{ 0, 0 });
+}
+
+LinearArena::Marker LinearArena::GetMarker()
+{
+	Marker marker = { used, overflow.size() };
+	return marker;
+}
+
+void LinearArena::Rewind(Marker marker)
+{
+	used = marker.used;
+	while (overflow.size() > marker.overflowBlocks)
+	{
+		MemoryTracker::Free(overflow.back().block);
+		overflowBytes -= overflow.back().bytes;
+		overflow.pop_back();
+	}
+}
+
+size_t LinearArena::GetCapacity()
+{
+	return capacity;
+}
+
+size_t LinearArena::GetUsed()
+{
+	return used;
+}
+
+size_t LinearArena::GetPeak()
+{
+	return peak;
+}
+
+unsigned long long LinearArena::GetOverflowCount()
+{
+	return overflowCount;
+}
+
+LinearArena& LinearArena::GetThreadScratch()
+{
+	static thread_local LinearArena scratch(SCRATCH_ARENA_BYTES);
+	return scratch;
+}
\ No newline at end of file
@@ -0,0 +1,112 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+// Each of FramePipeline's per-slot frame arenas
+#define FRAME_ARENA_BYTES (1024 * 1024)
+
+// Each thread's scratch arena
+#define SCRATCH_ARENA_BYTES (256 * 1024)
+
+// --------------------------------------------------------
+// Hands out memory by bumping an offset through one block, and
+// takes it all back at once with Reset() (or back to a marker
+// with Rewind()). Nothing is constructed or destroyed, so it's
+// for plain data only: arrays of numbers, bounds, lights and
+// the like that only live for a frame or a function.
+//
+// Past its capacity, allocations fall back to the heap (freed
+// on Reset() or Rewind()) and are counted, so running out is a
+// slowdown rather than a crash, and shows up as an allocation
+// in zero-allocation frames. GetPeak() says how big it needs
+// to be.
+//
+// An arena is only ever used by one thread at a time.
+// --------------------------------------------------------
+class LinearArena
+{
+public:
+	// Where an arena is up to, for Rewind()
+	struct Marker
+	{
+		size_t used;
+		size_t overflowBlocks;
+	};
+
+	LinearArena(size_t capacity);
+	~LinearArena();
+
+	LinearArena(LinearArena const&) = delete;
+	void operator=(LinearArena const&) = delete;
+
+	// Alignment must be a power of two
+	void* Allocate(size_t bytes, size_t alignment = 16);
+
+	template<typename T>
+	T* AllocateArray(size_t count)
+	{
+		return (T*)Allocate(sizeof(T) * count, alignof(T));
+	}
+
+	// Frees everything, or everything since the marker was taken
+	void Reset();
+	Marker GetMarker();
+	void Rewind(Marker marker);
+
+	size_t GetCapacity();
+	size_t GetUsed();
+	size_t GetPeak();                       // Most ever used at once (including overflow)
+	unsigned long long GetOverflowCount();  // Allocations that didn't fit
+
+	// This thread's scratch arena, made the first time it's asked for
+	static LinearArena& GetThreadScratch();
+
+private:
+	unsigned char* memory;
+	size_t capacity;
+	size_t used;
+	size_t overflowBytes;
+	size_t peak;
+	unsigned long long overflowCount;
+
+	struct OverflowBlock
+	{
+		void* block;
+		size_t bytes;
+	};
+	std::vector<OverflowBlock> overflow;
+};
+
+// --------------------------------------------------------
+// Scratch memory on this thread until the end of the scope,
+// which rewinds the thread's scratch arena to where it was.
+// Scopes nest, including in jobs a thread runs while waiting.
+// --------------------------------------------------------
+class ScratchScope
+{
+public:
+	ScratchScope() :
+		arena(LinearArena::GetThreadScratch()),
+		marker(arena.GetMarker())
+	{
+	}
+
+	~ScratchScope()
+	{
+		arena.Rewind(marker);
+	}
+
+	ScratchScope(ScratchScope const&) = delete;
+	void operator=(ScratchScope const&) = delete;
+
+	template<typename T>
+	T* AllocateArray(size_t count)
+	{
+		return arena.AllocateArray<T>(count);
+	}
+
+private:
+	LinearArena& arena;
+	LinearArena::Marker marker;
+};
\ No newline at end of file
@@ -1,23 +1,14 @@
 
 #include <Windows.h>
 #include "Game.h"
+#include "MemoryTracker.h"
 
 // --------------------------------------------------------
-// Entry point for a graphical (non-console) Windows application
+// Creates, sets up and runs the game, returning once it's
+// been closed (and destroyed)
 // --------------------------------------------------------
-int WINAPI WinMain(
-	_In_ HINSTANCE hInstance,			// The handle to this app's instance
-	_In_opt_ HINSTANCE hPrevInstance,	// A handle to the previous instance of the app (always NULL)
-	_In_ LPSTR lpCmdLine,				// Command line params
-	_In_ int nCmdShow)					// How the window should be shown (we ignore this)
+static int RunGame(HINSTANCE hInstance)
 {
-#if defined(DEBUG) | defined(_DEBUG)
-	// Enable memory leak detection as a quick and dirty
-	// way of determining if we forgot to clean something up
-	//  - You may want to use something more advanced, like Visual Leak Detector
-	_CrtSetDbgFlag( _CRTDBG_ALLOC_MEM_DF | _CRTDBG_LEAK_CHECK_DF );
-#endif
-
 	// Create the Game object using
 	// the app handle we got from WinMain
 	Game dxGame(hInstance);
@@ -39,3 +30,25 @@ int WINAPI WinMain(
 	// whatever we get back once the game loop is over
 	return dxGame.Run();
 }
+
+// --------------------------------------------------------
+// Entry point for a graphical (non-console) Windows application
+// --------------------------------------------------------
+int WINAPI WinMain(
+	_In_ HINSTANCE hInstance,			// The handle to this app's instance
+	_In_opt_ HINSTANCE hPrevInstance,	// A handle to the previous instance of the app (always NULL)
+	_In_ LPSTR lpCmdLine,				// Command line params
+	_In_ int nCmdShow)					// How the window should be shown (we ignore this)
+{
+#if defined(DEBUG) | defined(_DEBUG)
+	// Enable memory leak detection as a quick and dirty
+	// way of determining if we forgot to clean something up
+	//  - You may want to use something more advanced, like Visual Leak Detector
+	_CrtSetDbgFlag( _CRTDBG_ALLOC_MEM_DF | _CRTDBG_LEAK_CHECK_DF );
+#endif
+
+	// Run the game, then check that everything it made is gone
+	int result = RunGame(hInstance);
+	MemoryTracker::ReportLeaks();
+	return result;
+}
\ No newline at end of file
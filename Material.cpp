@@ -1,29 +1,36 @@
 #include "Material.h"
-#include "DX12Helper.h"
 
 Material::Material(Microsoft::WRL::ComPtr<ID3D12PipelineState> pipelineState, DirectX::XMFLOAT3 colorTint, DirectX::XMFLOAT2 uvScale, DirectX::XMFLOAT2 uvOffset)
-	:colorTint(colorTint), pipelineState(pipelineState), uvScale(uvScale), uvOffset(uvOffset), finalized(false), finalGPUHandleForSRVs(D3D12_GPU_DESCRIPTOR_HANDLE()), textureSRVsBySlot()
+	:colorTint(colorTint), pipelineState(pipelineState), uvScale(uvScale), uvOffset(uvOffset), finalized(false), materialIndex(0), textureIndicesBySlot()
 {
 }
 
-void Material::AddTexture(D3D12_CPU_DESCRIPTOR_HANDLE srv, int slot)
+void Material::AddTexture(unsigned int textureIndex, int slot)
 {
 	if (slot > 3 || finalized)
 	{
 		return;
 	}
-	textureSRVsBySlot[slot] = srv;
+	textureIndicesBySlot[slot] = textureIndex;
 }
 
-void Material::FinalizeMaterial()
+// Registers this material's parameters and texture indices with the
+// material table. Draws then only need the resulting table index.
+void Material::FinalizeMaterial(MaterialTable& materialTable)
 {
 	if (finalized) return;
 
-	finalGPUHandleForSRVs =  DX12Helper::GetInstance().CopySRVsToDescriptorHeapAndGetGPUDescriptorHandle(textureSRVsBySlot[0], 1);
-	for (size_t i = 1; i < 4; i++)
-	{
-		DX12Helper::GetInstance().CopySRVsToDescriptorHeapAndGetGPUDescriptorHandle(textureSRVsBySlot[i], 1);
-	}
+	MaterialData data = {};
+	data.colorTint = colorTint;
+	data.uvScale = uvScale;
+	data.uvOffset = uvOffset;
+	data.albedoIndex = textureIndicesBySlot[0];
+	data.normalIndex = textureIndicesBySlot[1];
+	data.metalnessIndex = textureIndicesBySlot[2];
+	data.roughnessIndex = textureIndicesBySlot[3];
+
+	materialIndex = materialTable.AddMaterial(data);
+	finalized = true;
 }
 
 Microsoft::WRL::ComPtr<ID3D12PipelineState> Material::GetPipelineState()
@@ -31,9 +38,9 @@ Microsoft::WRL::ComPtr<ID3D12PipelineState> Material::GetPipelineState()
 	return pipelineState;
 }
 
-D3D12_GPU_DESCRIPTOR_HANDLE Material::GetFinalGPUHandleForSRVs()
+unsigned int Material::GetMaterialIndex()
 {
-	return finalGPUHandleForSRVs;
+	return materialIndex;
 }
 
 DirectX::XMFLOAT2 Material::GetUVScale()
@@ -44,4 +51,4 @@ DirectX::XMFLOAT2 Material::GetUVScale()
 DirectX::XMFLOAT2 Material::GetUVOffset()
 {
 	return uvOffset;
-}
+}
\ No newline at end of file
@@ -2,6 +2,7 @@
 #include <DirectXMath.h>
 #include "DXCore.h"
 #include <wrl/client.h>
+#include "MaterialTable.h"
 class Material
 {
 	// TODO: Add more usefull things from the dx11 version
@@ -9,11 +10,12 @@ public:
 	Material(Microsoft::WRL::ComPtr<ID3D12PipelineState> pipelineState, DirectX::XMFLOAT3 colorTint, DirectX::XMFLOAT2 uvScale, DirectX::XMFLOAT2 uvOffset);
 
 	// albedo, normal, metal, rough, in that order
-	void AddTexture(D3D12_CPU_DESCRIPTOR_HANDLE srv, int slot);
-	void FinalizeMaterial();
+	// textureIndex is the bindless index returned by DX12Helper::LoadTexture
+	void AddTexture(unsigned int textureIndex, int slot);
+	void FinalizeMaterial(MaterialTable& materialTable);
 
 	Microsoft::WRL::ComPtr<ID3D12PipelineState> GetPipelineState();
-	D3D12_GPU_DESCRIPTOR_HANDLE GetFinalGPUHandleForSRVs();
+	unsigned int GetMaterialIndex();
 	DirectX::XMFLOAT2 GetUVScale();
 	DirectX::XMFLOAT2 GetUVOffset();
 
@@ -25,7 +27,6 @@ private:
 
 	Microsoft::WRL::ComPtr<ID3D12PipelineState> pipelineState;
 	// TODO: This could be more flexible up to 128 if needed
-	D3D12_CPU_DESCRIPTOR_HANDLE textureSRVsBySlot [4];
-	D3D12_GPU_DESCRIPTOR_HANDLE finalGPUHandleForSRVs;
-};
-
+	unsigned int textureIndicesBySlot[4];
+	unsigned int materialIndex;
+};
\ No newline at end of file
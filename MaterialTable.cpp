@@ -0,0 +1,82 @@
+#include "MaterialTable.h"
+#include "DX12Helper.h"
+#include <cstring>
+
+MaterialTable::MaterialTable() :
+	dirty(false)
+{
+}
+
+// --------------------------------------------------------
+// Adds a material entry to the table
+//
+// data - The parameters and bindless texture indices of the material
+//
+// Returns the index to pass to the pixel shader when drawing with it.
+// Identical entries are shared, so materials that only differ by
+// pipeline state still resolve to the same table entry.
+// --------------------------------------------------------
+unsigned int MaterialTable::AddMaterial(const MaterialData& data)
+{
+	for (size_t i = 0; i < materials.size(); i++)
+	{
+		if (memcmp(&materials[i], &data, sizeof(MaterialData)) == 0)
+			return (unsigned int)i;
+	}
+
+	materials.push_back(data);
+	dirty = true;
+	return (unsigned int)(materials.size() - 1);
+}
+
+void MaterialTable::UpdateMaterial(unsigned int index, const MaterialData& data)
+{
+	if (index >= materials.size())
+		return;
+
+	materials[index] = data;
+	dirty = true;
+}
+
+unsigned int MaterialTable::GetMaterialCount()
+{
+	return (unsigned int)materials.size();
+}
+
+MaterialData MaterialTable::GetMaterial(unsigned int index)
+{
+	return materials[index];
+}
+
+bool MaterialTable::IsDirty()
+{
+	return dirty;
+}
+
+// --------------------------------------------------------
+// Creates the GPU side structured buffer holding every entry
+// of the table. This only happens when the table has changed
+// since the last upload, which is usually just once after loading.
+// --------------------------------------------------------
+D3D12_GPU_VIRTUAL_ADDRESS MaterialTable::Upload()
+{
+	if (dirty && materials.size() > 0)
+	{
+		// The old buffer may still be in use by in flight frames
+		DX12Helper& dx12Helper = DX12Helper::GetInstance();
+		dx12Helper.WaitForGPU();
+
+		buffer = dx12Helper.CreateStaticBuffer(
+			sizeof(MaterialData),
+			(unsigned int)materials.size(),
+			&materials[0]);
+		dirty = false;
+	}
+
+	return GetGPUAddress();
+}
+
+D3D12_GPU_VIRTUAL_ADDRESS MaterialTable::GetGPUAddress()
+{
+	return buffer ? buffer->GetGPUVirtualAddress() : 0;
+}
\ No newline at end of file
@@ -0,0 +1,33 @@
+#pragma once
+#include <d3d12.h>
+#include <wrl/client.h>
+#include <vector>
+#include "BufferStructs.h"
+
+// CPU-side builder for the material table that the pixel shader reads
+// from a structured buffer. Materials register their parameters and
+// texture indices here and get back the index that each draw passes
+// to the shader, so no per-material descriptor tables are needed.
+class MaterialTable
+{
+public:
+	MaterialTable();
+
+	// Adds an entry, reusing an identical one if it already exists
+	unsigned int AddMaterial(const MaterialData& data);
+	void UpdateMaterial(unsigned int index, const MaterialData& data);
+
+	unsigned int GetMaterialCount();
+	MaterialData GetMaterial(unsigned int index);
+	bool IsDirty();
+
+	// Copies the table to a GPU buffer if anything has changed
+	// and returns its address for binding as a root SRV
+	D3D12_GPU_VIRTUAL_ADDRESS Upload();
+	D3D12_GPU_VIRTUAL_ADDRESS GetGPUAddress();
+
+private:
+	std::vector<MaterialData> materials;
+	Microsoft::WRL::ComPtr<ID3D12Resource> buffer;
+	bool dirty;
+};
\ No newline at end of file
@@ -0,0 +1,296 @@
+#include "MemoryTracker.h"
+#include <atomic>
+#include <cassert>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+
+// Live, peak and total counts for one tag, heap or category. These
+// only live in static storage, which is zeroed before anything runs,
+// so allocations made before main() are counted too.
+struct MemoryCounter
+{
+	std::atomic<unsigned long long> liveBytes;
+	std::atomic<unsigned long long> peakBytes;
+	std::atomic<unsigned long long> liveCount;
+	std::atomic<unsigned long long> totalCount;
+};
+
+// In front of every block from operator new (16 bytes, which keeps
+// the block as aligned as malloc() made it)
+struct AllocationHeader
+{
+	unsigned long long size;
+	unsigned long long tag;
+};
+
+static MemoryCounter cpuCounters[MEMORY_TAG_COUNT];
+static MemoryCounter gpuHeapCounters[GPU_HEAP_COUNT];
+static MemoryCounter gpuCategoryCounters[GPU_MEMORY_COUNT];
+static thread_local unsigned int currentTag = MEMORY_TAG_UNTAGGED;
+static thread_local unsigned long long threadAllocationCount = 0;
+static thread_local bool allocationsForbidden = false;
+static std::atomic<unsigned long long> forbiddenAllocationCount;
+static std::atomic<bool> forbiddenAllocationAsserts(true);
+
+static const char* tagNames[MEMORY_TAG_COUNT] = { "untagged", "mesh", "texture", "scene", "frame" };
+static const char* gpuHeapNames[GPU_HEAP_COUNT] = { "default", "upload", "readback", "descriptor" };
+static const char* gpuCategoryNames[GPU_MEMORY_COUNT] = { "buffers", "textures", "render targets", "upload rings", "staging", "readback", "descriptors" };
+
+// Adds to the live total, raising the peak if it's a new high
+static void CountAllocation(MemoryCounter& counter, unsigned long long bytes)
+{
+	unsigned long long live = counter.liveBytes.fetch_add(bytes, std::memory_order_relaxed) + bytes;
+	counter.liveCount.fetch_add(1, std::memory_order_relaxed);
+	counter.totalCount.fetch_add(1, std::memory_order_relaxed);
+
+	unsigned long long peak = counter.peakBytes.load(std::memory_order_relaxed);
+	while (live > peak && !counter.peakBytes.compare_exchange_weak(peak, live, std::memory_order_relaxed))
+	{
+	}
+}
+
+static void CountFree(MemoryCounter& counter, unsigned long long bytes)
+{
+	counter.liveBytes.fetch_sub(bytes, std::memory_order_relaxed);
+	counter.liveCount.fetch_sub(1, std::memory_order_relaxed);
+}
+
+// --------------------------------------------------------
+// An allocation where none are allowed. Printing may allocate
+// itself, so allocations are allowed while it does.
+// --------------------------------------------------------
+static void ReportForbiddenAllocation(size_t size, unsigned int tag)
+{
+	forbiddenAllocationCount.fetch_add(1, std::memory_order_relaxed);
+
+	allocationsForbidden = false;
+	printf("Heap allocation of %zu bytes (%s) where none are allowed\n", size, tagNames[tag]);
+	assert(!forbiddenAllocationAsserts && "Heap allocation in a ZERO_ALLOCATIONS scope");
+	allocationsForbidden = true;
+}
+
+static MemoryStats GetStats(MemoryCounter& counter)
+{
+	MemoryStats stats;
+	stats.liveBytes = counter.liveBytes.load(std::memory_order_relaxed);
+	stats.peakBytes = counter.peakBytes.load(std::memory_order_relaxed);
+	stats.liveCount = counter.liveCount.load(std::memory_order_relaxed);
+	stats.totalCount = counter.totalCount.load(std::memory_order_relaxed);
+	return stats;
+}
+
+static void PrintStats(const char* name, MemoryCounter& counter)
+{
+	MemoryStats stats = GetStats(counter);
+	printf("  %-16s %10.3fMB live (%llu blocks), %10.3fMB peak, %llu ever\n",
+		name,
+		stats.liveBytes / (1024.0 * 1024.0),
+		stats.liveCount,
+		stats.peakBytes / (1024.0 * 1024.0),
+		stats.totalCount);
+}
+
+void* MemoryTracker::Allocate(size_t size)
+{
+	AllocationHeader* header = (AllocationHeader*)malloc(sizeof(AllocationHeader) + size);
+	if (!header)
+		return 0;
+
+	unsigned int tag = currentTag;
+	header->size = size;
+	header->tag = tag;
+	CountAllocation(cpuCounters[tag], size);
+
+	threadAllocationCount++;
+	if (allocationsForbidden)
+		ReportForbiddenAllocation(size, tag);
+	return header + 1;
+}
+
+void MemoryTracker::Free(void* block)
+{
+	if (!block)
+		return;
+
+	AllocationHeader* header = (AllocationHeader*)block - 1;
+	CountFree(cpuCounters[header->tag], header->size);
+	free(header);
+}
+
+unsigned int MemoryTracker::SetThreadTag(unsigned int tag)
+{
+	unsigned int previousTag = currentTag;
+	currentTag = tag;
+	return previousTag;
+}
+
+unsigned int MemoryTracker::GetThreadTag()
+{
+	return currentTag;
+}
+
+unsigned long long MemoryTracker::GetThreadAllocationCount()
+{
+	return threadAllocationCount;
+}
+
+bool MemoryTracker::SetThreadAllocationsForbidden(bool forbidden)
+{
+	bool previouslyForbidden = allocationsForbidden;
+	allocationsForbidden = forbidden;
+	return previouslyForbidden;
+}
+
+bool MemoryTracker::GetThreadAllocationsForbidden()
+{
+	return allocationsForbidden;
+}
+
+unsigned long long MemoryTracker::GetForbiddenAllocationCount()
+{
+	return forbiddenAllocationCount.load(std::memory_order_relaxed);
+}
+
+void MemoryTracker::SetForbiddenAllocationAsserts(bool enabled)
+{
+	forbiddenAllocationAsserts = enabled;
+}
+
+void MemoryTracker::AddGpuAllocation(unsigned int heap, unsigned int category, unsigned long long bytes)
+{
+	CountAllocation(gpuHeapCounters[heap], bytes);
+	CountAllocation(gpuCategoryCounters[category], bytes);
+}
+
+void MemoryTracker::RemoveGpuAllocation(unsigned int heap, unsigned int category, unsigned long long bytes)
+{
+	CountFree(gpuHeapCounters[heap], bytes);
+	CountFree(gpuCategoryCounters[category], bytes);
+}
+
+MemoryStats MemoryTracker::GetCPUStats(unsigned int tag)
+{
+	return GetStats(cpuCounters[tag]);
+}
+
+MemoryStats MemoryTracker::GetGpuHeapStats(unsigned int heap)
+{
+	return GetStats(gpuHeapCounters[heap]);
+}
+
+MemoryStats MemoryTracker::GetGpuCategoryStats(unsigned int category)
+{
+	return GetStats(gpuCategoryCounters[category]);
+}
+
+void MemoryTracker::PrintReport()
+{
+	printf("CPU memory by tag:\n");
+	for (unsigned int t = 0; t < MEMORY_TAG_COUNT; t++)
+		PrintStats(tagNames[t], cpuCounters[t]);
+
+	printf("GPU memory by heap:\n");
+	for (unsigned int h = 0; h < GPU_HEAP_COUNT; h++)
+		PrintStats(gpuHeapNames[h], gpuHeapCounters[h]);
+
+	printf("GPU memory by use:\n");
+	for (unsigned int c = 0; c < GPU_MEMORY_COUNT; c++)
+		PrintStats(gpuCategoryNames[c], gpuCategoryCounters[c]);
+}
+
+unsigned long long MemoryTracker::ReportLeaks()
+{
+	unsigned long long leaks = 0;
+	for (unsigned int t = MEMORY_TAG_UNTAGGED + 1; t < MEMORY_TAG_COUNT; t++)
+	{
+		MemoryStats stats = GetStats(cpuCounters[t]);
+		if (stats.liveCount > 0)
+			printf("Memory leak: %llu %s blocks (%llu bytes) still allocated\n", stats.liveCount, tagNames[t], stats.liveBytes);
+		leaks += stats.liveCount;
+	}
+	for (unsigned int c = 0; c < GPU_MEMORY_COUNT; c++)
+	{
+		MemoryStats stats = GetStats(gpuCategoryCounters[c]);
+		if (stats.liveCount > 0)
+			printf("Memory leak: %llu GPU %s (%llu bytes) still allocated\n", stats.liveCount, gpuCategoryNames[c], stats.liveBytes);
+		leaks += stats.liveCount;
+	}
+
+	if (leaks == 0)
+		printf("No tagged CPU or GPU memory left allocated\n");
+	return leaks;
+}
+
+const char* MemoryTracker::GetTagName(unsigned int tag)
+{
+	return tagNames[tag];
+}
+
+const char* MemoryTracker::GetGpuHeapName(unsigned int heap)
+{
+	return gpuHeapNames[heap];
+}
+
+const char* MemoryTracker::GetGpuCategoryName(unsigned int category)
+{
+	return gpuCategoryNames[category];
+}
+
+#ifndef MEMORY_TRACKING_DISABLED
+// --------------------------------------------------------
+// Every new and delete in the program goes through the tracker
+// --------------------------------------------------------
+void* operator new(size_t size)
+{
+	void* block = MemoryTracker::Allocate(size);
+	if (!block)
+		throw std::bad_alloc();
+	return block;
+}
+
+void* operator new[](size_t size)
+{
+	return operator new(size);
+}
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept
+{
+	return MemoryTracker::Allocate(size);
+}
+
+void* operator new[](size_t size, const std::nothrow_t&) noexcept
+{
+	return MemoryTracker::Allocate(size);
+}
+
+void operator delete(void* block) noexcept
+{
+	MemoryTracker::Free(block);
+}
+
+void operator delete[](void* block) noexcept
+{
+	MemoryTracker::Free(block);
+}
+
+void operator delete(void* block, size_t) noexcept
+{
+	MemoryTracker::Free(block);
+}
+
+void operator delete[](void* block, size_t) noexcept
+{
+	MemoryTracker::Free(block);
+}
+
+void operator delete(void* block, const std::nothrow_t&) noexcept
+{
+	MemoryTracker::Free(block);
+}
+
+void operator delete[](void* block, const std::nothrow_t&) noexcept
+{
+	MemoryTracker::Free(block);
+}
+#endif
\ No newline at end of file
@@ -0,0 +1,157 @@
+#pragma once
+
+#include <cstddef>
+
+// What CPU memory is for, picked by the innermost MEMORY_TAG scope
+// on the allocating thread
+#define MEMORY_TAG_UNTAGGED 0
+#define MEMORY_TAG_MESH 1     // Loading meshes: OBJ parsing, geometry kept for picking, triangle BVHs
+#define MEMORY_TAG_TEXTURE 2  // Decoding and uploading textures
+#define MEMORY_TAG_SCENE 3    // Entities, transforms, lights and anything else the scene is made of
+#define MEMORY_TAG_FRAME 4    // Update() and Draw(): render snapshots and per-frame scratch
+#define MEMORY_TAG_COUNT 5
+
+// Which kind of heap GPU memory lives in
+#define GPU_HEAP_DEFAULT 0     // GPU only
+#define GPU_HEAP_UPLOAD 1      // CPU writes, GPU reads
+#define GPU_HEAP_READBACK 2    // GPU writes, CPU reads
+#define GPU_HEAP_DESCRIPTOR 3  // Descriptor and query heaps (the driver's memory)
+#define GPU_HEAP_COUNT 4
+
+// And what it's for
+#define GPU_MEMORY_BUFFER 0        // Static vertex and index buffers
+#define GPU_MEMORY_TEXTURE 1       // Loaded textures
+#define GPU_MEMORY_RENDER_TARGET 2 // Render targets and depth buffers
+#define GPU_MEMORY_UPLOAD_RING 3   // Per-frame upload rings (constant buffers, dynamic buffers)
+#define GPU_MEMORY_STAGING 4       // Upload copies that only live until the copy is done
+#define GPU_MEMORY_READBACK 5      // Results the CPU reads back (like timestamps)
+#define GPU_MEMORY_DESCRIPTORS 6   // Descriptor and query heaps
+#define GPU_MEMORY_COUNT 7
+
+// Tags every allocation on this thread until the end of the scope
+#define MEMORY_TAG_CONCAT_INNER(a, b) a##b
+#define MEMORY_TAG_CONCAT(a, b) MEMORY_TAG_CONCAT_INNER(a, b)
+#define MEMORY_TAG(tag) MemoryTagScope MEMORY_TAG_CONCAT(memoryTag, __LINE__)(tag)
+
+// With forbid true, heap allocations on this thread are errors until the
+// end of the scope. ALLOW_ALLOCATIONS() lifts that for an inner scope (like
+// a debug key handler that's allowed to allocate).
+#define ZERO_ALLOCATIONS(forbid) ZeroAllocationScope MEMORY_TAG_CONCAT(zeroAllocations, __LINE__)(forbid)
+#define ALLOW_ALLOCATIONS() ZeroAllocationScope MEMORY_TAG_CONCAT(allowAllocations, __LINE__)(false)
+
+struct MemoryStats
+{
+	unsigned long long liveBytes;
+	unsigned long long peakBytes;
+	unsigned long long liveCount;
+	unsigned long long totalCount; // Allocations ever made
+};
+
+// --------------------------------------------------------
+// Keeps live and peak totals of memory by what it's for.
+//
+// CPU memory is counted by replacing the global operator new and
+// delete (unless MEMORY_TRACKING_DISABLED is defined): each block
+// gets a small header with its size and the allocating thread's
+// tag, so it comes off the right total whichever thread frees it.
+// That's a few uncontended atomic adds per allocation, on top of
+// the allocation itself.
+//
+// Code that shouldn't allocate at all (like a frame, once it's warmed
+// up) can forbid it: allocations in a ZERO_ALLOCATIONS scope are
+// counted and printed, and assert in debug builds.
+//
+// GPU memory is counted by DX12Helper as it makes resources and
+// heaps, by heap type and by what they're for. It knows when they
+// go away, too (see DX12Helper::TrackGpuMemory()).
+// --------------------------------------------------------
+class MemoryTracker
+{
+public:
+	// Used by the replacement operator new and delete
+	static void* Allocate(size_t size);
+	static void Free(void* block);
+
+	// Sets this thread's tag, returning the one it replaces
+	static unsigned int SetThreadTag(unsigned int tag);
+	static unsigned int GetThreadTag();
+
+	// Allocations made on this thread, so a stretch of code's
+	// allocations can be counted without other threads' getting in
+	static unsigned long long GetThreadAllocationCount();
+
+	// Forbids (or allows) this thread's allocations, returning whether
+	// they were forbidden before. Forbidden ones are counted, printed and,
+	// with asserts on (the default), assert.
+	static bool SetThreadAllocationsForbidden(bool forbidden);
+	static bool GetThreadAllocationsForbidden();
+	static unsigned long long GetForbiddenAllocationCount();
+	static void SetForbiddenAllocationAsserts(bool enabled);
+
+	static void AddGpuAllocation(unsigned int heap, unsigned int category, unsigned long long bytes);
+	static void RemoveGpuAllocation(unsigned int heap, unsigned int category, unsigned long long bytes);
+
+	static MemoryStats GetCPUStats(unsigned int tag);
+	static MemoryStats GetGpuHeapStats(unsigned int heap);
+	static MemoryStats GetGpuCategoryStats(unsigned int category);
+
+	// Live and peak totals for every tag, heap and category
+	static void PrintReport();
+
+	// Whatever tagged CPU memory and GPU memory is still around. Meant
+	// for shutdown, once everything should be gone. Untagged memory
+	// isn't counted, since statics are freed after this. Returns the
+	// number of allocations still live.
+	static unsigned long long ReportLeaks();
+
+	static const char* GetTagName(unsigned int tag);
+	static const char* GetGpuHeapName(unsigned int heap);
+	static const char* GetGpuCategoryName(unsigned int category);
+};
+
+// --------------------------------------------------------
+// Sets the thread's memory tag for its lifetime (see MEMORY_TAG)
+// --------------------------------------------------------
+class MemoryTagScope
+{
+public:
+	MemoryTagScope(unsigned int tag) :
+		previousTag(MemoryTracker::SetThreadTag(tag))
+	{
+	}
+
+	~MemoryTagScope()
+	{
+		MemoryTracker::SetThreadTag(previousTag);
+	}
+
+	MemoryTagScope(MemoryTagScope const&) = delete;
+	void operator=(MemoryTagScope const&) = delete;
+
+private:
+	unsigned int previousTag;
+};
+
+// --------------------------------------------------------
+// Forbids or allows heap allocations on this thread for its
+// lifetime (see ZERO_ALLOCATIONS)
+// --------------------------------------------------------
+class ZeroAllocationScope
+{
+public:
+	ZeroAllocationScope(bool forbid) :
+		previouslyForbidden(MemoryTracker::SetThreadAllocationsForbidden(forbid))
+	{
+	}
+
+	~ZeroAllocationScope()
+	{
+		MemoryTracker::SetThreadAllocationsForbidden(previouslyForbidden);
+	}
+
+	ZeroAllocationScope(ZeroAllocationScope const&) = delete;
+	void operator=(ZeroAllocationScope const&) = delete;
+
+private:
+	bool previouslyForbidden;
+};
\ No newline at end of file
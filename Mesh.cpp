@@ -1,38 +1,43 @@
 #include "Mesh.h"
 #include <fstream>
+#include <unordered_map>
 #include <vector>
 #include <DirectXMath.h>
 #include "DX12Helper.h"
+#include "Profiler.h"
+#include "MemoryTracker.h"
 
 using namespace DirectX;
 
-Mesh::Mesh(Vertex* vertexData, unsigned int vertexCount, unsigned int* indexData, unsigned int _indexCount)
+Mesh::Mesh(Vertex* vertexData, unsigned int vertexCount, unsigned int* indexData, unsigned int _indexCount, bool keepCPUGeometry)
 {
-	indexCount = _indexCount;
-
-	CalculateTangents(vertexData, vertexCount, indexData, indexCount);
-
-	DX12Helper& dx12Helper = DX12Helper::GetInstance();
-
-	// Create a vertex buffer on the gpu to hold the geometry of this mesh
-	vertexBuffer = dx12Helper.CreateStaticBuffer(sizeof(Vertex), vertexCount, vertexData);
-
-	// Create an index buffer on the gpu to specify indexes of the vertex buffer to use
-	indexBuffer = dx12Helper.CreateStaticBuffer(sizeof(unsigned int), indexCount, indexData);
-
-	// Set up the views
-	vbView.StrideInBytes = sizeof(Vertex);
-	vbView.SizeInBytes = sizeof(Vertex) * vertexCount;
-	vbView.BufferLocation = vertexBuffer->GetGPUVirtualAddress();
+	Create(vertexData, vertexCount, indexData, _indexCount, keepCPUGeometry);
+}
 
-	ibView.Format = DXGI_FORMAT_R32_UINT;
-	ibView.SizeInBytes = sizeof(unsigned int) * indexCount;
-	ibView.BufferLocation = indexBuffer->GetGPUVirtualAddress();
+Mesh::Mesh(const wchar_t* fileName, bool keepCPUGeometry):
+	indexCount(0),
+	boundsMin(0, 0, 0),
+	boundsMax(0, 0, 0),
+	sphereCenter(0, 0, 0),
+	sphereRadius(0)
+{
+	std::vector<Vertex> verts;
+	std::vector<unsigned int> indices;
+	if (LoadOBJ(fileName, verts, indices))
+		Create(&verts[0], (unsigned int)verts.size(), &indices[0], (unsigned int)indices.size(), keepCPUGeometry);
 }
 
-Mesh::Mesh(const wchar_t* fileName):
-	indexCount(0)
+// --------------------------------------------------------
+// Reads an OBJ file into a vertex and index list without touching
+// the GPU, so several files can be parsed on different threads and
+// turned into meshes afterwards. Returns false if the file couldn't
+// be opened or has no triangles.
+// --------------------------------------------------------
+bool Mesh::LoadOBJ(const wchar_t* fileName, std::vector<Vertex>& verts, std::vector<unsigned int>& indices)
 {
+	PROFILE_FUNCTION();
+	MEMORY_TAG(MEMORY_TAG_MESH);
+
 	// Author: Chris Cascioli
 	// Purpose: Basic .OBJ 3D model loading, supporting positions, uvs and normals
 	// 
@@ -47,15 +52,15 @@ Mesh::Mesh(const wchar_t* fileName):
 	std::ifstream obj(fileName);
 
 	// Check for successful open
+	verts.clear();
+	indices.clear();
 	if (!obj.is_open())
-		return;
+		return false;
 
 	// Variables used while reading the file
 	std::vector<XMFLOAT3> positions;	// Positions from the file
 	std::vector<XMFLOAT3> normals;		// Normals from the file
 	std::vector<XMFLOAT2> uvs;		// UVs from the file
-	std::vector<Vertex> verts;		// Verts we're assembling
-	std::vector<UINT> indices;		// Indices of these verts
 	int vertCounter = 0;			// Count of vertices
 	int indexCounter = 0;			// Count of indices
 	char chars[100];			// String for line reading
@@ -232,41 +237,73 @@ Mesh::Mesh(const wchar_t* fileName):
 		}
 	}
 
-	// Close the file and create the actual buffers
+	// Close the file
 	obj.close();
 
-	CalculateTangents(&verts[0], vertCounter, &indices[0], indexCounter);
+	// - "vertCounter" is the number of vertices
+	// - "indexCounter" is the number of indices
+	// - Yes, these are effectively the same since OBJs do not index entire vertices!  This means
+	//    an index buffer isn't doing much for us.  We could try to optimize the mesh ourselves
+	//    and detect duplicate vertices, but at that point it would be better to use a more
+	//    sophisticated model loading library like TinyOBJLoader or The Open Asset Importer Library
+	return indexCounter > 0;
+}
+
+void Mesh::Create(Vertex* vertexData, unsigned int vertexCount, unsigned int* indexData, unsigned int _indexCount, bool keepCPUGeometry)
+{
+	PROFILE_FUNCTION();
+	MEMORY_TAG(MEMORY_TAG_MESH);
+	indexCount = _indexCount;
+
+	CalculateBounds(vertexData, vertexCount);
+	CalculateTangents(vertexData, vertexCount, indexData, indexCount);
+	if (keepCPUGeometry)
+		KeepCPUGeometry(vertexData, vertexCount, indexData, indexCount);
 
 	DX12Helper& dx12Helper = DX12Helper::GetInstance();
 
-	// - At this point, "verts" is a vector of Vertex structs, and can be used
-	//    directly to create a vertex buffer:  &verts[0] is the address of the first vert
 	// Create a vertex buffer on the gpu to hold the geometry of this mesh
-	vertexBuffer = dx12Helper.CreateStaticBuffer(sizeof(Vertex), vertCounter, &verts[0]);
+	vertexBuffer = dx12Helper.CreateStaticBuffer(sizeof(Vertex), vertexCount, vertexData);
 
-	// - The vector "indices" is similar. It's a vector of unsigned ints and
-	//    can be used directly for the index buffer: &indices[0] is the address of the first int
 	// Create an index buffer on the gpu to specify indexes of the vertex buffer to use
-	indexBuffer = dx12Helper.CreateStaticBuffer(sizeof(unsigned int), indexCounter, &indices[0]);
+	indexBuffer = dx12Helper.CreateStaticBuffer(sizeof(unsigned int), indexCount, indexData);
 
 	// Set up the views
 	vbView.StrideInBytes = sizeof(Vertex);
-	vbView.SizeInBytes = sizeof(Vertex) * vertCounter;
+	vbView.SizeInBytes = sizeof(Vertex) * vertexCount;
 	vbView.BufferLocation = vertexBuffer->GetGPUVirtualAddress();
 
 	ibView.Format = DXGI_FORMAT_R32_UINT;
-	ibView.SizeInBytes = sizeof(unsigned int) * indexCounter;
+	ibView.SizeInBytes = sizeof(unsigned int) * indexCount;
 	ibView.BufferLocation = indexBuffer->GetGPUVirtualAddress();
+}
 
-	// 
-	// - "vertCounter" is the number of vertices
-	// - "indexCounter" is the number of indices
- 	indexCount = indexCounter;
-	// - Yes, these are effectively the same since OBJs do not index entire vertices!  This means
-	//    an index buffer isn't doing much for us.  We could try to optimize the mesh ourselves
-	//    and detect duplicate vertices, but at that point it would be better to use a more
-	//    sophisticated model loading library like TinyOBJLoader or The Open Asset Importer Library
+// --------------------------------------------------------
+// Finds the local space bounding box of the vertices and
+// the bounding sphere that encloses that box
+// --------------------------------------------------------
+void Mesh::CalculateBounds(Vertex* verts, int numVerts)
+{
+	if (numVerts <= 0)
+	{
+		boundsMin = boundsMax = sphereCenter = XMFLOAT3(0, 0, 0);
+		sphereRadius = 0;
+		return;
+	}
+
+	XMVECTOR minV = XMLoadFloat3(&verts[0].Position);
+	XMVECTOR maxV = minV;
+	for (int i = 1; i < numVerts; i++)
+	{
+		XMVECTOR pos = XMLoadFloat3(&verts[i].Position);
+		minV = XMVectorMin(minV, pos);
+		maxV = XMVectorMax(maxV, pos);
+	}
 
+	XMStoreFloat3(&boundsMin, minV);
+	XMStoreFloat3(&boundsMax, maxV);
+	XMStoreFloat3(&sphereCenter, XMVectorScale(XMVectorAdd(minV, maxV), 0.5f));
+	sphereRadius = XMVectorGetX(XMVector3Length(XMVectorSubtract(maxV, minV))) * 0.5f;
 }
 
 // --------------------------------------------------------
@@ -282,6 +319,8 @@ Mesh::Mesh(const wchar_t* fileName):
 // --------------------------------------------------------
 void Mesh::CalculateTangents(Vertex* verts, int numVerts, unsigned int* indices, int numIndices)
 {
+	PROFILE_FUNCTION();
+
 	// Reset tangents
 	for (int i = 0; i < numVerts; i++)
 	{
@@ -340,6 +379,55 @@ void Mesh::CalculateTangents(Vertex* verts, int numVerts, unsigned int* indices,
 	}
 }
 
+// --------------------------------------------------------
+// Keeps just the positions and indices on the CPU for ray
+// queries, then builds a triangle BVH over them
+//
+// - OBJ files give every triangle its own three vertices, so
+//   vertices at the same position are merged into one
+// --------------------------------------------------------
+void Mesh::KeepCPUGeometry(Vertex* verts, int numVerts, unsigned int* indices, int numIndices)
+{
+	PROFILE_FUNCTION();
+
+	struct PositionHash
+	{
+		size_t operator()(const XMFLOAT3& p) const
+		{
+			size_t hash = std::hash<float>()(p.x);
+			hash = hash * 31 + std::hash<float>()(p.y);
+			return hash * 31 + std::hash<float>()(p.z);
+		}
+	};
+	struct PositionEqual
+	{
+		bool operator()(const XMFLOAT3& a, const XMFLOAT3& b) const
+		{
+			return a.x == b.x && a.y == b.y && a.z == b.z;
+		}
+	};
+
+	std::unordered_map<XMFLOAT3, unsigned int, PositionHash, PositionEqual> merged;
+	merged.reserve(numVerts);
+	std::vector<unsigned int> remap(numVerts);
+	cpuPositions.clear();
+	for (int i = 0; i < numVerts; i++)
+	{
+		std::pair<std::unordered_map<XMFLOAT3, unsigned int, PositionHash, PositionEqual>::iterator, bool> found =
+			merged.insert(std::make_pair(verts[i].Position, (unsigned int)cpuPositions.size()));
+		if (found.second)
+			cpuPositions.push_back(verts[i].Position);
+		remap[i] = found.first->second;
+	}
+	cpuPositions.shrink_to_fit();
+
+	cpuIndices.resize(numIndices);
+	for (int i = 0; i < numIndices; i++)
+		cpuIndices[i] = remap[indices[i]];
+
+	triangleBVH = std::make_shared<MeshBVH>(cpuPositions.data(), cpuIndices.data(), (unsigned int)cpuIndices.size());
+}
+
 Mesh::~Mesh()
 {
 	// Using smart ComPtrs this shouldnt need to do much
@@ -370,6 +458,46 @@ unsigned int Mesh::GetIndexCount()
 	return indexCount;
 }
 
+DirectX::XMFLOAT3 Mesh::GetBoundsMin()
+{
+	return boundsMin;
+}
+
+DirectX::XMFLOAT3 Mesh::GetBoundsMax()
+{
+	return boundsMax;
+}
+
+DirectX::XMFLOAT3 Mesh::GetBoundingSphereCenter()
+{
+	return sphereCenter;
+}
+
+float Mesh::GetBoundingSphereRadius()
+{
+	return sphereRadius;
+}
+
+bool Mesh::HasCPUGeometry()
+{
+	return triangleBVH != 0;
+}
+
+const std::vector<XMFLOAT3>& Mesh::GetCPUPositions()
+{
+	return cpuPositions;
+}
+
+const std::vector<unsigned int>& Mesh::GetCPUIndices()
+{
+	return cpuIndices;
+}
+
+MeshBVH* Mesh::GetTriangleBVH()
+{
+	return triangleBVH.get();
+}
+
 /* Im guessing this wont work anymore in dx12 untill updated
 void Mesh::Draw()
 {
@@ -2,7 +2,10 @@
 
 #include <wrl/client.h> // Used for ComPtr - a smart pointer for COM objects
 #include <d3d12.h>
+#include <memory>
+#include <vector>
 #include "vertex.h"
+#include "MeshBVH.h"
 
 // Mesh object containing geometry data
 class Mesh
@@ -12,8 +15,12 @@ public:
 		Vertex* vertexData,                                 // Vertex data of the mesh (array)
 		unsigned int vertexCount,                           // Number of vertexes in the vertexData
 		unsigned int* indexData,                            // List of indexes (indices?) into the vertex data to use
-		unsigned int indexCount);                           // Number of indexes (indices?) in indexData
-	Mesh(const wchar_t* fileName);
+		unsigned int indexCount,                            // Number of indexes (indices?) in indexData
+		bool keepCPUGeometry = false);                      // Keep positions and a triangle BVH for picking
+	Mesh(const wchar_t* fileName, bool keepCPUGeometry = false);
+
+	// Parses an OBJ file on the CPU only (safe to call from any thread)
+	static bool LoadOBJ(const wchar_t* fileName, std::vector<Vertex>& verts, std::vector<unsigned int>& indices);
 	
 	~Mesh();
 
@@ -27,6 +34,20 @@ public:
 	// Get the number of indexes (indices?) in the index buffer
 	unsigned int GetIndexCount();
 
+	// Local space bounds of the vertices
+	DirectX::XMFLOAT3 GetBoundsMin();
+	DirectX::XMFLOAT3 GetBoundsMax();
+	DirectX::XMFLOAT3 GetBoundingSphereCenter();
+	float GetBoundingSphereRadius();
+
+	// Local space positions and triangle list kept on the CPU (duplicate
+	// positions merged), and a BVH over them. Empty (and 0) unless the
+	// mesh was created with keepCPUGeometry.
+	bool HasCPUGeometry();
+	const std::vector<DirectX::XMFLOAT3>& GetCPUPositions();
+	const std::vector<unsigned int>& GetCPUIndices();
+	MeshBVH* GetTriangleBVH();
+
 	// Draw this mesh
 	//void Draw();
 
@@ -43,6 +64,20 @@ private:
 	// Number of indexes (or indices?) in the index buffer
 	unsigned int indexCount;
 
+	// Local space bounding box and the sphere around it
+	DirectX::XMFLOAT3 boundsMin;
+	DirectX::XMFLOAT3 boundsMax;
+	DirectX::XMFLOAT3 sphereCenter;
+	float sphereRadius;
+
+	// CPU copy of the geometry (the BVH is shared between copies of the mesh)
+	std::vector<DirectX::XMFLOAT3> cpuPositions;
+	std::vector<unsigned int> cpuIndices;
+	std::shared_ptr<MeshBVH> triangleBVH;
+
+	void Create(Vertex* vertexData, unsigned int vertexCount, unsigned int* indexData, unsigned int indexCount, bool keepCPUGeometry);
+	void CalculateBounds(Vertex* verts, int numVerts);
 	void CalculateTangents(Vertex* verts, int numVerts, unsigned int* indices, int numIndices);
+	void KeepCPUGeometry(Vertex* verts, int numVerts, unsigned int* indices, int numIndices);
 };
 
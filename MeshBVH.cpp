@@ -0,0 +1,240 @@
+#include "MeshBVH.h"
+#include <cmath>
+
+using namespace DirectX;
+
+// Triangle index in a pack's unused lanes
+#define MESH_BVH_EMPTY 0xFFFFFFFFu
+
+// --------------------------------------------------------
+// Builds the tree: binned SAH down to at most four triangles
+// per leaf, then collapsed into 4-wide nodes
+//
+// positions, indices - The mesh's triangle list (local space)
+// --------------------------------------------------------
+MeshBVH::MeshBVH(const XMFLOAT3* positions, const unsigned int* indices, unsigned int indexCount) :
+	triangleCount(indexCount / 3),
+	buildPositions(positions),
+	buildIndices(indices)
+{
+	if (triangleCount == 0)
+		return;
+
+	std::vector<XMFLOAT4> boundsMin(triangleCount);
+	std::vector<XMFLOAT4> boundsMax(triangleCount);
+	std::vector<XMFLOAT4> centroids(triangleCount);
+	buildTriangles.resize(triangleCount);
+	for (unsigned int t = 0; t < triangleCount; t++)
+	{
+		XMFLOAT3 triangleMin, triangleMax;
+		GetTriangleBounds(t, triangleMin, triangleMax);
+		buildTriangles[t] = t;
+		centroids[t] = XMFLOAT4(
+			(triangleMin.x + triangleMax.x) * 0.5f,
+			(triangleMin.y + triangleMax.y) * 0.5f,
+			(triangleMin.z + triangleMax.z) * 0.5f, 0);
+
+		// The slab test and the triangle test round differently, so a ray
+		// grazing an edge on a box's face could pass one and fail the
+		// other. A few ulps of slack lets the triangle test decide.
+		float padX = (fabsf(triangleMin.x) + fabsf(triangleMax.x)) * 1e-6f;
+		float padY = (fabsf(triangleMin.y) + fabsf(triangleMax.y)) * 1e-6f;
+		float padZ = (fabsf(triangleMin.z) + fabsf(triangleMax.z)) * 1e-6f;
+		boundsMin[t] = XMFLOAT4(triangleMin.x - padX, triangleMin.y - padY, triangleMin.z - padZ, 0);
+		boundsMax[t] = XMFLOAT4(triangleMax.x + padX, triangleMax.y + padY, triangleMax.z + padZ, 0);
+	}
+
+	// Each leaf becomes a pack, and its slot holds the pack's index
+	packs.reserve(triangleCount / 2 + 1);
+	WideBVH::Build(boundsMin.data(), boundsMax.data(), centroids.data(), buildTriangles, nodes,
+		[&](unsigned int first, unsigned int count) { return AddPack(first, count); });
+
+	buildPositions = 0;
+	buildIndices = 0;
+	buildTriangles.clear();
+	buildTriangles.shrink_to_fit();
+}
+
+// --------------------------------------------------------
+// Walks the tree nearest box first, skipping boxes that start
+// past the closest hit so far. Leaves test all four of their
+// triangles at once (Moller-Trumbore). Ties go to the lowest
+// triangle, so the result doesn't depend on the tree's shape.
+// --------------------------------------------------------
+bool MeshBVH::Raycast(XMFLOAT3 origin, XMFLOAT3 direction, float maxDistance, unsigned int& hitTriangle, float& hitDistance)
+{
+	if (nodes.empty() || (direction.x == 0 && direction.y == 0 && direction.z == 0))
+		return false;
+
+	XMVECTOR originX = XMVectorReplicate(origin.x);
+	XMVECTOR originY = XMVectorReplicate(origin.y);
+	XMVECTOR originZ = XMVectorReplicate(origin.z);
+	XMVECTOR directionX = XMVectorReplicate(direction.x);
+	XMVECTOR directionY = XMVectorReplicate(direction.y);
+	XMVECTOR directionZ = XMVectorReplicate(direction.z);
+
+	bool hit = false;
+	hitDistance = maxDistance;
+	WideBVH::Raycast(nodes, origin, direction, hitDistance, [&](unsigned int packIndex, unsigned int)
+	{
+		// All four triangles of the leaf at once
+		const TrianglePack& pack = packs[packIndex];
+		XMVECTOR edge1X = XMLoadFloat4((const XMFLOAT4*)pack.edge1X);
+		XMVECTOR edge1Y = XMLoadFloat4((const XMFLOAT4*)pack.edge1Y);
+		XMVECTOR edge1Z = XMLoadFloat4((const XMFLOAT4*)pack.edge1Z);
+		XMVECTOR edge2X = XMLoadFloat4((const XMFLOAT4*)pack.edge2X);
+		XMVECTOR edge2Y = XMLoadFloat4((const XMFLOAT4*)pack.edge2Y);
+		XMVECTOR edge2Z = XMLoadFloat4((const XMFLOAT4*)pack.edge2Z);
+
+		// p = direction x edge2, det = edge1 . p
+		XMVECTOR pX = XMVectorSubtract(XMVectorMultiply(directionY, edge2Z), XMVectorMultiply(directionZ, edge2Y));
+		XMVECTOR pY = XMVectorSubtract(XMVectorMultiply(directionZ, edge2X), XMVectorMultiply(directionX, edge2Z));
+		XMVECTOR pZ = XMVectorSubtract(XMVectorMultiply(directionX, edge2Y), XMVectorMultiply(directionY, edge2X));
+		XMVECTOR det = XMVectorAdd(XMVectorAdd(XMVectorMultiply(edge1X, pX), XMVectorMultiply(edge1Y, pY)), XMVectorMultiply(edge1Z, pZ));
+		XMVECTOR inverseDet = XMVectorReciprocal(det);
+
+		// Barycentrics and distance, with s = origin - v0 and q = s x edge1
+		XMVECTOR sX = XMVectorSubtract(originX, XMLoadFloat4((const XMFLOAT4*)pack.v0X));
+		XMVECTOR sY = XMVectorSubtract(originY, XMLoadFloat4((const XMFLOAT4*)pack.v0Y));
+		XMVECTOR sZ = XMVectorSubtract(originZ, XMLoadFloat4((const XMFLOAT4*)pack.v0Z));
+		XMVECTOR u = XMVectorMultiply(XMVectorAdd(XMVectorAdd(XMVectorMultiply(sX, pX), XMVectorMultiply(sY, pY)), XMVectorMultiply(sZ, pZ)), inverseDet);
+		XMVECTOR qX = XMVectorSubtract(XMVectorMultiply(sY, edge1Z), XMVectorMultiply(sZ, edge1Y));
+		XMVECTOR qY = XMVectorSubtract(XMVectorMultiply(sZ, edge1X), XMVectorMultiply(sX, edge1Z));
+		XMVECTOR qZ = XMVectorSubtract(XMVectorMultiply(sX, edge1Y), XMVectorMultiply(sY, edge1X));
+		XMVECTOR v = XMVectorMultiply(XMVectorAdd(XMVectorAdd(XMVectorMultiply(directionX, qX), XMVectorMultiply(directionY, qY)), XMVectorMultiply(directionZ, qZ)), inverseDet);
+		XMVECTOR t = XMVectorMultiply(XMVectorAdd(XMVectorAdd(XMVectorMultiply(edge2X, qX), XMVectorMultiply(edge2Y, qY)), XMVectorMultiply(edge2Z, qZ)), inverseDet);
+
+		XMVECTOR zero = XMVectorZero();
+		XMVECTOR hitLanes = XMVectorAndInt(XMVectorAndInt(
+			XMVectorAndInt(XMVectorNotEqual(det, zero), XMVectorGreaterOrEqual(u, zero)),
+			XMVectorAndInt(XMVectorGreaterOrEqual(v, zero), XMVectorLessOrEqual(XMVectorAdd(u, v), XMVectorSplatOne()))),
+			XMVectorAndInt(XMVectorGreaterOrEqual(t, zero), XMVectorLessOrEqual(t, XMVectorReplicate(hitDistance))));
+		int hitMask = _mm_movemask_ps(hitLanes);
+		if (!hitMask)
+			return;
+
+		XMFLOAT4 triangleDistance;
+		XMStoreFloat4(&triangleDistance, t);
+		for (int triangleLane = 0; triangleLane < 4; triangleLane++)
+		{
+			if (!(hitMask & (1 << triangleLane)))
+				continue;
+
+			float distance = (&triangleDistance.x)[triangleLane];
+			unsigned int triangle = pack.triangles[triangleLane];
+			if (distance > hitDistance || (distance == hitDistance && hit && triangle > hitTriangle))
+				continue;
+
+			hit = true;
+			hitTriangle = triangle;
+			hitDistance = distance;
+		}
+	});
+	return hit;
+}
+
+// --------------------------------------------------------
+// Reference for Raycast(): every pack's triangles one lane
+// at a time, with the scalar version of the same test
+// --------------------------------------------------------
+bool MeshBVH::RaycastBruteForce(XMFLOAT3 origin, XMFLOAT3 direction, float maxDistance, unsigned int& hitTriangle, float& hitDistance)
+{
+	if (direction.x == 0 && direction.y == 0 && direction.z == 0)
+		return false;
+
+	bool hit = false;
+	hitDistance = maxDistance;
+	for (const TrianglePack& pack : packs)
+	{
+		for (int lane = 0; lane < 4; lane++)
+		{
+			// Same order of operations as the SIMD version
+			float edge1X = pack.edge1X[lane], edge1Y = pack.edge1Y[lane], edge1Z = pack.edge1Z[lane];
+			float edge2X = pack.edge2X[lane], edge2Y = pack.edge2Y[lane], edge2Z = pack.edge2Z[lane];
+			float pX = direction.y * edge2Z - direction.z * edge2Y;
+			float pY = direction.z * edge2X - direction.x * edge2Z;
+			float pZ = direction.x * edge2Y - direction.y * edge2X;
+			float det = (edge1X * pX + edge1Y * pY) + edge1Z * pZ;
+			float inverseDet = 1.0f / det;
+
+			float sX = origin.x - pack.v0X[lane];
+			float sY = origin.y - pack.v0Y[lane];
+			float sZ = origin.z - pack.v0Z[lane];
+			float u = ((sX * pX + sY * pY) + sZ * pZ) * inverseDet;
+			float qX = sY * edge1Z - sZ * edge1Y;
+			float qY = sZ * edge1X - sX * edge1Z;
+			float qZ = sX * edge1Y - sY * edge1X;
+			float v = ((direction.x * qX + direction.y * qY) + direction.z * qZ) * inverseDet;
+			float t = ((edge2X * qX + edge2Y * qY) + edge2Z * qZ) * inverseDet;
+
+			if (!(det != 0 && u >= 0 && v >= 0 && u + v <= 1 && t >= 0 && t <= hitDistance))
+				continue;
+
+			unsigned int triangle = pack.triangles[lane];
+			if (t == hitDistance && hit && triangle > hitTriangle)
+				continue;
+
+			hit = true;
+			hitTriangle = triangle;
+			hitDistance = t;
+		}
+	}
+	return hit;
+}
+
+unsigned int MeshBVH::GetTriangleCount()
+{
+	return triangleCount;
+}
+
+unsigned int MeshBVH::GetNodeCount()
+{
+	return (unsigned int)nodes.size();
+}
+
+size_t MeshBVH::GetMemorySize()
+{
+	return nodes.size() * sizeof(WideBVHNode) + packs.size() * sizeof(TrianglePack);
+}
+
+// --------------------------------------------------------
+// Copies triangles [first, first + count) into a new pack
+// and returns its index
+// --------------------------------------------------------
+unsigned int MeshBVH::AddPack(unsigned int first, unsigned int count)
+{
+	TrianglePack pack = {};
+	for (unsigned int lane = 0; lane < count; lane++)
+	{
+		unsigned int triangle = buildTriangles[first + lane];
+		const XMFLOAT3& v0 = buildPositions[buildIndices[triangle * 3]];
+		const XMFLOAT3& v1 = buildPositions[buildIndices[triangle * 3 + 1]];
+		const XMFLOAT3& v2 = buildPositions[buildIndices[triangle * 3 + 2]];
+		pack.v0X[lane] = v0.x;
+		pack.v0Y[lane] = v0.y;
+		pack.v0Z[lane] = v0.z;
+		pack.edge1X[lane] = v1.x - v0.x;
+		pack.edge1Y[lane] = v1.y - v0.y;
+		pack.edge1Z[lane] = v1.z - v0.z;
+		pack.edge2X[lane] = v2.x - v0.x;
+		pack.edge2Y[lane] = v2.y - v0.y;
+		pack.edge2Z[lane] = v2.z - v0.z;
+		pack.triangles[lane] = triangle;
+	}
+	for (unsigned int lane = count; lane < 4; lane++)
+		pack.triangles[lane] = MESH_BVH_EMPTY;
+
+	packs.push_back(pack);
+	return (unsigned int)packs.size() - 1;
+}
+
+void MeshBVH::GetTriangleBounds(unsigned int triangle, XMFLOAT3& boundsMin, XMFLOAT3& boundsMax)
+{
+	const XMFLOAT3& v0 = buildPositions[buildIndices[triangle * 3]];
+	const XMFLOAT3& v1 = buildPositions[buildIndices[triangle * 3 + 1]];
+	const XMFLOAT3& v2 = buildPositions[buildIndices[triangle * 3 + 2]];
+	boundsMin = v0;
+	boundsMax = v0;
+	WideBVH::Grow(boundsMin, boundsMax, v1, v1);
+	WideBVH::Grow(boundsMin, boundsMax, v2, v2);
+}
\ No newline at end of file
@@ -0,0 +1,66 @@
+#pragma once
+#include <DirectXMath.h>
+#include <vector>
+#include "WideBVH.h"
+
+// --------------------------------------------------------
+// Bounding volume hierarchy over one mesh's triangles, in the mesh's
+// local space, for picking and other CPU ray queries.
+//
+// Built and walked by WideBVH, like SceneBVH: 4-wide nodes with their
+// children's boxes side by side, so one SSE slab test covers four boxes.
+// Each leaf is a pack of up to four triangles stored the same way, so
+// the ray is tested against all four at once.
+//
+// Triangles are referred to by their position in the index list
+// (index / 3). Queries only read the tree, so several can run at once.
+// --------------------------------------------------------
+class MeshBVH
+{
+public:
+	MeshBVH(const DirectX::XMFLOAT3* positions, const unsigned int* indices, unsigned int indexCount);
+
+	// Nearest triangle (either side) the ray hits within maxDistance.
+	// The direction doesn't need to be normalized: distances are in units
+	// of its length, so a world space ray moved into the mesh's local space
+	// with its matrix still gives world space distances.
+	bool Raycast(DirectX::XMFLOAT3 origin, DirectX::XMFLOAT3 direction, float maxDistance, unsigned int& hitTriangle, float& hitDistance);
+
+	// Tests every triangle with the same math, for verification
+	bool RaycastBruteForce(DirectX::XMFLOAT3 origin, DirectX::XMFLOAT3 direction, float maxDistance, unsigned int& hitTriangle, float& hitDistance);
+
+	// Stats
+	unsigned int GetTriangleCount();
+	unsigned int GetNodeCount();
+	size_t GetMemorySize();
+
+private:
+	// Up to four triangles as a corner and two edges each, one
+	// coordinate per vector. Unused lanes have zero edges, so they
+	// never hit.
+	struct TrianglePack
+	{
+		float v0X[4];
+		float v0Y[4];
+		float v0Z[4];
+		float edge1X[4];
+		float edge1Y[4];
+		float edge1Z[4];
+		float edge2X[4];
+		float edge2Y[4];
+		float edge2Z[4];
+		unsigned int triangles[4];
+	};
+
+	std::vector<WideBVHNode> nodes;
+	std::vector<TrianglePack> packs;
+	unsigned int triangleCount;
+
+	// Only used while building
+	const DirectX::XMFLOAT3* buildPositions;
+	const unsigned int* buildIndices;
+	std::vector<unsigned int> buildTriangles;
+
+	unsigned int AddPack(unsigned int first, unsigned int count);
+	void GetTriangleBounds(unsigned int triangle, DirectX::XMFLOAT3& boundsMin, DirectX::XMFLOAT3& boundsMax);
+};
\ No newline at end of file
@@ -0,0 +1,602 @@
+#include "OcclusionCulling.h"
+#include "JobSystem.h"
+#include "LinearArena.h"
+#include <algorithm>
+#include <cfloat>
+#include <chrono>
+#include <cmath>
+
+using namespace DirectX;
+
+OcclusionCulling::OcclusionCulling(unsigned int width, unsigned int height) :
+	occluderCount(0),
+	skippedOccluderCount(0),
+	triangleCount(0),
+	testedCount(0),
+	lastRasterTimeMs(0),
+	lastTestTimeMs(0)
+{
+	tilesX = (width + OCCLUSION_TILE_WIDTH - 1) / OCCLUSION_TILE_WIDTH;
+	tilesY = (height + OCCLUSION_TILE_HEIGHT - 1) / OCCLUSION_TILE_HEIGHT;
+	this->width = tilesX * OCCLUSION_TILE_WIDTH;
+	this->height = tilesY * OCCLUSION_TILE_HEIGHT;
+
+	depth.resize(tilesX * tilesY * OCCLUSION_TILE_SIZE, 1.0f);
+	tileMaxDepth.resize(tilesX * tilesY, 1.0f);
+	XMStoreFloat4x4(&viewProjection, XMMatrixIdentity());
+}
+
+// --------------------------------------------------------
+// Copies occluder geometry in for later use by AddOccluder()
+// --------------------------------------------------------
+unsigned int OcclusionCulling::AddOccluderShape(const XMFLOAT3* positions, unsigned int vertexCount, const unsigned int* indices, unsigned int indexCount)
+{
+	OccluderShape shape;
+	shape.firstVertex = (unsigned int)shapePositions.size();
+	shape.vertexCount = vertexCount;
+	shape.firstIndex = (unsigned int)shapeIndices.size();
+	shape.indexCount = indexCount - indexCount % 3;
+
+	shapePositions.insert(shapePositions.end(), positions, positions + vertexCount);
+	shapeIndices.insert(shapeIndices.end(), indices, indices + shape.indexCount);
+	shapes.push_back(shape);
+	return (unsigned int)shapes.size() - 1;
+}
+
+// --------------------------------------------------------
+// Adds a box shape, which is a good (and cheap) occluder
+// for anything that is itself roughly a box
+// --------------------------------------------------------
+unsigned int OcclusionCulling::AddOccluderBox(XMFLOAT3 boundsMin, XMFLOAT3 boundsMax)
+{
+	XMFLOAT3 corners[8];
+	for (unsigned int i = 0; i < 8; i++)
+	{
+		corners[i] = XMFLOAT3(
+			(i & 1) ? boundsMax.x : boundsMin.x,
+			(i & 2) ? boundsMax.y : boundsMin.y,
+			(i & 4) ? boundsMax.z : boundsMin.z);
+	}
+
+	// Two clockwise (seen from outside) triangles per face
+	unsigned int indices[36] =
+	{
+		0, 2, 3, 0, 3, 1,	// -Z
+		4, 5, 7, 4, 7, 6,	// +Z
+		0, 4, 6, 0, 6, 2,	// -X
+		1, 3, 7, 1, 7, 5,	// +X
+		0, 1, 5, 0, 5, 4,	// -Y
+		2, 6, 7, 2, 7, 3,	// +Y
+	};
+	return AddOccluderShape(corners, 8, indices, 36);
+}
+
+void OcclusionCulling::BeginFrame(XMFLOAT4X4 viewProjection)
+{
+	this->viewProjection = viewProjection;
+	occluders.clear();
+}
+
+// --------------------------------------------------------
+// Queues an occluder for this frame. Ones that were hidden last
+// frame are held back for the second pass, since something hidden
+// probably won't hide much else either.
+// --------------------------------------------------------
+void OcclusionCulling::AddOccluder(unsigned int id, unsigned int shape, XMFLOAT4X4 world, XMFLOAT4 sphere)
+{
+	if (shape >= shapes.size())
+		return;
+
+	// New occluders start out visible
+	if (id >= occluderWasVisible.size())
+		occluderWasVisible.resize(id + 1, 1);
+
+	Occluder occluder;
+	occluder.id = id;
+	occluder.shape = shape;
+	occluder.world = world;
+	occluder.sphere = sphere;
+	occluder.wasVisible = occluderWasVisible[id] != 0;
+	occluder.late = false;
+	occluders.push_back(occluder);
+}
+
+// --------------------------------------------------------
+// Draws the occluders that were visible last frame, then tests
+// the rest against that and draws the ones that show through.
+// Something newly in view (like the far side of a corner) is then
+// drawn this frame instead of next frame.
+// --------------------------------------------------------
+void OcclusionCulling::RasterizeOccluders()
+{
+	std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+
+	occluderCount = 0;
+	triangleCount = 0;
+	SetUpTriangles(false);
+	RasterizeTriangles(true);
+
+	bool anyLate = false;
+	for (Occluder& occluder : occluders)
+	{
+		occluder.late = !occluder.wasVisible && IsVisible(occluder.sphere);
+		anyLate = anyLate || occluder.late;
+	}
+	if (anyLate)
+	{
+		SetUpTriangles(true);
+		RasterizeTriangles(false);
+	}
+	skippedOccluderCount = (unsigned int)occluders.size() - occluderCount;
+
+	std::chrono::duration<double, std::milli> elapsed = std::chrono::high_resolution_clock::now() - start;
+	lastRasterTimeMs = elapsed.count();
+}
+
+// --------------------------------------------------------
+// Rasterizes the current triangles with each job owning a band
+// of tile rows, so no two jobs ever write to the same pixel and
+// no locking is needed
+// --------------------------------------------------------
+void OcclusionCulling::RasterizeTriangles(bool clear)
+{
+	// Not worth the jobs for a handful of triangles
+	unsigned int minRowsPerJob = triangles.size() < 64 ? tilesY : 1;
+	JobSystem::GetInstance().ParallelFor(0, tilesY, minRowsPerJob, [&](unsigned int first, unsigned int last)
+	{
+		RasterizeRows(first, last, clear);
+	});
+}
+
+// --------------------------------------------------------
+// Tests each candidate sphere against the depth buffer
+//
+// spheres - World space bounding spheres (xyz = center, w = radius)
+// candidates - Which spheres to test (usually what frustum culling kept)
+// candidateCount - Number of candidates
+// --------------------------------------------------------
+void OcclusionCulling::Cull(const XMFLOAT4* spheres, const unsigned int* candidates, unsigned int candidateCount)
+{
+	std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+
+	visible.clear();
+	for (unsigned int i = 0; i < candidateCount; i++)
+	{
+		if (IsVisible(spheres[candidates[i]]))
+			visible.push_back(candidates[i]);
+	}
+	testedCount = candidateCount;
+
+	UpdateOccluderVisibility();
+
+	std::chrono::duration<double, std::milli> elapsed = std::chrono::high_resolution_clock::now() - start;
+	lastTestTimeMs = elapsed.count();
+}
+
+// --------------------------------------------------------
+// Reference version of RasterizeOccluders() + Cull(): every
+// triangle covers pixels one at a time in a row major buffer,
+// and every sphere checks every pixel it covers.
+// Doesn't update which occluders were visible.
+// --------------------------------------------------------
+void OcclusionCulling::CullBruteForce(const XMFLOAT4* spheres, const unsigned int* candidates, unsigned int candidateCount)
+{
+	std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+
+	occluderCount = 0;
+	triangleCount = 0;
+	referenceDepth.assign((size_t)width * height, 1.0f);
+	SetUpTriangles(false);
+	RasterizeTrianglesBruteForce();
+
+	for (Occluder& occluder : occluders)
+		occluder.late = !occluder.wasVisible && IsVisibleBruteForce(occluder.sphere);
+	SetUpTriangles(true);
+	RasterizeTrianglesBruteForce();
+	skippedOccluderCount = (unsigned int)occluders.size() - occluderCount;
+
+	std::chrono::duration<double, std::milli> elapsed = std::chrono::high_resolution_clock::now() - start;
+	lastRasterTimeMs = elapsed.count();
+	start = std::chrono::high_resolution_clock::now();
+
+	visible.clear();
+	for (unsigned int i = 0; i < candidateCount; i++)
+	{
+		if (IsVisibleBruteForce(spheres[candidates[i]]))
+			visible.push_back(candidates[i]);
+	}
+	testedCount = candidateCount;
+
+	elapsed = std::chrono::high_resolution_clock::now() - start;
+	lastTestTimeMs = elapsed.count();
+}
+
+// --------------------------------------------------------
+// Runs both versions on this frame's occluders and compares
+// their visible lists (leaves the brute force results behind)
+// --------------------------------------------------------
+bool OcclusionCulling::VerifyAgainstBruteForce(const XMFLOAT4* spheres, const unsigned int* candidates, unsigned int candidateCount)
+{
+	RasterizeOccluders();
+	Cull(spheres, candidates, candidateCount);
+	std::vector<unsigned int> fast = visible;
+	CullBruteForce(spheres, candidates, candidateCount);
+	return fast == visible;
+}
+
+// --------------------------------------------------------
+// Checks the tiles under the sphere first, and only looks at
+// pixels in tiles that aren't entirely in front of it
+// --------------------------------------------------------
+bool OcclusionCulling::IsVisible(XMFLOAT4 sphere)
+{
+	ScreenRect rect;
+	if (!GetScreenRect(sphere, rect))
+		return true;
+	if (rect.minX > rect.maxX || rect.minY > rect.maxY)
+		return false;
+
+	XMVECTOR nearest = XMVectorReplicate(rect.nearestDepth);
+	XMVECTOR laneX = XMVectorSet(0, 1, 2, 3);
+	XMVECTOR rectMinX = XMVectorReplicate((float)rect.minX);
+	XMVECTOR rectMaxX = XMVectorReplicate((float)rect.maxX);
+
+	int firstTileX = rect.minX / OCCLUSION_TILE_WIDTH;
+	int lastTileX = rect.maxX / OCCLUSION_TILE_WIDTH;
+	int firstTileY = rect.minY / OCCLUSION_TILE_HEIGHT;
+	int lastTileY = rect.maxY / OCCLUSION_TILE_HEIGHT;
+	for (int tileY = firstTileY; tileY <= lastTileY; tileY++)
+	{
+		for (int tileX = firstTileX; tileX <= lastTileX; tileX++)
+		{
+			// Everything in this tile is in front of the sphere
+			unsigned int tile = tileY * tilesX + tileX;
+			if (tileMaxDepth[tile] < rect.nearestDepth)
+				continue;
+
+			// Check the pixels of the tile that are inside the rect, four at a time
+			const float* tileDepth = &depth[(size_t)tile * OCCLUSION_TILE_SIZE];
+			int firstRow = std::max(rect.minY - tileY * OCCLUSION_TILE_HEIGHT, 0);
+			int lastRow = std::min(rect.maxY - tileY * OCCLUSION_TILE_HEIGHT, OCCLUSION_TILE_HEIGHT - 1);
+			for (int half = 0; half < OCCLUSION_TILE_WIDTH; half += 4)
+			{
+				XMVECTOR x = XMVectorAdd(laneX, XMVectorReplicate((float)(tileX * OCCLUSION_TILE_WIDTH + half)));
+				XMVECTOR inRect = XMVectorAndInt(XMVectorGreaterOrEqual(x, rectMinX), XMVectorLessOrEqual(x, rectMaxX));
+				for (int row = firstRow; row <= lastRow; row++)
+				{
+					XMVECTOR pixels = XMLoadFloat4((const XMFLOAT4*)&tileDepth[row * OCCLUSION_TILE_WIDTH + half]);
+					if (_mm_movemask_ps(XMVectorAndInt(XMVectorGreaterOrEqual(pixels, nearest), inRect)))
+						return true;
+				}
+			}
+		}
+	}
+	return false;
+}
+
+const std::vector<unsigned int>& OcclusionCulling::GetVisible()
+{
+	return visible;
+}
+
+void OcclusionCulling::Reserve(unsigned int objectCount)
+{
+	visible.reserve(objectCount);
+}
+
+unsigned int OcclusionCulling::GetWidth()
+{
+	return width;
+}
+
+unsigned int OcclusionCulling::GetHeight()
+{
+	return height;
+}
+
+unsigned int OcclusionCulling::GetOccluderCount()
+{
+	return occluderCount;
+}
+
+unsigned int OcclusionCulling::GetSkippedOccluderCount()
+{
+	return skippedOccluderCount;
+}
+
+unsigned int OcclusionCulling::GetTriangleCount()
+{
+	return triangleCount;
+}
+
+unsigned int OcclusionCulling::GetTestedCount()
+{
+	return testedCount;
+}
+
+unsigned int OcclusionCulling::GetVisibleCount()
+{
+	return (unsigned int)visible.size();
+}
+
+double OcclusionCulling::GetLastRasterTimeMs()
+{
+	return lastRasterTimeMs;
+}
+
+double OcclusionCulling::GetLastTestTimeMs()
+{
+	return lastTestTimeMs;
+}
+
+// --------------------------------------------------------
+// Projects every triangle of the occluders in one pass (the ones
+// visible last frame, or the late ones), keeping the front facing
+// ones that are on screen
+// --------------------------------------------------------
+void OcclusionCulling::SetUpTriangles(bool lateOccluders)
+{
+	triangles.clear();
+
+	XMMATRIX viewProj = XMLoadFloat4x4(&viewProjection);
+	for (const Occluder& occluder : occluders)
+	{
+		if (lateOccluders ? !occluder.late : !occluder.wasVisible)
+			continue;
+		occluderCount++;
+
+		const OccluderShape& shape = shapes[occluder.shape];
+		XMMATRIX worldViewProj = XMMatrixMultiply(XMLoadFloat4x4(&occluder.world), viewProj);
+		ScratchScope scratch;
+		XMFLOAT4* clip = scratch.AllocateArray<XMFLOAT4>(shape.vertexCount);
+		for (unsigned int v = 0; v < shape.vertexCount; v++)
+			XMStoreFloat4(&clip[v], XMVector3Transform(XMLoadFloat3(&shapePositions[shape.firstVertex + v]), worldViewProj));
+
+		for (unsigned int i = 0; i < shape.indexCount; i += 3)
+		{
+			const unsigned int* index = &shapeIndices[shape.firstIndex + i];
+			float x[3], y[3], z[3];
+			bool clipped = false;
+			for (int v = 0; v < 3; v++)
+			{
+				// Triangles crossing the near plane are just left out, which
+				// only ever means less is culled
+				const XMFLOAT4& c = clip[index[v]];
+				if (c.w <= 0 || c.z < 0)
+				{
+					clipped = true;
+					break;
+				}
+				x[v] = (c.x / c.w * 0.5f + 0.5f) * width;
+				y[v] = (0.5f - c.y / c.w * 0.5f) * height;
+				z[v] = c.z / c.w;
+			}
+			if (clipped)
+				continue;
+
+			// Clockwise on screen (y down) is front facing
+			float area = (x[1] - x[0]) * (y[2] - y[0]) - (x[2] - x[0]) * (y[1] - y[0]);
+			if (area <= 0)
+				continue;
+
+			ScreenTriangle triangle;
+			triangle.minX = std::max((int)floorf(std::min(x[0], std::min(x[1], x[2]))), 0);
+			triangle.maxX = std::min((int)ceilf(std::max(x[0], std::max(x[1], x[2]))), (int)width - 1);
+			triangle.minY = std::max((int)floorf(std::min(y[0], std::min(y[1], y[2]))), 0);
+			triangle.maxY = std::min((int)ceilf(std::max(y[0], std::max(y[1], y[2]))), (int)height - 1);
+			if (triangle.minX > triangle.maxX || triangle.minY > triangle.maxY)
+				continue;
+
+			// Edge from vertex e to the next one
+			for (int e = 0; e < 3; e++)
+			{
+				int next = (e + 1) % 3;
+				triangle.edgeA[e] = y[e] - y[next];
+				triangle.edgeB[e] = x[next] - x[e];
+				triangle.edgeC[e] = x[e] * y[next] - x[next] * y[e];
+			}
+
+			// Depth as a plane in screen space, pushed back to the farthest
+			// it gets anywhere in a pixel so it never hides too much
+			float dz1 = z[1] - z[0];
+			float dz2 = z[2] - z[0];
+			triangle.depthA = (dz1 * (y[2] - y[0]) - dz2 * (y[1] - y[0])) / area;
+			triangle.depthB = (dz2 * (x[1] - x[0]) - dz1 * (x[2] - x[0])) / area;
+			triangle.depthC = z[0] - triangle.depthA * x[0] - triangle.depthB * y[0] +
+				0.5f * (fabsf(triangle.depthA) + fabsf(triangle.depthB));
+			triangles.push_back(triangle);
+		}
+	}
+}
+
+// --------------------------------------------------------
+// Rasterizes tile rows [firstTileRow, lastTileRow) four pixels
+// at a time (after clearing them, if asked), then updates the
+// tiles' farthest depths
+// --------------------------------------------------------
+void OcclusionCulling::RasterizeRows(unsigned int firstTileRow, unsigned int lastTileRow, bool clear)
+{
+	float* bandDepth = &depth[(size_t)firstTileRow * tilesX * OCCLUSION_TILE_SIZE];
+	if (clear)
+		std::fill(bandDepth, bandDepth + (size_t)(lastTileRow - firstTileRow) * tilesX * OCCLUSION_TILE_SIZE, 1.0f);
+
+	int bandMinY = firstTileRow * OCCLUSION_TILE_HEIGHT;
+	int bandMaxY = lastTileRow * OCCLUSION_TILE_HEIGHT - 1;
+	XMVECTOR pixelOffsets = XMVectorSet(0.5f, 1.5f, 2.5f, 3.5f);
+	for (const ScreenTriangle& triangle : triangles)
+	{
+		int minY = std::max(triangle.minY, bandMinY);
+		int maxY = std::min(triangle.maxY, bandMaxY);
+		if (minY > maxY)
+			continue;
+
+		XMVECTOR edgeA[3], edgeB[3], edgeC[3];
+		for (int e = 0; e < 3; e++)
+		{
+			edgeA[e] = XMVectorReplicate(triangle.edgeA[e]);
+			edgeB[e] = XMVectorReplicate(triangle.edgeB[e]);
+			edgeC[e] = XMVectorReplicate(triangle.edgeC[e]);
+		}
+		XMVECTOR depthA = XMVectorReplicate(triangle.depthA);
+		XMVECTOR depthB = XMVectorReplicate(triangle.depthB);
+		XMVECTOR depthC = XMVectorReplicate(triangle.depthC);
+
+		// Groups of four start on a multiple of four, so they never straddle tiles
+		int firstX = triangle.minX & ~3;
+		for (int y = minY; y <= maxY; y++)
+		{
+			XMVECTOR py = XMVectorReplicate(y + 0.5f);
+			XMVECTOR rowEdge[3];
+			for (int e = 0; e < 3; e++)
+				rowEdge[e] = XMVectorAdd(XMVectorMultiply(edgeB[e], py), edgeC[e]);
+			XMVECTOR rowDepth = XMVectorAdd(XMVectorMultiply(depthB, py), depthC);
+
+			unsigned int tileRowStart = (y / OCCLUSION_TILE_HEIGHT) * tilesX;
+			unsigned int rowInTile = (y % OCCLUSION_TILE_HEIGHT) * OCCLUSION_TILE_WIDTH;
+			for (int x = firstX; x <= triangle.maxX; x += 4)
+			{
+				XMVECTOR px = XMVectorAdd(XMVectorReplicate((float)x), pixelOffsets);
+				XMVECTOR inside = XMVectorGreaterOrEqual(XMVectorAdd(XMVectorMultiply(edgeA[0], px), rowEdge[0]), XMVectorZero());
+				inside = XMVectorAndInt(inside, XMVectorGreaterOrEqual(XMVectorAdd(XMVectorMultiply(edgeA[1], px), rowEdge[1]), XMVectorZero()));
+				inside = XMVectorAndInt(inside, XMVectorGreaterOrEqual(XMVectorAdd(XMVectorMultiply(edgeA[2], px), rowEdge[2]), XMVectorZero()));
+				if (_mm_movemask_ps(inside) == 0)
+					continue;
+
+				float* pixels = &depth[(size_t)(tileRowStart + x / OCCLUSION_TILE_WIDTH) * OCCLUSION_TILE_SIZE + rowInTile + x % OCCLUSION_TILE_WIDTH];
+				XMVECTOR stored = XMLoadFloat4((const XMFLOAT4*)pixels);
+				XMVECTOR pixelDepth = XMVectorAdd(XMVectorMultiply(depthA, px), rowDepth);
+				XMStoreFloat4((XMFLOAT4*)pixels, XMVectorSelect(stored, XMVectorMin(stored, pixelDepth), inside));
+			}
+		}
+	}
+
+	// Coarse level: the farthest depth in each tile
+	for (unsigned int tile = firstTileRow * tilesX; tile < lastTileRow * tilesX; tile++)
+	{
+		const float* tileDepth = &depth[(size_t)tile * OCCLUSION_TILE_SIZE];
+		XMVECTOR farthest = XMLoadFloat4((const XMFLOAT4*)tileDepth);
+		for (unsigned int i = 4; i < OCCLUSION_TILE_SIZE; i += 4)
+			farthest = XMVectorMax(farthest, XMLoadFloat4((const XMFLOAT4*)&tileDepth[i]));
+
+		XMFLOAT4 lanes;
+		XMStoreFloat4(&lanes, farthest);
+		tileMaxDepth[tile] = std::max(std::max(lanes.x, lanes.y), std::max(lanes.z, lanes.w));
+	}
+}
+
+// --------------------------------------------------------
+// Finds the pixels a sphere could cover and the nearest depth
+// it could have, from the eight corners of its bounding box
+//
+// Returns false if the box crosses the near plane, in which case
+// the sphere has to be treated as visible. The rect is empty if
+// the sphere is entirely off screen.
+// --------------------------------------------------------
+bool OcclusionCulling::GetScreenRect(XMFLOAT4 sphere, ScreenRect& rect)
+{
+	// The projection is linear, so the corners are the projected center
+	// plus or minus the projected radius along each axis
+	XMMATRIX viewProj = XMLoadFloat4x4(&viewProjection);
+	XMVECTOR radius = XMVectorReplicate(sphere.w);
+	XMVECTOR center = XMVector3Transform(XMVectorSet(sphere.x, sphere.y, sphere.z, 1), viewProj);
+	XMVECTOR axisX = XMVectorMultiply(viewProj.r[0], radius);
+	XMVECTOR axisY = XMVectorMultiply(viewProj.r[1], radius);
+	XMVECTOR axisZ = XMVectorMultiply(viewProj.r[2], radius);
+
+	XMVECTOR screenMin = XMVectorReplicate(FLT_MAX);
+	XMVECTOR screenMax = XMVectorReplicate(-FLT_MAX);
+	for (int i = 0; i < 8; i++)
+	{
+		XMVECTOR corner = center;
+		corner = (i & 1) ? XMVectorAdd(corner, axisX) : XMVectorSubtract(corner, axisX);
+		corner = (i & 2) ? XMVectorAdd(corner, axisY) : XMVectorSubtract(corner, axisY);
+		corner = (i & 4) ? XMVectorAdd(corner, axisZ) : XMVectorSubtract(corner, axisZ);
+
+		XMVECTOR w = XMVectorSplatW(corner);
+		if (XMVectorGetX(w) <= 0 || XMVectorGetZ(corner) < 0)
+			return false;
+
+		XMVECTOR projected = XMVectorDivide(corner, w);
+		screenMin = XMVectorMin(screenMin, projected);
+		screenMax = XMVectorMax(screenMax, projected);
+	}
+
+	XMFLOAT4 ndcMin, ndcMax;
+	XMStoreFloat4(&ndcMin, screenMin);
+	XMStoreFloat4(&ndcMax, screenMax);
+
+	// Every pixel the rect touches at all (y flips going to the screen), plus
+	// one more all round: occluders cover whole pixels when they cover the
+	// center, so an edge pixel can be marked covered when part of it isn't
+	rect.minX = std::max((int)floorf((ndcMin.x * 0.5f + 0.5f) * width) - 1, 0);
+	rect.maxX = std::min((int)floorf((ndcMax.x * 0.5f + 0.5f) * width) + 1, (int)width - 1);
+	rect.minY = std::max((int)floorf((0.5f - ndcMax.y * 0.5f) * height) - 1, 0);
+	rect.maxY = std::min((int)floorf((0.5f - ndcMin.y * 0.5f) * height) + 1, (int)height - 1);
+	rect.nearestDepth = ndcMin.z;
+	return true;
+}
+
+// --------------------------------------------------------
+// Covers the current triangles' pixels one at a time in the
+// reference buffer
+// --------------------------------------------------------
+void OcclusionCulling::RasterizeTrianglesBruteForce()
+{
+	for (const ScreenTriangle& triangle : triangles)
+	{
+		for (int y = triangle.minY; y <= triangle.maxY; y++)
+		{
+			float py = y + 0.5f;
+			for (int x = triangle.minX; x <= triangle.maxX; x++)
+			{
+				// Same order of operations as the SIMD version
+				float px = x + 0.5f;
+				bool inside = true;
+				for (int e = 0; e < 3; e++)
+					inside = inside && triangle.edgeA[e] * px + (triangle.edgeB[e] * py + triangle.edgeC[e]) >= 0;
+				if (!inside)
+					continue;
+
+				float pixelDepth = triangle.depthA * px + (triangle.depthB * py + triangle.depthC);
+				float& stored = referenceDepth[(size_t)y * width + x];
+				stored = std::min(stored, pixelDepth);
+			}
+		}
+	}
+}
+
+// --------------------------------------------------------
+// Checks every pixel under the sphere in the reference buffer
+// --------------------------------------------------------
+bool OcclusionCulling::IsVisibleBruteForce(XMFLOAT4 sphere)
+{
+	ScreenRect rect;
+	if (!GetScreenRect(sphere, rect))
+		return true;
+
+	for (int y = rect.minY; y <= rect.maxY; y++)
+	{
+		for (int x = rect.minX; x <= rect.maxX; x++)
+		{
+			if (referenceDepth[(size_t)y * width + x] >= rect.nearestDepth)
+				return true;
+		}
+	}
+	return false;
+}
+
+// --------------------------------------------------------
+// Remembers which occluders are hidden behind others, to decide
+// which ones are worth drawing next frame
+// --------------------------------------------------------
+void OcclusionCulling::UpdateOccluderVisibility()
+{
+	for (const Occluder& occluder : occluders)
+	{
+		// Off screen isn't the same as hidden: the camera could turn to
+		// face it next frame, when it would matter most
+		ScreenRect rect;
+		bool offScreen = GetScreenRect(occluder.sphere, rect) && (rect.minX > rect.maxX || rect.minY > rect.maxY);
+		occluderWasVisible[occluder.id] = offScreen || IsVisible(occluder.sphere) ? 1 : 0;
+	}
+}
\ No newline at end of file
@@ -0,0 +1,166 @@
+#pragma once
+#include <DirectXMath.h>
+#include <vector>
+
+// Pixels per depth buffer tile. Tiles are stored one after another
+// (row major inside), so a tile row is two SSE registers and the
+// coarse level of the hierarchy keeps one value per tile.
+#define OCCLUSION_TILE_WIDTH 8
+#define OCCLUSION_TILE_HEIGHT 4
+#define OCCLUSION_TILE_SIZE (OCCLUSION_TILE_WIDTH * OCCLUSION_TILE_HEIGHT)
+
+// --------------------------------------------------------
+// Software occlusion culling. A few big, simple occluder meshes are
+// rasterized on the CPU into a small depth buffer, and object bounding
+// spheres are then tested against it so hidden objects never reach
+// the GPU.
+//
+// The depth buffer has two levels: the depth of every pixel, and the
+// farthest depth in each tile. Most tests are decided by the tiles.
+//
+// Depth is 0 at the near plane and 1 at the far plane (like D3D), and
+// written depths are pushed to the farthest point of each pixel, so
+// objects are only culled when they're behind an occluder (to within
+// a pixel of the buffer).
+//
+// Occluders that were hidden last frame are drawn in a second pass,
+// and only if the first pass didn't hide them again. Most frames that
+// second pass is empty, and the result is the same as drawing them all.
+// --------------------------------------------------------
+class OcclusionCulling
+{
+public:
+	// Width and height are rounded up to whole tiles
+	OcclusionCulling(unsigned int width = 320, unsigned int height = 192);
+
+	// Occluder geometry in local space. Front faces are clockwise, like the
+	// rest of the renderer, and back faces are skipped when rasterizing.
+	// Returns the shape's index for AddOccluder()
+	unsigned int AddOccluderShape(const DirectX::XMFLOAT3* positions, unsigned int vertexCount, const unsigned int* indices, unsigned int indexCount);
+	unsigned int AddOccluderBox(DirectX::XMFLOAT3 boundsMin, DirectX::XMFLOAT3 boundsMax);
+
+	// Starts a frame: clears the occluder list for this camera
+	void BeginFrame(DirectX::XMFLOAT4X4 viewProjection);
+
+	// id - Stable number for this occluder (like its entity index), used to
+	//      remember whether it was visible last frame
+	// sphere - World space bounds of the occluder
+	void AddOccluder(unsigned int id, unsigned int shape, DirectX::XMFLOAT4X4 world, DirectX::XMFLOAT4 sphere);
+
+	// Draws the occluders into the depth buffer, split across threads: first
+	// the ones visible last frame, then any of the others they don't hide
+	void RasterizeOccluders();
+
+	// Tests spheres[candidates[i]] and keeps the indices of those that could
+	// be visible (in the same order). Also decides which occluders to draw
+	// first next frame.
+	void Cull(const DirectX::XMFLOAT4* spheres, const unsigned int* candidates, unsigned int candidateCount);
+
+	// Same as RasterizeOccluders() + Cull(), but filling a plain row major
+	// depth buffer a pixel at a time and checking every pixel under each
+	// sphere, with no tiles or coarse depth to get wrong
+	void CullBruteForce(const DirectX::XMFLOAT4* spheres, const unsigned int* candidates, unsigned int candidateCount);
+
+	// Culls with both methods and checks the visible lists are the same
+	bool VerifyAgainstBruteForce(const DirectX::XMFLOAT4* spheres, const unsigned int* candidates, unsigned int candidateCount);
+
+	// Could any of this sphere be seen past the occluders?
+	bool IsVisible(DirectX::XMFLOAT4 sphere);
+
+	// Results of the last Cull()
+	const std::vector<unsigned int>& GetVisible();
+
+	// Makes room for this many candidates (call when the object count
+	// changes, outside any ZERO_ALLOCATIONS scope)
+	void Reserve(unsigned int objectCount);
+
+	unsigned int GetWidth();
+	unsigned int GetHeight();
+
+	// Stats
+	unsigned int GetOccluderCount();
+	unsigned int GetSkippedOccluderCount();
+	unsigned int GetTriangleCount();
+	unsigned int GetTestedCount();
+	unsigned int GetVisibleCount();
+	double GetLastRasterTimeMs();
+	double GetLastTestTimeMs();
+
+private:
+	struct OccluderShape
+	{
+		unsigned int firstVertex;
+		unsigned int vertexCount;
+		unsigned int firstIndex;
+		unsigned int indexCount;
+	};
+
+	struct Occluder
+	{
+		unsigned int id;
+		unsigned int shape;
+		DirectX::XMFLOAT4X4 world;
+		DirectX::XMFLOAT4 sphere;
+		bool wasVisible;	// Drawn in the first pass
+		bool late;			// Hidden last frame, but not by the first pass
+	};
+
+	// A triangle ready to rasterize: edge equations (inside where all
+	// three are >= 0), a depth plane and a pixel bounding box
+	struct ScreenTriangle
+	{
+		float edgeA[3];
+		float edgeB[3];
+		float edgeC[3];
+		float depthA;
+		float depthB;
+		float depthC;
+		int minX;
+		int maxX;
+		int minY;
+		int maxY;
+	};
+
+	// Where a sphere lands on screen, in pixels
+	struct ScreenRect
+	{
+		int minX;
+		int maxX;
+		int minY;
+		int maxY;
+		float nearestDepth;
+	};
+
+	unsigned int width;
+	unsigned int height;
+	unsigned int tilesX;
+	unsigned int tilesY;
+	std::vector<float> depth;           // Tile after tile
+	std::vector<float> tileMaxDepth;    // Farthest depth in each tile
+	std::vector<float> referenceDepth;  // Row major, for CullBruteForce()
+
+	std::vector<DirectX::XMFLOAT3> shapePositions;
+	std::vector<unsigned int> shapeIndices;
+	std::vector<OccluderShape> shapes;
+
+	DirectX::XMFLOAT4X4 viewProjection;
+	std::vector<Occluder> occluders;
+	std::vector<ScreenTriangle> triangles;
+	std::vector<unsigned char> occluderWasVisible;  // By occluder id
+
+	std::vector<unsigned int> visible;
+	unsigned int occluderCount;
+	unsigned int skippedOccluderCount;
+	unsigned int triangleCount;
+	unsigned int testedCount;
+	double lastRasterTimeMs;
+	double lastTestTimeMs;
+
+	void SetUpTriangles(bool lateOccluders);
+	void RasterizeTriangles(bool clear);
+	void RasterizeRows(unsigned int firstTileRow, unsigned int lastTileRow, bool clear);
+	void RasterizeTrianglesBruteForce();
+	bool GetScreenRect(DirectX::XMFLOAT4 sphere, ScreenRect& rect);
+	bool IsVisibleBruteForce(DirectX::XMFLOAT4 sphere);
+	void UpdateOccluderVisibility();
+};
\ No newline at end of file
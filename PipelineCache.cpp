@@ -0,0 +1,485 @@
+#include "PipelineCache.h"
+#include "Profiler.h"
+#include <fstream>
+
+#define FNV_PRIME 1099511628211ULL
+
+PipelineCache::PipelineCache() :
+	libraryDirty(false),
+	stopCompileThread(false),
+	memoryHits(0),
+	libraryHits(0),
+	compileCount(0)
+{
+}
+
+PipelineCache::~PipelineCache()
+{
+	Shutdown();
+}
+
+// --------------------------------------------------------
+// Sets up the cache with the device and attempts to load a
+// previously saved pipeline library from disk.
+//
+// device - The device to compile pipelines with
+// cacheFile - Full path of the library file to load and save
+// --------------------------------------------------------
+void PipelineCache::Initialize(Microsoft::WRL::ComPtr<ID3D12Device> device, const std::wstring& cacheFile)
+{
+	this->device = device;
+	this->cacheFile = cacheFile;
+
+	// Pipeline libraries need a newer device interface. If that's
+	// unavailable, we simply run with an in-memory cache only.
+	Microsoft::WRL::ComPtr<ID3D12Device1> device1;
+	if (SUCCEEDED(device.As(&device1)))
+	{
+		// Read the whole file (if it exists)
+		std::ifstream file(cacheFile, std::ios::binary | std::ios::ate);
+		if (file.is_open())
+		{
+			std::streamsize size = file.tellg();
+			file.seekg(0, std::ios::beg);
+			libraryBlob.resize((size_t)size);
+			if (size > 0)
+				file.read(&libraryBlob[0], size);
+		}
+
+		// A library saved by another driver or GPU will fail to load,
+		// in which case we throw the old data out and start fresh
+		HRESULT hr = E_FAIL;
+		if (libraryBlob.size() > 0)
+		{
+			hr = device1->CreatePipelineLibrary(
+				&libraryBlob[0],
+				libraryBlob.size(),
+				IID_PPV_ARGS(library.GetAddressOf()));
+		}
+		if (FAILED(hr))
+		{
+			libraryBlob.clear();
+			device1->CreatePipelineLibrary(0, 0, IID_PPV_ARGS(library.GetAddressOf()));
+		}
+	}
+
+	// Start the background compiler
+	stopCompileThread = false;
+	compileThread = std::thread(&PipelineCache::CompileThreadMain, this);
+}
+
+// --------------------------------------------------------
+// Stops the compile thread (dropping anything still queued)
+// and saves the library. Safe to call more than once.
+// --------------------------------------------------------
+void PipelineCache::Shutdown()
+{
+	{
+		std::lock_guard<std::mutex> lock(entryMutex);
+		stopCompileThread = true;
+	}
+	compileSignal.notify_all();
+	if (compileThread.joinable())
+		compileThread.join();
+
+	for (size_t i = 0; i < compileQueue.size(); i++)
+		delete compileQueue[i];
+	compileQueue.clear();
+
+	Save();
+}
+
+// --------------------------------------------------------
+// FNV-1a hash of a chunk of memory
+//
+// data - The bytes to hash
+// size - How many bytes to hash
+// seed - Previous hash value, for chaining several hashes together
+// --------------------------------------------------------
+unsigned long long PipelineCache::HashBytes(const void* data, size_t size, unsigned long long seed)
+{
+	unsigned long long hash = seed;
+	const unsigned char* bytes = (const unsigned char*)data;
+	for (size_t i = 0; i < size; i++)
+	{
+		hash ^= bytes[i];
+		hash *= FNV_PRIME;
+	}
+	return hash;
+}
+
+// --------------------------------------------------------
+// Hashes every field of a pipeline description that affects the
+// compiled result. Pointers are followed (shader bytecode, input
+// layout) and structs are hashed field by field so padding bytes
+// never change the key.
+//
+// desc - The full pipeline description
+// rootSignatureHash - Hash of the serialized root signature, since
+//                     the root signature object itself can't be read back
+// --------------------------------------------------------
+unsigned long long PipelineCache::HashPipelineDesc(const D3D12_GRAPHICS_PIPELINE_STATE_DESC& desc, unsigned long long rootSignatureHash)
+{
+	unsigned long long h = rootSignatureHash;
+#define HASH_VALUE(v) h = HashBytes(&(v), sizeof(v), h)
+
+	// Shaders
+	const D3D12_SHADER_BYTECODE* shaders[] = { &desc.VS, &desc.PS, &desc.DS, &desc.HS, &desc.GS };
+	for (int i = 0; i < 5; i++)
+	{
+		SIZE_T length = shaders[i]->BytecodeLength;
+		HASH_VALUE(length);
+		if (shaders[i]->pShaderBytecode)
+			h = HashBytes(shaders[i]->pShaderBytecode, length, h);
+	}
+	HASH_VALUE(desc.StreamOutput.NumEntries);
+	HASH_VALUE(desc.StreamOutput.RasterizedStream);
+
+	// Blend state
+	HASH_VALUE(desc.BlendState.AlphaToCoverageEnable);
+	HASH_VALUE(desc.BlendState.IndependentBlendEnable);
+	for (int i = 0; i < 8; i++)
+	{
+		const D3D12_RENDER_TARGET_BLEND_DESC& rt = desc.BlendState.RenderTarget[i];
+		HASH_VALUE(rt.BlendEnable);
+		HASH_VALUE(rt.LogicOpEnable);
+		HASH_VALUE(rt.SrcBlend);
+		HASH_VALUE(rt.DestBlend);
+		HASH_VALUE(rt.BlendOp);
+		HASH_VALUE(rt.SrcBlendAlpha);
+		HASH_VALUE(rt.DestBlendAlpha);
+		HASH_VALUE(rt.BlendOpAlpha);
+		HASH_VALUE(rt.LogicOp);
+		HASH_VALUE(rt.RenderTargetWriteMask);
+	}
+	HASH_VALUE(desc.SampleMask);
+
+	// Rasterizer state has no padding, so it can go in one piece
+	HASH_VALUE(desc.RasterizerState);
+
+	// Depth stencil state
+	HASH_VALUE(desc.DepthStencilState.DepthEnable);
+	HASH_VALUE(desc.DepthStencilState.DepthWriteMask);
+	HASH_VALUE(desc.DepthStencilState.DepthFunc);
+	HASH_VALUE(desc.DepthStencilState.StencilEnable);
+	HASH_VALUE(desc.DepthStencilState.StencilReadMask);
+	HASH_VALUE(desc.DepthStencilState.StencilWriteMask);
+	HASH_VALUE(desc.DepthStencilState.FrontFace);
+	HASH_VALUE(desc.DepthStencilState.BackFace);
+
+	// Input layout
+	HASH_VALUE(desc.InputLayout.NumElements);
+	for (unsigned int i = 0; i < desc.InputLayout.NumElements; i++)
+	{
+		const D3D12_INPUT_ELEMENT_DESC& e = desc.InputLayout.pInputElementDescs[i];
+		if (e.SemanticName)
+			h = HashBytes(e.SemanticName, strlen(e.SemanticName), h);
+		HASH_VALUE(e.SemanticIndex);
+		HASH_VALUE(e.Format);
+		HASH_VALUE(e.InputSlot);
+		HASH_VALUE(e.AlignedByteOffset);
+		HASH_VALUE(e.InputSlotClass);
+		HASH_VALUE(e.InstanceDataStepRate);
+	}
+
+	// Everything else
+	HASH_VALUE(desc.IBStripCutValue);
+	HASH_VALUE(desc.PrimitiveTopologyType);
+	HASH_VALUE(desc.NumRenderTargets);
+	for (int i = 0; i < 8; i++)
+		HASH_VALUE(desc.RTVFormats[i]);
+	HASH_VALUE(desc.DSVFormat);
+	HASH_VALUE(desc.SampleDesc);
+	HASH_VALUE(desc.NodeMask);
+	HASH_VALUE(desc.Flags);
+
+#undef HASH_VALUE
+	return h;
+}
+
+// --------------------------------------------------------
+// Turns a key into the name used inside the pipeline library
+// --------------------------------------------------------
+std::wstring PipelineCache::KeyToName(unsigned long long key)
+{
+	wchar_t name[17] = {};
+	swprintf_s(name, L"%016llX", key);
+	return std::wstring(name);
+}
+
+// --------------------------------------------------------
+// Gets a pipeline right now, compiling it if necessary.
+// Use this for pipelines that everything else falls back to.
+// --------------------------------------------------------
+Microsoft::WRL::ComPtr<ID3D12PipelineState> PipelineCache::GetPipeline(
+	const D3D12_GRAPHICS_PIPELINE_STATE_DESC& desc,
+	unsigned long long rootSignatureHash)
+{
+	unsigned long long key = HashPipelineDesc(desc, rootSignatureHash);
+
+	bool existed = false;
+	PipelineHandle handle = FindOrAddEntry(key, 0, existed);
+	{
+		// If another thread is already compiling it, wait for that instead
+		std::unique_lock<std::mutex> lock(entryMutex);
+		compileDone.wait(lock, [&] { return entries[handle].ready || !entries[handle].compiling; });
+		if (entries[handle].ready)
+			return entries[handle].pipeline;
+		entries[handle].compiling = true;
+	}
+
+	// Not ready (or brand new), so compile it on this thread. If it's
+	// also queued, the compile thread will see it's claimed and skip it.
+	Microsoft::WRL::ComPtr<ID3D12PipelineState> pipeline = CompilePipeline(desc, key);
+	{
+		std::lock_guard<std::mutex> lock(entryMutex);
+		entries[handle].pipeline = pipeline;
+		entries[handle].ready = true;
+		entries[handle].compiling = false;
+	}
+	compileDone.notify_all();
+	return pipeline;
+}
+
+// --------------------------------------------------------
+// Queues a pipeline for compilation on the background thread
+//
+// desc - The full pipeline description (copied, so it needn't stay alive)
+// rootSignatureHash - Hash of the serialized root signature
+// placeholder - Pipeline to use until this one is ready
+//
+// Returns a handle that can be resolved every frame with GetPipeline()
+// --------------------------------------------------------
+PipelineHandle PipelineCache::RequestPipeline(
+	const D3D12_GRAPHICS_PIPELINE_STATE_DESC& desc,
+	unsigned long long rootSignatureHash,
+	Microsoft::WRL::ComPtr<ID3D12PipelineState> placeholder)
+{
+	unsigned long long key = HashPipelineDesc(desc, rootSignatureHash);
+
+	bool existed = false;
+	PipelineHandle handle = FindOrAddEntry(key, placeholder, existed);
+	if (existed)
+		return handle;
+
+	// Deep copy everything the description points to
+	PendingCompile* pending = new PendingCompile();
+	pending->handle = handle;
+	pending->desc = desc;
+	pending->rootSignature = desc.pRootSignature;
+
+	D3D12_SHADER_BYTECODE* shaders[] = { &pending->desc.VS, &pending->desc.PS, &pending->desc.DS, &pending->desc.HS, &pending->desc.GS };
+	for (int i = 0; i < 5; i++)
+	{
+		if (!shaders[i]->pShaderBytecode || shaders[i]->BytecodeLength == 0)
+			continue;
+		const unsigned char* start = (const unsigned char*)shaders[i]->pShaderBytecode;
+		pending->shaderBytes[i].assign(start, start + shaders[i]->BytecodeLength);
+		shaders[i]->pShaderBytecode = &pending->shaderBytes[i][0];
+	}
+
+	pending->inputElements.assign(
+		desc.InputLayout.pInputElementDescs,
+		desc.InputLayout.pInputElementDescs + desc.InputLayout.NumElements);
+	pending->semanticNames.resize(pending->inputElements.size());
+	for (size_t i = 0; i < pending->inputElements.size(); i++)
+	{
+		pending->semanticNames[i] = pending->inputElements[i].SemanticName;
+		pending->inputElements[i].SemanticName = pending->semanticNames[i].c_str();
+	}
+	pending->desc.InputLayout.pInputElementDescs = pending->inputElements.size() > 0 ? &pending->inputElements[0] : 0;
+
+	// Stream output isn't supported by the copy
+	pending->desc.StreamOutput = {};
+	pending->desc.CachedPSO = {};
+
+	{
+		std::lock_guard<std::mutex> lock(entryMutex);
+		compileQueue.push_back(pending);
+	}
+	compileSignal.notify_one();
+	return handle;
+}
+
+// --------------------------------------------------------
+// Resolves a handle to the compiled pipeline,
+// or its placeholder if it isn't finished yet
+// --------------------------------------------------------
+Microsoft::WRL::ComPtr<ID3D12PipelineState> PipelineCache::GetPipeline(PipelineHandle handle)
+{
+	std::lock_guard<std::mutex> lock(entryMutex);
+	if (handle >= entries.size())
+		return 0;
+
+	Entry& entry = entries[handle];
+	return entry.ready && entry.pipeline ? entry.pipeline : entry.placeholder;
+}
+
+bool PipelineCache::IsReady(PipelineHandle handle)
+{
+	std::lock_guard<std::mutex> lock(entryMutex);
+	return handle < entries.size() && entries[handle].ready;
+}
+
+// --------------------------------------------------------
+// Serializes the pipeline library to disk, but only
+// if new pipelines have been stored since the last save
+// --------------------------------------------------------
+void PipelineCache::Save()
+{
+	std::lock_guard<std::mutex> lock(libraryMutex);
+	if (!library || !libraryDirty || cacheFile.empty())
+		return;
+
+	SIZE_T size = library->GetSerializedSize();
+	if (size == 0)
+		return;
+
+	std::vector<char> data(size);
+	if (FAILED(library->Serialize(&data[0], size)))
+		return;
+
+	std::ofstream file(cacheFile, std::ios::binary | std::ios::trunc);
+	if (!file.is_open())
+		return;
+
+	file.write(&data[0], (std::streamsize)size);
+	libraryDirty = false;
+}
+
+unsigned int PipelineCache::GetPipelineCount()
+{
+	std::lock_guard<std::mutex> lock(entryMutex);
+	return (unsigned int)entries.size();
+}
+
+unsigned int PipelineCache::GetPendingCount()
+{
+	std::lock_guard<std::mutex> lock(entryMutex);
+	return (unsigned int)compileQueue.size();
+}
+
+unsigned int PipelineCache::GetMemoryHits()
+{
+	return memoryHits;
+}
+
+unsigned int PipelineCache::GetLibraryHits()
+{
+	return libraryHits;
+}
+
+unsigned int PipelineCache::GetCompileCount()
+{
+	return compileCount;
+}
+
+// --------------------------------------------------------
+// Finds the entry for a key, or makes a new (not ready) one
+//
+// existed - Set to whether the entry was already in the cache
+// --------------------------------------------------------
+PipelineHandle PipelineCache::FindOrAddEntry(unsigned long long key, Microsoft::WRL::ComPtr<ID3D12PipelineState> placeholder, bool& existed)
+{
+	std::lock_guard<std::mutex> lock(entryMutex);
+
+	std::unordered_map<unsigned long long, PipelineHandle>::iterator it = handlesByKey.find(key);
+	if (it != handlesByKey.end())
+	{
+		existed = true;
+		memoryHits++;
+		if (!entries[it->second].placeholder)
+			entries[it->second].placeholder = placeholder;
+		return it->second;
+	}
+
+	Entry entry = {};
+	entry.key = key;
+	entry.ready = false;
+	entry.compiling = false;
+	entry.placeholder = placeholder;
+	entries.push_back(entry);
+
+	PipelineHandle handle = (PipelineHandle)(entries.size() - 1);
+	handlesByKey[key] = handle;
+	existed = false;
+	return handle;
+}
+
+// --------------------------------------------------------
+// Loads the pipeline from the library if it's there, otherwise
+// has the driver compile it and stores it in the library
+// --------------------------------------------------------
+Microsoft::WRL::ComPtr<ID3D12PipelineState> PipelineCache::CompilePipeline(
+	const D3D12_GRAPHICS_PIPELINE_STATE_DESC& desc,
+	unsigned long long key)
+{
+	PROFILE_FUNCTION();
+	Microsoft::WRL::ComPtr<ID3D12PipelineState> pipeline;
+	std::wstring name = KeyToName(key);
+
+	if (library)
+	{
+		std::lock_guard<std::mutex> lock(libraryMutex);
+		if (SUCCEEDED(library->LoadGraphicsPipeline(name.c_str(), &desc, IID_PPV_ARGS(pipeline.GetAddressOf()))))
+		{
+			libraryHits++;
+			return pipeline;
+		}
+	}
+
+	device->CreateGraphicsPipelineState(&desc, IID_PPV_ARGS(pipeline.GetAddressOf()));
+	compileCount++;
+
+	if (library && pipeline)
+	{
+		std::lock_guard<std::mutex> lock(libraryMutex);
+		if (SUCCEEDED(library->StorePipeline(name.c_str(), pipeline.Get())))
+			libraryDirty = true;
+	}
+
+	return pipeline;
+}
+
+// --------------------------------------------------------
+// Background thread that works through the compile queue
+// --------------------------------------------------------
+void PipelineCache::CompileThreadMain()
+{
+	Profiler::GetInstance().SetThreadName("Pipeline compiler");
+	while (true)
+	{
+		PendingCompile* pending = 0;
+		unsigned long long key = 0;
+		{
+			std::unique_lock<std::mutex> lock(entryMutex);
+			compileSignal.wait(lock, [this] { return stopCompileThread || !compileQueue.empty(); });
+			if (stopCompileThread)
+				return;
+
+			pending = compileQueue.front();
+			compileQueue.pop_front();
+
+			// Someone may have needed it right away and compiled it (or
+			// be compiling it) already
+			Entry& entry = entries[pending->handle];
+			if (entry.ready || entry.compiling)
+			{
+				delete pending;
+				continue;
+			}
+			entry.compiling = true;
+			key = entry.key;
+		}
+
+		Microsoft::WRL::ComPtr<ID3D12PipelineState> pipeline = CompilePipeline(pending->desc, key);
+		{
+			std::lock_guard<std::mutex> lock(entryMutex);
+			entries[pending->handle].pipeline = pipeline;
+			entries[pending->handle].ready = true;
+			entries[pending->handle].compiling = false;
+		}
+		compileDone.notify_all();
+		delete pending;
+	}
+}
\ No newline at end of file
@@ -0,0 +1,110 @@
+#pragma once
+#include <d3d12.h>
+#include <wrl/client.h>
+#include <vector>
+#include <string>
+#include <unordered_map>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+#include <atomic>
+
+// Handle to a pipeline that may still be compiling in the background
+typedef unsigned int PipelineHandle;
+#define INVALID_PIPELINE_HANDLE 0xFFFFFFFF
+
+// Caches pipeline state objects by a hash of their full description.
+// Compiled pipelines are persisted to disk with an ID3D12PipelineLibrary
+// so later runs skip driver compilation, and new pipelines can be
+// compiled on a background thread while a placeholder is used instead.
+class PipelineCache
+{
+public:
+	PipelineCache();
+	~PipelineCache();
+
+	// Loads the on-disk library (if any) and starts the compile thread
+	void Initialize(Microsoft::WRL::ComPtr<ID3D12Device> device, const std::wstring& cacheFile);
+	void Shutdown();
+
+	// Key hashing (no device needed)
+	static unsigned long long HashBytes(const void* data, size_t size, unsigned long long seed = 14695981039346656037ULL);
+	static unsigned long long HashPipelineDesc(const D3D12_GRAPHICS_PIPELINE_STATE_DESC& desc, unsigned long long rootSignatureHash);
+	static std::wstring KeyToName(unsigned long long key);
+
+	// Synchronous lookup, compiling (or loading from the library) on a miss
+	Microsoft::WRL::ComPtr<ID3D12PipelineState> GetPipeline(
+		const D3D12_GRAPHICS_PIPELINE_STATE_DESC& desc,
+		unsigned long long rootSignatureHash);
+
+	// Asynchronous request, returns immediately. Until the real pipeline
+	// is ready, GetPipeline(handle) hands back the placeholder.
+	PipelineHandle RequestPipeline(
+		const D3D12_GRAPHICS_PIPELINE_STATE_DESC& desc,
+		unsigned long long rootSignatureHash,
+		Microsoft::WRL::ComPtr<ID3D12PipelineState> placeholder);
+	Microsoft::WRL::ComPtr<ID3D12PipelineState> GetPipeline(PipelineHandle handle);
+	bool IsReady(PipelineHandle handle);
+
+	// Writes the library back to disk if anything new was stored
+	void Save();
+
+	// Bookkeeping
+	unsigned int GetPipelineCount();
+	unsigned int GetPendingCount();
+	unsigned int GetMemoryHits();
+	unsigned int GetLibraryHits();
+	unsigned int GetCompileCount();
+
+private:
+	struct Entry
+	{
+		unsigned long long key;
+		bool ready;
+		bool compiling; // Claimed by a thread, so nobody else compiles it too
+		Microsoft::WRL::ComPtr<ID3D12PipelineState> pipeline;
+		Microsoft::WRL::ComPtr<ID3D12PipelineState> placeholder;
+	};
+
+	// A deep copy of a pipeline description, so the caller's
+	// shader blobs and input layout don't need to outlive the request
+	struct PendingCompile
+	{
+		PipelineHandle handle;
+		D3D12_GRAPHICS_PIPELINE_STATE_DESC desc;
+		Microsoft::WRL::ComPtr<ID3D12RootSignature> rootSignature;
+		std::vector<unsigned char> shaderBytes[5];
+		std::vector<D3D12_INPUT_ELEMENT_DESC> inputElements;
+		std::vector<std::string> semanticNames;
+	};
+
+	Microsoft::WRL::ComPtr<ID3D12Device> device;
+	Microsoft::WRL::ComPtr<ID3D12PipelineLibrary> library;
+	std::vector<char> libraryBlob; // Must stay alive as long as the library
+	std::wstring cacheFile;
+	bool libraryDirty;
+
+	// Entries and lookup by key, guarded by entryMutex
+	std::vector<Entry> entries;
+	std::unordered_map<unsigned long long, PipelineHandle> handlesByKey;
+	std::mutex entryMutex;
+	std::mutex libraryMutex;
+	std::condition_variable compileDone;
+
+	// Background compile queue
+	std::deque<PendingCompile*> compileQueue;
+	std::condition_variable compileSignal;
+	std::thread compileThread;
+	bool stopCompileThread;
+
+	std::atomic<unsigned int> memoryHits;
+	std::atomic<unsigned int> libraryHits;
+	std::atomic<unsigned int> compileCount;
+
+	PipelineHandle FindOrAddEntry(unsigned long long key, Microsoft::WRL::ComPtr<ID3D12PipelineState> placeholder, bool& existed);
+	Microsoft::WRL::ComPtr<ID3D12PipelineState> CompilePipeline(
+		const D3D12_GRAPHICS_PIPELINE_STATE_DESC& desc,
+		unsigned long long key);
+	void CompileThreadMain();
+};
\ No newline at end of file
@@ -18,19 +18,88 @@ struct VertexToPixel
     float3 worldPos       : POSITION;
 };
 
+// Lights arrive sorted into directional, point and spot ranges
+// (see PartitionLights() on the C++ side)
 cbuffer ExternalData : register(b0)
 {
-    float2 uvScale;
-    float2 uvOffset;
     float3 cameraPosition;
-    int lightCount;
+    int directionalLightCount;
+    int pointLightCount;
+    int spotLightCount;
+    float clusterSliceScale;
+    float clusterSliceBias;
+    uint clusterCountX;
+    uint clusterCountY;
+    uint clusterCountZ;
+    float padding;
+    float2 clusterTileSize;
+    float2 padding2;
     Light lights[20];
 }
 
-Texture2D Albedo : register(t0);
-Texture2D NormalMap : register(t1);
-Texture2D MetalnessMap : register(t2);
-Texture2D RoughnessMap : register(t3);
+#if defined(CLUSTERED_LIGHTING) || defined(PER_OBJECT_LIGHTS)
+// Point lights followed by spot lights, for the light lists below to index into
+StructuredBuffer<Light> LocalLights : register(t1, space1);
+#endif
+
+#ifdef CLUSTERED_LIGHTING
+// Where a cluster's lights are in ClusterLightIndices (must match BufferStructs.h)
+struct LightCluster
+{
+    uint offset;
+    uint pointCount;
+    uint spotCount;
+    uint padding;
+};
+
+// Local lights binned into screen space tiles and
+// depth slices on the CPU (see ClusteredLighting)
+StructuredBuffer<LightCluster> Clusters : register(t2, space1);
+StructuredBuffer<uint> ClusterLightIndices : register(t3, space1);
+#endif
+
+// Permutations compile the light counts in (see the PixelShader_Lights_*.hlsl
+// files) so these loops have constant bounds and can be fully unrolled.
+// Without them, the counts come from the constant buffer instead.
+#ifndef DIRECTIONAL_LIGHT_COUNT
+#define DIRECTIONAL_LIGHT_COUNT directionalLightCount
+#endif
+#ifndef POINT_LIGHT_COUNT
+#define POINT_LIGHT_COUNT pointLightCount
+#endif
+#ifndef SPOT_LIGHT_COUNT
+#define SPOT_LIGHT_COUNT spotLightCount
+#endif
+
+// Per draw root constants (must match DrawData in BufferStructs.h)
+// The light list is only filled in for the per-object light shader,
+// and indexes LocalLights with point lights first (see LightSelection)
+cbuffer DrawData : register(b1)
+{
+    uint materialIndex;
+    uint objectPointLightCount;
+    uint objectSpotLightCount;
+    uint drawPadding;
+    uint4 objectLightIndices[2]; // MAX_LIGHTS_PER_OBJECT, four per element
+}
+
+// One entry of the material table (must match MaterialData in BufferStructs.h)
+struct MaterialData
+{
+    float3 colorTint;
+    uint albedoIndex;
+    float2 uvScale;
+    float2 uvOffset;
+    uint normalIndex;
+    uint metalnessIndex;
+    uint roughnessIndex;
+    uint padding;
+};
+
+StructuredBuffer<MaterialData> Materials : register(t0, space1);
+
+// Every texture in the program, indexed by the material table
+Texture2D Textures[] : register(t0, space0);
 
 SamplerState Sampler : register(s0);
 
@@ -45,6 +114,14 @@ SamplerState Sampler : register(s0);
 // --------------------------------------------------------
 float4 main(VertexToPixel input) : SV_TARGET
 {
+    // Look up this draw's material and its textures
+    MaterialData material = Materials[materialIndex];
+    Texture2D Albedo = Textures[material.albedoIndex];
+    Texture2D NormalMap = Textures[material.normalIndex];
+    Texture2D MetalnessMap = Textures[material.metalnessIndex];
+    Texture2D RoughnessMap = Textures[material.roughnessIndex];
+    input.uv = input.uv * material.uvScale + material.uvOffset;
+    
     // Rasterizer doesn't give normalized vectors
     input.normal = normalize(input.normal);
     input.tangent = normalize(input.tangent);
@@ -59,7 +136,7 @@ float4 main(VertexToPixel input) : SV_TARGET
     float3x3 TBN = float3x3(input.tangent, bitangent, input.normal);
     input.normal = mul(unpackedNormal, TBN); // Note multiplication order!
     
-    float3 surfaceColor = GammaUncorrect(Albedo.Sample(Sampler, input.uv).rgb);// * colorTint.rgb;
+    float3 surfaceColor = GammaUncorrect(Albedo.Sample(Sampler, input.uv).rgb) * material.colorTint;
     float3 view = ViewVector(cameraPosition, input.worldPos);
     
     float roughness = RoughnessMap.Sample(Sampler, input.uv).r;
@@ -71,18 +148,54 @@ float4 main(VertexToPixel input) : SV_TARGET
 	// because of linear texture sampling, so we lerp the specular color to match
     float3 specularColor = lerp(F0_NON_METAL, surfaceColor.rgb, metalness);
     
-    float3 litPixel;
+    float3 litPixel = 0;
+    
+    // One loop per light type over its range, so there's no type branch
+    int pointStart = DIRECTIONAL_LIGHT_COUNT;
+    int spotStart = pointStart + POINT_LIGHT_COUNT;
+    for (int d = 0; d < DIRECTIONAL_LIGHT_COUNT; d++)
+    {
+        litPixel += HandleDirectionalLightPBR(input.normal, lights[d], view, roughness, metalness, specularColor, surfaceColor);
+    }
+    
+#ifdef CLUSTERED_LIGHTING
+    // Find this pixel's cluster: screen tile from the pixel position and
+    // depth slice from the view space depth (which SV_POSITION.w holds)
+    uint3 cluster;
+    cluster.x = min((uint)(input.screenPosition.x / clusterTileSize.x), clusterCountX - 1);
+    cluster.y = min((uint)(input.screenPosition.y / clusterTileSize.y), clusterCountY - 1);
+    cluster.z = (uint)clamp(log(input.screenPosition.w) * clusterSliceScale + clusterSliceBias, 0, clusterCountZ - 1);
+    LightCluster lightCluster = Clusters[cluster.x + cluster.y * clusterCountX + cluster.z * clusterCountX * clusterCountY];
     
-    for (int i = 0; i < lightCount; i++)
+    uint clusterSpotStart = lightCluster.offset + lightCluster.pointCount;
+    for (uint cp = lightCluster.offset; cp < clusterSpotStart; cp++)
+    {
+        litPixel += HandlePointLightPBR(input.normal, LocalLights[ClusterLightIndices[cp]], view, roughness, metalness, specularColor, surfaceColor, input.worldPos);
+    }
+    for (uint cs = clusterSpotStart; cs < clusterSpotStart + lightCluster.spotCount; cs++)
+    {
+        litPixel += HandleSpotLightPBR(input.normal, LocalLights[ClusterLightIndices[cs]], view, roughness, metalness, specularColor, surfaceColor, input.worldPos);
+    }
+#elif defined(PER_OBJECT_LIGHTS)
+    // Only the few lights picked for this object on the CPU
+    uint objectLightCount = objectPointLightCount + objectSpotLightCount;
+    for (uint op = 0; op < objectPointLightCount; op++)
+    {
+        litPixel += HandlePointLightPBR(input.normal, LocalLights[objectLightIndices[op / 4][op % 4]], view, roughness, metalness, specularColor, surfaceColor, input.worldPos);
+    }
+    for (uint os = objectPointLightCount; os < objectLightCount; os++)
+    {
+        litPixel += HandleSpotLightPBR(input.normal, LocalLights[objectLightIndices[os / 4][os % 4]], view, roughness, metalness, specularColor, surfaceColor, input.worldPos);
+    }
+#else
+    for (int p = 0; p < POINT_LIGHT_COUNT; p++)
+    {
+        litPixel += HandlePointLightPBR(input.normal, lights[pointStart + p], view, roughness, metalness, specularColor, surfaceColor, input.worldPos);
+    }
+    for (int s = 0; s < SPOT_LIGHT_COUNT; s++)
     {
-        if (lights[i].Type == 0)
-        {
-            litPixel += HandleDirectionalLightPBR(input.normal, lights[i], view, roughness, metalness, specularColor, surfaceColor);
-        }
-        else
-        {
-            litPixel += HandlePointLightPBR(input.normal, lights[i], view, roughness, metalness, specularColor, surfaceColor, input.worldPos);
-        }
+        litPixel += HandleSpotLightPBR(input.normal, lights[spotStart + s], view, roughness, metalness, specularColor, surfaceColor, input.worldPos);
     }
+#endif
     return float4(GammaCorrect(litPixel), 1);
 }
\ No newline at end of file
@@ -0,0 +1,4 @@
+// Pixel shader that reads point and spot lights from per-cluster
+// light lists instead of the constant buffer (see ClusteredLighting)
+#define CLUSTERED_LIGHTING
+#include "PixelShader.hlsl"
\ No newline at end of file
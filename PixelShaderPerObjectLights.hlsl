@@ -0,0 +1,4 @@
+// Pixel shader that only evaluates the few point and spot lights
+// picked for each object on the CPU (see LightSelection)
+#define PER_OBJECT_LIGHTS
+#include "PixelShader.hlsl"
\ No newline at end of file
@@ -0,0 +1,30 @@
+// Root constants (must match UpscaleData in BufferStructs.h)
+cbuffer UpscaleData : register(b1)
+{
+    float2 uvScale;     // How much of the scene texture was rendered to
+    float2 uvMin;       // Texel centres at the edges of that region, so
+    float2 uvMax;       // filtering never reaches outside of it
+    uint sceneIndex;    // Scene texture's index in the bindless range
+}
+
+// Every texture in the program, including the scene render target
+Texture2D Textures[] : register(t0, space0);
+
+SamplerState Sampler : register(s0);
+
+struct VertexToPixel
+{
+	float4 screenPosition	: SV_POSITION;
+	float2 uv				: TEXCOORD;
+};
+
+// --------------------------------------------------------
+// Stretches the part of the scene texture that was rendered to
+// (the top left corner, at lower resolutions) over the whole
+// back buffer with bilinear filtering
+// --------------------------------------------------------
+float4 main(VertexToPixel input) : SV_TARGET
+{
+    float2 uv = clamp(input.uv * uvScale, uvMin, uvMax);
+    return Textures[sceneIndex].SampleLevel(Sampler, uv, 0);
+}
\ No newline at end of file
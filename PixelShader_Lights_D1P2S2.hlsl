@@ -0,0 +1,5 @@
+// Pixel shader permutation for 1 directional, 2 point and 2 spot lights
+#define DIRECTIONAL_LIGHT_COUNT 1
+#define POINT_LIGHT_COUNT 2
+#define SPOT_LIGHT_COUNT 2
+#include "PixelShader.hlsl"
\ No newline at end of file
@@ -0,0 +1,5 @@
+// Pixel shader permutation for 1 directional, 4 point and 0 spot lights
+#define DIRECTIONAL_LIGHT_COUNT 1
+#define POINT_LIGHT_COUNT 4
+#define SPOT_LIGHT_COUNT 0
+#include "PixelShader.hlsl"
\ No newline at end of file
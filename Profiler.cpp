@@ -0,0 +1,253 @@
+#include "Profiler.h"
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <mutex>
+
+// Singleton requirement
+Profiler* Profiler::instance;
+
+// Only taken the first time a thread records, never per zone
+static std::mutex trackMutex;
+
+Profiler::Profiler() :
+	tracks(new Track[PROFILER_MAX_TRACKS]),
+	trackCount(0),
+	capturing(false),
+	capture(0),
+	captureStart(0),
+	gpuTrack(0),
+	gpuFrequency(1),
+	gpuTimestamp(0),
+	gpuCpuTime(0)
+{
+	for (unsigned int t = 0; t < PROFILER_MAX_TRACKS; t++)
+	{
+		tracks[t].count = 0;
+		tracks[t].dropped = 0;
+		tracks[t].capture = 0;
+		tracks[t].name[0] = 0;
+	}
+}
+
+// --------------------------------------------------------
+// Every track starts over the first time it records into the
+// new capture, so nothing here touches another thread's buffer
+// --------------------------------------------------------
+void Profiler::StartCapture()
+{
+	captureStart.store(Now(), std::memory_order_relaxed);
+	capture.fetch_add(1, std::memory_order_release);
+	capturing.store(true, std::memory_order_release);
+}
+
+// Zones already started still finish into the capture
+void Profiler::StopCapture()
+{
+	capturing.store(false, std::memory_order_release);
+}
+
+bool Profiler::IsCapturing()
+{
+	return capturing.load(std::memory_order_relaxed);
+}
+
+void Profiler::SetThreadName(const char* name)
+{
+	Track* track = GetThreadTrack();
+	if (!track)
+		return;
+
+	std::lock_guard<std::mutex> lock(trackMutex);
+	strncpy_s(track->name, name, PROFILER_TRACK_NAME_LENGTH - 1);
+}
+
+unsigned long long Profiler::BeginZone()
+{
+	return capturing.load(std::memory_order_relaxed) ? Now() : 0;
+}
+
+void Profiler::EndZone(const char* name, unsigned long long start)
+{
+	Track* track = GetThreadTrack();
+	if (track)
+		Record(track, name, start, Now());
+}
+
+void Profiler::SetGpuClock(double gpuFrequency, unsigned long long gpuTimestamp, unsigned long long cpuTime)
+{
+	if (!gpuTrack)
+		gpuTrack = CreateTrack("GPU");
+
+	this->gpuFrequency = gpuFrequency;
+	this->gpuTimestamp = gpuTimestamp;
+	gpuCpuTime = cpuTime;
+}
+
+// --------------------------------------------------------
+// Moves a range of GPU timestamps onto the profiler's clock,
+// counting from the calibration point (either way, since GPU
+// work can finish after the clocks were compared)
+// --------------------------------------------------------
+void Profiler::AddGpuRange(const char* name, unsigned long long gpuStart, unsigned long long gpuEnd)
+{
+	if (!gpuTrack || !IsCapturing())
+		return;
+
+	double nanosecondsPerTick = 1000000000.0 / gpuFrequency;
+	long long startOffset = (long long)((double)(long long)(gpuStart - gpuTimestamp) * nanosecondsPerTick);
+	long long endOffset = (long long)((double)(long long)(gpuEnd - gpuTimestamp) * nanosecondsPerTick);
+	Record(gpuTrack, name, gpuCpuTime + startOffset, gpuCpuTime + endOffset);
+}
+
+unsigned int Profiler::GetTrackCount()
+{
+	return trackCount.load(std::memory_order_acquire);
+}
+
+const char* Profiler::GetTrackName(unsigned int track)
+{
+	return tracks[track].name;
+}
+
+unsigned int Profiler::GetEventCount(unsigned int track)
+{
+	return GetCapturedCount(&tracks[track]);
+}
+
+ProfileEvent Profiler::GetEvent(unsigned int track, unsigned int index)
+{
+	return tracks[track].events[index];
+}
+
+unsigned int Profiler::GetDroppedCount(unsigned int track)
+{
+	return GetCapturedCount(&tracks[track]) == 0 ? 0 : tracks[track].dropped.load(std::memory_order_relaxed);
+}
+
+// --------------------------------------------------------
+// Writes the trace event format (a "complete" event per zone,
+// plus each track's name as thread metadata), with times in
+// microseconds from the start of the capture
+// --------------------------------------------------------
+bool Profiler::ExportChromeTrace(const std::string& file)
+{
+	std::ofstream output(file, std::ios::trunc);
+	if (!output)
+		return false;
+
+	unsigned long long start = captureStart.load(std::memory_order_relaxed);
+	unsigned int count = GetTrackCount();
+	bool first = true;
+	output << std::fixed << std::setprecision(3) << "{\"traceEvents\":[";
+	for (unsigned int t = 0; t < count; t++)
+	{
+		output << (first ? "\n" : ",\n") <<
+			"{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << t << ",\"args\":{\"name\":\"" << tracks[t].name << "\"}},\n" <<
+			"{\"name\":\"thread_sort_index\",\"ph\":\"M\",\"pid\":1,\"tid\":" << t << ",\"args\":{\"sort_index\":" << t << "}}";
+		first = false;
+
+		unsigned int eventCount = GetEventCount(t);
+		for (unsigned int e = 0; e < eventCount; e++)
+		{
+			const ProfileEvent& event = tracks[t].events[e];
+			output << ",\n{\"name\":\"";
+			for (const char* c = event.name; *c; c++)
+			{
+				if (*c == '"' || *c == '\\')
+					output << '\\';
+				output << *c;
+			}
+			output << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << t <<
+				",\"ts\":" << (event.start - start) / 1000.0 <<
+				",\"dur\":" << (event.end - event.start) / 1000.0 << "}";
+		}
+	}
+	output << "\n],\"displayTimeUnit\":\"ms\"}\n";
+	return output.good();
+}
+
+unsigned long long Profiler::Now()
+{
+	return (unsigned long long)std::chrono::duration_cast<std::chrono::nanoseconds>(
+		std::chrono::high_resolution_clock::now().time_since_epoch()).count();
+}
+
+// --------------------------------------------------------
+// The calling thread's track, made the first time it's needed
+// (0 if every track is taken)
+// --------------------------------------------------------
+Profiler::Track* Profiler::GetThreadTrack()
+{
+	static thread_local Track* threadTrack = 0;
+	static thread_local bool outOfTracks = false;
+	if (!threadTrack && !outOfTracks)
+	{
+		char name[PROFILER_TRACK_NAME_LENGTH];
+		sprintf_s(name, "Thread %u", GetTrackCount());
+		threadTrack = CreateTrack(name);
+		outOfTracks = !threadTrack;
+	}
+	return threadTrack;
+}
+
+// --------------------------------------------------------
+// Sets up the next track and publishes it, so readers never
+// see one that's only partly made
+// --------------------------------------------------------
+Profiler::Track* Profiler::CreateTrack(const char* name)
+{
+	std::lock_guard<std::mutex> lock(trackMutex);
+	unsigned int index = trackCount.load(std::memory_order_relaxed);
+	if (index == PROFILER_MAX_TRACKS)
+		return 0;
+
+	Track* track = &tracks[index];
+	track->events.reset(new ProfileEvent[PROFILER_EVENTS_PER_THREAD]);
+	strncpy_s(track->name, name, PROFILER_TRACK_NAME_LENGTH - 1);
+	trackCount.store(index + 1, std::memory_order_release);
+	return track;
+}
+
+// --------------------------------------------------------
+// Appends a zone to a track, from the track's own thread. The
+// count is stored after the event, so a reader that sees the
+// count sees the event too.
+// --------------------------------------------------------
+void Profiler::Record(Track* track, const char* name, unsigned long long start, unsigned long long end)
+{
+	unsigned int current = capture.load(std::memory_order_acquire);
+	if (track->capture.load(std::memory_order_relaxed) != current)
+	{
+		track->count.store(0, std::memory_order_relaxed);
+		track->dropped.store(0, std::memory_order_relaxed);
+		track->capture.store(current, std::memory_order_release);
+	}
+
+	// Zones that started before this capture did belong to the last one
+	if (start < captureStart.load(std::memory_order_relaxed))
+		return;
+
+	unsigned int count = track->count.load(std::memory_order_relaxed);
+	if (count == PROFILER_EVENTS_PER_THREAD)
+	{
+		track->dropped.store(track->dropped.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+		return;
+	}
+
+	ProfileEvent& event = track->events[count];
+	event.name = name;
+	event.start = start;
+	event.end = end;
+	track->count.store(count + 1, std::memory_order_release);
+}
+
+// Tracks that haven't recorded since the capture started have nothing in it
+unsigned int Profiler::GetCapturedCount(Track* track)
+{
+	if (track->capture.load(std::memory_order_acquire) != capture.load(std::memory_order_relaxed))
+		return 0;
+	return track->count.load(std::memory_order_acquire);
+}
\ No newline at end of file
@@ -0,0 +1,167 @@
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <string>
+
+// Zones each thread can record in one capture (the rest are dropped)
+#define PROFILER_EVENTS_PER_THREAD 65536
+
+// Threads (and the GPU) that can have their own track
+#define PROFILER_MAX_TRACKS 64
+
+// Longest track name kept, including the terminator
+#define PROFILER_TRACK_NAME_LENGTH 32
+
+// Zone macros, which compile to nothing if PROFILER_DISABLED is defined.
+// Names have to outlive the capture (string literals, __FUNCTION__).
+#define PROFILE_CONCAT_INNER(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_INNER(a, b)
+#ifdef PROFILER_DISABLED
+#define PROFILE_ZONE(name)
+#define PROFILE_FUNCTION()
+#else
+#define PROFILE_ZONE(name) ProfileZone PROFILE_CONCAT(profileZone, __LINE__)(name)
+#define PROFILE_FUNCTION() PROFILE_ZONE(__FUNCTION__)
+#endif
+
+// One finished zone, in profiler ticks (nanoseconds)
+struct ProfileEvent
+{
+	const char* name;
+	unsigned long long start;
+	unsigned long long end;
+};
+
+// --------------------------------------------------------
+// Instrumentation profiler: scoped zones record when they start
+// and end, on whichever thread they run, while a capture is going.
+// Zones nest, so a capture shows where each frame's time goes,
+// level by level, on every thread. ExportChromeTrace() writes it
+// out for chrome://tracing or Perfetto.
+//
+// Each thread writes to its own buffer, so recording a zone is two
+// clock reads and a store, with no locks or shared writes. Buffers
+// are made the first time a thread records (or is named) and kept
+// for the life of the program. Outside a capture a zone is just a
+// check of one flag.
+//
+// GPU work comes in as ranges of GPU timestamps, converted to the
+// profiler's clock with a calibration pair from whatever measured
+// them (DX12Helper's timestamp queries, or a stand-in without a GPU).
+// --------------------------------------------------------
+class Profiler
+{
+#pragma region Singleton
+public:
+	// Gets the one and only instance of this class
+	static Profiler& GetInstance()
+	{
+		if (!instance)
+		{
+			instance = new Profiler();
+		}
+
+		return *instance;
+	}
+
+	// Remove these functions (C++ 11 version)
+	Profiler(Profiler const&) = delete;
+	void operator=(Profiler const&) = delete;
+
+private:
+	static Profiler* instance;
+	Profiler();
+#pragma endregion
+
+public:
+	// Forgets the last capture and starts recording every thread
+	void StartCapture();
+	void StopCapture();
+	bool IsCapturing();
+
+	// Names the calling thread's track (copied, so any string works)
+	void SetThreadName(const char* name);
+
+	// Used by ProfileZone: 0 if there's no capture to record into
+	unsigned long long BeginZone();
+	void EndZone(const char* name, unsigned long long start);
+
+	// GPU ranges, from one thread at a time. The clock is described
+	// by its frequency and one GPU timestamp taken at the same moment
+	// as the given profiler time, and has to be set before ranges
+	// that use it are added.
+	void SetGpuClock(double gpuFrequency, unsigned long long gpuTimestamp, unsigned long long cpuTime);
+	void AddGpuRange(const char* name, unsigned long long gpuStart, unsigned long long gpuEnd);
+
+	// The last capture, track by track (safe while threads record)
+	unsigned int GetTrackCount();
+	const char* GetTrackName(unsigned int track);
+	unsigned int GetEventCount(unsigned int track);
+	ProfileEvent GetEvent(unsigned int track, unsigned int index);
+	unsigned int GetDroppedCount(unsigned int track);
+
+	// Every zone in the last capture as "complete" trace events, with
+	// times relative to the start of the capture. Returns false if
+	// the file can't be written.
+	bool ExportChromeTrace(const std::string& file);
+
+	// The profiler's clock, in nanoseconds
+	static unsigned long long Now();
+
+private:
+	struct Track
+	{
+		std::unique_ptr<ProfileEvent[]> events;
+		std::atomic<unsigned int> count;
+		std::atomic<unsigned int> dropped;
+
+		// The capture count and dropped belong to. The owner clears
+		// them when it first records into a new capture.
+		std::atomic<unsigned int> capture;
+		char name[PROFILER_TRACK_NAME_LENGTH];
+	};
+
+	std::unique_ptr<Track[]> tracks;
+	std::atomic<unsigned int> trackCount;
+	std::atomic<bool> capturing;
+	std::atomic<unsigned int> capture;
+	std::atomic<unsigned long long> captureStart;
+
+	// GPU clock calibration
+	Track* gpuTrack;
+	double gpuFrequency;
+	unsigned long long gpuTimestamp;
+	unsigned long long gpuCpuTime;
+
+	Track* GetThreadTrack();
+	Track* CreateTrack(const char* name);
+	void Record(Track* track, const char* name, unsigned long long start, unsigned long long end);
+	unsigned int GetCapturedCount(Track* track);
+};
+
+// --------------------------------------------------------
+// Records the scope it lives in as a zone (see PROFILE_ZONE)
+// --------------------------------------------------------
+class ProfileZone
+{
+public:
+	ProfileZone(const char* name) :
+		name(name),
+		start(Profiler::GetInstance().BeginZone())
+	{
+	}
+
+	~ProfileZone()
+	{
+		if (start)
+			Profiler::GetInstance().EndZone(name, start);
+	}
+
+	ProfileZone(ProfileZone const&) = delete;
+	void operator=(ProfileZone const&) = delete;
+
+private:
+	const char* name;
+	unsigned long long start;
+};
\ No newline at end of file
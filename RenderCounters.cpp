@@ -0,0 +1,136 @@
+#include "RenderCounters.h"
+#include <cstdio>
+
+static const char* counterNames[RENDER_COUNTER_COUNT] =
+{
+	"draw calls",
+	"PSO changes",
+	"descriptor table binds",
+	"CBVs created",
+	"CB bytes copied",
+	"CB ring wraps",
+	"descriptors consumed",
+	"dynamic bytes copied",
+	"dynamic ring wraps"
+};
+
+RenderCounters::RenderCounters() :
+	budgetWarnings(true),
+	dumpEveryFrame(false)
+{
+	for (unsigned int c = 0; c < RENDER_COUNTER_COUNT; c++)
+		budgets[c] = RENDER_COUNTER_NO_BUDGET;
+	Reset();
+}
+
+// --------------------------------------------------------
+// Publishes the frame's counts and starts the next frame at
+// zero. A counter over budget only warns on the first frame
+// of a run of such frames, so a steady overrun isn't a wall
+// of text.
+// --------------------------------------------------------
+void RenderCounters::EndFrame()
+{
+	unsigned long long frame = frameCount.load(std::memory_order_relaxed);
+	for (unsigned int c = 0; c < RENDER_COUNTER_COUNT; c++)
+	{
+		unsigned long long count = current[c].load(std::memory_order_relaxed);
+		current[c].store(0, std::memory_order_relaxed);
+		lastFrame[c].store(count, std::memory_order_relaxed);
+		totals[c] += count;
+
+		bool over = count > budgets[c];
+		if (over)
+		{
+			overBudgetFrames[c]++;
+			if (!overBudget[c] && budgetWarnings)
+				printf("Render counter over budget on frame %llu: %llu %s (budget %llu)\n", frame, count, counterNames[c], budgets[c]);
+		}
+		overBudget[c] = over;
+	}
+	frameCount.store(frame + 1, std::memory_order_relaxed);
+
+	if (dumpEveryFrame)
+		PrintLastFrame();
+}
+
+unsigned long long RenderCounters::GetCurrent(unsigned int counter)
+{
+	return current[counter].load(std::memory_order_relaxed);
+}
+
+unsigned long long RenderCounters::GetLastFrame(unsigned int counter)
+{
+	return lastFrame[counter].load(std::memory_order_relaxed);
+}
+
+unsigned long long RenderCounters::GetTotal(unsigned int counter)
+{
+	return totals[counter];
+}
+
+unsigned long long RenderCounters::GetFrameCount()
+{
+	return frameCount.load(std::memory_order_relaxed);
+}
+
+void RenderCounters::SetBudget(unsigned int counter, unsigned long long maxPerFrame)
+{
+	budgets[counter] = maxPerFrame;
+}
+
+unsigned long long RenderCounters::GetBudget(unsigned int counter)
+{
+	return budgets[counter];
+}
+
+unsigned long long RenderCounters::GetOverBudgetFrames(unsigned int counter)
+{
+	return overBudgetFrames[counter];
+}
+
+void RenderCounters::SetBudgetWarnings(bool enabled)
+{
+	budgetWarnings = enabled;
+}
+
+bool RenderCounters::GetBudgetWarnings()
+{
+	return budgetWarnings;
+}
+
+void RenderCounters::SetDumpEveryFrame(bool enabled)
+{
+	dumpEveryFrame = enabled;
+}
+
+bool RenderCounters::GetDumpEveryFrame()
+{
+	return dumpEveryFrame;
+}
+
+void RenderCounters::PrintLastFrame()
+{
+	printf("Frame %llu:", frameCount.load(std::memory_order_relaxed) - 1);
+	for (unsigned int c = 0; c < RENDER_COUNTER_COUNT; c++)
+		printf("%s %llu %s", c == 0 ? "" : ",", lastFrame[c].load(std::memory_order_relaxed), counterNames[c]);
+	printf("\n");
+}
+
+const char* RenderCounters::GetName(unsigned int counter)
+{
+	return counterNames[counter];
+}
+
+void RenderCounters::Reset()
+{
+	for (unsigned int c = 0; c < RENDER_COUNTER_COUNT; c++)
+	{
+		current[c].store(0);
+		lastFrame[c].store(0);
+		totals[c] = 0;
+		overBudgetFrames[c] = 0;
+		overBudget[c] = false;
+	}
+	frameCount.store(0);
+}
\ No newline at end of file
@@ -0,0 +1,87 @@
+#pragma once
+
+#include <atomic>
+
+// What gets counted each frame
+#define RENDER_COUNTER_DRAW_CALLS 0             // Draw*Instanced() calls
+#define RENDER_COUNTER_PSO_CHANGES 1            // SetPipelineState() calls
+#define RENDER_COUNTER_DESCRIPTOR_TABLE_BINDS 2 // SetGraphicsRootDescriptorTable() calls
+#define RENDER_COUNTER_CBVS_CREATED 3           // Constant buffer views made in the CBV ring
+#define RENDER_COUNTER_CB_BYTES_COPIED 4        // Bytes memcpy'd into the constant buffer upload heap
+#define RENDER_COUNTER_CB_RING_WRAPS 5          // Times the constant buffer upload heap started over
+#define RENDER_COUNTER_DESCRIPTORS_CONSUMED 6   // CBV/SRV heap descriptors handed out (CBVs and SRVs)
+#define RENDER_COUNTER_DYNAMIC_BYTES_COPIED 7   // Bytes memcpy'd into the dynamic upload heap
+#define RENDER_COUNTER_DYNAMIC_RING_WRAPS 8     // Times the dynamic upload heap started over
+#define RENDER_COUNTER_COUNT 9
+
+// A budget of this means the counter has none
+#define RENDER_COUNTER_NO_BUDGET 0xFFFFFFFFFFFFFFFFULL
+
+// --------------------------------------------------------
+// Counts what the renderer does each frame (draws, state changes,
+// upload heap traffic), so changes to how a frame is recorded
+// come with numbers rather than guesses.
+//
+// The thread that records the frame calls Add() as it goes and
+// EndFrame() once the frame is submitted, which keeps the frame's
+// counts for GetLastFrame() and starts the next one at zero. Any
+// thread can read the last frame's counts.
+//
+// Each counter can have a per-frame budget. Frames over it are
+// counted, and with warnings on, a frame that goes over after
+// being within budget prints which counter and by how much (like
+// the constant buffer ring wrapping more than once in a frame,
+// which means the frame overwrote its own constants).
+// --------------------------------------------------------
+class RenderCounters
+{
+public:
+	RenderCounters();
+
+	// Only ever called from one thread at a time, so it's a plain add
+	void Add(unsigned int counter, unsigned long long amount = 1)
+	{
+		current[counter].store(current[counter].load(std::memory_order_relaxed) + amount, std::memory_order_relaxed);
+	}
+
+	// Finishes the frame: keeps its counts and checks them against the budgets
+	void EndFrame();
+
+	// The frame being recorded, the last finished one, and every frame since Reset()
+	unsigned long long GetCurrent(unsigned int counter);
+	unsigned long long GetLastFrame(unsigned int counter);
+	unsigned long long GetTotal(unsigned int counter);
+	unsigned long long GetFrameCount();
+
+	// Per-frame budgets (RENDER_COUNTER_NO_BUDGET for none, the default)
+	void SetBudget(unsigned int counter, unsigned long long maxPerFrame);
+	unsigned long long GetBudget(unsigned int counter);
+	unsigned long long GetOverBudgetFrames(unsigned int counter);
+
+	// Budget check mode: print a warning when a counter goes over budget
+	void SetBudgetWarnings(bool enabled);
+	bool GetBudgetWarnings();
+
+	// Print every frame's counts as it finishes
+	void SetDumpEveryFrame(bool enabled);
+	bool GetDumpEveryFrame();
+
+	// One line with every counter from the last frame
+	void PrintLastFrame();
+
+	static const char* GetName(unsigned int counter);
+
+	// Zeroes every count (budgets and modes are kept)
+	void Reset();
+
+private:
+	std::atomic<unsigned long long> current[RENDER_COUNTER_COUNT];
+	std::atomic<unsigned long long> lastFrame[RENDER_COUNTER_COUNT];
+	unsigned long long totals[RENDER_COUNTER_COUNT];
+	unsigned long long budgets[RENDER_COUNTER_COUNT];
+	unsigned long long overBudgetFrames[RENDER_COUNTER_COUNT];
+	bool overBudget[RENDER_COUNTER_COUNT];
+	std::atomic<unsigned long long> frameCount;
+	std::atomic<bool> budgetWarnings;
+	std::atomic<bool> dumpEveryFrame;
+};
\ No newline at end of file
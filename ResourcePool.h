@@ -0,0 +1,162 @@
+#pragma once
+#include <vector>
+
+// 32 bit handle: low 20 bits pick a slot, high 12 bits are the slot's
+// generation when the handle was issued (so a stale handle can only
+// match again once its slot has been reused 4096 times). Typed so a
+// mesh handle can't be passed where a material is expected.
+#define RESOURCE_SLOT_BITS 20
+#define RESOURCE_SLOT_MASK ((1u << RESOURCE_SLOT_BITS) - 1)
+#define RESOURCE_GENERATION_MASK (0xFFFFFFFFu >> RESOURCE_SLOT_BITS)
+#define INVALID_RESOURCE_HANDLE 0xFFFFFFFF
+
+template<typename T>
+struct ResourceHandle
+{
+	unsigned int value;
+
+	unsigned int GetSlot() const { return value & RESOURCE_SLOT_MASK; }
+	unsigned int GetGeneration() const { return value >> RESOURCE_SLOT_BITS; }
+	bool operator==(const ResourceHandle& other) const { return value == other.value; }
+	bool operator!=(const ResourceHandle& other) const { return value != other.value; }
+};
+
+// --------------------------------------------------------
+// Owns objects of one type in a dense array and hands out generational
+// handles to them. Looking up a handle is two array reads and a
+// generation check, and a handle to something that's been removed
+// just stops resolving (Get returns null) instead of dangling.
+//
+// Removal is deferred: the handle goes stale immediately, but the
+// object itself lives until Collect() is told the given retire value
+// (e.g. a GPU fence value, or a count of frames drawn) has been reached, so work already in
+// flight can keep using it.
+//
+// Pointers from Get() are only valid until the next Add() or Collect().
+// Nothing in here touches the GPU, so it can be tested on its own.
+// --------------------------------------------------------
+template<typename T>
+class ResourcePool
+{
+public:
+	static ResourceHandle<T> InvalidHandle()
+	{
+		ResourceHandle<T> handle = { INVALID_RESOURCE_HANDLE };
+		return handle;
+	}
+
+	ResourceHandle<T> Add(const T& object)
+	{
+		unsigned int slot;
+		if (!freeSlots.empty())
+		{
+			slot = freeSlots.back();
+			freeSlots.pop_back();
+		}
+		else
+		{
+			// The very last slot would make the invalid handle pattern
+			slot = (unsigned int)slotToDense.size();
+			if (slot >= RESOURCE_SLOT_MASK)
+				return InvalidHandle();
+			slotToDense.push_back(0);
+			generations.push_back(0);
+		}
+
+		slotToDense[slot] = (unsigned int)objects.size();
+		objects.push_back(object);
+		denseToSlot.push_back(slot);
+
+		ResourceHandle<T> handle = { (generations[slot] << RESOURCE_SLOT_BITS) | slot };
+		return handle;
+	}
+
+	bool IsValid(ResourceHandle<T> handle) const
+	{
+		unsigned int slot = handle.GetSlot();
+		return handle.value != INVALID_RESOURCE_HANDLE &&
+			slot < generations.size() &&
+			generations[slot] == handle.GetGeneration();
+	}
+
+	// Null if the handle is stale or was never valid
+	T* Get(ResourceHandle<T> handle)
+	{
+		if (!IsValid(handle))
+			return 0;
+		return &objects[slotToDense[handle.GetSlot()]];
+	}
+
+	// Invalidates the handle now, and destroys the object once
+	// Collect() is called with a value of at least retireValue
+	void Remove(ResourceHandle<T> handle, unsigned long long retireValue)
+	{
+		if (!IsValid(handle))
+			return;
+
+		unsigned int slot = handle.GetSlot();
+		generations[slot] = (generations[slot] + 1) & RESOURCE_GENERATION_MASK;
+		RetiredSlot retired = { slot, retireValue };
+		retiredSlots.push_back(retired);
+	}
+
+	// Destroys removed objects whose retire value has been reached
+	// Returns how many were destroyed
+	unsigned int Collect(unsigned long long completedValue)
+	{
+		return Collect(completedValue, [](T&) {});
+	}
+
+	// Same, but calls onRelease(object) for each one first
+	template<typename Function>
+	unsigned int Collect(unsigned long long completedValue, Function onRelease)
+	{
+		unsigned int collected = 0;
+		for (unsigned int r = 0; r < retiredSlots.size();)
+		{
+			if (retiredSlots[r].retireValue > completedValue)
+			{
+				r++;
+				continue;
+			}
+
+			// Swap the last object into the hole to keep the array dense
+			unsigned int slot = retiredSlots[r].slot;
+			unsigned int dense = slotToDense[slot];
+			unsigned int last = (unsigned int)objects.size() - 1;
+			onRelease(objects[dense]);
+			if (dense != last)
+			{
+				objects[dense] = objects[last];
+				denseToSlot[dense] = denseToSlot[last];
+				slotToDense[denseToSlot[dense]] = dense;
+			}
+			objects.pop_back();
+			denseToSlot.pop_back();
+			freeSlots.push_back(slot);
+
+			retiredSlots[r] = retiredSlots.back();
+			retiredSlots.pop_back();
+			collected++;
+		}
+		return collected;
+	}
+
+	// Live objects plus those waiting to be collected
+	unsigned int GetCount() const { return (unsigned int)objects.size(); }
+	unsigned int GetPendingCount() const { return (unsigned int)retiredSlots.size(); }
+
+private:
+	struct RetiredSlot
+	{
+		unsigned int slot;
+		unsigned long long retireValue;
+	};
+
+	std::vector<T> objects;
+	std::vector<unsigned int> denseToSlot;
+	std::vector<unsigned int> slotToDense;
+	std::vector<unsigned int> generations;
+	std::vector<unsigned int> freeSlots;
+	std::vector<RetiredSlot> retiredSlots;
+};
\ No newline at end of file
@@ -0,0 +1,70 @@
+#include "ResourceRegistry.h"
+#include "DX12Helper.h"
+
+MeshHandle ResourceRegistry::AddMesh(const Mesh& mesh)
+{
+	return meshes.Add(mesh);
+}
+
+MaterialHandle ResourceRegistry::AddMaterial(const Material& material)
+{
+	return materials.Add(material);
+}
+
+// --------------------------------------------------------
+// Loads a texture into its own bindless slot. The registry owns the
+// resource, so the slot can be reused once the texture is unloaded.
+// Returns an invalid handle if there was no slot left for it.
+// --------------------------------------------------------
+TextureHandle ResourceRegistry::LoadTexture(const wchar_t* file, bool generateMips)
+{
+	Texture texture;
+	texture.bindlessIndex = DX12Helper::GetInstance().LoadTexture(file, generateMips, &texture.resource);
+	if (texture.bindlessIndex == INVALID_TEXTURE_INDEX)
+		return ResourcePool<Texture>::InvalidHandle();
+	return textures.Add(texture);
+}
+
+unsigned int ResourceRegistry::GetBindlessIndex(TextureHandle handle)
+{
+	Texture* texture = textures.Get(handle);
+	return texture ? texture->bindlessIndex : 0;
+}
+
+void ResourceRegistry::UnloadMesh(MeshHandle handle)
+{
+	meshes.Remove(handle, updateFrame + 1);
+}
+
+// Note: The material's row in the material table isn't reclaimed
+void ResourceRegistry::UnloadMaterial(MaterialHandle handle)
+{
+	materials.Remove(handle, updateFrame + 1);
+}
+
+void ResourceRegistry::UnloadTexture(TextureHandle handle)
+{
+	textures.Remove(handle, updateFrame + 1);
+}
+
+// --------------------------------------------------------
+// Destroys unloaded resources no frame can still draw with, and
+// hands their bindless slots back. Snapshots of frames published
+// before an unload hold on to its buffers, and the frame being
+// simulated is the last of those, so an unload waits for that frame
+// to be drawn. Draw() waits for the GPU when it submits, so a drawn
+// frame is finished on the GPU as well.
+// --------------------------------------------------------
+void ResourceRegistry::Collect(unsigned int frame, unsigned int drawnFrames)
+{
+	updateFrame = frame;
+
+	meshes.Collect(drawnFrames);
+	materials.Collect(drawnFrames);
+	textures.Collect(drawnFrames, [&](Texture& texture)
+	{
+		// The 0 returned when the range is full isn't ours to free
+		if (texture.resource)
+			DX12Helper::GetInstance().ReleaseTextureIndex(texture.bindlessIndex);
+	});
+}
\ No newline at end of file
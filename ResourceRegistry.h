@@ -0,0 +1,65 @@
+#pragma once
+#include <d3d12.h>
+#include <wrl/client.h>
+#include "ResourcePool.h"
+#include "Mesh.h"
+#include "Material.h"
+
+// A texture and where its SRV lives in the bindless range
+struct Texture
+{
+	Microsoft::WRL::ComPtr<ID3D12Resource> resource;
+	unsigned int bindlessIndex;
+};
+
+typedef ResourceHandle<Mesh> MeshHandle;
+typedef ResourceHandle<Material> MaterialHandle;
+typedef ResourceHandle<Texture> TextureHandle;
+
+// --------------------------------------------------------
+// Owns every mesh, material and texture the game loads. Everything
+// else refers to them with handles, so drawing looks them up by index
+// without touching reference counts, and something that's been
+// unloaded is noticed (the handle stops resolving) rather than used.
+//
+// Unloading is deferred until every frame that might still use the
+// resource has been drawn, so snapshots already handed to the render
+// thread (and draws already submitted) can still use it.
+// --------------------------------------------------------
+class ResourceRegistry
+{
+public:
+	MeshHandle AddMesh(const Mesh& mesh);
+	MaterialHandle AddMaterial(const Material& material);
+	TextureHandle LoadTexture(const wchar_t* file, bool generateMips = true); // Invalid if the bindless range is full
+
+	// Null if the handle is stale
+	Mesh* GetMesh(MeshHandle handle) { return meshes.Get(handle); }
+	Material* GetMaterial(MaterialHandle handle) { return materials.Get(handle); }
+	Texture* GetTexture(TextureHandle handle) { return textures.Get(handle); }
+
+	bool IsValid(MeshHandle handle) const { return meshes.IsValid(handle); }
+	bool IsValid(MaterialHandle handle) const { return materials.IsValid(handle); }
+	bool IsValid(TextureHandle handle) const { return textures.IsValid(handle); }
+
+	// Bindless index for a material to use, or 0 (the first texture) if stale
+	unsigned int GetBindlessIndex(TextureHandle handle);
+
+	// The handle is invalid right away, the resource goes in Collect()
+	void UnloadMesh(MeshHandle handle);
+	void UnloadMaterial(MaterialHandle handle);
+	void UnloadTexture(TextureHandle handle);
+
+	// Frees unloaded resources no frame is still using. Call once a
+	// frame, before anything is unloaded, with the frame being simulated
+	// and how many have been drawn (see FramePipeline).
+	void Collect(unsigned int frame, unsigned int drawnFrames);
+
+private:
+	ResourcePool<Mesh> meshes;
+	ResourcePool<Material> materials;
+	ResourcePool<Texture> textures;
+
+	// Unloads wait for this frame to be drawn
+	unsigned int updateFrame = 0;
+};
\ No newline at end of file
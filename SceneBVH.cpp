@@ -0,0 +1,659 @@
+#include "SceneBVH.h"
+#include "FrustumCulling.h"
+#include "LinearArena.h"
+#include "MemoryTracker.h"
+#include <algorithm>
+#include <cfloat>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <functional>
+
+using namespace DirectX;
+
+// --------------------------------------------------------
+// Box around a sphere, padded a little so rounding never makes
+// the box test stricter than the sphere test it stands in for
+// --------------------------------------------------------
+static void GetObjectBounds(XMFLOAT4 sphere, XMFLOAT3& boundsMin, XMFLOAT3& boundsMax)
+{
+	float padX = sphere.w + (fabsf(sphere.x) + sphere.w) * 1e-6f;
+	float padY = sphere.w + (fabsf(sphere.y) + sphere.w) * 1e-6f;
+	float padZ = sphere.w + (fabsf(sphere.z) + sphere.w) * 1e-6f;
+	boundsMin = XMFLOAT3(sphere.x - padX, sphere.y - padY, sphere.z - padZ);
+	boundsMax = XMFLOAT3(sphere.x + padX, sphere.y + padY, sphere.z + padZ);
+}
+
+static bool SpheresOverlap(XMFLOAT4 a, XMFLOAT4 b)
+{
+	float dx = a.x - b.x;
+	float dy = a.y - b.y;
+	float dz = a.z - b.z;
+	float radii = a.w + b.w;
+	return dx * dx + dy * dy + dz * dz <= radii * radii;
+}
+
+SceneBVH::SceneBVH() :
+	objectCount(0),
+	cost(0),
+	buildCost(0),
+	rebuildCount(0),
+	lastBuildTimeMs(0),
+	lastRefitTimeMs(0)
+{
+}
+
+// --------------------------------------------------------
+// Builds the tree from scratch
+// --------------------------------------------------------
+void SceneBVH::Build(const XMFLOAT4* spheres, unsigned int count)
+{
+	std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+
+	objectCount = count;
+	nodes.clear();
+	objectIndices.resize(count);
+	for (unsigned int i = 0; i < count; i++)
+		objectIndices[i] = i;
+
+	if (count > 0)
+	{
+		buildBoundsMin.resize(count);
+		buildBoundsMax.resize(count);
+		for (unsigned int i = 0; i < count; i++)
+		{
+			XMFLOAT3 objectMin, objectMax;
+			GetObjectBounds(spheres[i], objectMin, objectMax);
+			buildBoundsMin[i] = XMFLOAT4(objectMin.x, objectMin.y, objectMin.z, 0);
+			buildBoundsMax[i] = XMFLOAT4(objectMax.x, objectMax.y, objectMax.z, 0);
+		}
+
+		// Split by sphere centers (the builder ignores w)
+		WideBVH::Build(buildBoundsMin.data(), buildBoundsMax.data(), spheres, objectIndices, nodes);
+	}
+
+	// The build leaves the same boxes a refit would
+	objectSpheres.resize(count);
+	for (unsigned int i = 0; i < count; i++)
+		objectSpheres[i] = spheres[objectIndices[i]];
+	cost = buildCost = ComputeCost();
+
+	std::chrono::duration<double, std::milli> elapsed = std::chrono::high_resolution_clock::now() - start;
+	lastBuildTimeMs = elapsed.count();
+}
+
+// --------------------------------------------------------
+// Recomputes every box bottom up without changing the tree
+// --------------------------------------------------------
+void SceneBVH::Refit(const XMFLOAT4* spheres)
+{
+	std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+
+	for (unsigned int i = 0; i < objectCount; i++)
+		objectSpheres[i] = spheres[objectIndices[i]];
+	RefitNodes();
+	cost = ComputeCost();
+
+	std::chrono::duration<double, std::milli> elapsed = std::chrono::high_resolution_clock::now() - start;
+	lastRefitTimeMs = elapsed.count();
+}
+
+bool SceneBVH::Update(const XMFLOAT4* spheres, unsigned int count)
+{
+	if (count == objectCount)
+	{
+		Refit(spheres);
+		if (cost <= buildCost * BVH_REBUILD_COST_RATIO)
+			return false;
+	}
+
+	// Building allocates its scratch space (refitting doesn't), so a
+	// rebuild is allowed to even in a ZERO_ALLOCATIONS frame
+	ALLOW_ALLOCATIONS();
+	Build(spheres, count);
+	rebuildCount++;
+	return true;
+}
+
+// --------------------------------------------------------
+// Walks the tree testing four child boxes against the frustum
+// planes at a time. Boxes entirely inside add everything under
+// them without further tests; objects in leaves that cross a
+// plane get the exact sphere test.
+// --------------------------------------------------------
+void SceneBVH::QueryFrustum(XMFLOAT4X4 viewProjection, std::vector<unsigned int>& results)
+{
+	results.clear();
+	if (nodes.empty())
+		return;
+
+	XMVECTOR planes[6];
+	ExtractFrustumPlanes(viewProjection, planes);
+	XMFLOAT4 planeValues[6];
+	for (int p = 0; p < 6; p++)
+		XMStoreFloat4(&planeValues[p], planes[p]);
+
+	unsigned int stack[BVH_STACK_SIZE];
+	unsigned int stackSize = 0;
+	stack[stackSize++] = 0;
+	while (stackSize > 0)
+	{
+		const WideBVHNode& node = nodes[stack[--stackSize]];
+		XMVECTOR minX = XMLoadFloat4((const XMFLOAT4*)node.minX);
+		XMVECTOR minY = XMLoadFloat4((const XMFLOAT4*)node.minY);
+		XMVECTOR minZ = XMLoadFloat4((const XMFLOAT4*)node.minZ);
+		XMVECTOR maxX = XMLoadFloat4((const XMFLOAT4*)node.maxX);
+		XMVECTOR maxY = XMLoadFloat4((const XMFLOAT4*)node.maxY);
+		XMVECTOR maxZ = XMLoadFloat4((const XMFLOAT4*)node.maxZ);
+
+		// A box is outside if its corner farthest along a plane's normal
+		// is behind it, and crosses it if its nearest corner is
+		XMVECTOR outside = XMVectorFalseInt();
+		XMVECTOR crossing = XMVectorFalseInt();
+		for (int p = 0; p < 6; p++)
+		{
+			const XMFLOAT4& plane = planeValues[p];
+			XMVECTOR normalX = XMVectorSplatX(planes[p]);
+			XMVECTOR normalY = XMVectorSplatY(planes[p]);
+			XMVECTOR normalZ = XMVectorSplatZ(planes[p]);
+			XMVECTOR offset = XMVectorSplatW(planes[p]);
+
+			XMVECTOR farDistance = XMVectorAdd(
+				XMVectorMultiplyAdd(plane.x >= 0 ? maxX : minX, normalX,
+				XMVectorMultiplyAdd(plane.y >= 0 ? maxY : minY, normalY,
+				XMVectorMultiply(plane.z >= 0 ? maxZ : minZ, normalZ))),
+				offset);
+			XMVECTOR nearDistance = XMVectorAdd(
+				XMVectorMultiplyAdd(plane.x >= 0 ? minX : maxX, normalX,
+				XMVectorMultiplyAdd(plane.y >= 0 ? minY : maxY, normalY,
+				XMVectorMultiply(plane.z >= 0 ? minZ : maxZ, normalZ))),
+				offset);
+			outside = XMVectorOrInt(outside, XMVectorLess(farDistance, XMVectorZero()));
+			crossing = XMVectorOrInt(crossing, XMVectorLess(nearDistance, XMVectorZero()));
+		}
+		int outsideMask = _mm_movemask_ps(outside);
+		int crossingMask = _mm_movemask_ps(crossing);
+
+		for (int lane = 0; lane < 4; lane++)
+		{
+			if (outsideMask & (1 << lane))
+				continue;
+
+			unsigned int child = node.children[lane];
+			bool inside = !(crossingMask & (1 << lane));
+			if (!(child & BVH_LEAF))
+			{
+				if (inside)
+					AddObjects(nodes[child].firstItem, nodes[child].itemCount, results);
+				else
+					stack[stackSize++] = child;
+				continue;
+			}
+
+			unsigned int first = WideBVH::GetLeafIndex(child);
+			unsigned int count = WideBVH::GetLeafCount(child);
+			if (inside)
+			{
+				AddObjects(first, count, results);
+				continue;
+			}
+
+			for (unsigned int o = first; o < first + count; o++)
+			{
+				// Same test (and order of operations) as FrustumCulling
+				const XMFLOAT4& sphere = objectSpheres[o];
+				bool sphereOutside = false;
+				for (int p = 0; p < 6 && !sphereOutside; p++)
+				{
+					const XMFLOAT4& plane = planeValues[p];
+					float distance = (sphere.x * plane.x + (sphere.y * plane.y + sphere.z * plane.z)) + plane.w;
+					sphereOutside = distance < -sphere.w;
+				}
+				if (!sphereOutside)
+					results.push_back(objectIndices[o]);
+			}
+		}
+	}
+	SortResults(results);
+}
+
+// --------------------------------------------------------
+// Finds every object whose sphere touches the given one
+// (like the objects a point light reaches)
+// --------------------------------------------------------
+void SceneBVH::QuerySphere(XMFLOAT4 sphere, std::vector<unsigned int>& results)
+{
+	results.clear();
+	if (nodes.empty())
+		return;
+
+	XMVECTOR centerX = XMVectorReplicate(sphere.x);
+	XMVECTOR centerY = XMVectorReplicate(sphere.y);
+	XMVECTOR centerZ = XMVectorReplicate(sphere.z);
+	XMVECTOR radiusSquared = XMVectorReplicate(sphere.w * sphere.w);
+
+	unsigned int stack[BVH_STACK_SIZE];
+	unsigned int stackSize = 0;
+	stack[stackSize++] = 0;
+	while (stackSize > 0)
+	{
+		const WideBVHNode& node = nodes[stack[--stackSize]];
+
+		// Squared distance from the center to each box
+		XMVECTOR dx = XMVectorMax(XMVectorMax(
+			XMVectorSubtract(XMLoadFloat4((const XMFLOAT4*)node.minX), centerX),
+			XMVectorSubtract(centerX, XMLoadFloat4((const XMFLOAT4*)node.maxX))), XMVectorZero());
+		XMVECTOR dy = XMVectorMax(XMVectorMax(
+			XMVectorSubtract(XMLoadFloat4((const XMFLOAT4*)node.minY), centerY),
+			XMVectorSubtract(centerY, XMLoadFloat4((const XMFLOAT4*)node.maxY))), XMVectorZero());
+		XMVECTOR dz = XMVectorMax(XMVectorMax(
+			XMVectorSubtract(XMLoadFloat4((const XMFLOAT4*)node.minZ), centerZ),
+			XMVectorSubtract(centerZ, XMLoadFloat4((const XMFLOAT4*)node.maxZ))), XMVectorZero());
+		XMVECTOR distanceSquared = XMVectorMultiplyAdd(dx, dx, XMVectorMultiplyAdd(dy, dy, XMVectorMultiply(dz, dz)));
+		int touching = _mm_movemask_ps(XMVectorLessOrEqual(distanceSquared, radiusSquared));
+
+		for (int lane = 0; lane < 4; lane++)
+		{
+			if (!(touching & (1 << lane)))
+				continue;
+
+			unsigned int child = node.children[lane];
+			if (!(child & BVH_LEAF))
+			{
+				stack[stackSize++] = child;
+				continue;
+			}
+
+			unsigned int first = WideBVH::GetLeafIndex(child);
+			unsigned int count = WideBVH::GetLeafCount(child);
+			for (unsigned int o = first; o < first + count; o++)
+			{
+				if (SpheresOverlap(sphere, objectSpheres[o]))
+					results.push_back(objectIndices[o]);
+			}
+		}
+	}
+	SortResults(results);
+}
+
+bool SceneBVH::Raycast(XMFLOAT3 origin, XMFLOAT3 direction, float maxDistance, unsigned int& hitIndex, float& hitDistance)
+{
+	return Raycast(origin, direction, maxDistance, std::function<float(unsigned int, float, float)>(), hitIndex, hitDistance);
+}
+
+// --------------------------------------------------------
+// Walks the tree nearest box first, skipping boxes that start
+// past the closest hit so far. Ties go to the lowest index, so
+// the result doesn't depend on the tree's shape.
+//
+// A sphere is never hit farther along the ray than what's inside
+// it, so only objects whose spheres are hit in time need the
+// caller's (usually much slower) test.
+// --------------------------------------------------------
+bool SceneBVH::Raycast(XMFLOAT3 origin, XMFLOAT3 direction, float maxDistance,
+	const std::function<float(unsigned int, float, float)>& intersect, unsigned int& hitIndex, float& hitDistance)
+{
+	XMStoreFloat3(&direction, XMVector3Normalize(XMLoadFloat3(&direction)));
+	if (nodes.empty() || (direction.x == 0 && direction.y == 0 && direction.z == 0))
+		return false;
+
+	bool hit = false;
+	hitDistance = maxDistance;
+	WideBVH::Raycast(nodes, origin, direction, hitDistance, [&](unsigned int first, unsigned int count)
+	{
+		for (unsigned int o = first; o < first + count; o++)
+		{
+			float t = RaySphere(origin, direction, objectSpheres[o]);
+			if (t == FLT_MAX || t > hitDistance)
+				continue;
+			if (intersect)
+			{
+				t = intersect(objectIndices[o], t, hitDistance);
+				if (t == FLT_MAX || t > hitDistance)
+					continue;
+			}
+			if (t == hitDistance && hit && objectIndices[o] > hitIndex)
+				continue;
+
+			hit = true;
+			hitIndex = objectIndices[o];
+			hitDistance = t;
+		}
+	});
+	return hit;
+}
+
+// --------------------------------------------------------
+// Best first search: boxes are opened nearest first, and the
+// search stops once the nearest unopened box is farther than
+// the kth nearest object found so far
+// --------------------------------------------------------
+void SceneBVH::QueryNearest(XMFLOAT3 point, unsigned int k, std::vector<unsigned int>& results)
+{
+	results.clear();
+	if (nodes.empty() || k == 0)
+		return;
+
+	// (distance, index) pairs, so equal distances are broken by index
+	typedef std::pair<float, unsigned int> Candidate;
+	std::vector<Candidate> nearest;     // Max heap of the best k so far
+	std::vector<Candidate> open;        // Min heap of boxes to open
+	nearest.reserve(k + 1);
+	open.push_back(Candidate(0.0f, 0u));
+
+	XMVECTOR pointX = XMVectorReplicate(point.x);
+	XMVECTOR pointY = XMVectorReplicate(point.y);
+	XMVECTOR pointZ = XMVectorReplicate(point.z);
+	while (!open.empty())
+	{
+		std::pop_heap(open.begin(), open.end(), std::greater<Candidate>());
+		Candidate box = open.back();
+		open.pop_back();
+		if (nearest.size() == k && box.first > nearest.front().first)
+			break;
+		const WideBVHNode& node = nodes[box.second];
+
+		XMVECTOR dx = XMVectorMax(XMVectorMax(
+			XMVectorSubtract(XMLoadFloat4((const XMFLOAT4*)node.minX), pointX),
+			XMVectorSubtract(pointX, XMLoadFloat4((const XMFLOAT4*)node.maxX))), XMVectorZero());
+		XMVECTOR dy = XMVectorMax(XMVectorMax(
+			XMVectorSubtract(XMLoadFloat4((const XMFLOAT4*)node.minY), pointY),
+			XMVectorSubtract(pointY, XMLoadFloat4((const XMFLOAT4*)node.maxY))), XMVectorZero());
+		XMVECTOR dz = XMVectorMax(XMVectorMax(
+			XMVectorSubtract(XMLoadFloat4((const XMFLOAT4*)node.minZ), pointZ),
+			XMVectorSubtract(pointZ, XMLoadFloat4((const XMFLOAT4*)node.maxZ))), XMVectorZero());
+		XMFLOAT4 boxDistance;
+		XMStoreFloat4(&boxDistance, XMVectorSqrt(XMVectorMultiplyAdd(dx, dx, XMVectorMultiplyAdd(dy, dy, XMVectorMultiply(dz, dz)))));
+
+		for (int lane = 0; lane < 4; lane++)
+		{
+			float distance = (&boxDistance.x)[lane];
+			if (nearest.size() == k && distance > nearest.front().first)
+				continue;
+
+			unsigned int child = node.children[lane];
+			if (!(child & BVH_LEAF))
+			{
+				open.push_back(Candidate(distance, child));
+				std::push_heap(open.begin(), open.end(), std::greater<Candidate>());
+				continue;
+			}
+
+			unsigned int first = WideBVH::GetLeafIndex(child);
+			unsigned int count = WideBVH::GetLeafCount(child);
+			for (unsigned int o = first; o < first + count; o++)
+			{
+				Candidate object(SphereDistance(point, objectSpheres[o]), objectIndices[o]);
+				if (nearest.size() < k)
+				{
+					nearest.push_back(object);
+					std::push_heap(nearest.begin(), nearest.end());
+				}
+				else if (object < nearest.front())
+				{
+					std::pop_heap(nearest.begin(), nearest.end());
+					nearest.back() = object;
+					std::push_heap(nearest.begin(), nearest.end());
+				}
+			}
+		}
+	}
+
+	std::sort_heap(nearest.begin(), nearest.end());
+	for (const Candidate& object : nearest)
+		results.push_back(object.second);
+}
+
+void SceneBVH::QueryFrustumBruteForce(XMFLOAT4X4 viewProjection, std::vector<unsigned int>& results)
+{
+	XMVECTOR planes[6];
+	ExtractFrustumPlanes(viewProjection, planes);
+	XMFLOAT4 planeValues[6];
+	for (int p = 0; p < 6; p++)
+		XMStoreFloat4(&planeValues[p], planes[p]);
+
+	results.clear();
+	for (unsigned int o = 0; o < objectCount; o++)
+	{
+		const XMFLOAT4& sphere = objectSpheres[o];
+		bool outside = false;
+		for (int p = 0; p < 6 && !outside; p++)
+		{
+			const XMFLOAT4& plane = planeValues[p];
+			float distance = (sphere.x * plane.x + (sphere.y * plane.y + sphere.z * plane.z)) + plane.w;
+			outside = distance < -sphere.w;
+		}
+		if (!outside)
+			results.push_back(objectIndices[o]);
+	}
+	std::sort(results.begin(), results.end());
+}
+
+void SceneBVH::QuerySphereBruteForce(XMFLOAT4 sphere, std::vector<unsigned int>& results)
+{
+	results.clear();
+	for (unsigned int o = 0; o < objectCount; o++)
+	{
+		if (SpheresOverlap(sphere, objectSpheres[o]))
+			results.push_back(objectIndices[o]);
+	}
+	std::sort(results.begin(), results.end());
+}
+
+bool SceneBVH::RaycastBruteForce(XMFLOAT3 origin, XMFLOAT3 direction, float maxDistance, unsigned int& hitIndex, float& hitDistance)
+{
+	XMStoreFloat3(&direction, XMVector3Normalize(XMLoadFloat3(&direction)));
+	if (direction.x == 0 && direction.y == 0 && direction.z == 0)
+		return false;
+
+	bool hit = false;
+	hitDistance = maxDistance;
+	for (unsigned int o = 0; o < objectCount; o++)
+	{
+		float t = RaySphere(origin, direction, objectSpheres[o]);
+		if (t == FLT_MAX || t > hitDistance || (t == hitDistance && hit && objectIndices[o] > hitIndex))
+			continue;
+
+		hit = true;
+		hitIndex = objectIndices[o];
+		hitDistance = t;
+	}
+	return hit;
+}
+
+void SceneBVH::QueryNearestBruteForce(XMFLOAT3 point, unsigned int k, std::vector<unsigned int>& results)
+{
+	std::vector<std::pair<float, unsigned int>> all(objectCount);
+	for (unsigned int o = 0; o < objectCount; o++)
+		all[o] = std::pair<float, unsigned int>(SphereDistance(point, objectSpheres[o]), objectIndices[o]);
+
+	k = std::min(k, objectCount);
+	std::partial_sort(all.begin(), all.begin() + k, all.end());
+	results.resize(k);
+	for (unsigned int i = 0; i < k; i++)
+		results[i] = all[i].second;
+}
+
+unsigned int SceneBVH::GetObjectCount()
+{
+	return objectCount;
+}
+
+unsigned int SceneBVH::GetNodeCount()
+{
+	return (unsigned int)nodes.size();
+}
+
+float SceneBVH::GetCost()
+{
+	return cost;
+}
+
+float SceneBVH::GetBuildCost()
+{
+	return buildCost;
+}
+
+unsigned int SceneBVH::GetRebuildCount()
+{
+	return rebuildCount;
+}
+
+double SceneBVH::GetLastBuildTimeMs()
+{
+	return lastBuildTimeMs;
+}
+
+double SceneBVH::GetLastRefitTimeMs()
+{
+	return lastRefitTimeMs;
+}
+
+// --------------------------------------------------------
+// Children are always stored after their parents, so going
+// backwards every child's boxes are done before its parent's
+// --------------------------------------------------------
+void SceneBVH::RefitNodes()
+{
+	for (size_t n = nodes.size(); n-- > 0;)
+	{
+		WideBVHNode& node = nodes[n];
+		for (int lane = 0; lane < 4; lane++)
+		{
+			XMFLOAT3 boundsMin(FLT_MAX, FLT_MAX, FLT_MAX);
+			XMFLOAT3 boundsMax(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+			unsigned int child = node.children[lane];
+			if (child & BVH_LEAF)
+			{
+				unsigned int first = WideBVH::GetLeafIndex(child);
+				unsigned int count = WideBVH::GetLeafCount(child);
+				for (unsigned int o = first; o < first + count; o++)
+				{
+					XMFLOAT3 objectMin, objectMax;
+					GetObjectBounds(objectSpheres[o], objectMin, objectMax);
+					WideBVH::Grow(boundsMin, boundsMax, objectMin, objectMax);
+				}
+			}
+			else
+			{
+				const WideBVHNode& childNode = nodes[child];
+				for (int childLane = 0; childLane < 4; childLane++)
+				{
+					WideBVH::Grow(boundsMin, boundsMax,
+						XMFLOAT3(childNode.minX[childLane], childNode.minY[childLane], childNode.minZ[childLane]),
+						XMFLOAT3(childNode.maxX[childLane], childNode.maxY[childLane], childNode.maxZ[childLane]));
+				}
+			}
+
+			node.minX[lane] = boundsMin.x;
+			node.minY[lane] = boundsMin.y;
+			node.minZ[lane] = boundsMin.z;
+			node.maxX[lane] = boundsMax.x;
+			node.maxY[lane] = boundsMax.y;
+			node.maxZ[lane] = boundsMax.z;
+		}
+	}
+}
+
+// --------------------------------------------------------
+// SAH cost of the whole tree: the expected number of nodes visited
+// and objects tested by a random ray through the root's box
+// --------------------------------------------------------
+float SceneBVH::ComputeCost()
+{
+	if (nodes.empty())
+		return 0;
+
+	XMFLOAT3 rootMin(FLT_MAX, FLT_MAX, FLT_MAX);
+	XMFLOAT3 rootMax(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+	const WideBVHNode& root = nodes[0];
+	for (int lane = 0; lane < 4; lane++)
+		WideBVH::Grow(rootMin, rootMax, XMFLOAT3(root.minX[lane], root.minY[lane], root.minZ[lane]), XMFLOAT3(root.maxX[lane], root.maxY[lane], root.maxZ[lane]));
+	float rootArea = WideBVH::SurfaceArea(rootMin, rootMax);
+	if (rootArea <= 0)
+		return 1;
+
+	float total = 1;
+	for (const WideBVHNode& node : nodes)
+	{
+		for (int lane = 0; lane < 4; lane++)
+		{
+			unsigned int child = node.children[lane];
+			float area = WideBVH::SurfaceArea(
+				XMFLOAT3(node.minX[lane], node.minY[lane], node.minZ[lane]),
+				XMFLOAT3(node.maxX[lane], node.maxY[lane], node.maxZ[lane]));
+			total += area * ((child & BVH_LEAF) ? WideBVH::GetLeafCount(child) : 1);
+		}
+	}
+	return total / rootArea;
+}
+
+// --------------------------------------------------------
+// Puts query results back in ascending order. Big result sets
+// are marked in a bitset and read back out in order, which is
+// linear instead of n log n.
+// --------------------------------------------------------
+void SceneBVH::SortResults(std::vector<unsigned int>& results)
+{
+	if (results.size() * 16 < objectCount)
+	{
+		std::sort(results.begin(), results.end());
+		return;
+	}
+
+	unsigned int wordCount = (objectCount + 63) / 64;
+	ScratchScope scratch;
+	unsigned long long* bits = scratch.AllocateArray<unsigned long long>(wordCount);
+	memset(bits, 0, sizeof(unsigned long long) * wordCount);
+	for (unsigned int index : results)
+		bits[index >> 6] |= 1ull << (index & 63);
+
+	// Write every bit's index and only advance past the set ones
+	unsigned int count = 0;
+	results.resize(results.size() + 64);
+	for (unsigned int word = 0; word < wordCount; word++)
+	{
+		unsigned long long remaining = bits[word];
+		for (unsigned int bit = 0; remaining != 0; bit++, remaining >>= 1)
+		{
+			results[count] = word * 64 + bit;
+			count += (unsigned int)(remaining & 1);
+		}
+	}
+	results.resize(count);
+}
+
+void SceneBVH::AddObjects(unsigned int firstObject, unsigned int count, std::vector<unsigned int>& results)
+{
+	results.insert(results.end(), objectIndices.begin() + firstObject, objectIndices.begin() + firstObject + count);
+}
+
+// --------------------------------------------------------
+// Distance along a (normalized) ray to a sphere, 0 if the ray
+// starts inside it, or FLT_MAX if it misses
+// --------------------------------------------------------
+float SceneBVH::RaySphere(XMFLOAT3 origin, XMFLOAT3 direction, XMFLOAT4 sphere)
+{
+	float toCenterX = sphere.x - origin.x;
+	float toCenterY = sphere.y - origin.y;
+	float toCenterZ = sphere.z - origin.z;
+	float along = toCenterX * direction.x + toCenterY * direction.y + toCenterZ * direction.z;
+	float missSquared = (toCenterX * toCenterX + toCenterY * toCenterY + toCenterZ * toCenterZ) - along * along;
+	float radiusSquared = sphere.w * sphere.w;
+	if (missSquared > radiusSquared)
+		return FLT_MAX;
+
+	float halfChord = sqrtf(radiusSquared - missSquared);
+	if (along + halfChord < 0)
+		return FLT_MAX;
+	return std::max(along - halfChord, 0.0f);
+}
+
+// Distance from a point to the surface of a sphere (0 inside)
+float SceneBVH::SphereDistance(XMFLOAT3 point, XMFLOAT4 sphere)
+{
+	float dx = sphere.x - point.x;
+	float dy = sphere.y - point.y;
+	float dz = sphere.z - point.z;
+	return std::max(sqrtf(dx * dx + dy * dy + dz * dz) - sphere.w, 0.0f);
+}
\ No newline at end of file
@@ -0,0 +1,98 @@
+#pragma once
+#include <DirectXMath.h>
+#include <functional>
+#include <vector>
+#include "WideBVH.h"
+
+// Refitting keeps the tree correct but slowly makes it worse as things
+// move. Once its SAH cost is this many times a fresh build's, rebuild.
+#define BVH_REBUILD_COST_RATIO 1.5f
+
+// --------------------------------------------------------
+// Bounding volume hierarchy over object bounding spheres, for culling
+// and spatial queries that would otherwise scan every object.
+//
+// Built by WideBVH: binned SAH collapsed into 4-wide nodes stored in
+// one array, parent before children, so one SSE test covers a node's
+// four children and a refit is a single backwards pass. Leaves index
+// their first object in leaf order.
+//
+// Objects are referred to by their index in the sphere array passed
+// to Build(). Query results are in ascending order, like FrustumCulling.
+// Queries only read the tree, so several can run at once.
+// --------------------------------------------------------
+class SceneBVH
+{
+public:
+	SceneBVH();
+
+	// spheres - World space bounding spheres (xyz = center, w = radius)
+	void Build(const DirectX::XMFLOAT4* spheres, unsigned int count);
+
+	// Updates the bounds for objects that moved (same objects, same order)
+	void Refit(const DirectX::XMFLOAT4* spheres);
+
+	// Refits, or rebuilds if the object count changed or refitting has
+	// made the tree too slow. Returns true if it rebuilt. Only a rebuild
+	// allocates, so only it is let off a ZERO_ALLOCATIONS scope.
+	bool Update(const DirectX::XMFLOAT4* spheres, unsigned int count);
+
+	// Objects at least partly inside the frustum (same test as FrustumCulling).
+	// Sorting the results borrows 64 entries past the end, so results with
+	// room for the object count plus 64 never grow.
+	void QueryFrustum(DirectX::XMFLOAT4X4 viewProjection, std::vector<unsigned int>& results);
+
+	// Objects whose spheres overlap this one
+	void QuerySphere(DirectX::XMFLOAT4 sphere, std::vector<unsigned int>& results);
+
+	// Nearest object whose sphere the ray hits within maxDistance (a
+	// ray starting inside a sphere hits it at distance 0)
+	bool Raycast(DirectX::XMFLOAT3 origin, DirectX::XMFLOAT3 direction, float maxDistance, unsigned int& hitIndex, float& hitDistance);
+
+	// Same, but the exact test is up to the caller (like a mesh's triangles):
+	// objects whose spheres the ray hits nearer than the best hit so far are
+	// passed to intersect(object, sphereDistance, maxDistance), which returns
+	// the distance along the ray to its hit, or FLT_MAX if it misses
+	bool Raycast(DirectX::XMFLOAT3 origin, DirectX::XMFLOAT3 direction, float maxDistance,
+		const std::function<float(unsigned int, float, float)>& intersect, unsigned int& hitIndex, float& hitDistance);
+
+	// The k objects whose spheres are nearest the point, nearest first
+	void QueryNearest(DirectX::XMFLOAT3 point, unsigned int k, std::vector<unsigned int>& results);
+
+	// Linear scans over every object with the same tests, for verification
+	void QueryFrustumBruteForce(DirectX::XMFLOAT4X4 viewProjection, std::vector<unsigned int>& results);
+	void QuerySphereBruteForce(DirectX::XMFLOAT4 sphere, std::vector<unsigned int>& results);
+	bool RaycastBruteForce(DirectX::XMFLOAT3 origin, DirectX::XMFLOAT3 direction, float maxDistance, unsigned int& hitIndex, float& hitDistance);
+	void QueryNearestBruteForce(DirectX::XMFLOAT3 point, unsigned int k, std::vector<unsigned int>& results);
+
+	// Stats
+	unsigned int GetObjectCount();
+	unsigned int GetNodeCount();
+	float GetCost();              // SAH cost now
+	float GetBuildCost();         // SAH cost right after the last build
+	unsigned int GetRebuildCount();
+	double GetLastBuildTimeMs();
+	double GetLastRefitTimeMs();
+
+private:
+	std::vector<WideBVHNode> nodes;
+	std::vector<unsigned int> objectIndices;            // Leaf order -> caller's index
+	std::vector<DirectX::XMFLOAT4> objectSpheres;       // In leaf order
+	std::vector<DirectX::XMFLOAT4> buildBoundsMin;      // Each object's box, by
+	std::vector<DirectX::XMFLOAT4> buildBoundsMax;      // the caller's index
+
+	unsigned int objectCount;
+	float cost;
+	float buildCost;
+	unsigned int rebuildCount;
+	double lastBuildTimeMs;
+	double lastRefitTimeMs;
+
+	void RefitNodes();
+	float ComputeCost();
+	void AddObjects(unsigned int firstObject, unsigned int count, std::vector<unsigned int>& results);
+	void SortResults(std::vector<unsigned int>& results);
+
+	static float RaySphere(DirectX::XMFLOAT3 origin, DirectX::XMFLOAT3 direction, DirectX::XMFLOAT4 sphere);
+	static float SphereDistance(DirectX::XMFLOAT3 point, DirectX::XMFLOAT4 sphere);
+};
\ No newline at end of file
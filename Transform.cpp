@@ -1,4 +1,5 @@
 #include "Transform.h"
+#include <cmath>
 
 using namespace DirectX;
 
@@ -6,6 +7,10 @@ Transform::Transform():
     position(XMFLOAT3()),
     scale(XMFLOAT3(1, 1, 1)),
     pitchYawRoll(XMFLOAT3()),
+    orientation(XMFLOAT4(0, 0, 0, 1)),
+    right(XMFLOAT3(1, 0, 0)),
+    up(XMFLOAT3(0, 1, 0)),
+    forward(XMFLOAT3(0, 0, 1)),
     dirty(false)
 {
     XMStoreFloat4x4(&worldMatrix, XMMatrixIdentity());
@@ -16,8 +21,13 @@ Transform::Transform(DirectX::XMFLOAT3 _position, DirectX::XMFLOAT3 _scale, Dire
     position(_position),
     scale(_scale),
     pitchYawRoll(_pitchYawRoll),
+    right(XMFLOAT3(1, 0, 0)),
+    up(XMFLOAT3(0, 1, 0)),
+    forward(XMFLOAT3(0, 0, 1)),
     dirty(true)
 {
+    UpdateQuaternion();
+
     // Matricies are dirty and will be calculated upon retrieval in case more changes are made before then
     // This is to make the compiler warnings shut up
     XMStoreFloat4x4(&worldMatrix, XMMatrixIdentity());
@@ -39,12 +49,29 @@ void Transform::SetPosition(DirectX::XMFLOAT3 _position)
 void Transform::SetRotation(float pitch, float yaw, float roll)
 {
     pitchYawRoll = XMFLOAT3(pitch, yaw, roll);
+    UpdateQuaternion();
     dirty = true;
 }
 
 void Transform::setRotation(DirectX::XMFLOAT3 rotation)
 {
     pitchYawRoll = rotation;
+    UpdateQuaternion();
+    dirty = true;
+}
+
+void Transform::SetRotation(DirectX::XMFLOAT4 quaternion)
+{
+    XMStoreFloat4(&orientation, XMQuaternionNormalize(XMLoadFloat4(&quaternion)));
+
+    // Recover pitch/yaw/roll from the rotated forward and right/up vectors
+    // (same roll -> pitch -> yaw order as XMQuaternionRotationRollPitchYaw)
+    XMFLOAT4X4 matrix;
+    XMStoreFloat4x4(&matrix, XMMatrixRotationQuaternion(XMLoadFloat4(&orientation)));
+    float sinPitch = -matrix._32;
+    pitchYawRoll.x = asinf(sinPitch < -1.0f ? -1.0f : (sinPitch > 1.0f ? 1.0f : sinPitch));
+    pitchYawRoll.y = atan2f(matrix._31, matrix._33);
+    pitchYawRoll.z = atan2f(matrix._12, matrix._22);
     dirty = true;
 }
 
@@ -76,6 +103,11 @@ DirectX::XMFLOAT3 Transform::GetPitchYawRoll()
     return pitchYawRoll;
 }
 
+DirectX::XMFLOAT4 Transform::GetRotation()
+{
+    return orientation;
+}
+
 DirectX::XMFLOAT3 Transform::GetScale()
 {
     return scale;
@@ -97,32 +129,23 @@ DirectX::XMFLOAT4X4 Transform::GetWorldInverseTransposeMatrix()
 
 DirectX::XMFLOAT3 Transform::GetRight()
 {
-    XMVECTOR right = XMVectorSet(1, 0, 0, 0);
-    XMVECTOR quaternion = XMQuaternionRotationRollPitchYaw(pitchYawRoll.x, pitchYawRoll.y, pitchYawRoll.z); // TODO: What if i make a similar get quaternion to the world matrix so i dont need to keep re converting from roll pitch yaw. or honelstly same with the direction vectors... hmm more memory for probably little performance saving. sounds like a later problem
-    right = XMVector3Rotate(right, quaternion);
-    XMFLOAT3 result;
-    XMStoreFloat3(&result, right);
-    return result;
+    if (dirty) GenerateMatricies();
+
+    return right;
 }
 
 DirectX::XMFLOAT3 Transform::GetUp()
 {
-    XMVECTOR up = XMVectorSet(0, 1, 0, 0);
-    XMVECTOR quaternion = XMQuaternionRotationRollPitchYaw(pitchYawRoll.x, pitchYawRoll.y, pitchYawRoll.z); 
-    up = XMVector3Rotate(up, quaternion);
-    XMFLOAT3 result;
-    XMStoreFloat3(&result, up);
-    return result;
+    if (dirty) GenerateMatricies();
+
+    return up;
 }
 
 DirectX::XMFLOAT3 Transform::GetForward()
 {
-    XMVECTOR forward = XMVectorSet(0, 0, 1, 0);
-    XMVECTOR quaternion = XMQuaternionRotationRollPitchYaw(pitchYawRoll.x, pitchYawRoll.y, pitchYawRoll.z);
-    forward = XMVector3Rotate(forward, quaternion);
-    XMFLOAT3 result;
-    XMStoreFloat3(&result, forward);
-    return result;
+    if (dirty) GenerateMatricies();
+
+    return forward;
 }
 
 void Transform::MoveAbsolute(float x, float y, float z)
@@ -140,12 +163,14 @@ void Transform::MoveAbsolute(DirectX::XMFLOAT3 offset)
 void Transform::Rotate(float pitch, float yaw, float roll)
 {
     XMStoreFloat3(&pitchYawRoll, XMVectorAdd(XMLoadFloat3(&pitchYawRoll), XMVectorSet(pitch, yaw, roll, 0)));
+    UpdateQuaternion();
     dirty = true;
 }
 
 void Transform::Rotate(DirectX::XMFLOAT3 rotation)
 {
     XMStoreFloat3(&pitchYawRoll, XMVectorAdd(XMLoadFloat3(&pitchYawRoll), XMLoadFloat3(&rotation)));
+    UpdateQuaternion();
     dirty = true;
 }
 
@@ -169,32 +194,53 @@ void Transform::Scale(float _scale)
 
 void Transform::MoveRelative(float x, float y, float z)
 {
-    XMVECTOR move = XMVectorSet(x, y, z, 0);
-    XMVECTOR quaternion = XMQuaternionRotationRollPitchYaw(pitchYawRoll.x, pitchYawRoll.y, pitchYawRoll.z);
-    move = XMVector3Rotate(move, quaternion);
+    XMVECTOR move = XMVector3Rotate(XMVectorSet(x, y, z, 0), XMLoadFloat4(&orientation));
     XMStoreFloat3(&position, XMVectorAdd(move, XMLoadFloat3(&position)));
+    dirty = true;
 }
 
 void Transform::MoveRelative(DirectX::XMFLOAT3 offset)
 {
-    XMVECTOR move = XMLoadFloat3(&offset);
-    XMVECTOR quaternion = XMQuaternionRotationRollPitchYaw(pitchYawRoll.x, pitchYawRoll.y, pitchYawRoll.z);
-    move = XMVector3Rotate(move, quaternion);
+    XMVECTOR move = XMVector3Rotate(XMLoadFloat3(&offset), XMLoadFloat4(&orientation));
     XMStoreFloat3(&position, XMVectorAdd(move, XMLoadFloat3(&position)));
+    dirty = true;
 }
 
-void Transform::GenerateMatricies()
+// Only place pitch/yaw/roll gets converted, so getters and moves don't redo the trig
+void Transform::UpdateQuaternion()
 {
-    XMMATRIX translation = XMMatrixTranslation(position.x, position.y, position.z);
-    XMMATRIX rotation = XMMatrixRotationRollPitchYaw(pitchYawRoll.x, pitchYawRoll.y, pitchYawRoll.z);
-    XMMATRIX scaling = XMMatrixScaling(scale.x, scale.y, scale.z);
-
-    // multiplied reverse for GPU
-    XMMATRIX world = XMMatrixMultiply(XMMatrixMultiply(scaling, rotation), translation);
+    XMStoreFloat4(&orientation, XMQuaternionRotationRollPitchYaw(pitchYawRoll.x, pitchYawRoll.y, pitchYawRoll.z));
+}
 
+void Transform::GenerateMatricies()
+{
+    // Rows of the rotation matrix are the local right, up and forward vectors
+    XMMATRIX rotationMatrix = XMMatrixRotationQuaternion(XMLoadFloat4(&orientation));
+    XMStoreFloat3(&right, rotationMatrix.r[0]);
+    XMStoreFloat3(&up, rotationMatrix.r[1]);
+    XMStoreFloat3(&forward, rotationMatrix.r[2]);
+
+    // World is scale * rotation * translation (multiplied reverse for GPU),
+    // which for a TRS transform is just the scaled basis rows plus the position
+    XMVECTOR translation = XMVectorSetW(XMLoadFloat3(&position), 1);
+    XMMATRIX world;
+    world.r[0] = XMVectorScale(rotationMatrix.r[0], scale.x);
+    world.r[1] = XMVectorScale(rotationMatrix.r[1], scale.y);
+    world.r[2] = XMVectorScale(rotationMatrix.r[2], scale.z);
+    world.r[3] = translation;
     XMStoreFloat4x4(&worldMatrix, world);
-    // For a future thing
-    XMStoreFloat4x4(&worldInverseTransposeMatrix, XMMatrixInverse(0, XMMatrixTranspose(world)));
+
+    // Inverse transpose is (1/scale) * rotation with the inverse translation in the last column,
+    // so there's no need for a general 4x4 inverse
+    XMMATRIX inverseTranspose;
+    inverseTranspose.r[0] = XMVectorScale(rotationMatrix.r[0], 1.0f / scale.x);
+    inverseTranspose.r[1] = XMVectorScale(rotationMatrix.r[1], 1.0f / scale.y);
+    inverseTranspose.r[2] = XMVectorScale(rotationMatrix.r[2], 1.0f / scale.z);
+    inverseTranspose.r[0] = XMVectorSetW(inverseTranspose.r[0], -XMVectorGetX(XMVector3Dot(inverseTranspose.r[0], translation)));
+    inverseTranspose.r[1] = XMVectorSetW(inverseTranspose.r[1], -XMVectorGetX(XMVector3Dot(inverseTranspose.r[1], translation)));
+    inverseTranspose.r[2] = XMVectorSetW(inverseTranspose.r[2], -XMVectorGetX(XMVector3Dot(inverseTranspose.r[2], translation)));
+    inverseTranspose.r[3] = XMVectorSet(0, 0, 0, 1);
+    XMStoreFloat4x4(&worldInverseTransposeMatrix, inverseTranspose);
 
     dirty = false;
 }
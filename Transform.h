@@ -2,6 +2,8 @@
 #include <DirectXMath.h>
 
 // Holds a global position, rotation, and scale with a combined world matrix.
+// Rotation is stored as a quaternion (with the pitch/yaw/roll it came from),
+// and the matrices and direction vectors are rebuilt together when dirty.
 class Transform
 {
 
@@ -18,6 +20,7 @@ public:
 	void SetPosition(DirectX::XMFLOAT3 _position);
 	void SetRotation(float pitch, float yaw, float roll);
 	void setRotation(DirectX::XMFLOAT3 rotation);
+	void SetRotation(DirectX::XMFLOAT4 quaternion);
 	void SetScale(float x, float y, float z);
 	void SetScale(float _scale);
 	void SetScale(DirectX::XMFLOAT3 _scale);
@@ -26,6 +29,7 @@ public:
 	
 	DirectX::XMFLOAT3 GetPosition();
 	DirectX::XMFLOAT3 GetPitchYawRoll();
+	DirectX::XMFLOAT4 GetRotation();
 	DirectX::XMFLOAT3 GetScale();
 	DirectX::XMFLOAT4X4 GetWorldMatrix();
 	DirectX::XMFLOAT4X4 GetWorldInverseTransposeMatrix();
@@ -50,11 +54,17 @@ private:
 	DirectX::XMFLOAT3 position;
 	DirectX::XMFLOAT3 scale;
 	DirectX::XMFLOAT3 pitchYawRoll;
+	DirectX::XMFLOAT4 orientation;
 
+	// Cached, rebuilt by GenerateMatricies() when dirty
 	DirectX::XMFLOAT4X4 worldMatrix;
 	DirectX::XMFLOAT4X4 worldInverseTransposeMatrix;
+	DirectX::XMFLOAT3 right;
+	DirectX::XMFLOAT3 up;
+	DirectX::XMFLOAT3 forward;
 	bool dirty;
 
+	void UpdateQuaternion();
 	void GenerateMatricies();
 };
 
@@ -0,0 +1,816 @@
+#include "TransformSystem.h"
+#include "JobSystem.h"
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstring>
+
+using namespace DirectX;
+
+#define INVALID_TRANSFORM_INDEX 0xFFFFFFFF
+
+// Batches of four per job; fewer than this aren't worth another thread
+#define MIN_BATCHES_PER_UPDATE_JOB 1024
+
+// Smallest sphere around two spheres (negative radius = empty)
+static XMFLOAT4 MergeSpheres(const XMFLOAT4& a, const XMFLOAT4& b)
+{
+	if (b.w < 0) return a;
+	if (a.w < 0) return b;
+
+	float dx = b.x - a.x;
+	float dy = b.y - a.y;
+	float dz = b.z - a.z;
+	float distance = sqrtf(dx * dx + dy * dy + dz * dz);
+	if (distance + b.w <= a.w) return a;
+	if (distance + a.w <= b.w) return b;
+
+	float radius = (distance + a.w + b.w) * 0.5f;
+	float t = (radius - a.w) / distance;
+	return XMFLOAT4(a.x + dx * t, a.y + dy * t, a.z + dz * t, radius);
+}
+
+// Reorders the first order.size() elements of a dense array so element i
+// comes from order[i], using scratch memory that's kept between sorts
+template<typename T>
+static void Permute(std::vector<T>& values, const std::vector<unsigned int>& order, std::vector<unsigned char>& scratch)
+{
+	scratch.resize(order.size() * sizeof(T));
+	T* sorted = (T*)scratch.data();
+	for (unsigned int i = 0; i < order.size(); i++)
+		sorted[i] = values[order[i]];
+	memcpy(values.data(), sorted, order.size() * sizeof(T));
+}
+
+TransformSystem::TransformSystem() :
+	count(0),
+	hierarchyChanged(false)
+{
+}
+
+// --------------------------------------------------------
+// Adds a transform and returns the handle used to refer to it
+// --------------------------------------------------------
+TransformHandle TransformSystem::Create(XMFLOAT3 position, XMFLOAT3 pitchYawRoll, XMFLOAT3 scale, TransformHandle parent)
+{
+	// Grow in batches of four so there is always a whole batch
+	if (count + 1 > positionX.size())
+		Resize((unsigned int)positionX.size() * 2 + 4);
+
+	TransformHandle handle;
+	if (!freeHandles.empty())
+	{
+		handle = freeHandles.back();
+		freeHandles.pop_back();
+	}
+	else
+	{
+		handle = (TransformHandle)handleToIndex.size();
+		handleToIndex.push_back(INVALID_TRANSFORM_INDEX);
+		parents.push_back(INVALID_TRANSFORM_HANDLE);
+		firstChildren.push_back(INVALID_TRANSFORM_HANDLE);
+		nextSiblings.push_back(INVALID_TRANSFORM_HANDLE);
+		previousSiblings.push_back(INVALID_TRANSFORM_HANDLE);
+	}
+
+	unsigned int index = count++;
+	handleToIndex[handle] = index;
+	indexToHandle[index] = handle;
+
+	positionX[index] = position.x;
+	positionY[index] = position.y;
+	positionZ[index] = position.z;
+	pitch[index] = pitchYawRoll.x;
+	yaw[index] = pitchYawRoll.y;
+	roll[index] = pitchYawRoll.z;
+	scaleX[index] = scale.x;
+	scaleY[index] = scale.y;
+	scaleZ[index] = scale.z;
+	dirty[index] = 1;
+	localBounds[index] = XMFLOAT4(0, 0, 0, -1);
+
+	// Nothing to interpolate from yet
+	previousPositionX[index] = position.x;
+	previousPositionY[index] = position.y;
+	previousPositionZ[index] = position.z;
+	previousPitch[index] = pitchYawRoll.x;
+	previousYaw[index] = pitchYawRoll.y;
+	previousRoll[index] = pitchYawRoll.z;
+	previousScaleX[index] = scale.x;
+	previousScaleY[index] = scale.y;
+	previousScaleZ[index] = scale.z;
+	movedThisTick[index] = 0;
+
+	// Always added after its parent, so the sorting still holds
+	parentIndices[index] = INVALID_TRANSFORM_INDEX;
+	if (IsValid(parent))
+	{
+		Link(handle, parent);
+		parentIndices[index] = handleToIndex[parent];
+	}
+	return handle;
+}
+
+// --------------------------------------------------------
+// Removes a transform by moving the last one into its place,
+// keeping storage dense. Other handles remain valid, and any
+// children become roots.
+// --------------------------------------------------------
+void TransformSystem::Destroy(TransformHandle handle)
+{
+	if (!IsValid(handle))
+		return;
+
+	TransformHandle child = firstChildren[handle];
+	while (child != INVALID_TRANSFORM_HANDLE)
+	{
+		TransformHandle next = nextSiblings[child];
+		parents[child] = INVALID_TRANSFORM_HANDLE;
+		nextSiblings[child] = INVALID_TRANSFORM_HANDLE;
+		previousSiblings[child] = INVALID_TRANSFORM_HANDLE;
+		dirty[handleToIndex[child]] = 1;
+		parentIndices[handleToIndex[child]] = INVALID_TRANSFORM_INDEX;
+		child = next;
+	}
+	firstChildren[handle] = INVALID_TRANSFORM_HANDLE;
+	Unlink(handle);
+
+	unsigned int index = handleToIndex[handle];
+	unsigned int last = count - 1;
+	if (index != last)
+	{
+		positionX[index] = positionX[last];
+		positionY[index] = positionY[last];
+		positionZ[index] = positionZ[last];
+		pitch[index] = pitch[last];
+		yaw[index] = yaw[last];
+		roll[index] = roll[last];
+		scaleX[index] = scaleX[last];
+		scaleY[index] = scaleY[last];
+		scaleZ[index] = scaleZ[last];
+		dirty[index] = dirty[last];
+		localMatrices[index] = localMatrices[last];
+		localInverseTransposeMatrices[index] = localInverseTransposeMatrices[last];
+		worldMatrices[index] = worldMatrices[last];
+		worldInverseTransposeMatrices[index] = worldInverseTransposeMatrices[last];
+		localBounds[index] = localBounds[last];
+		worldBounds[index] = worldBounds[last];
+		hierarchyBounds[index] = hierarchyBounds[last];
+		parentIndices[index] = parentIndices[last];
+		previousPositionX[index] = previousPositionX[last];
+		previousPositionY[index] = previousPositionY[last];
+		previousPositionZ[index] = previousPositionZ[last];
+		previousPitch[index] = previousPitch[last];
+		previousYaw[index] = previousYaw[last];
+		previousRoll[index] = previousRoll[last];
+		previousScaleX[index] = previousScaleX[last];
+		previousScaleY[index] = previousScaleY[last];
+		previousScaleZ[index] = previousScaleZ[last];
+		movedThisTick[index] = movedThisTick[last];
+		interpolatedWorldMatrices[index] = interpolatedWorldMatrices[last];
+		interpolatedWorldInverseTransposeMatrices[index] = interpolatedWorldInverseTransposeMatrices[last];
+
+		// The last transform can't have children (they'd come after it),
+		// but it may now be in front of its own parent
+		if (parentIndices[index] != INVALID_TRANSFORM_INDEX && parentIndices[index] > index)
+			hierarchyChanged = true;
+
+		TransformHandle moved = indexToHandle[last];
+		indexToHandle[index] = moved;
+		handleToIndex[moved] = index;
+	}
+
+	// Leave the old last slot as harmless padding
+	scaleX[last] = scaleY[last] = scaleZ[last] = 1;
+	previousScaleX[last] = previousScaleY[last] = previousScaleZ[last] = 1;
+	dirty[last] = 0;
+	movedThisTick[last] = 0;
+
+	handleToIndex[handle] = INVALID_TRANSFORM_INDEX;
+	freeHandles.push_back(handle);
+	count--;
+}
+
+bool TransformSystem::IsValid(TransformHandle handle)
+{
+	return handle < handleToIndex.size() && handleToIndex[handle] != INVALID_TRANSFORM_INDEX;
+}
+
+unsigned int TransformSystem::GetCount()
+{
+	return count;
+}
+
+void TransformSystem::SetPosition(TransformHandle handle, XMFLOAT3 position)
+{
+	unsigned int i = handleToIndex[handle];
+	positionX[i] = position.x;
+	positionY[i] = position.y;
+	positionZ[i] = position.z;
+	dirty[i] = 1;
+}
+
+void TransformSystem::SetRotation(TransformHandle handle, XMFLOAT3 pitchYawRoll)
+{
+	unsigned int i = handleToIndex[handle];
+	pitch[i] = pitchYawRoll.x;
+	yaw[i] = pitchYawRoll.y;
+	roll[i] = pitchYawRoll.z;
+	dirty[i] = 1;
+}
+
+void TransformSystem::SetScale(TransformHandle handle, XMFLOAT3 scale)
+{
+	unsigned int i = handleToIndex[handle];
+	scaleX[i] = scale.x;
+	scaleY[i] = scale.y;
+	scaleZ[i] = scale.z;
+	dirty[i] = 1;
+}
+
+XMFLOAT3 TransformSystem::GetPosition(TransformHandle handle)
+{
+	unsigned int i = handleToIndex[handle];
+	return XMFLOAT3(positionX[i], positionY[i], positionZ[i]);
+}
+
+XMFLOAT3 TransformSystem::GetPitchYawRoll(TransformHandle handle)
+{
+	unsigned int i = handleToIndex[handle];
+	return XMFLOAT3(pitch[i], yaw[i], roll[i]);
+}
+
+XMFLOAT3 TransformSystem::GetScale(TransformHandle handle)
+{
+	unsigned int i = handleToIndex[handle];
+	return XMFLOAT3(scaleX[i], scaleY[i], scaleZ[i]);
+}
+
+const XMFLOAT4X4& TransformSystem::GetWorldMatrix(TransformHandle handle)
+{
+	return worldMatrices[handleToIndex[handle]];
+}
+
+const XMFLOAT4X4& TransformSystem::GetWorldInverseTransposeMatrix(TransformHandle handle)
+{
+	return worldInverseTransposeMatrices[handleToIndex[handle]];
+}
+
+// --------------------------------------------------------
+// Attaches a transform to a new parent (or detaches it with
+// INVALID_TRANSFORM_HANDLE). Fails if it would create a loop.
+// --------------------------------------------------------
+bool TransformSystem::SetParent(TransformHandle child, TransformHandle parent)
+{
+	if (!IsValid(child) || (parent != INVALID_TRANSFORM_HANDLE && !IsValid(parent)))
+		return false;
+	if (parents[child] == parent)
+		return true;
+
+	// Can't parent something to its own descendant
+	for (TransformHandle ancestor = parent; ancestor != INVALID_TRANSFORM_HANDLE; ancestor = parents[ancestor])
+	{
+		if (ancestor == child)
+			return false;
+	}
+
+	Unlink(child);
+	unsigned int index = handleToIndex[child];
+	parentIndices[index] = INVALID_TRANSFORM_INDEX;
+	if (parent != INVALID_TRANSFORM_HANDLE)
+	{
+		Link(child, parent);
+		parentIndices[index] = handleToIndex[parent];
+
+		// Only needs sorting if the new parent comes later in storage
+		if (parentIndices[index] > index)
+			hierarchyChanged = true;
+	}
+	dirty[index] = 1;
+	return true;
+}
+
+TransformHandle TransformSystem::GetParent(TransformHandle handle)
+{
+	return parents[handle];
+}
+
+TransformHandle TransformSystem::GetFirstChild(TransformHandle handle)
+{
+	return firstChildren[handle];
+}
+
+TransformHandle TransformSystem::GetNextSibling(TransformHandle handle)
+{
+	return nextSiblings[handle];
+}
+
+void TransformSystem::SetLocalBounds(TransformHandle handle, XMFLOAT4 sphere)
+{
+	unsigned int i = handleToIndex[handle];
+	localBounds[i] = sphere;
+	dirty[i] = 1;
+}
+
+const XMFLOAT4& TransformSystem::GetWorldBounds(TransformHandle handle)
+{
+	return worldBounds[handleToIndex[handle]];
+}
+
+const XMFLOAT4& TransformSystem::GetHierarchyBounds(TransformHandle handle)
+{
+	return hierarchyBounds[handleToIndex[handle]];
+}
+
+void TransformSystem::MoveAbsolute(TransformHandle handle, XMFLOAT3 offset)
+{
+	unsigned int i = handleToIndex[handle];
+	positionX[i] += offset.x;
+	positionY[i] += offset.y;
+	positionZ[i] += offset.z;
+	dirty[i] = 1;
+}
+
+void TransformSystem::Rotate(TransformHandle handle, XMFLOAT3 pitchYawRoll)
+{
+	unsigned int i = handleToIndex[handle];
+	pitch[i] += pitchYawRoll.x;
+	yaw[i] += pitchYawRoll.y;
+	roll[i] += pitchYawRoll.z;
+	dirty[i] = 1;
+}
+
+void TransformSystem::Scale(TransformHandle handle, XMFLOAT3 scale)
+{
+	unsigned int i = handleToIndex[handle];
+	scaleX[i] *= scale.x;
+	scaleY[i] *= scale.y;
+	scaleZ[i] *= scale.z;
+	dirty[i] = 1;
+}
+
+// --------------------------------------------------------
+// Adds the same rotation to every transform, four at a time
+// --------------------------------------------------------
+void TransformSystem::RotateAll(XMFLOAT3 pitchYawRoll)
+{
+	XMVECTOR deltaPitch = XMVectorReplicate(pitchYawRoll.x);
+	XMVECTOR deltaYaw = XMVectorReplicate(pitchYawRoll.y);
+	XMVECTOR deltaRoll = XMVectorReplicate(pitchYawRoll.z);
+	for (unsigned int i = 0; i < count; i += 4)
+	{
+		XMStoreFloat4((XMFLOAT4*)&pitch[i], XMVectorAdd(XMLoadFloat4((const XMFLOAT4*)&pitch[i]), deltaPitch));
+		XMStoreFloat4((XMFLOAT4*)&yaw[i], XMVectorAdd(XMLoadFloat4((const XMFLOAT4*)&yaw[i]), deltaYaw));
+		XMStoreFloat4((XMFLOAT4*)&roll[i], XMVectorAdd(XMLoadFloat4((const XMFLOAT4*)&roll[i]), deltaRoll));
+	}
+	std::fill(dirty.begin(), dirty.begin() + count, (unsigned char)1);
+}
+
+// --------------------------------------------------------
+// Rebuilds local matrices for every batch of four that has at least
+// one changed transform in it, then walks the hierarchy once to
+// combine them with their parents' world matrices
+// --------------------------------------------------------
+unsigned int TransformSystem::UpdateMatrices()
+{
+	if (hierarchyChanged)
+		SortHierarchy();
+
+	// Batches only write their own four transforms, so they can be split across threads
+	std::atomic<bool> anyDirty(false);
+	JobSystem::GetInstance().ParallelFor(0, (count + 3) / 4, MIN_BATCHES_PER_UPDATE_JOB, [&](unsigned int firstBatch, unsigned int lastBatch)
+	{
+		bool rangeDirty = false;
+		for (unsigned int first = firstBatch * 4; first < lastBatch * 4; first += 4)
+		{
+			// Four dirty flags at once
+			unsigned int batchDirty;
+			memcpy(&batchDirty, &dirty[first], sizeof(batchDirty));
+			if (batchDirty == 0)
+				continue;
+
+			UpdateBatch(first);
+			rangeDirty = true;
+		}
+		if (rangeDirty)
+			anyDirty = true;
+	});
+	if (!anyDirty)
+		return 0;
+
+	// Parents come first, so their world matrices (and whether they
+	// changed) are always known by the time a child gets here
+	unsigned int recalculated = 0;
+	for (unsigned int i = 0; i < count; i++)
+	{
+		unsigned int parent = parentIndices[i];
+		bool parentChanged = parent != INVALID_TRANSFORM_INDEX && worldChanged[parent];
+		worldChanged[i] = dirty[i] || parentChanged;
+		if (!worldChanged[i])
+			continue;
+		movedThisTick[i] = 1;
+
+		// Roots already had their world matrices written by the batch
+		XMMATRIX world;
+		if (parent == INVALID_TRANSFORM_INDEX)
+		{
+			world = XMLoadFloat4x4(&worldMatrices[i]);
+		}
+		else
+		{
+			// Inverse transpose of (local * parent) is the product of the inverse transposes
+			world = XMMatrixMultiply(XMLoadFloat4x4(&localMatrices[i]), XMLoadFloat4x4(&worldMatrices[parent]));
+			XMStoreFloat4x4(&worldMatrices[i], world);
+			XMStoreFloat4x4(&worldInverseTransposeMatrices[i], XMMatrixMultiply(
+				XMLoadFloat4x4(&localInverseTransposeMatrices[i]),
+				XMLoadFloat4x4(&worldInverseTransposeMatrices[parent])));
+		}
+
+		// Radius grows by the largest scale along any axis
+		XMFLOAT4 bounds = localBounds[i];
+		if (bounds.w >= 0)
+		{
+			float maxScaleSq = XMVectorGetX(XMVectorMax(XMVector3LengthSq(world.r[0]),
+				XMVectorMax(XMVector3LengthSq(world.r[1]), XMVector3LengthSq(world.r[2]))));
+			XMVECTOR center = XMVector3TransformCoord(XMLoadFloat4(&bounds), world);
+			XMStoreFloat4(&worldBounds[i], XMVectorSetW(center, bounds.w * sqrtf(maxScaleSq)));
+		}
+		else
+		{
+			worldBounds[i] = bounds;
+		}
+		recalculated++;
+	}
+	memset(dirty.data(), 0, count);
+
+	UpdateBounds();
+	return recalculated;
+}
+
+// --------------------------------------------------------
+// Starts a simulation tick: the current state becomes the one
+// interpolation blends from, and nothing has moved yet
+// --------------------------------------------------------
+void TransformSystem::BeginTick()
+{
+	memcpy(previousPositionX.data(), positionX.data(), count * sizeof(float));
+	memcpy(previousPositionY.data(), positionY.data(), count * sizeof(float));
+	memcpy(previousPositionZ.data(), positionZ.data(), count * sizeof(float));
+	memcpy(previousPitch.data(), pitch.data(), count * sizeof(float));
+	memcpy(previousYaw.data(), yaw.data(), count * sizeof(float));
+	memcpy(previousRoll.data(), roll.data(), count * sizeof(float));
+	memcpy(previousScaleX.data(), scaleX.data(), count * sizeof(float));
+	memcpy(previousScaleY.data(), scaleY.data(), count * sizeof(float));
+	memcpy(previousScaleZ.data(), scaleZ.data(), count * sizeof(float));
+	memset(movedThisTick.data(), 0, count);
+}
+
+// --------------------------------------------------------
+// Builds world matrices partway between the last two ticks for
+// everything that moved, the same way UpdateMatrices() does:
+// blended local matrices in batches of four, then one pass down
+// the hierarchy. Anything that didn't move just uses its current
+// world matrix, so a mostly static scene costs next to nothing.
+// Returns how many world matrices were interpolated.
+// --------------------------------------------------------
+unsigned int TransformSystem::UpdateInterpolatedMatrices(float alpha)
+{
+	std::atomic<bool> anyMoved(false);
+	JobSystem::GetInstance().ParallelFor(0, (count + 3) / 4, MIN_BATCHES_PER_UPDATE_JOB, [&](unsigned int firstBatch, unsigned int lastBatch)
+	{
+		bool rangeMoved = false;
+		for (unsigned int first = firstBatch * 4; first < lastBatch * 4; first += 4)
+		{
+			unsigned int batchMoved;
+			memcpy(&batchMoved, &movedThisTick[first], sizeof(batchMoved));
+			if (batchMoved == 0)
+				continue;
+
+			InterpolateBatch(first, alpha);
+			rangeMoved = true;
+		}
+		if (rangeMoved)
+			anyMoved = true;
+	});
+	if (!anyMoved)
+		return 0;
+
+	// The batches left local matrices behind, which roots can use as they are
+	unsigned int interpolated = 0;
+	for (unsigned int i = 0; i < count; i++)
+	{
+		if (!movedThisTick[i])
+			continue;
+		interpolated++;
+
+		unsigned int parent = parentIndices[i];
+		if (parent == INVALID_TRANSFORM_INDEX)
+			continue;
+
+		const XMFLOAT4X4& parentWorld = movedThisTick[parent] ? interpolatedWorldMatrices[parent] : worldMatrices[parent];
+		const XMFLOAT4X4& parentInverseTranspose = movedThisTick[parent] ? interpolatedWorldInverseTransposeMatrices[parent] : worldInverseTransposeMatrices[parent];
+		XMStoreFloat4x4(&interpolatedWorldMatrices[i], XMMatrixMultiply(
+			XMLoadFloat4x4(&interpolatedWorldMatrices[i]),
+			XMLoadFloat4x4(&parentWorld)));
+		XMStoreFloat4x4(&interpolatedWorldInverseTransposeMatrices[i], XMMatrixMultiply(
+			XMLoadFloat4x4(&interpolatedWorldInverseTransposeMatrices[i]),
+			XMLoadFloat4x4(&parentInverseTranspose)));
+	}
+	return interpolated;
+}
+
+const XMFLOAT4X4& TransformSystem::GetInterpolatedWorldMatrix(TransformHandle handle)
+{
+	unsigned int i = handleToIndex[handle];
+	return movedThisTick[i] ? interpolatedWorldMatrices[i] : worldMatrices[i];
+}
+
+const XMFLOAT4X4& TransformSystem::GetInterpolatedWorldInverseTransposeMatrix(TransformHandle handle)
+{
+	unsigned int i = handleToIndex[handle];
+	return movedThisTick[i] ? interpolatedWorldInverseTransposeMatrices[i] : worldInverseTransposeMatrices[i];
+}
+
+void TransformSystem::Resize(unsigned int capacity)
+{
+	// Keep the capacity a multiple of four
+	capacity = (capacity + 3) & ~3u;
+
+	positionX.resize(capacity, 0);
+	positionY.resize(capacity, 0);
+	positionZ.resize(capacity, 0);
+	pitch.resize(capacity, 0);
+	yaw.resize(capacity, 0);
+	roll.resize(capacity, 0);
+	scaleX.resize(capacity, 1);
+	scaleY.resize(capacity, 1);
+	scaleZ.resize(capacity, 1);
+	dirty.resize(capacity, 0);
+	worldChanged.resize(capacity, 0);
+	previousPositionX.resize(capacity, 0);
+	previousPositionY.resize(capacity, 0);
+	previousPositionZ.resize(capacity, 0);
+	previousPitch.resize(capacity, 0);
+	previousYaw.resize(capacity, 0);
+	previousRoll.resize(capacity, 0);
+	previousScaleX.resize(capacity, 1);
+	previousScaleY.resize(capacity, 1);
+	previousScaleZ.resize(capacity, 1);
+	movedThisTick.resize(capacity, 0);
+	interpolatedWorldMatrices.resize(capacity);
+	interpolatedWorldInverseTransposeMatrices.resize(capacity);
+	localMatrices.resize(capacity);
+	localInverseTransposeMatrices.resize(capacity);
+	worldMatrices.resize(capacity);
+	worldInverseTransposeMatrices.resize(capacity);
+	localBounds.resize(capacity, XMFLOAT4(0, 0, 0, -1));
+	worldBounds.resize(capacity, XMFLOAT4(0, 0, 0, -1));
+	hierarchyBounds.resize(capacity, XMFLOAT4(0, 0, 0, -1));
+	parentIndices.resize(capacity, INVALID_TRANSFORM_INDEX);
+	indexToHandle.resize(capacity, INVALID_TRANSFORM_HANDLE);
+}
+
+// Four neighbouring transforms' state, one transform per lane
+struct TransformLanes
+{
+	XMVECTOR positionX, positionY, positionZ;
+	XMVECTOR pitch, yaw, roll;
+	XMVECTOR scaleX, scaleY, scaleZ;
+};
+
+// --------------------------------------------------------
+// Builds the world (relative to parent) and inverse transpose
+// matrices of four transforms at once
+//
+// Rather than a general 4x4 inverse, this uses the fact that the
+// matrix is always scale * rotation * translation: the upper 3x3 of
+// the inverse transpose is just the rotation with each row divided by
+// its scale, and the last column is -(translation . row) / scale.
+// --------------------------------------------------------
+static void BuildMatrices(const TransformLanes& lanes, XMFLOAT4X4* matrices, XMFLOAT4X4* inverseTransposeMatrices)
+{
+	XMVECTOR sinPitch, cosPitch, sinYaw, cosYaw, sinRoll, cosRoll;
+	XMVectorSinCos(&sinPitch, &cosPitch, lanes.pitch);
+	XMVectorSinCos(&sinYaw, &cosYaw, lanes.yaw);
+	XMVectorSinCos(&sinRoll, &cosRoll, lanes.roll);
+
+	// Same rotation as XMMatrixRotationRollPitchYaw(), one element per vector
+	XMVECTOR sinPitchSinYaw = XMVectorMultiply(sinPitch, sinYaw);
+	XMVECTOR sinPitchCosYaw = XMVectorMultiply(sinPitch, cosYaw);
+	XMVECTOR r00 = XMVectorMultiplyAdd(sinRoll, sinPitchSinYaw, XMVectorMultiply(cosRoll, cosYaw));
+	XMVECTOR r01 = XMVectorMultiply(sinRoll, cosPitch);
+	XMVECTOR r02 = XMVectorNegativeMultiplySubtract(cosRoll, sinYaw, XMVectorMultiply(sinRoll, sinPitchCosYaw));
+	XMVECTOR r10 = XMVectorNegativeMultiplySubtract(sinRoll, cosYaw, XMVectorMultiply(cosRoll, sinPitchSinYaw));
+	XMVECTOR r11 = XMVectorMultiply(cosRoll, cosPitch);
+	XMVECTOR r12 = XMVectorMultiplyAdd(cosRoll, sinPitchCosYaw, XMVectorMultiply(sinRoll, sinYaw));
+	XMVECTOR r20 = XMVectorMultiply(cosPitch, sinYaw);
+	XMVECTOR r21 = XMVectorNegate(sinPitch);
+	XMVECTOR r22 = XMVectorMultiply(cosPitch, cosYaw);
+
+	XMVECTOR sx = lanes.scaleX;
+	XMVECTOR sy = lanes.scaleY;
+	XMVECTOR sz = lanes.scaleZ;
+	XMVECTOR tx = lanes.positionX;
+	XMVECTOR ty = lanes.positionY;
+	XMVECTOR tz = lanes.positionZ;
+	XMVECTOR zero = XMVectorZero();
+	XMVECTOR one = XMVectorSplatOne();
+
+	// Each XMMATRIX below holds one row of all four matrices (one
+	// element per vector), so transposing it gives that row of each
+	XMMATRIX worldRows[4] =
+	{
+		XMMatrixTranspose(XMMATRIX(XMVectorMultiply(sx, r00), XMVectorMultiply(sx, r01), XMVectorMultiply(sx, r02), zero)),
+		XMMatrixTranspose(XMMATRIX(XMVectorMultiply(sy, r10), XMVectorMultiply(sy, r11), XMVectorMultiply(sy, r12), zero)),
+		XMMatrixTranspose(XMMATRIX(XMVectorMultiply(sz, r20), XMVectorMultiply(sz, r21), XMVectorMultiply(sz, r22), zero)),
+		XMMatrixTranspose(XMMATRIX(tx, ty, tz, one)),
+	};
+
+	XMVECTOR invSx = XMVectorReciprocal(sx);
+	XMVECTOR invSy = XMVectorReciprocal(sy);
+	XMVECTOR invSz = XMVectorReciprocal(sz);
+	XMVECTOR dot0 = XMVectorMultiplyAdd(tz, r02, XMVectorMultiplyAdd(ty, r01, XMVectorMultiply(tx, r00)));
+	XMVECTOR dot1 = XMVectorMultiplyAdd(tz, r12, XMVectorMultiplyAdd(ty, r11, XMVectorMultiply(tx, r10)));
+	XMVECTOR dot2 = XMVectorMultiplyAdd(tz, r22, XMVectorMultiplyAdd(ty, r21, XMVectorMultiply(tx, r20)));
+	XMMATRIX inverseTransposeRows[4] =
+	{
+		XMMatrixTranspose(XMMATRIX(XMVectorMultiply(r00, invSx), XMVectorMultiply(r01, invSx), XMVectorMultiply(r02, invSx), XMVectorNegate(XMVectorMultiply(dot0, invSx)))),
+		XMMatrixTranspose(XMMATRIX(XMVectorMultiply(r10, invSy), XMVectorMultiply(r11, invSy), XMVectorMultiply(r12, invSy), XMVectorNegate(XMVectorMultiply(dot1, invSy)))),
+		XMMatrixTranspose(XMMATRIX(XMVectorMultiply(r20, invSz), XMVectorMultiply(r21, invSz), XMVectorMultiply(r22, invSz), XMVectorNegate(XMVectorMultiply(dot2, invSz)))),
+		XMMatrixTranspose(XMMATRIX(zero, zero, zero, one)),
+	};
+
+	for (unsigned int lane = 0; lane < 4; lane++)
+	{
+		for (int row = 0; row < 4; row++)
+		{
+			XMStoreFloat4((XMFLOAT4*)matrices[lane].m[row], worldRows[row].r[lane]);
+			XMStoreFloat4((XMFLOAT4*)inverseTransposeMatrices[lane].m[row], inverseTransposeRows[row].r[lane]);
+		}
+	}
+}
+
+// --------------------------------------------------------
+// Builds the local (relative to parent) world and inverse
+// transpose matrices of four neighbouring transforms at once
+// --------------------------------------------------------
+void TransformSystem::UpdateBatch(unsigned int first)
+{
+	TransformLanes lanes;
+	lanes.positionX = XMLoadFloat4((const XMFLOAT4*)&positionX[first]);
+	lanes.positionY = XMLoadFloat4((const XMFLOAT4*)&positionY[first]);
+	lanes.positionZ = XMLoadFloat4((const XMFLOAT4*)&positionZ[first]);
+	lanes.pitch = XMLoadFloat4((const XMFLOAT4*)&pitch[first]);
+	lanes.yaw = XMLoadFloat4((const XMFLOAT4*)&yaw[first]);
+	lanes.roll = XMLoadFloat4((const XMFLOAT4*)&roll[first]);
+	lanes.scaleX = XMLoadFloat4((const XMFLOAT4*)&scaleX[first]);
+	lanes.scaleY = XMLoadFloat4((const XMFLOAT4*)&scaleY[first]);
+	lanes.scaleZ = XMLoadFloat4((const XMFLOAT4*)&scaleZ[first]);
+	BuildMatrices(lanes, &localMatrices[first], &localInverseTransposeMatrices[first]);
+
+	// A root's local matrices are also its world matrices
+	for (unsigned int i = first; i < first + 4; i++)
+	{
+		if (parentIndices[i] == INVALID_TRANSFORM_INDEX && dirty[i])
+		{
+			worldMatrices[i] = localMatrices[i];
+			worldInverseTransposeMatrices[i] = localInverseTransposeMatrices[i];
+		}
+	}
+}
+
+// --------------------------------------------------------
+// Same as UpdateBatch(), but from state blended between the last
+// two ticks, and into the interpolated matrices (which still need
+// their parents' applied)
+//
+// Blending pitch, yaw and roll separately matches how the state is
+// stored, and is indistinguishable from a slerp over one tick.
+// --------------------------------------------------------
+void TransformSystem::InterpolateBatch(unsigned int first, float alpha)
+{
+	TransformLanes lanes;
+	lanes.positionX = XMVectorLerp(XMLoadFloat4((const XMFLOAT4*)&previousPositionX[first]), XMLoadFloat4((const XMFLOAT4*)&positionX[first]), alpha);
+	lanes.positionY = XMVectorLerp(XMLoadFloat4((const XMFLOAT4*)&previousPositionY[first]), XMLoadFloat4((const XMFLOAT4*)&positionY[first]), alpha);
+	lanes.positionZ = XMVectorLerp(XMLoadFloat4((const XMFLOAT4*)&previousPositionZ[first]), XMLoadFloat4((const XMFLOAT4*)&positionZ[first]), alpha);
+	lanes.pitch = XMVectorLerp(XMLoadFloat4((const XMFLOAT4*)&previousPitch[first]), XMLoadFloat4((const XMFLOAT4*)&pitch[first]), alpha);
+	lanes.yaw = XMVectorLerp(XMLoadFloat4((const XMFLOAT4*)&previousYaw[first]), XMLoadFloat4((const XMFLOAT4*)&yaw[first]), alpha);
+	lanes.roll = XMVectorLerp(XMLoadFloat4((const XMFLOAT4*)&previousRoll[first]), XMLoadFloat4((const XMFLOAT4*)&roll[first]), alpha);
+	lanes.scaleX = XMVectorLerp(XMLoadFloat4((const XMFLOAT4*)&previousScaleX[first]), XMLoadFloat4((const XMFLOAT4*)&scaleX[first]), alpha);
+	lanes.scaleY = XMVectorLerp(XMLoadFloat4((const XMFLOAT4*)&previousScaleY[first]), XMLoadFloat4((const XMFLOAT4*)&scaleY[first]), alpha);
+	lanes.scaleZ = XMVectorLerp(XMLoadFloat4((const XMFLOAT4*)&previousScaleZ[first]), XMLoadFloat4((const XMFLOAT4*)&scaleZ[first]), alpha);
+	BuildMatrices(lanes, &interpolatedWorldMatrices[first], &interpolatedWorldInverseTransposeMatrices[first]);
+}
+
+// Adds a child to the front of its parent's child list
+void TransformSystem::Link(TransformHandle child, TransformHandle parent)
+{
+	parents[child] = parent;
+	previousSiblings[child] = INVALID_TRANSFORM_HANDLE;
+	nextSiblings[child] = firstChildren[parent];
+	if (firstChildren[parent] != INVALID_TRANSFORM_HANDLE)
+		previousSiblings[firstChildren[parent]] = child;
+	firstChildren[parent] = child;
+}
+
+// Removes a transform from its parent's child list, making it a root
+void TransformSystem::Unlink(TransformHandle child)
+{
+	TransformHandle parent = parents[child];
+	if (parent == INVALID_TRANSFORM_HANDLE)
+		return;
+
+	TransformHandle previous = previousSiblings[child];
+	TransformHandle next = nextSiblings[child];
+	if (previous != INVALID_TRANSFORM_HANDLE)
+		nextSiblings[previous] = next;
+	else
+		firstChildren[parent] = next;
+	if (next != INVALID_TRANSFORM_HANDLE)
+		previousSiblings[next] = previous;
+
+	parents[child] = INVALID_TRANSFORM_HANDLE;
+	previousSiblings[child] = INVALID_TRANSFORM_HANDLE;
+	nextSiblings[child] = INVALID_TRANSFORM_HANDLE;
+}
+
+// --------------------------------------------------------
+// Re-sorts dense storage into breadth-first order: all roots, then
+// all of their children, and so on. Only needed after a destroy or
+// reparent leaves a child in front of its parent, so any number of
+// those cost a single O(n) sort on the next update.
+// --------------------------------------------------------
+void TransformSystem::SortHierarchy()
+{
+	std::vector<unsigned int>& order = sortOrder;
+	order.clear();
+	for (unsigned int i = 0; i < count; i++)
+	{
+		if (parents[indexToHandle[i]] == INVALID_TRANSFORM_HANDLE)
+			order.push_back(i);
+	}
+
+	// The list doubles as the queue for the breadth-first walk
+	for (unsigned int k = 0; k < order.size(); k++)
+	{
+		for (TransformHandle child = firstChildren[indexToHandle[order[k]]];
+			child != INVALID_TRANSFORM_HANDLE;
+			child = nextSiblings[child])
+		{
+			order.push_back(handleToIndex[child]);
+		}
+	}
+
+	Permute(positionX, order, sortScratch);
+	Permute(positionY, order, sortScratch);
+	Permute(positionZ, order, sortScratch);
+	Permute(pitch, order, sortScratch);
+	Permute(yaw, order, sortScratch);
+	Permute(roll, order, sortScratch);
+	Permute(scaleX, order, sortScratch);
+	Permute(scaleY, order, sortScratch);
+	Permute(scaleZ, order, sortScratch);
+	Permute(previousPositionX, order, sortScratch);
+	Permute(previousPositionY, order, sortScratch);
+	Permute(previousPositionZ, order, sortScratch);
+	Permute(previousPitch, order, sortScratch);
+	Permute(previousYaw, order, sortScratch);
+	Permute(previousRoll, order, sortScratch);
+	Permute(previousScaleX, order, sortScratch);
+	Permute(previousScaleY, order, sortScratch);
+	Permute(previousScaleZ, order, sortScratch);
+	Permute(localBounds, order, sortScratch);
+	Permute(indexToHandle, order, sortScratch);
+
+	// Moving the matrices around costs more than rebuilding them
+	memset(dirty.data(), 1, count);
+
+	for (unsigned int i = 0; i < count; i++)
+		handleToIndex[indexToHandle[i]] = i;
+	for (unsigned int i = 0; i < count; i++)
+	{
+		TransformHandle parent = parents[indexToHandle[i]];
+		parentIndices[i] = parent == INVALID_TRANSFORM_HANDLE ? INVALID_TRANSFORM_INDEX : handleToIndex[parent];
+	}
+
+	hierarchyChanged = false;
+}
+
+// --------------------------------------------------------
+// Recalculates the spheres around each transform and everything
+// below it. Walking storage backwards visits every child before its
+// parent, so each subtree is complete by the time it gets merged
+// upwards.
+// --------------------------------------------------------
+void TransformSystem::UpdateBounds()
+{
+	for (unsigned int i = 0; i < count; i++)
+		hierarchyBounds[i] = worldBounds[i];
+
+	for (unsigned int i = count; i-- > 0;)
+	{
+		unsigned int parent = parentIndices[i];
+		if (parent != INVALID_TRANSFORM_INDEX)
+			hierarchyBounds[parent] = MergeSpheres(hierarchyBounds[parent], hierarchyBounds[i]);
+	}
+}
\ No newline at end of file
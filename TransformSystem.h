@@ -0,0 +1,137 @@
+#pragma once
+#include <DirectXMath.h>
+#include <vector>
+
+// Identifies one transform within a TransformSystem
+typedef unsigned int TransformHandle;
+#define INVALID_TRANSFORM_HANDLE 0xFFFFFFFF
+
+// Stores many transforms as structure of arrays and rebuilds the
+// matrices of every changed one in SIMD batches of four, instead of
+// one Transform at a time on demand.
+//
+// Matrices match what Transform produces: world = scale * rotation
+// (roll, then pitch, then yaw) * translation, plus its inverse transpose.
+// Call UpdateMatrices() once after changes and before reading matrices.
+//
+// Transforms can have a parent, in which case their position, rotation
+// and scale are relative to it. Dense storage is kept sorted so parents
+// always come before their children (breadth-first, so by depth), and
+// world matrices are propagated in a single linear pass that only
+// recalculates subtrees under something that changed.
+class TransformSystem
+{
+public:
+	TransformSystem();
+
+	TransformHandle Create(
+		DirectX::XMFLOAT3 position = DirectX::XMFLOAT3(0, 0, 0),
+		DirectX::XMFLOAT3 pitchYawRoll = DirectX::XMFLOAT3(0, 0, 0),
+		DirectX::XMFLOAT3 scale = DirectX::XMFLOAT3(1, 1, 1),
+		TransformHandle parent = INVALID_TRANSFORM_HANDLE);
+	void Destroy(TransformHandle handle);
+	bool IsValid(TransformHandle handle);
+	unsigned int GetCount();
+
+	// Setters
+	void SetPosition(TransformHandle handle, DirectX::XMFLOAT3 position);
+	void SetRotation(TransformHandle handle, DirectX::XMFLOAT3 pitchYawRoll);
+	void SetScale(TransformHandle handle, DirectX::XMFLOAT3 scale);
+
+	// Getters
+	DirectX::XMFLOAT3 GetPosition(TransformHandle handle);
+	DirectX::XMFLOAT3 GetPitchYawRoll(TransformHandle handle);
+	DirectX::XMFLOAT3 GetScale(TransformHandle handle);
+	const DirectX::XMFLOAT4X4& GetWorldMatrix(TransformHandle handle);
+	const DirectX::XMFLOAT4X4& GetWorldInverseTransposeMatrix(TransformHandle handle);
+
+	// Hierarchy
+	// Children keep their local position/rotation/scale when (re)parented.
+	// Destroying a transform turns its children into roots.
+	bool SetParent(TransformHandle child, TransformHandle parent);
+	TransformHandle GetParent(TransformHandle handle);
+	TransformHandle GetFirstChild(TransformHandle handle);
+	TransformHandle GetNextSibling(TransformHandle handle);
+
+	// Bounding spheres (xyz = center, w = radius, negative radius = none)
+	// Local bounds are in the transform's own space, e.g. a mesh's bounds.
+	// Hierarchy bounds enclose a transform and everything below it.
+	void SetLocalBounds(TransformHandle handle, DirectX::XMFLOAT4 sphere);
+	const DirectX::XMFLOAT4& GetWorldBounds(TransformHandle handle);
+	const DirectX::XMFLOAT4& GetHierarchyBounds(TransformHandle handle);
+
+	// Transformers
+	void MoveAbsolute(TransformHandle handle, DirectX::XMFLOAT3 offset);
+	void Rotate(TransformHandle handle, DirectX::XMFLOAT3 pitchYawRoll);
+	void Scale(TransformHandle handle, DirectX::XMFLOAT3 scale);
+
+	// Rotates every transform by the same amount in one SIMD pass
+	void RotateAll(DirectX::XMFLOAT3 pitchYawRoll);
+
+	// Rebuilds the matrices of all transforms changed since the last call,
+	// along with everything parented under them, then the bounds
+	// Returns how many world matrices were recalculated
+	unsigned int UpdateMatrices();
+
+	// Interpolation between fixed simulation ticks
+	// BeginTick() remembers every transform's position, rotation and
+	// scale as the previous tick's (call it before changing anything).
+	// UpdateInterpolatedMatrices() then blends from there to the current
+	// state, alpha of the way (0 = previous tick, 1 = current), for
+	// everything whose world matrix changed during the tick. Bounds
+	// aren't interpolated, so they're up to a tick ahead of what's drawn.
+	void BeginTick();
+	unsigned int UpdateInterpolatedMatrices(float alpha);
+	const DirectX::XMFLOAT4X4& GetInterpolatedWorldMatrix(TransformHandle handle);
+	const DirectX::XMFLOAT4X4& GetInterpolatedWorldInverseTransposeMatrix(TransformHandle handle);
+
+private:
+	// Dense storage, padded to a multiple of four so batches never run
+	// off the end. Destroying swaps the last transform into the hole.
+	std::vector<float> positionX, positionY, positionZ;
+	std::vector<float> pitch, yaw, roll;
+	std::vector<float> scaleX, scaleY, scaleZ;
+	std::vector<unsigned char> dirty;
+	std::vector<unsigned char> worldChanged;
+
+	// State as of BeginTick(), and whether the world matrix has changed since
+	std::vector<float> previousPositionX, previousPositionY, previousPositionZ;
+	std::vector<float> previousPitch, previousYaw, previousRoll;
+	std::vector<float> previousScaleX, previousScaleY, previousScaleZ;
+	std::vector<unsigned char> movedThisTick;
+	std::vector<DirectX::XMFLOAT4X4> interpolatedWorldMatrices;
+	std::vector<DirectX::XMFLOAT4X4> interpolatedWorldInverseTransposeMatrices;
+	std::vector<DirectX::XMFLOAT4X4> localMatrices;
+	std::vector<DirectX::XMFLOAT4X4> localInverseTransposeMatrices;
+	std::vector<DirectX::XMFLOAT4X4> worldMatrices;
+	std::vector<DirectX::XMFLOAT4X4> worldInverseTransposeMatrices;
+	std::vector<DirectX::XMFLOAT4> localBounds;
+	std::vector<DirectX::XMFLOAT4> worldBounds;
+	std::vector<DirectX::XMFLOAT4> hierarchyBounds;
+	std::vector<unsigned int> parentIndices;
+	unsigned int count;
+
+	// Handles stay stable while dense indices move around
+	std::vector<unsigned int> handleToIndex;
+	std::vector<TransformHandle> indexToHandle;
+	std::vector<TransformHandle> freeHandles;
+
+	// Hierarchy links by handle (so they survive dense indices moving)
+	std::vector<TransformHandle> parents;
+	std::vector<TransformHandle> firstChildren;
+	std::vector<TransformHandle> nextSiblings;
+	std::vector<TransformHandle> previousSiblings;
+
+	// Set when a parent may now come after its child in dense storage
+	bool hierarchyChanged;
+	std::vector<unsigned int> sortOrder;
+	std::vector<unsigned char> sortScratch;
+
+	void Resize(unsigned int capacity);
+	void UpdateBatch(unsigned int first);
+	void InterpolateBatch(unsigned int first, float alpha);
+	void Link(TransformHandle child, TransformHandle parent);
+	void Unlink(TransformHandle child);
+	void SortHierarchy();
+	void UpdateBounds();
+};
\ No newline at end of file
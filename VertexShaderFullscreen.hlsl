@@ -0,0 +1,20 @@
+// What the upscale pixel shader gets from each corner
+struct VertexToPixel
+{
+	float4 screenPosition	: SV_POSITION;
+	float2 uv				: TEXCOORD;
+};
+
+// --------------------------------------------------------
+// Makes one triangle that covers the whole screen from nothing
+// but the vertex ID (0-2), so full screen passes need no vertex
+// or index buffer. The part of the triangle off screen is clipped,
+// and the uvs run 0-1 across the part that's left.
+// --------------------------------------------------------
+VertexToPixel main(uint vertexID : SV_VertexID)
+{
+	VertexToPixel output;
+	output.uv = float2((vertexID << 1) & 2, vertexID & 2);
+	output.screenPosition = float4(output.uv * float2(2, -2) + float2(-1, 1), 0, 1);
+	return output;
+}
\ No newline at end of file
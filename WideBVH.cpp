@@ -0,0 +1,448 @@
+#include "WideBVH.h"
+#include "JobSystem.h"
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstring>
+
+using namespace DirectX;
+
+// Items per job; below this, binning on one thread is faster
+#define MIN_ITEMS_PER_BUILD_JOB 16384
+
+static float GetAxis(XMFLOAT3 v, int axis)
+{
+	return axis == 0 ? v.x : (axis == 1 ? v.y : v.z);
+}
+
+static float GetAxis(const XMFLOAT4& v, int axis)
+{
+	return axis == 0 ? v.x : (axis == 1 ? v.y : v.z);
+}
+
+static unsigned int GetBin(float centroid, float centroidMin, float binScale)
+{
+	return std::min((unsigned int)((centroid - centroidMin) * binScale), BVH_BIN_COUNT - 1u);
+}
+
+// --------------------------------------------------------
+// Binary tree built top down over the items, then collapsed
+// into the 4-wide nodes. Only lives for one Build().
+// --------------------------------------------------------
+class WideBVHBuilder
+{
+public:
+	WideBVHBuilder(const XMFLOAT4* boundsMin, const XMFLOAT4* boundsMax, const XMFLOAT4* centroids, std::vector<unsigned int>& items);
+
+	// Binary node
+	struct BuildNode
+	{
+		XMFLOAT3 boundsMin;
+		XMFLOAT3 boundsMax;
+		unsigned int left;
+		unsigned int right;
+		unsigned int firstItem;
+		unsigned int itemCount;
+	};
+
+	struct Bin
+	{
+		XMFLOAT3 boundsMin;
+		XMFLOAT3 boundsMax;
+		unsigned int count;
+	};
+
+	unsigned int BuildRange(unsigned int first, unsigned int last, unsigned int depth, std::vector<BuildNode>& buildNodes);
+	unsigned int Collapse(const std::vector<BuildNode>& buildNodes, unsigned int buildIndex, std::vector<WideBVHNode>& nodes,
+		const std::function<unsigned int(unsigned int, unsigned int)>& addLeaf);
+
+private:
+	const XMFLOAT4* itemBoundsMin;
+	const XMFLOAT4* itemBoundsMax;
+	const XMFLOAT4* itemCentroids;
+	std::vector<unsigned int>& items;
+
+	void BinRange(unsigned int first, unsigned int last, int axis, float centroidMin, float binScale, Bin bins[BVH_BIN_COUNT]);
+};
+
+WideBVHBuilder::WideBVHBuilder(const XMFLOAT4* boundsMin, const XMFLOAT4* boundsMax, const XMFLOAT4* centroids, std::vector<unsigned int>& items) :
+	itemBoundsMin(boundsMin),
+	itemBoundsMax(boundsMax),
+	itemCentroids(centroids),
+	items(items)
+{
+}
+
+// --------------------------------------------------------
+// Builds the binary node for items [first, last) and everything
+// under it, splitting where the surface area heuristic says a ray
+// (or frustum, or sphere) would do the least work on average
+//
+// Returns the node's index in buildNodes
+// --------------------------------------------------------
+unsigned int WideBVHBuilder::BuildRange(unsigned int first, unsigned int last, unsigned int depth, std::vector<BuildNode>& buildNodes)
+{
+	BuildNode node;
+	node.left = BVH_LEAF;
+	node.right = BVH_LEAF;
+	node.firstItem = first;
+	node.itemCount = last - first;
+
+	// Bounds of the items, and of their centroids (which decide the split)
+	XMVECTOR boundsMin = XMVectorReplicate(FLT_MAX);
+	XMVECTOR boundsMax = XMVectorReplicate(-FLT_MAX);
+	XMVECTOR centroidsMin = XMVectorReplicate(FLT_MAX);
+	XMVECTOR centroidsMax = XMVectorReplicate(-FLT_MAX);
+	for (unsigned int i = first; i < last; i++)
+	{
+		unsigned int item = items[i];
+		XMVECTOR centroid = XMLoadFloat4(&itemCentroids[item]);
+		boundsMin = XMVectorMin(boundsMin, XMLoadFloat4(&itemBoundsMin[item]));
+		boundsMax = XMVectorMax(boundsMax, XMLoadFloat4(&itemBoundsMax[item]));
+		centroidsMin = XMVectorMin(centroidsMin, centroid);
+		centroidsMax = XMVectorMax(centroidsMax, centroid);
+	}
+	XMFLOAT3 centroidMin, centroidMax;
+	XMStoreFloat3(&node.boundsMin, boundsMin);
+	XMStoreFloat3(&node.boundsMax, boundsMax);
+	XMStoreFloat3(&centroidMin, centroidsMin);
+	XMStoreFloat3(&centroidMax, centroidsMax);
+
+	// Small enough ranges are always leaves: testing a few items
+	// is about as cheap as testing one more node's four boxes
+	unsigned int count = last - first;
+	unsigned int index = (unsigned int)buildNodes.size();
+	buildNodes.push_back(node);
+	if (count <= BVH_MAX_LEAF_SIZE)
+		return index;
+
+	// Split along the axis the centroids are most spread out on
+	XMFLOAT3 extent(centroidMax.x - centroidMin.x, centroidMax.y - centroidMin.y, centroidMax.z - centroidMin.z);
+	int axis = (extent.x > extent.y && extent.x > extent.z) ? 0 : (extent.y > extent.z ? 1 : 2);
+	float axisMin = GetAxis(centroidMin, axis);
+	float axisExtent = GetAxis(extent, axis);
+
+	unsigned int middle = first;
+	if (axisExtent > 0 && depth < BVH_MAX_BUILD_DEPTH)
+	{
+		float binScale = BVH_BIN_COUNT / axisExtent;
+		Bin bins[BVH_BIN_COUNT];
+		unsigned int pieceCount = std::max(1u, count / MIN_ITEMS_PER_BUILD_JOB);
+		if (pieceCount == 1)
+		{
+			BinRange(first, last, axis, axisMin, binScale, bins);
+		}
+		else
+		{
+			// Each job bins pieces of the range, then the bins are merged
+			unsigned int itemsPerPiece = (count + pieceCount - 1) / pieceCount;
+			std::vector<Bin> pieceBins((size_t)pieceCount * BVH_BIN_COUNT);
+			JobSystem::GetInstance().ParallelFor(0, pieceCount, 1, [&](unsigned int firstPiece, unsigned int lastPiece)
+			{
+				for (unsigned int p = firstPiece; p < lastPiece; p++)
+				{
+					unsigned int pieceFirst = first + p * itemsPerPiece;
+					unsigned int pieceLast = std::min(pieceFirst + itemsPerPiece, last);
+					BinRange(pieceFirst, pieceLast, axis, axisMin, binScale, &pieceBins[(size_t)p * BVH_BIN_COUNT]);
+				}
+			});
+
+			memcpy(bins, pieceBins.data(), sizeof(bins));
+			for (unsigned int p = 1; p < pieceCount; p++)
+			{
+				for (unsigned int b = 0; b < BVH_BIN_COUNT; b++)
+				{
+					const Bin& pieceBin = pieceBins[(size_t)p * BVH_BIN_COUNT + b];
+					WideBVH::Grow(bins[b].boundsMin, bins[b].boundsMax, pieceBin.boundsMin, pieceBin.boundsMax);
+					bins[b].count += pieceBin.count;
+				}
+			}
+		}
+
+		// Sweep in from the right to get the area and count on the right
+		// of each possible split, then in from the left to find the best
+		float rightArea[BVH_BIN_COUNT - 1];
+		unsigned int rightCount[BVH_BIN_COUNT - 1];
+		XMFLOAT3 sideMin(FLT_MAX, FLT_MAX, FLT_MAX);
+		XMFLOAT3 sideMax(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+		unsigned int sideCount = 0;
+		for (unsigned int b = BVH_BIN_COUNT - 1; b > 0; b--)
+		{
+			WideBVH::Grow(sideMin, sideMax, bins[b].boundsMin, bins[b].boundsMax);
+			sideCount += bins[b].count;
+			rightArea[b - 1] = WideBVH::SurfaceArea(sideMin, sideMax);
+			rightCount[b - 1] = sideCount;
+		}
+
+		sideMin = XMFLOAT3(FLT_MAX, FLT_MAX, FLT_MAX);
+		sideMax = XMFLOAT3(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+		sideCount = 0;
+		float bestSplitCost = FLT_MAX;
+		unsigned int bestSplit = 0;
+		for (unsigned int b = 0; b < BVH_BIN_COUNT - 1; b++)
+		{
+			WideBVH::Grow(sideMin, sideMax, bins[b].boundsMin, bins[b].boundsMax);
+			sideCount += bins[b].count;
+			if (sideCount == 0 || rightCount[b] == 0)
+				continue;
+
+			float splitCost = WideBVH::SurfaceArea(sideMin, sideMax) * sideCount + rightArea[b] * rightCount[b];
+			if (splitCost < bestSplitCost)
+			{
+				bestSplitCost = splitCost;
+				bestSplit = b;
+			}
+		}
+
+		if (bestSplitCost < FLT_MAX)
+		{
+			middle = (unsigned int)(std::partition(items.begin() + first, items.begin() + last,
+				[&](unsigned int item)
+			{
+				return GetBin(GetAxis(itemCentroids[item], axis), axisMin, binScale) <= bestSplit;
+			}) - items.begin());
+		}
+	}
+
+	// Centroids all in one place, or too deep: split in the middle
+	if (middle == first || middle == last)
+	{
+		middle = first + count / 2;
+		std::nth_element(items.begin() + first, items.begin() + middle, items.begin() + last,
+			[&](unsigned int a, unsigned int b)
+		{
+			return GetAxis(itemCentroids[a], axis) < GetAxis(itemCentroids[b], axis);
+		});
+	}
+
+	unsigned int left;
+	unsigned int right;
+	JobSystem& jobs = JobSystem::GetInstance();
+	if (count >= 2 * MIN_ITEMS_PER_BUILD_JOB && jobs.GetThreadCount() > 1)
+	{
+		// Build the left half as a job into its own array, then move
+		// its nodes in after the right half's. Waiting runs other jobs
+		// (often pieces of the left half), so this can nest freely.
+		std::vector<BuildNode> leftNodes;
+		unsigned int leftRoot = 0;
+		JobCounter leftDone;
+		jobs.Run([&]() { leftRoot = BuildRange(first, middle, depth + 1, leftNodes); }, &leftDone);
+		right = BuildRange(middle, last, depth + 1, buildNodes);
+		jobs.Wait(leftDone);
+
+		unsigned int offset = (unsigned int)buildNodes.size();
+		left = leftRoot + offset;
+		for (BuildNode leftNode : leftNodes)
+		{
+			if (leftNode.left != BVH_LEAF)
+			{
+				leftNode.left += offset;
+				leftNode.right += offset;
+			}
+			buildNodes.push_back(leftNode);
+		}
+	}
+	else
+	{
+		left = BuildRange(first, middle, depth + 1, buildNodes);
+		right = BuildRange(middle, last, depth + 1, buildNodes);
+	}
+
+	buildNodes[index].left = left;
+	buildNodes[index].right = right;
+	return index;
+}
+
+// --------------------------------------------------------
+// Sorts items [first, last) into bins by where their centroids
+// fall along the split axis
+// --------------------------------------------------------
+void WideBVHBuilder::BinRange(unsigned int first, unsigned int last, int axis, float centroidMin, float binScale, Bin bins[BVH_BIN_COUNT])
+{
+	XMVECTOR binMin[BVH_BIN_COUNT];
+	XMVECTOR binMax[BVH_BIN_COUNT];
+	unsigned int binCount[BVH_BIN_COUNT];
+	for (unsigned int b = 0; b < BVH_BIN_COUNT; b++)
+	{
+		binMin[b] = XMVectorReplicate(FLT_MAX);
+		binMax[b] = XMVectorReplicate(-FLT_MAX);
+		binCount[b] = 0;
+	}
+
+	for (unsigned int i = first; i < last; i++)
+	{
+		unsigned int item = items[i];
+		unsigned int b = GetBin(GetAxis(itemCentroids[item], axis), centroidMin, binScale);
+		binMin[b] = XMVectorMin(binMin[b], XMLoadFloat4(&itemBoundsMin[item]));
+		binMax[b] = XMVectorMax(binMax[b], XMLoadFloat4(&itemBoundsMax[item]));
+		binCount[b]++;
+	}
+
+	for (unsigned int b = 0; b < BVH_BIN_COUNT; b++)
+	{
+		XMStoreFloat3(&bins[b].boundsMin, binMin[b]);
+		XMStoreFloat3(&bins[b].boundsMax, binMax[b]);
+		bins[b].count = binCount[b];
+	}
+}
+
+// --------------------------------------------------------
+// Turns a binary node into a 4-wide one by pulling up its
+// biggest descendants until it has four children, then does
+// the same for those children. Nodes are stored parent first.
+//
+// Returns the new node's index
+// --------------------------------------------------------
+unsigned int WideBVHBuilder::Collapse(const std::vector<BuildNode>& buildNodes, unsigned int buildIndex, std::vector<WideBVHNode>& nodes,
+	const std::function<unsigned int(unsigned int, unsigned int)>& addLeaf)
+{
+	const BuildNode& buildNode = buildNodes[buildIndex];
+	unsigned int children[4] = { buildIndex };
+	unsigned int childCount = 1;
+	if (buildNode.left != BVH_LEAF)
+	{
+		children[0] = buildNode.left;
+		children[1] = buildNode.right;
+		childCount = 2;
+		while (childCount < 4)
+		{
+			int largest = -1;
+			float largestArea = -1;
+			for (unsigned int c = 0; c < childCount; c++)
+			{
+				const BuildNode& child = buildNodes[children[c]];
+				float area = WideBVH::SurfaceArea(child.boundsMin, child.boundsMax);
+				if (child.left != BVH_LEAF && area > largestArea)
+				{
+					largest = c;
+					largestArea = area;
+				}
+			}
+			if (largest < 0)
+				break;
+
+			unsigned int opened = children[largest];
+			children[largest] = buildNodes[opened].left;
+			children[childCount++] = buildNodes[opened].right;
+		}
+	}
+
+	unsigned int index = (unsigned int)nodes.size();
+	WideBVHNode node = {};
+	for (int lane = 0; lane < 4; lane++)
+	{
+		node.minX[lane] = node.minY[lane] = node.minZ[lane] = FLT_MAX;
+		node.maxX[lane] = node.maxY[lane] = node.maxZ[lane] = -FLT_MAX;
+		node.children[lane] = BVH_LEAF;
+	}
+	node.firstItem = buildNode.firstItem;
+	node.itemCount = buildNode.itemCount;
+	nodes.push_back(node);
+
+	for (unsigned int c = 0; c < childCount; c++)
+	{
+		const BuildNode& child = buildNodes[children[c]];
+		unsigned int slot;
+		if (child.left == BVH_LEAF)
+		{
+			unsigned int leafIndex = addLeaf ? addLeaf(child.firstItem, child.itemCount) : child.firstItem;
+			slot = BVH_LEAF | (leafIndex << 3) | child.itemCount;
+		}
+		else
+		{
+			slot = Collapse(buildNodes, children[c], nodes, addLeaf);
+		}
+
+		WideBVHNode& collapsed = nodes[index];
+		collapsed.children[c] = slot;
+		collapsed.minX[c] = child.boundsMin.x;
+		collapsed.minY[c] = child.boundsMin.y;
+		collapsed.minZ[c] = child.boundsMin.z;
+		collapsed.maxX[c] = child.boundsMax.x;
+		collapsed.maxY[c] = child.boundsMax.y;
+		collapsed.maxZ[c] = child.boundsMax.z;
+	}
+	return index;
+}
+
+void WideBVH::Build(
+	const XMFLOAT4* boundsMin,
+	const XMFLOAT4* boundsMax,
+	const XMFLOAT4* centroids,
+	std::vector<unsigned int>& items,
+	std::vector<WideBVHNode>& nodes,
+	const std::function<unsigned int(unsigned int, unsigned int)>& addLeaf)
+{
+	nodes.clear();
+	if (items.empty())
+		return;
+
+	WideBVHBuilder builder(boundsMin, boundsMax, centroids, items);
+	std::vector<WideBVHBuilder::BuildNode> buildNodes;
+	buildNodes.reserve(items.size());
+	unsigned int root = builder.BuildRange(0, (unsigned int)items.size(), 0, buildNodes);
+
+	nodes.reserve(buildNodes.size() / 3 + 1);
+	builder.Collapse(buildNodes, root, nodes, addLeaf);
+}
+
+void WideBVH::Grow(XMFLOAT3& boundsMin, XMFLOAT3& boundsMax, XMFLOAT3 otherMin, XMFLOAT3 otherMax)
+{
+	boundsMin = XMFLOAT3(std::min(boundsMin.x, otherMin.x), std::min(boundsMin.y, otherMin.y), std::min(boundsMin.z, otherMin.z));
+	boundsMax = XMFLOAT3(std::max(boundsMax.x, otherMax.x), std::max(boundsMax.y, otherMax.y), std::max(boundsMax.z, otherMax.z));
+}
+
+// Half the surface area, which is all SAH needs (ratios of areas)
+float WideBVH::SurfaceArea(XMFLOAT3 boundsMin, XMFLOAT3 boundsMax)
+{
+	if (boundsMin.x > boundsMax.x)
+		return 0;
+
+	float x = boundsMax.x - boundsMin.x;
+	float y = boundsMax.y - boundsMin.y;
+	float z = boundsMax.z - boundsMin.z;
+	return x * y + y * z + z * x;
+}
+
+WideBVH::SlabRay WideBVH::SetUpRay(XMFLOAT3 origin, XMFLOAT3 direction)
+{
+	// Keep the inverse finite, so a ray starting on a box's face
+	// doesn't turn into 0 * infinity
+	XMFLOAT3 inverse(
+		1.0f / (fabsf(direction.x) > 1e-20f ? direction.x : copysignf(1e-20f, direction.x)),
+		1.0f / (fabsf(direction.y) > 1e-20f ? direction.y : copysignf(1e-20f, direction.y)),
+		1.0f / (fabsf(direction.z) > 1e-20f ? direction.z : copysignf(1e-20f, direction.z)));
+
+	SlabRay ray;
+	ray.originX = XMVectorReplicate(origin.x);
+	ray.originY = XMVectorReplicate(origin.y);
+	ray.originZ = XMVectorReplicate(origin.z);
+	ray.inverseX = XMVectorReplicate(inverse.x);
+	ray.inverseY = XMVectorReplicate(inverse.y);
+	ray.inverseZ = XMVectorReplicate(inverse.z);
+	return ray;
+}
+
+// --------------------------------------------------------
+// Slab test: where the ray enters and leaves each box, from
+// where it crosses each pair of planes
+// --------------------------------------------------------
+int WideBVH::IntersectBoxes(const WideBVHNode& node, const SlabRay& ray, float maxDistance, XMFLOAT4& enterDistance)
+{
+	XMVECTOR x1 = XMVectorMultiply(XMVectorSubtract(XMLoadFloat4((const XMFLOAT4*)node.minX), ray.originX), ray.inverseX);
+	XMVECTOR x2 = XMVectorMultiply(XMVectorSubtract(XMLoadFloat4((const XMFLOAT4*)node.maxX), ray.originX), ray.inverseX);
+	XMVECTOR y1 = XMVectorMultiply(XMVectorSubtract(XMLoadFloat4((const XMFLOAT4*)node.minY), ray.originY), ray.inverseY);
+	XMVECTOR y2 = XMVectorMultiply(XMVectorSubtract(XMLoadFloat4((const XMFLOAT4*)node.maxY), ray.originY), ray.inverseY);
+	XMVECTOR z1 = XMVectorMultiply(XMVectorSubtract(XMLoadFloat4((const XMFLOAT4*)node.minZ), ray.originZ), ray.inverseZ);
+	XMVECTOR z2 = XMVectorMultiply(XMVectorSubtract(XMLoadFloat4((const XMFLOAT4*)node.maxZ), ray.originZ), ray.inverseZ);
+	XMVECTOR enter = XMVectorMax(
+		XMVectorMax(XMVectorMin(x1, x2), XMVectorMin(y1, y2)),
+		XMVectorMax(XMVectorMin(z1, z2), XMVectorZero()));
+	XMVECTOR exit = XMVectorMin(
+		XMVectorMin(XMVectorMax(x1, x2), XMVectorMax(y1, y2)),
+		XMVectorMax(z1, z2));
+	XMStoreFloat4(&enterDistance, enter);
+	return _mm_movemask_ps(XMVectorAndInt(
+		XMVectorLessOrEqual(enter, exit),
+		XMVectorLessOrEqual(enter, XMVectorReplicate(maxDistance))));
+}
\ No newline at end of file
@@ -0,0 +1,160 @@
+#pragma once
+#include <DirectXMath.h>
+#include <functional>
+#include <vector>
+
+// Most items in one leaf (leaves keep their count in 3 bits)
+#define BVH_MAX_LEAF_SIZE 4
+
+// Centroid bins tried along the widest axis when splitting a node
+#define BVH_BIN_COUNT 12
+
+// Past this depth nodes are split in the middle instead of by SAH, which
+// bounds the depth (and the traversal stack) for badly clustered items
+#define BVH_MAX_BUILD_DEPTH 48
+#define BVH_STACK_SIZE 256
+
+// A leaf is stored in its parent's child slot as this flag, an index
+// shifted up 3 bits, and its item count in the low 3 bits. The index is
+// its first item in leaf order unless the tree's owner says otherwise.
+// A leaf with no items is an empty slot.
+#define BVH_LEAF 0x80000000u
+
+// --------------------------------------------------------
+// Four children's boxes side by side, so each coordinate of all
+// four loads as one vector. Exactly two cache lines.
+// --------------------------------------------------------
+struct WideBVHNode
+{
+	float minX[4];
+	float minY[4];
+	float minZ[4];
+	float maxX[4];
+	float maxY[4];
+	float maxZ[4];
+	unsigned int children[4];	// Node index, or a leaf
+	unsigned int firstItem;		// Every item under this node, which
+	unsigned int itemCount;		// are contiguous in leaf order
+	unsigned int padding[2];
+};
+
+// --------------------------------------------------------
+// What SceneBVH and MeshBVH have in common: building a tree of
+// 4-wide nodes over anything with a box, and walking it with a ray.
+//
+// Build() is top down binned SAH (big ranges are binned and split on
+// several threads), collapsed into 4-wide nodes stored in one array,
+// parent before children. Raycast() walks them nearest box first with
+// one SSE slab test per node and leaves the leaves to the caller.
+// --------------------------------------------------------
+class WideBVH
+{
+public:
+	// Sorts items (indices into the arrays below) into leaf order and
+	// fills nodes with their boxes. Leaves index their first item unless
+	// addLeaf is given, in which case they get addLeaf(first, count).
+	//
+	// boundsMin, boundsMax - Each item's box (w unused)
+	// centroids - The point each item is split by (w unused)
+	static void Build(
+		const DirectX::XMFLOAT4* boundsMin,
+		const DirectX::XMFLOAT4* boundsMax,
+		const DirectX::XMFLOAT4* centroids,
+		std::vector<unsigned int>& items,
+		std::vector<WideBVHNode>& nodes,
+		const std::function<unsigned int(unsigned int, unsigned int)>& addLeaf = std::function<unsigned int(unsigned int, unsigned int)>());
+
+	// Calls testLeaf(index, count) for every leaf whose box the ray
+	// enters within hitDistance, nearest box first. The test lowers
+	// hitDistance when it finds something nearer, which prunes the rest.
+	// Distances are in units of the direction's length.
+	template<typename LeafTest>
+	static void Raycast(const std::vector<WideBVHNode>& nodes, DirectX::XMFLOAT3 origin, DirectX::XMFLOAT3 direction, float& hitDistance, const LeafTest& testLeaf);
+
+	static unsigned int GetLeafIndex(unsigned int child) { return (child & ~BVH_LEAF) >> 3; }
+	static unsigned int GetLeafCount(unsigned int child) { return child & 7; }
+
+	static void Grow(DirectX::XMFLOAT3& boundsMin, DirectX::XMFLOAT3& boundsMax, DirectX::XMFLOAT3 otherMin, DirectX::XMFLOAT3 otherMax);
+	static float SurfaceArea(DirectX::XMFLOAT3 boundsMin, DirectX::XMFLOAT3 boundsMax);
+
+private:
+	// A ray set up for slab tests: splatted origin and inverse direction
+	struct SlabRay
+	{
+		DirectX::XMVECTOR originX;
+		DirectX::XMVECTOR originY;
+		DirectX::XMVECTOR originZ;
+		DirectX::XMVECTOR inverseX;
+		DirectX::XMVECTOR inverseY;
+		DirectX::XMVECTOR inverseZ;
+	};
+
+	static SlabRay SetUpRay(DirectX::XMFLOAT3 origin, DirectX::XMFLOAT3 direction);
+
+	// Bit per lane for the boxes the ray enters within maxDistance,
+	// and where it enters each one
+	static int IntersectBoxes(const WideBVHNode& node, const SlabRay& ray, float maxDistance, DirectX::XMFLOAT4& enterDistance);
+};
+
+// --------------------------------------------------------
+// Keeps a small stack of nodes with the distance the ray enters
+// each one, and drops any that start past the best hit by the
+// time they're popped
+// --------------------------------------------------------
+template<typename LeafTest>
+void WideBVH::Raycast(const std::vector<WideBVHNode>& nodes, DirectX::XMFLOAT3 origin, DirectX::XMFLOAT3 direction, float& hitDistance, const LeafTest& testLeaf)
+{
+	if (nodes.empty())
+		return;
+
+	SlabRay ray = SetUpRay(origin, direction);
+	unsigned int stack[BVH_STACK_SIZE];
+	float stackDistance[BVH_STACK_SIZE];
+	unsigned int stackSize = 0;
+	stack[stackSize] = 0;
+	stackDistance[stackSize++] = 0;
+	while (stackSize > 0)
+	{
+		stackSize--;
+		if (stackDistance[stackSize] > hitDistance)
+			continue;
+		const WideBVHNode& node = nodes[stack[stackSize]];
+
+		DirectX::XMFLOAT4 enterDistance;
+		int hitBoxes = IntersectBoxes(node, ray, hitDistance, enterDistance);
+
+		// Child nodes to visit, sorted nearest last so they're popped first
+		unsigned int visit[4];
+		float visitDistance[4];
+		unsigned int visitCount = 0;
+		for (int lane = 0; lane < 4; lane++)
+		{
+			if (!(hitBoxes & (1 << lane)))
+				continue;
+
+			unsigned int child = node.children[lane];
+			if (child & BVH_LEAF)
+			{
+				if (GetLeafCount(child) > 0)
+					testLeaf(GetLeafIndex(child), GetLeafCount(child));
+				continue;
+			}
+
+			float distance = (&enterDistance.x)[lane];
+			unsigned int v = visitCount++;
+			for (; v > 0 && visitDistance[v - 1] < distance; v--)
+			{
+				visit[v] = visit[v - 1];
+				visitDistance[v] = visitDistance[v - 1];
+			}
+			visit[v] = child;
+			visitDistance[v] = distance;
+		}
+
+		for (unsigned int v = 0; v < visitCount; v++)
+		{
+			stack[stackSize] = visit[v];
+			stackDistance[stackSize++] = visitDistance[v];
+		}
+	}
+}
\ No newline at end of file